@@ -31,6 +31,7 @@
 #include <optixu/optixu_matrix_namespace.h>
 #include <optixu/optixu_aabb_namespace.h>
 #include "intersection_refinement.h"
+#include "../include/stats.hpp"
 
 using namespace optix;
 
@@ -58,6 +59,8 @@ template<bool DO_REFINE>
 static __device__
 void meshIntersect( int primIdx )
 {
+  GRPT_STATS(++pixel_stats().primitives_tested;)
+
   const int3 v_idx = index_buffer[primIdx];
 
   const float3 p0 = vertex_buffer[ v_idx.x ];
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace grpt
+{
+    // Progressive accumulation state of one render: the running mean of the
+    // beauty image, the AOV buffers and everything needed to continue
+    // converging from where the render stopped.
+    //
+    // On disk: a fixed header, the RGB means as floats, then one section per
+    // AOV (flag, byte count, raw buffer contents).  Rows are stored in OptiX
+    // buffer order.
+    struct accumulation_file
+    {
+        struct header_t
+        {
+            char     magic[4];          // "GRAC"
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint32_t aov_mask;
+            uint32_t sqrt_num_samples;
+            uint32_t first_frame;       // RNG frame index of the first accumulated launch
+            uint32_t next_frame;        // RNG frame index of the next launch
+            uint64_t sample_count;      // samples per pixel in the means
+            uint64_t scene_hash;        // camera and scene settings the samples belong to
+        };
+
+        struct aov_section
+        {
+            uint32_t flag;
+            std::vector<unsigned char> data;
+        };
+
+        header_t header;
+        std::vector<float> color;       // width * height * 3
+        std::vector<aov_section> aovs;
+
+        accumulation_file();
+    };
+
+    // Writes to '<path>.tmp' and renames it over 'path', so a reader never
+    // sees a partial file.  Throws std::runtime_error on failure.
+    void write_accumulation_file(const std::string& path, const accumulation_file& file);
+    accumulation_file read_accumulation_file(const std::string& path);
+
+    // Combines renders of the same scene over disjoint RNG frame ranges,
+    // weighting each by its sample count; the result is what one render over
+    // the union of the ranges would have produced, up to float rounding.
+    // Throws std::runtime_error if the files belong to different renders or
+    // their frame ranges overlap.
+    accumulation_file merge_accumulation_files(const std::vector<accumulation_file>& files);
+
+    // FNV-1a, for building scene hashes.
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+    // Writes accumulation files on a background thread.  Submitting while a
+    // write is in flight waits for it first, so at most one snapshot is held
+    // in memory besides the one being written.
+    class accumulation_writer
+    {
+    public:
+        accumulation_writer() = default;
+        ~accumulation_writer();
+
+        void submit(const std::string& path, std::unique_ptr<accumulation_file> file);
+
+        // Blocks until the pending write finished; returns false if it failed.
+        bool wait();
+
+    private:
+        accumulation_writer(const accumulation_writer&) = delete;
+        accumulation_writer& operator=(const accumulation_writer&) = delete;
+
+        std::thread m_thread;
+        bool        m_failed = false;
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+#include <vector>
+
+namespace grpt
+{
+    struct denoise_settings
+    {
+        int   iterations   = 5;       // a-trous passes, the filter spans 2^(iterations+2) - 3 pixels
+        float sigma_color  = 0.6f;    // edge stop on tone mapped irradiance, halved every pass
+        float sigma_normal = 64.0f;   // sharpness of the normal edge stop
+        float sigma_albedo = 0.1f;
+        float sigma_depth  = 0.05f;   // relative view depth difference, scaled by the step
+
+        // Weight of the new frame against the history when temporal
+        // accumulation is on; 1 disables it.  Only for inputs that are
+        // independent per frame estimates, not a running mean such as the
+        // renderer's accumulated output_buffer.
+        float temporal_alpha = 1.0f;
+    };
+
+    struct denoise_timings
+    {
+        double prepare_ms  = 0.0;     // demodulation and conversion to planes
+        double filter_ms   = 0.0;
+        double temporal_ms = 0.0;
+        double total_ms    = 0.0;
+    };
+
+    // Edge avoiding a-trous wavelet filter guided by first hit albedo, normal
+    // and (optionally) depth, the buffers written with --aov.  The color is
+    // divided by the albedo before filtering so texture detail survives, and
+    // the filter runs multithreaded with SSE over four pixels at a time.
+    //
+    // All images are width x height, row-major, in OptiX buffer order.
+    class denoiser
+    {
+    public:
+        explicit denoiser(const denoise_settings& settings = denoise_settings());
+
+        void denoise(const optix::float4* color,
+                     const optix::float4* albedo,
+                     const optix::float4* normal,
+                     const float* depth,          // may be null
+                     unsigned int width,
+                     unsigned int height,
+                     optix::float4* out);
+
+        // Drops the temporal history, e.g. when the camera moves.
+        void reset_history();
+
+        const denoise_settings& settings() const { return m_settings; }
+        const denoise_timings&  timings() const { return m_timings; }
+
+    private:
+        struct planes
+        {
+            std::vector<float> r, g, b;
+            void resize(size_t n) { r.resize(n); g.resize(n); b.resize(n); }
+        };
+
+        void filter_pass(const planes& src, planes& dst, int step, float sigma_color) const;
+        void temporal_blend(planes& current);
+
+        denoise_settings m_settings;
+        denoise_timings  m_timings;
+
+        unsigned int m_width  = 0;
+        unsigned int m_height = 0;
+
+        // Guides, structure of arrays so SSE loads stay contiguous.
+        std::vector<float> m_nx, m_ny, m_nz;
+        std::vector<float> m_ar, m_ag, m_ab;
+        std::vector<float> m_depth;
+        planes m_ping, m_pong;
+
+        planes m_history;
+        std::vector<float> m_history_nx, m_history_ny, m_history_nz, m_history_depth;
+        bool m_has_history = false;
+    };
+
+    namespace metrics
+    {
+        // Over the RGB channels of two width x height images; peak 1.
+        double mse(const optix::float4* a, const optix::float4* reference, size_t count);
+        double psnr(const optix::float4* a, const optix::float4* reference, size_t count);
+
+        // Mean of (a - ref)^2 / (ref^2 + 0.01), robust for HDR images.
+        double rel_mse(const optix::float4* a, const optix::float4* reference, size_t count);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+// Efficiency-aware Russian roulette and splitting (Rath et al., "EARS:
+// Efficiency-Aware Russian Roulette and Splitting").  At each path vertex the
+// number of continuations q is chosen to maximise variance reduction per
+// unit of cost:
+//
+//   q = T * sqrt( (M2 / V) * (C_pixel / C) )
+//
+// with T the path throughput, M2 and C the second moment of the radiance
+// leaving the vertex's region and the cost of continuing from it, and V and
+// C_pixel the variance and cost of the pixel estimate.  q < 1 kills the path
+// with probability 1 - q, q > 1 splits it into q continuations on average.
+// Shared by the camera program and the learner on the host (ears_learner.hpp).
+namespace grpt
+{
+    namespace ears
+    {
+        enum
+        {
+            record_depth = 4,    // path vertices recorded per pixel for learning
+            max_split    = 8     // continuations a vertex may split into
+        };
+
+        // Cell of 'position' in a resolution^3 grid over the scene bounds.
+        RT_HOSTDEVICE inline unsigned int cell_index(const optix::float3& position, const optix::float3& bounds_min,
+                                                     const optix::float3& bounds_extent, unsigned int resolution)
+        {
+            const optix::float3 p = optix::clamp((position - bounds_min) / bounds_extent, 0.0f, 0.99999994f) *
+                                    static_cast<float>(resolution);
+            return (static_cast<unsigned int>(p.z) * resolution + static_cast<unsigned int>(p.y)) * resolution +
+                   static_cast<unsigned int>(p.x);
+        }
+
+        // Splitting factor for throughput 'throughput' (luminance) at a
+        // vertex in a cell with statistics (M2, C), for a pixel with
+        // statistics (V, C_pixel).  Returns 0 when either is unknown.
+        RT_HOSTDEVICE inline float factor(float throughput, const optix::float2& cell, const optix::float2& pixel,
+                                          float min_factor, float max_factor)
+        {
+            if (cell.y <= 0.0f || pixel.x <= 0.0f || pixel.y <= 0.0f)
+                return 0.0f;
+            const float q = throughput * sqrtf(cell.x / pixel.x * pixel.y / cell.y);
+            return optix::clamp(q, min_factor, max_factor);
+        }
+    }
+}
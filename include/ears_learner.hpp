@@ -0,0 +1,70 @@
+#pragma once
+
+#include <ears.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace grpt
+{
+    namespace ears
+    {
+        struct learner_settings
+        {
+            unsigned int grid_resolution = 16;   // cells per axis of the radiance statistics
+            unsigned int tile_size       = 16;   // pixels per side over which the image variance is pooled
+        };
+
+        // Learns the statistics EARS needs from paths recorded by the camera
+        // program: per grid cell the second moment of the radiance leaving
+        // path vertices and the cost of continuing from them, per pixel the
+        // variance and cost of its estimate.  The pixel variance is pooled
+        // over tiles in relative terms, since a few samples per pixel do not
+        // estimate it.
+        class learner
+        {
+        public:
+            learner(unsigned int width, unsigned int height, const learner_settings& settings = learner_settings());
+
+            // Adds one launch's records: per pixel record_depth + 1 pairs of
+            // float4.  The first pair is the path, with the luminance of its
+            // contribution in the first w and the segments it traced in the
+            // second x; the others are its vertices, with the position and the
+            // luminance of the radiance leaving the vertex over the
+            // throughput, then the segments traced after it and w = 1 for
+            // valid records.
+            void add_records(const optix::float4* records);
+
+            // Recomputes cells() and pixels() from everything added so far.
+            void update();
+
+            bool ready() const { return m_ready; }
+            const std::vector<optix::float2>& cells()  const { return m_cells; }    // (M2, C)
+            const std::vector<optix::float2>& pixels() const { return m_pixels; }   // (V, C_pixel)
+            unsigned int  grid_resolution() const { return m_settings.grid_resolution; }
+            optix::float3 bounds_min()      const { return m_bounds_min; }
+            optix::float3 bounds_extent()   const { return m_bounds_extent; }
+
+        private:
+            struct moments
+            {
+                double count;
+                double sum;
+                double sum_sq;
+                double cost;
+            };
+
+            learner_settings           m_settings;
+            unsigned int               m_width;
+            unsigned int               m_height;
+            std::vector<moments>       m_cell_moments;
+            std::vector<moments>       m_pixel_moments;
+            std::vector<optix::float2> m_cells;
+            std::vector<optix::float2> m_pixels;
+            optix::float3              m_bounds_min;
+            optix::float3              m_bounds_extent;
+            bool                       m_has_bounds;
+            bool                       m_ready;
+        };
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+// Flattened SD-tree used for path guiding, shared by the host builder
+// (sd_tree.hpp) and the closest hit programs.  A binary spatial tree over
+// the scene bounds holds one directional quadtree per leaf; the quadtrees
+// live in the square [0,1]^2 that the cylindrical, area preserving map takes
+// the sphere of directions to, so a density on the square is a density on
+// the sphere up to the constant 4 pi.
+namespace grpt
+{
+    namespace guiding
+    {
+        enum
+        {
+            leaf_axis    = 3,     // spatial_node::axis of leaves
+            record_depth = 4      // training vertices recorded per path
+        };
+
+        struct spatial_node
+        {
+            unsigned int axis;    // 0, 1, 2: split at the middle of that axis; leaf_axis: leaf
+            unsigned int index;   // inner: first of the two children; leaf: root of its quadtree
+        };
+
+        struct directional_node
+        {
+            float        sum[4];  // flux per quadrant, index x + 2 y
+            unsigned int child[4];// 0: the quadrant is not subdivided
+        };
+
+        RT_HOSTDEVICE inline optix::float2 direction_to_square(const optix::float3& d)
+        {
+            const float cos_theta = optix::clamp(d.z, -1.0f, 1.0f);
+            float phi = atan2f(d.y, d.x);
+            if (phi < 0.0f)
+                phi += 2.0f * M_PIf;
+            return optix::make_float2(optix::clamp((cos_theta + 1.0f) * 0.5f, 0.0f, 0.99999994f),
+                                      optix::clamp(phi * (0.5f / M_PIf), 0.0f, 0.99999994f));
+        }
+
+        RT_HOSTDEVICE inline optix::float3 square_to_direction(const optix::float2& p)
+        {
+            const float cos_theta = 2.0f * p.x - 1.0f;
+            const float sin_theta = sqrtf(fmaxf(0.0f, 1.0f - cos_theta * cos_theta));
+            const float phi = 2.0f * M_PIf * p.y;
+            return optix::make_float3(sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta);
+        }
+
+        RT_HOSTDEVICE inline float total(const directional_node& n)
+        {
+            return n.sum[0] + n.sum[1] + n.sum[2] + n.sum[3];
+        }
+
+        // Root of the quadtree for point 'p', given in [0,1)^3 scene bounds
+        // coordinates.  'Nodes' is anything indexable: an rtBuffer on the
+        // device, a std::vector on the host.
+        template <class Nodes>
+        RT_HOSTDEVICE inline unsigned int find_quadtree(const Nodes& nodes, optix::float3 p)
+        {
+            unsigned int i = 0;
+            while (nodes[i].axis != leaf_axis)
+            {
+                const unsigned int axis = nodes[i].axis;
+                float& x = axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+                const unsigned int upper = x >= 0.5f ? 1u : 0u;
+                x = x * 2.0f - upper;
+                i = nodes[i].index + upper;
+            }
+            return nodes[i].index;
+        }
+
+        // Density on the square of the quadtree at 'root', for a quadtree
+        // with flux.
+        template <class Nodes>
+        RT_HOSTDEVICE inline float pdf(const Nodes& nodes, unsigned int root, optix::float2 p)
+        {
+            float density = 1.0f;
+            unsigned int i = root;
+            for (;;)
+            {
+                const directional_node& n = nodes[i];
+                const float sum = total(n);
+                if (sum <= 0.0f)
+                    return density;
+
+                const unsigned int qx = p.x >= 0.5f ? 1u : 0u;
+                const unsigned int qy = p.y >= 0.5f ? 1u : 0u;
+                const unsigned int q  = qx + 2u * qy;
+                density *= 4.0f * n.sum[q] / sum;
+                if (n.child[q] == 0u || density <= 0.0f)
+                    return density;
+
+                p = p * 2.0f - optix::make_float2(static_cast<float>(qx), static_cast<float>(qy));
+                i = n.child[q];
+            }
+        }
+
+        // Draws a point on the square proportionally to the flux, reusing
+        // the random numbers as the descent narrows them down, and returns
+        // its density.
+        template <class Nodes>
+        RT_HOSTDEVICE inline optix::float2 sample(const Nodes& nodes, unsigned int root, optix::float2 u, float& density)
+        {
+            optix::float2 origin = optix::make_float2(0.0f);
+            float size = 1.0f;
+            density = 1.0f;
+            unsigned int i = root;
+            for (;;)
+            {
+                const directional_node& n = nodes[i];
+                const float sum = total(n);
+                if (sum <= 0.0f)
+                    break;
+
+                // Column first, then the quadrant within it.
+                const float left = (n.sum[0] + n.sum[2]) / sum;
+                unsigned int qx;
+                if (u.x < left)
+                {
+                    qx = 0u;
+                    u.x = u.x / left;
+                }
+                else
+                {
+                    qx = 1u;
+                    u.x = (u.x - left) / (1.0f - left);
+                }
+                const float column = n.sum[qx] + n.sum[qx + 2u];
+                const float bottom = column > 0.0f ? n.sum[qx] / column : 0.5f;
+                unsigned int qy;
+                if (u.y < bottom)
+                {
+                    qy = 0u;
+                    u.y = u.y / bottom;
+                }
+                else
+                {
+                    qy = 1u;
+                    u.y = (u.y - bottom) / (1.0f - bottom);
+                }
+                u = optix::make_float2(fminf(u.x, 0.99999994f), fminf(u.y, 0.99999994f));
+
+                const unsigned int q = qx + 2u * qy;
+                density *= 4.0f * n.sum[q] / sum;
+                size *= 0.5f;
+                origin = origin + optix::make_float2(static_cast<float>(qx), static_cast<float>(qy)) * size;
+                if (n.child[q] == 0u)
+                    break;
+                i = n.child[q];
+            }
+            return origin + u * size;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <optixu/optixpp_namespace.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace grpt
+{
+    namespace image_io
+    {
+        // Float images with 1 or 3 interleaved channels, rows stored bottom
+        // to top, which is both the PFM row order and the OptiX buffer order.
+        struct image
+        {
+            unsigned int width    = 0;
+            unsigned int height   = 0;
+            unsigned int channels = 0;
+            std::vector<float> pixels;
+        };
+
+        // Portable float map.  Throws std::runtime_error on I/O failure.
+        void write_pfm(const std::string& path, const image& img);
+        image read_pfm(const std::string& path);
+
+        // Copies a 2D FLOAT, FLOAT3, FLOAT4, UNSIGNED_INT or UNSIGNED_INT2
+        // buffer into an image; 4 channel buffers drop w, 2 channel buffers
+        // get a zero third channel.
+        image from_buffer(optix::Buffer buffer);
+
+        void write_buffer_pfm(const std::string& path, optix::Buffer buffer);
+
+        // Writes a PFM one region at a time, so images that do not fit in
+        // memory can be produced tile by tile.  The file is sized up front;
+        // pixels no region covers read back as zero.
+        class pfm_writer
+        {
+        public:
+            pfm_writer(const std::string& path, unsigned int width, unsigned int height, unsigned int channels);
+
+            // 'pixels' holds w x h pixels, rows in image order.
+            void write_region(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const float* pixels);
+
+            // Flushes and reports errors; the destructor closes silently.
+            void close();
+
+        private:
+            std::string    m_path;
+            std::ofstream  m_out;
+            std::streamoff m_raster;      // offset of the first pixel
+            unsigned int   m_width, m_height, m_channels;
+        };
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+namespace grpt
+{
+    struct preview_settings
+    {
+        float    target_fps    = 30.0f;   // 0 keeps full resolution while moving
+        float    min_scale     = 0.25f;   // smallest fraction of the width and height
+        float    smoothing     = 0.5f;    // weight of the newest frame time
+        unsigned settle_frames = 1;       // still frames before going back to full resolution
+    };
+
+    // Picks the resolution of interactive frames.  While the camera moves,
+    // frames are rendered at a fraction of the window size chosen from the
+    // measured frame times so the frame rate stays near the target; once the
+    // camera rests, frames go back to full resolution and accumulate.
+    //
+    // Knows nothing about OptiX or GLUT, so the render loop can drive it
+    // headlessly.
+    class preview_controller
+    {
+    public:
+        explicit preview_controller(const preview_settings& settings = preview_settings());
+
+        // Returns the scale to render the next frame at; 1 is full resolution.
+        float begin_frame(bool camera_changed);
+
+        // Reports how long the frame begun last took at the scale it used.
+        void end_frame(double frame_ms, float scale);
+
+        bool moving() const { return m_moving; }
+        const preview_settings& settings() const { return m_settings; }
+
+    private:
+        preview_settings m_settings;
+        float    m_scale;
+        double   m_full_frame_ms;      // estimated cost of a full resolution frame, 0 if unknown
+        bool     m_moving;
+        unsigned m_still_frames;
+    };
+}
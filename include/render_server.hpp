@@ -0,0 +1,114 @@
+#pragma once
+
+#include <optixu/optixpp_namespace.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace grpt
+{
+    // Long running render daemon.  Scenes and their acceleration structures
+    // are built once and stay on the device; clients connect over a Unix
+    // socket, submit jobs against the loaded scenes and receive the image
+    // back tile by tile as each one finishes.
+    //
+    // Protocol, one line per message:
+    //   client -> server   render scene=<name> [width= height= spp= frames= tile=
+    //                      region=x0,y0,x1,y1 eye=x,y,z lookat=x,y,z up=x,y,z fov=]
+    //   server -> client   tile <x> <y> <w> <h>, then w * h * 3 floats (RGB, rows
+    //                      in OptiX buffer order, native byte order)
+    //   server -> client   done <samples per pixel> <milliseconds>
+    //   client -> server   scenes
+    //   server -> client   scenes <name> ...
+    //   client -> server   shutdown
+    //   server -> client   error <message>, for any request that failed
+    //
+    // The region is half open and defaults to the whole image.  Jobs of
+    // different clients share the device: the server renders one tile of
+    // each active job in turn, so a large job does not hold up a small one.
+    //
+    // Clients never block the server: requests are read and replies written
+    // without blocking, a job only renders its next tile once the client has
+    // taken most of the previous one, request lines are limited to
+    // max_request_line bytes, and a client that sends and receives nothing
+    // for client_timeout_s seconds while no tile of it is rendering is
+    // disconnected.
+    class render_server
+    {
+    public:
+        static const size_t max_request_line = 4096;
+        static const int    client_timeout_s = 60;
+
+        struct scene
+        {
+            optix::GeometryGroup top_object;
+            optix::float3 eye, lookat, up;   // camera used when a job gives none
+            float fov;                       // vertical, in degrees
+        };
+
+        // 'context' must use the progressive ray generation program, which
+        // honours render_offset and render_size.
+        render_server(optix::Context context, const std::string& socket_path);
+        ~render_server();
+
+        void add_scene(const std::string& name, const scene& s);
+
+        // Serves clients until one of them sends 'shutdown'.
+        void run();
+
+    private:
+        struct connection
+        {
+            int fd;
+            std::string input;               // bytes after the last complete request
+            std::string output;              // replies and tiles the client has not taken yet
+            size_t output_sent;              // leading bytes of 'output' already sent
+            std::chrono::steady_clock::time_point last_activity;
+        };
+
+        struct job
+        {
+            int client;
+            const scene* target;
+            unsigned int width, height;
+            unsigned int sqrt_num_samples, frames;
+            unsigned int tile;
+            unsigned int x0, y0, x1, y1;
+            optix::float3 eye, U, V, W;
+            unsigned int next_tile;          // in row-major tile order over the region
+            double elapsed_ms;
+        };
+
+        render_server(const render_server&) = delete;
+        render_server& operator=(const render_server&) = delete;
+
+        // read_requests returns false once the client is to be dropped.
+        void accept_client();
+        bool read_requests(connection& c);
+        void flush(connection& c);
+        void send(int client, const std::string& line);
+        void send(int client, const void* data, size_t size);
+        connection* find_client(int client);
+        bool ready(const job& j);
+
+        void handle_request(int client, const std::string& line);
+        job parse_job(int client, const std::string& line) const;
+
+        // Renders and sends the next tile; returns false once the job is done.
+        bool render_tile(job& j);
+        void drop_client(int client);
+
+        optix::Context m_context;
+        std::string    m_socket_path;
+        int            m_listen_fd;
+        bool           m_running;
+        size_t         m_next_job;           // round robin over m_jobs
+        unsigned int   m_tile_capacity;
+
+        std::map<std::string, scene> m_scenes;
+        std::vector<connection> m_clients;
+        std::vector<job> m_jobs;
+    };
+}
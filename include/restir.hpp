@@ -0,0 +1,152 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include "../optixPathTracer.h"
+
+// Reservoir based spatiotemporal importance resampling of direct lighting
+// (Bitterli et al., "Spatiotemporal reservoir resampling for real-time ray
+// tracing with dynamic direct lighting").  Shared by the camera programs and
+// the host, which can run the same resampling over the light buffers as a
+// reference.  Only area lights are resampled; point lights keep their
+// next event estimation in the closest hit programs, which already samples
+// each of them exactly.
+namespace grpt
+{
+    namespace restir
+    {
+        enum
+        {
+            max_spatial_samples = 8     // neighbours a pixel may reuse
+        };
+
+        // A point on an area light.
+        struct light_sample
+        {
+            optix::float3 position;
+            optix::float3 normal;
+            optix::float3 emission;
+        };
+
+        struct reservoir
+        {
+            light_sample y;
+            float        weight_sum;
+            float        M;          // candidates seen
+            float        W;          // contribution weight of y; 0 if y is unusable
+        };
+
+        // Primary hit of a pixel with its reservoir.
+        struct pixel
+        {
+            optix::float3 position;
+            optix::float3 normal;
+            optix::float3 albedo;
+            unsigned int  valid;     // a diffuse surface was hit
+            reservoir     r;
+        };
+
+        RT_HOSTDEVICE inline float luminance(const optix::float3& c)
+        {
+            return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+        }
+
+        RT_HOSTDEVICE inline reservoir empty_reservoir()
+        {
+            reservoir r;
+            r.y.position = r.y.normal = r.y.emission = optix::make_float3(0.0f);
+            r.weight_sum = r.M = r.W = 0.0f;
+            return r;
+        }
+
+        // Picks a light uniformly, then a uniform point on it; 'pdf' is the
+        // density of the point over the combined light area.
+        template <class AreaLights>
+        RT_HOSTDEVICE inline light_sample sample_light(const AreaLights& area_lights, unsigned int num_area,
+                                                       float u0, float u1, float u2, float& pdf)
+        {
+            const unsigned int pick = static_cast<unsigned int>(u0 * num_area);
+            const unsigned int i = pick < num_area ? pick : num_area - 1;
+
+            const ParallelogramLight& light = area_lights[i];
+            light_sample y;
+            y.position = light.corner + light.v1 * u1 + light.v2 * u2;
+            y.normal   = light.normal;
+            y.emission = light.emission;
+            pdf = 1.0f / (num_area * optix::length(optix::cross(light.v1, light.v2)));
+            return y;
+        }
+
+        // Lambertian reflection of 'y' at the surface, ignoring occlusion.
+        RT_HOSTDEVICE inline optix::float3 unshadowed(const optix::float3& position, const optix::float3& normal,
+                                                      const optix::float3& albedo, const light_sample& y)
+        {
+            const optix::float3 d = y.position - position;
+            const float dist2 = optix::dot(d, d);
+            if (dist2 <= 0.0f)
+                return optix::make_float3(0.0f);
+            const optix::float3 L = d / sqrtf(dist2);
+            const float cos_x = optix::dot(normal, L);
+            const float cos_y = optix::dot(y.normal, -L);
+            if (cos_x <= 0.0f || cos_y <= 0.0f)
+                return optix::make_float3(0.0f);
+            return albedo * y.emission * (M_1_PIf * cos_x * cos_y / dist2);
+        }
+
+        // Target function the candidates are resampled towards.
+        RT_HOSTDEVICE inline float target(const pixel& p, const light_sample& y)
+        {
+            return luminance(unshadowed(p.position, p.normal, p.albedo, y));
+        }
+
+        // Streams candidate 'y' with resampling weight 'weight', standing for
+        // 'count' candidates, into 'r'.  Returns whether it was kept.
+        RT_HOSTDEVICE inline bool update(reservoir& r, const light_sample& y, float weight, float count, float u)
+        {
+            r.M += count;
+            if (!(weight > 0.0f))
+                return false;
+            r.weight_sum += weight;
+            if (u * r.weight_sum >= weight)
+                return false;
+            r.y = y;
+            return true;
+        }
+
+        // Sets W from the kept sample's target at 'p' and the normalisation
+        // 'Z', the candidate count for the biased estimator or the count of
+        // candidates that could have produced y for the unbiased one.
+        RT_HOSTDEVICE inline void finalize(reservoir& r, float target_y, float Z)
+        {
+            r.W = target_y > 0.0f && Z > 0.0f ? r.weight_sum / (Z * target_y) : 0.0f;
+        }
+
+#if !defined(__CUDACC__)
+        // Unshadowed direct lighting at a surface integrated over every area
+        // light with n x n stratified points each, for checking the resampled
+        // estimates against.
+        template <class AreaLights>
+        optix::float3 reference_unshadowed(const pixel& p, const AreaLights& area_lights, unsigned int num_area,
+                                           unsigned int n)
+        {
+            optix::float3 sum = optix::make_float3(0.0f);
+            for (unsigned int i = 0; i < num_area; ++i)
+            {
+                const ParallelogramLight& light = area_lights[i];
+                const float area = optix::length(optix::cross(light.v1, light.v2));
+                for (unsigned int a = 0; a < n; ++a)
+                {
+                    for (unsigned int b = 0; b < n; ++b)
+                    {
+                        light_sample y;
+                        y.position = light.corner + light.v1 * ((a + 0.5f) / n) + light.v2 * ((b + 0.5f) / n);
+                        y.normal   = light.normal;
+                        y.emission = light.emission;
+                        sum += unshadowed(p.position, p.normal, p.albedo, y) * (area / (n * n));
+                    }
+                }
+            }
+            return sum;
+        }
+#endif
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <guiding.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace grpt
+{
+    namespace guiding
+    {
+        struct sd_tree_settings
+        {
+            float    spatial_threshold = 4000.0f; // samples a leaf takes before it splits, scaled by sqrt(2^iteration)
+            float    flux_threshold    = 0.01f;   // fraction of a leaf's flux a quadrant needs to be subdivided
+            unsigned max_depth         = 20;      // of the directional quadtrees
+            size_t   max_bytes         = 64u << 20; // bound on the flattened tree
+        };
+
+        // Learns the incident radiance of a scene across progressive
+        // iterations (Mueller et al., "Practical Path Guiding").  Each
+        // iteration deposits the radiance arriving at path vertices into a
+        // building tree; end_iteration() refines the spatial subdivision by
+        // sample counts and the quadtrees by flux, and the result becomes the
+        // sampling distribution that flatten() hands to the device.
+        class sd_tree
+        {
+        public:
+            explicit sd_tree(const sd_tree_settings& settings = sd_tree_settings());
+
+            // Deposits 'count' records as the device writes them: two float4
+            // each, the position with the luminance of the incident radiance
+            // in w, then the direction it arrives from with w = 1 for valid
+            // records.  The spatial bounds are taken from the first batch.
+            void add_records(const optix::float4* records, size_t count);
+            void add_sample(const optix::float3& position, const optix::float3& direction, float radiance);
+
+            void end_iteration();
+
+            // Flattened sampling tree; directional roots are absolute indices.
+            void flatten(std::vector<spatial_node>& spatial, std::vector<directional_node>& directional) const;
+
+            bool          empty()         const { return m_iterations == 0; }
+            unsigned int  iterations()    const { return m_iterations; }
+            size_t        leaf_count()    const { return m_leaves.size(); }
+            size_t        node_count()    const;
+            size_t        byte_size()     const;
+            optix::float3 bounds_min()    const { return m_bounds_min; }
+            optix::float3 bounds_extent() const { return m_bounds_extent; }
+
+        private:
+            struct leaf
+            {
+                // Quadtrees with indices relative to their own vector, so
+                // that leaves can be copied when they split.
+                std::vector<directional_node> sampling;
+                std::vector<directional_node> building;
+                float samples;
+            };
+
+            void split_leaves(unsigned int node, unsigned int depth, float threshold, size_t& budget);
+            void refine_quadtree(leaf& l, size_t& budget) const;
+
+            sd_tree_settings          m_settings;
+            std::vector<spatial_node> m_nodes;       // leaf index holds the position in m_leaves
+            std::vector<leaf>         m_leaves;
+            optix::float3             m_bounds_min;
+            optix::float3             m_bounds_extent;
+            bool                      m_has_bounds;
+            unsigned int              m_iterations;
+        };
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+// Integrator statistics, compiled in by configuring with
+// -DGRPT_ENABLE_STATS=ON.  Without it GRPT_STATS() expands to nothing and no
+// program declares stats_buffer, so the counters cost nothing.
+//
+// Every launch index owns its counters in stats_buffer, so the programs of a
+// launch count without atomics; the host sums them up (stats_report.hpp).
+namespace grpt
+{
+    namespace stats
+    {
+        enum
+        {
+            depth_bins = 15       // path depth histogram; the last bin holds deeper paths
+        };
+
+        struct pixel_counters
+        {
+            unsigned long long cycles;             // clock64() ticks spent in ray generation
+            unsigned int       paths;              // camera paths and split branches traced
+            unsigned int       radiance_rays;
+            unsigned int       shadow_rays;
+            unsigned int       primitives_tested;  // intersection program invocations
+            unsigned int       roulette_kills;     // paths ended by Russian roulette
+            unsigned int       depth[depth_bins];  // paths by the bounces they made
+        };
+    }
+}
+
+#if defined(GRPT_ENABLE_STATS)
+#define GRPT_STATS(...) __VA_ARGS__
+#else
+#define GRPT_STATS(...)
+#endif
+
+#if defined(__CUDACC__) && defined(GRPT_ENABLE_STATS)
+#include <optix.h>
+
+rtDeclareVariable(uint2, stats_launch_index, rtLaunchIndex, );
+rtBuffer<grpt::stats::pixel_counters, 2> stats_buffer;
+
+static __device__ __inline__ grpt::stats::pixel_counters& pixel_stats()
+{
+    return stats_buffer[stats_launch_index];
+}
+
+static __device__ __inline__ void count_path_end(int depth)
+{
+    ++pixel_stats().depth[depth < (int)grpt::stats::depth_bins ? depth : grpt::stats::depth_bins - 1];
+}
+#endif
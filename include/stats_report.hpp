@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stats.hpp>
+
+#include <string>
+
+namespace grpt
+{
+    namespace stats
+    {
+        // Totals over every pixel of a stats_buffer.
+        struct summary
+        {
+            unsigned int       width  = 0;
+            unsigned int       height = 0;
+            unsigned long long cycles            = 0;
+            unsigned long long max_pixel_cycles  = 0;
+            unsigned long long paths             = 0;
+            unsigned long long radiance_rays     = 0;
+            unsigned long long shadow_rays       = 0;
+            unsigned long long primitives_tested = 0;
+            unsigned long long roulette_kills    = 0;
+            unsigned long long depth[depth_bins] = {};
+        };
+
+        // 'counters' holds width x height pixels as the device wrote them.
+        summary summarize(const pixel_counters* counters, unsigned int width, unsigned int height);
+
+        // Writes the totals, per path and per ray averages and the depth
+        // histogram as JSON.  Throws std::runtime_error on I/O failure.
+        void write_json(const std::string& path, const summary& s, double render_ms);
+
+        // Writes per pixel heatmaps as single channel PFMs:
+        // '<prefix>_cycles.pfm'     clock ticks spent in ray generation,
+        // '<prefix>_rays.pfm'       radiance and shadow rays traced,
+        // '<prefix>_primitives.pfm' primitives tested per ray,
+        // '<prefix>_depth.pfm'      mean bounces per path.
+        void write_heatmaps(const std::string& prefix, const pixel_counters* counters, unsigned int width,
+                            unsigned int height);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace grpt
+{
+    // Minimal line based messaging over Unix domain stream sockets, used by
+    // the render coordinator, its workers and the render server.  All functions throw
+    // std::runtime_error on failure; on Windows they always throw.
+    namespace unix_socket
+    {
+        // Binds and listens on 'path', replacing a stale socket file.
+        int listen(const std::string& path, int backlog);
+        int accept(int listen_fd);
+        int connect(const std::string& path);
+        void close(int fd);
+
+        // Waits up to 'timeout_ms' for 'fd' to be readable, or for a pending
+        // connection on a listening socket.  Returns false on timeout or
+        // when interrupted by a signal.
+        bool wait_readable(int fd, int timeout_ms);
+
+        // Lines are '\n' terminated; the terminator is not part of 'line'.
+        void send_line(int fd, const std::string& line);
+
+        // Returns false if the peer closed the connection.
+        bool recv_line(int fd, std::string& line);
+
+        // Raw payloads following a line that announces their size.
+        void send_bytes(int fd, const void* data, size_t size);
+        bool recv_bytes(int fd, void* data, size_t size);
+
+        // For servers that multiplex clients with poll().  After
+        // set_nonblocking, recv_some appends at most 'max_size' bytes of
+        // whatever has arrived to 'buffer' and returns false if the peer
+        // closed the connection; send_some returns how many bytes the
+        // socket took, 0 if it is full.
+        void set_nonblocking(int fd);
+        bool recv_some(int fd, std::string& buffer, size_t max_size);
+        size_t send_some(int fd, const void* data, size_t size);
+    }
+}
@@ -20,14 +20,28 @@
 #include <optixu/optixu_math_stream_namespace.h>
 
 #include "point_light.hpp"
+#include "image_io.hpp"
+#include "denoiser.hpp"
+#include "accumulation_file.hpp"
+#include "unix_socket.hpp"
+#include "render_server.hpp"
+#include "preview_controller.hpp"
+#include "sd_tree.hpp"
+#include "restir.hpp"
+#include "ears_learner.hpp"
+#include "stats_report.hpp"
 
 #include "optixPathTracer.h"
 #include <sutil.h>
 #include <Arcball.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
 #include <stdint.h>
 #include <chrono>
 #include <experimental/filesystem>
@@ -49,6 +63,89 @@ uint32_t       width  = 512;
 uint32_t       height = 512;
 bool           use_pbo = true;
 bool           progressive = false;
+unsigned int   aov_mask = 0;      // AovFlags written alongside output_buffer
+bool           denoise = false;
+grpt::denoiser denoiser;
+Buffer         denoised_buffer = 0;
+
+// Headless progressive rendering
+unsigned int   num_frames = 1;
+std::string    checkpoint_file;
+double         checkpoint_interval = 60.0;   // seconds
+std::string    resume_file;
+uint64_t       scene_hash = 0;
+grpt::accumulation_writer checkpoint_writer;
+
+// Distributed rendering: workers render disjoint RNG frame ranges of the
+// same image and their accumulation files are merged afterwards.
+unsigned int   frame_seed_offset = 0;
+std::string    coordinator_socket;
+int            coordinator_fd = -1;
+
+// Render server: keeps the scene loaded and renders tiles for socket clients.
+std::string    server_socket;
+
+// Crop window (half open, image pixels; crop_x1 == 0 means the whole image)
+// and bucket rendering, which walks the crop in bucket_size tiles so the
+// buffers never hold more than one tile.
+uint32_t       crop_x0 = 0, crop_y0 = 0, crop_x1 = 0, crop_y1 = 0;
+uint32_t       bucket_size = 0;
+
+// Time budgeted rendering: instead of a fixed num_frames, render as many
+// frames as fit in time_budget seconds.
+double         time_budget = 0.0;
+
+// Interactive frames drop to a reduced resolution while the camera moves to
+// hold the target frame rate.  The loop can also run headlessly, orbiting
+// the camera, to measure it.
+grpt::preview_controller preview;
+Buffer         preview_buffer = 0;
+bool           preview_reduced = false;      // the last frame was rendered below full resolution
+float          preview_scale = 1.0f;         // resolution scale of the last frame
+unsigned int   preview_benchmark_frames = 0;
+
+// Temporal reprojection: a camera move carries the image accumulated for the
+// previous camera over into the new view instead of discarding it.
+bool           reproject = false;
+bool           history_valid = false;        // history_buffer holds an accumulated image
+Buffer         history_buffer = 0;
+Buffer         history_depth_buffer = 0;
+
+// Path guiding: an SD-tree learns the incident radiance over training
+// iterations of doubling length and steers diffuse bounces towards it.
+bool           guide = false;
+grpt::guiding::sd_tree guide_tree;
+Buffer         guiding_record_buffer = 0;
+Buffer         guiding_spatial_buffer = 0;
+Buffer         guiding_directional_buffer = 0;
+
+// ReSTIR: direct lighting at primary hits is resampled from per-pixel
+// reservoirs that reuse their neighbours' and the previous frame's samples.
+bool           restir = false;
+bool           restir_unbiased = false;
+Buffer         restir_pixels = 0;
+Buffer         restir_history = 0;
+Buffer         restir_frame_buffer = 0;
+
+// Efficiency-aware Russian roulette and splitting: frames 1, 2, 4, ... record
+// their paths, and the statistics learnt from them pick how often each path
+// vertex continues.  rr_stats counts the segments traced either way.
+bool           ears = false;
+bool           rr_stats = false;
+unsigned int   ears_launches = 0;
+bool           pilot_launch = false;        // timing only; EARS neither learns from nor counts it
+double         rr_baseline_segments = 0.0;   // per path, classic roulette in the first frame
+std::unique_ptr<grpt::ears::learner> ears_learner;
+Buffer         ears_record_buffer = 0;
+Buffer         ears_cells_buffer = 0;
+Buffer         ears_pixels_buffer = 0;
+Buffer         rr_stats_buffer = 0;
+
+// Integrator statistics; stats_buffer only exists in builds configured with
+// GRPT_ENABLE_STATS, and --stats writes it out as '<prefix>_stats.json' and
+// heatmaps.
+std::string    stats_prefix;
+Buffer         stats_buffer = 0;
 
 unsigned int   frame_number = 1;
 unsigned int   sqrt_num_samples = 10;
@@ -60,6 +157,8 @@ Program        pgram_bounding_box = 0;
 float3         camera_up;
 float3         camera_lookat;
 float3         camera_eye;
+float          camera_fov = 35.0f;   // vertical, in degrees
+float3         frame_eye, frame_u, frame_v, frame_w;   // camera of the last launched frame
 Matrix4x4      camera_rotate;
 bool           camera_changed = true;
 sutil::Arcball arcball;
@@ -76,6 +175,34 @@ int            mouse_button;
 //------------------------------------------------------------------------------
 
 Buffer getOutputBuffer();
+uint32_t cropWidth();
+uint32_t cropHeight();
+uint32_t bufferWidth();
+uint32_t bufferHeight();
+void createAovBuffers();
+void resizeAovBuffers();
+void saveAovs( const std::string& prefix );
+Buffer denoiseOutputBuffer();
+bool interactive();
+void launchFrame( uint32_t w, uint32_t h );
+void learnRussianRoulette();
+void reportRussianRouletteStats();
+void saveStats( const std::string& prefix, double render_ms );
+bool accumulating();
+uint64_t sceneHash();
+void renderBuckets( const std::string& filename );
+std::unique_ptr<grpt::accumulation_file> captureAccumulation();
+void restoreAccumulation( const grpt::accumulation_file& file );
+void clearRestirHistory();
+double pilotFrameCost();
+unsigned int framesWithin( double seconds, double frame_cost );
+void renderFrames();
+void uploadGuidingTree();
+unsigned int renderGuidedFrames();
+void storeHistory();
+Buffer renderInteractiveFrame();
+void runPreviewBenchmark();
+void receiveAssignment();
 void destroyContext();
 void registerExitHandler();
 void createContext();
@@ -104,6 +231,734 @@ Buffer getOutputBuffer()
 }
 
 
+uint32_t cropWidth()
+{
+    return crop_x1 ? crop_x1 - crop_x0 : width;
+}
+
+
+uint32_t cropHeight()
+{
+    return crop_x1 ? crop_y1 - crop_y0 : height;
+}
+
+
+// Launch and buffer extent: the crop window, or one bucket of it.
+uint32_t bufferWidth()
+{
+    return bucket_size ? std::min( bucket_size, cropWidth() ) : cropWidth();
+}
+
+
+uint32_t bufferHeight()
+{
+    return bucket_size ? std::min( bucket_size, cropHeight() ) : cropHeight();
+}
+
+
+struct AovOutput
+{
+    unsigned int flag;
+    const char*  name;       // --aov name and output file suffix
+    const char*  buffer;
+    RTformat     format;
+};
+
+const AovOutput aov_outputs[] =
+{
+    { AOV_ALBEDO,       "albedo", "aov_albedo_buffer",       RT_FORMAT_FLOAT4 },
+    { AOV_NORMAL,       "normal", "aov_normal_buffer",       RT_FORMAT_FLOAT4 },
+    { AOV_DEPTH,        "depth",  "aov_depth_buffer",        RT_FORMAT_FLOAT },
+    { AOV_ID,           "id",     "aov_id_buffer",           RT_FORMAT_UNSIGNED_INT2 },
+    { AOV_SAMPLE_COUNT, "count",  "aov_sample_count_buffer", RT_FORMAT_UNSIGNED_INT }
+};
+
+
+// Disabled AOVs get a 1x1 placeholder so the programs stay valid without
+// allocating full frame buffers.
+void createAovBuffers()
+{
+    for( const AovOutput& aov : aov_outputs )
+    {
+        const bool enabled = ( aov_mask & aov.flag ) != 0;
+        Buffer buffer = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, aov.format,
+                                               enabled ? bufferWidth() : 1u, enabled ? bufferHeight() : 1u );
+        context[ aov.buffer ]->set( buffer );
+    }
+    context[ "aov_mask" ]->setUint( aov_mask );
+}
+
+
+void resizeAovBuffers()
+{
+    for( const AovOutput& aov : aov_outputs )
+        if( aov_mask & aov.flag )
+            context[ aov.buffer ]->getBuffer()->setSize( width, height );
+}
+
+
+// Writes every enabled AOV to '<prefix>_<name>.pfm', and the beauty image
+// to '<prefix>_color.pfm' so the set can be denoised or composited offline.
+void saveAovs( const std::string& prefix )
+{
+    if( aov_mask )
+        grpt::image_io::write_buffer_pfm( prefix + "_color.pfm", getOutputBuffer() );
+
+    for( const AovOutput& aov : aov_outputs )
+    {
+        if( !( aov_mask & aov.flag ) )
+            continue;
+        const std::string filename = prefix + "_" + aov.name + ".pfm";
+        std::cerr << "Saving " << aov.name << " AOV to '" << filename << "'\n";
+        grpt::image_io::write_buffer_pfm( filename, context[ aov.buffer ]->getBuffer() );
+    }
+}
+
+
+// Runs the CPU denoiser on output_buffer, guided by the albedo, normal and
+// depth AOVs, and returns the buffer holding the result.
+Buffer denoiseOutputBuffer()
+{
+    if( !denoised_buffer )
+        denoised_buffer = context->createBuffer( RT_BUFFER_INPUT, RT_FORMAT_FLOAT4, bufferWidth(), bufferHeight() );
+
+    Buffer color  = getOutputBuffer();
+    Buffer albedo = context[ "aov_albedo_buffer" ]->getBuffer();
+    Buffer normal = context[ "aov_normal_buffer" ]->getBuffer();
+    Buffer depth  = context[ "aov_depth_buffer"  ]->getBuffer();
+
+    denoiser.denoise( static_cast<const float4*>( color->map( 0, RT_BUFFER_MAP_READ ) ),
+                      static_cast<const float4*>( albedo->map( 0, RT_BUFFER_MAP_READ ) ),
+                      static_cast<const float4*>( normal->map( 0, RT_BUFFER_MAP_READ ) ),
+                      static_cast<const float*>( depth->map( 0, RT_BUFFER_MAP_READ ) ),
+                      bufferWidth(), bufferHeight(),
+                      static_cast<float4*>( denoised_buffer->map( 0, RT_BUFFER_MAP_WRITE_DISCARD ) ) );
+    denoised_buffer->unmap();
+    depth->unmap();
+    normal->unmap();
+    albedo->unmap();
+    color->unmap();
+
+    return denoised_buffer;
+}
+
+
+bool interactive()
+{
+    return progressive || preview_benchmark_frames > 0;
+}
+
+
+// Headless renders of several frames, renders that checkpoint or resume,
+// bucket renders, guided and ReSTIR renders, the render server and
+// interactive frames while the camera rests average their launches in
+// output_buffer.
+bool accumulating()
+{
+    return num_frames > 1 || !checkpoint_file.empty() || !resume_file.empty() || !server_socket.empty() ||
+           bucket_size || time_budget > 0.0 || guide || restir || ears || rr_stats || interactive();
+}
+
+
+// Launches one path tracing frame; with ReSTIR, the resolve pass then adds
+// the primary hits' direct lighting and accumulates the frame.  With EARS,
+// full buffer launches 1, 2, 4, ... record their paths for learning; the
+// pilot frame of pilotFrameCost() does not count.
+void launchFrame( uint32_t w, uint32_t h )
+{
+    const bool full = w == bufferWidth() && h == bufferHeight() && w * h > 0 && !pilot_launch;
+    const bool learn = ears && full && ( ears_launches & ( ears_launches + 1 ) ) == 0;
+    if( learn )
+        context[ "ears_record" ]->setUint( 1u );
+
+    context->launch( 0, w, h );
+    if( restir )
+        context->launch( 3, w, h );
+
+    if( learn )
+    {
+        context[ "ears_record" ]->setUint( 0u );
+        learnRussianRoulette();
+    }
+    if( ears && full )
+        ++ears_launches;
+}
+
+
+// Feeds the paths the last launch recorded to the EARS learner and hands the
+// updated statistics to the camera program.
+void learnRussianRoulette()
+{
+    if( !ears_learner )
+    {
+        ears_learner.reset( new grpt::ears::learner( bufferWidth(), bufferHeight() ) );
+
+        // Nothing was learnt yet, so the first frame ran classic roulette.
+        const unsigned int* counts = static_cast<const unsigned int*>( rr_stats_buffer->map( 0, RT_BUFFER_MAP_READ ) );
+        rr_baseline_segments = counts[RR_STATS_PATHS] ? static_cast<double>( counts[RR_STATS_SEGMENTS] ) / counts[RR_STATS_PATHS] : 0.0;
+        rr_stats_buffer->unmap();
+    }
+
+    ears_learner->add_records( static_cast<const float4*>( ears_record_buffer->map( 0, RT_BUFFER_MAP_READ ) ) );
+    ears_record_buffer->unmap();
+    ears_learner->update();
+    if( !ears_learner->ready() )
+        return;
+
+    const std::vector<float2>& cells = ears_learner->cells();
+    ears_cells_buffer->setSize( cells.size() );
+    memcpy( ears_cells_buffer->map(), cells.data(), cells.size() * sizeof( float2 ) );
+    ears_cells_buffer->unmap();
+
+    const std::vector<float2>& pixels = ears_learner->pixels();
+    memcpy( ears_pixels_buffer->map(), pixels.data(), pixels.size() * sizeof( float2 ) );
+    ears_pixels_buffer->unmap();
+
+    context[ "ears_bounds_min"      ]->setFloat( ears_learner->bounds_min() );
+    context[ "ears_bounds_extent"   ]->setFloat( ears_learner->bounds_extent() );
+    context[ "ears_grid_resolution" ]->setUint( ears_learner->grid_resolution() );
+    context[ "ears_enabled"         ]->setUint( 1u );
+}
+
+
+void reportRussianRouletteStats()
+{
+    const unsigned int* counts = static_cast<const unsigned int*>( rr_stats_buffer->map( 0, RT_BUFFER_MAP_READ ) );
+    const double paths = counts[RR_STATS_PATHS];
+    const double segments_per_path = paths > 0.0 ? counts[RR_STATS_SEGMENTS] / paths : 0.0;
+    std::cout << ( ears ? "EARS" : "Russian roulette" ) << ": " << counts[RR_STATS_PATHS] << " paths traced "
+              << counts[RR_STATS_SEGMENTS] << " segments (" << segments_per_path << " per path); "
+              << counts[RR_STATS_KILLED] << " paths killed, " << counts[RR_STATS_SPLIT] << " branches split off.\n";
+    rr_stats_buffer->unmap();
+
+    if( ears && rr_baseline_segments > 0.0 )
+        std::cout << "Classic roulette traced " << rr_baseline_segments << " segments per path in the first frame; "
+                  << 100.0 * ( 1.0 - segments_per_path / rr_baseline_segments ) << "% of them saved.\n";
+}
+
+
+void saveStats( const std::string& prefix, double render_ms )
+{
+    const grpt::stats::pixel_counters* counters =
+        static_cast<const grpt::stats::pixel_counters*>( stats_buffer->map( 0, RT_BUFFER_MAP_READ ) );
+    const grpt::stats::summary summary = grpt::stats::summarize( counters, bufferWidth(), bufferHeight() );
+    std::cerr << "Saving statistics to '" << prefix << "_stats.json' and '" << prefix << "_*.pfm'\n";
+    grpt::stats::write_json( prefix + "_stats.json", summary, render_ms );
+    grpt::stats::write_heatmaps( prefix, counters, bufferWidth(), bufferHeight() );
+    stats_buffer->unmap();
+
+    const unsigned long long rays = summary.radiance_rays + summary.shadow_rays;
+    std::cout << "Statistics: " << summary.paths << " paths, " << summary.radiance_rays << " radiance and "
+              << summary.shadow_rays << " shadow rays, " << ( rays ? static_cast<double>( summary.primitives_tested ) / rays : 0.0 )
+              << " primitives tested per ray, " << summary.roulette_kills << " roulette kills.\n";
+}
+
+
+// Identifies the settings a checkpoint's samples belong to.
+uint64_t sceneHash()
+{
+    uint64_t hash = grpt::hash_bytes( SAMPLE_NAME, strlen( SAMPLE_NAME ) );
+    hash = grpt::hash_bytes( &camera_eye,       sizeof( camera_eye ),       hash );
+    hash = grpt::hash_bytes( &camera_lookat,    sizeof( camera_lookat ),    hash );
+    hash = grpt::hash_bytes( &camera_up,        sizeof( camera_up ),        hash );
+    hash = grpt::hash_bytes( &width,            sizeof( width ),            hash );
+    hash = grpt::hash_bytes( &height,           sizeof( height ),           hash );
+    hash = grpt::hash_bytes( &crop_x0,          sizeof( crop_x0 ),          hash );
+    hash = grpt::hash_bytes( &crop_y0,          sizeof( crop_y0 ),          hash );
+    hash = grpt::hash_bytes( &crop_x1,          sizeof( crop_x1 ),          hash );
+    hash = grpt::hash_bytes( &crop_y1,          sizeof( crop_y1 ),          hash );
+    hash = grpt::hash_bytes( &sqrt_num_samples, sizeof( sqrt_num_samples ), hash );
+    hash = grpt::hash_bytes( &rr_begin_depth,   sizeof( rr_begin_depth ),   hash );
+    hash = grpt::hash_bytes( &restir,           sizeof( restir ),           hash );
+    hash = grpt::hash_bytes( &restir_unbiased,  sizeof( restir_unbiased ),  hash );
+    hash = grpt::hash_bytes( &ears,             sizeof( ears ),             hash );
+    return hash;
+}
+
+
+// Copies the accumulated frames out of the OptiX buffers.
+std::unique_ptr<grpt::accumulation_file> captureAccumulation()
+{
+    std::unique_ptr<grpt::accumulation_file> file( new grpt::accumulation_file );
+    file->header.width            = bufferWidth();
+    file->header.height           = bufferHeight();
+    file->header.aov_mask         = aov_mask;
+    file->header.sqrt_num_samples = sqrt_num_samples;
+    file->header.first_frame      = 1 + frame_seed_offset;
+    file->header.next_frame       = frame_number + frame_seed_offset;
+    file->header.sample_count     = static_cast<uint64_t>( frame_number - 1 ) * sqrt_num_samples * sqrt_num_samples;
+    file->header.scene_hash       = scene_hash;
+
+    const size_t count = static_cast<size_t>( bufferWidth() ) * bufferHeight();
+    file->color.resize( count * 3 );
+    Buffer output = getOutputBuffer();
+    const float4* color = static_cast<const float4*>( output->map( 0, RT_BUFFER_MAP_READ ) );
+    for( size_t i = 0; i < count; ++i )
+    {
+        file->color[ i*3 + 0 ] = color[i].x;
+        file->color[ i*3 + 1 ] = color[i].y;
+        file->color[ i*3 + 2 ] = color[i].z;
+    }
+    output->unmap();
+
+    for( const AovOutput& aov : aov_outputs )
+    {
+        if( !( aov_mask & aov.flag ) )
+            continue;
+        Buffer buffer = context[ aov.buffer ]->getBuffer();
+        grpt::accumulation_file::aov_section section;
+        section.flag = aov.flag;
+        section.data.resize( count * buffer->getElementSize() );
+        memcpy( section.data.data(), buffer->map( 0, RT_BUFFER_MAP_READ ), section.data.size() );
+        buffer->unmap();
+        file->aovs.push_back( std::move( section ) );
+    }
+
+    return file;
+}
+
+
+// Loads a checkpoint back into the OptiX buffers; the next launch continues
+// with the RNG frame index the interrupted render would have used.
+void restoreAccumulation( const grpt::accumulation_file& file )
+{
+    const grpt::accumulation_file::header_t& header = file.header;
+    if( header.width != bufferWidth() || header.height != bufferHeight() ||
+        header.sqrt_num_samples != sqrt_num_samples || header.aov_mask != aov_mask ||
+        header.scene_hash != scene_hash || header.first_frame != 1 + frame_seed_offset )
+        throw Exception( "Checkpoint '" + resume_file + "' was rendered with different settings" );
+
+    const size_t count = static_cast<size_t>( bufferWidth() ) * bufferHeight();
+    Buffer output = getOutputBuffer();
+    float4* color = static_cast<float4*>( output->map( 0, RT_BUFFER_MAP_WRITE_DISCARD ) );
+    for( size_t i = 0; i < count; ++i )
+        color[i] = make_float4( file.color[ i*3 + 0 ], file.color[ i*3 + 1 ], file.color[ i*3 + 2 ], 1.0f );
+    output->unmap();
+
+    for( const grpt::accumulation_file::aov_section& section : file.aovs )
+    {
+        for( const AovOutput& aov : aov_outputs )
+        {
+            if( aov.flag != section.flag )
+                continue;
+            Buffer buffer = context[ aov.buffer ]->getBuffer();
+            if( section.data.size() != count * buffer->getElementSize() )
+                throw Exception( "Checkpoint '" + resume_file + "' has a malformed " + aov.name + " AOV" );
+            memcpy( buffer->map( 0, RT_BUFFER_MAP_WRITE_DISCARD ), section.data.data(), section.data.size() );
+            buffer->unmap();
+        }
+    }
+
+    // Temporal reservoirs are not saved; the first resumed frame starts
+    // without them.
+    if( restir )
+        clearRestirHistory();
+
+    frame_number = header.next_frame - frame_seed_offset;
+}
+
+
+// Invalid reservoirs everywhere, which temporal reuse skips.
+void clearRestirHistory()
+{
+    RTsize w, h;
+    restir_history->getSize( w, h );
+    memset( restir_history->map(), 0, w * h * sizeof( grpt::restir::pixel ) );
+    restir_history->unmap();
+}
+
+
+// Pilot pass for time budgeted renders: times one sample per pixel over the
+// crop window, bucket by bucket when bucketing, and returns the estimated
+// seconds of one frame at the full sample count.  Its output is overwritten
+// by the first real frame or by a restored checkpoint.
+double pilotFrameCost()
+{
+    // Compiles the programs and builds the acceleration structures outside
+    // the measurement.
+    launchFrame( 0, 0 );
+
+    context[ "sqrt_num_samples" ]->setUint( 1u );
+    context[ "frame_number"     ]->setUint( 1u );
+    pilot_launch = true;
+
+    const auto begin = std::chrono::steady_clock::now();
+    const uint32_t step = bucket_size ? bucket_size : std::max( cropWidth(), cropHeight() );
+    for( uint32_t y = 0; y < cropHeight(); y += step )
+    {
+        for( uint32_t x = 0; x < cropWidth(); x += step )
+        {
+            context[ "render_offset" ]->setUint( crop_x0 + x, crop_y0 + y );
+            launchFrame( std::min( step, cropWidth() - x ), std::min( step, cropHeight() - y ) );
+        }
+    }
+    const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+    pilot_launch = false;
+
+    // The segment counts start with the first real frame, which the classic
+    // roulette baseline is measured on.
+    memset( rr_stats_buffer->map(), 0, RR_STATS_COUNT * sizeof( unsigned int ) );
+    rr_stats_buffer->unmap();
+
+    context[ "sqrt_num_samples" ]->setUint( sqrt_num_samples );
+    context[ "render_offset"    ]->setUint( crop_x0, crop_y0 );
+    return seconds * sqrt_num_samples * sqrt_num_samples;
+}
+
+
+// Whole frames that fit in 'seconds'; at least one, so a budget too small
+// for a single frame still produces an image.
+unsigned int framesWithin( double seconds, double frame_cost )
+{
+    if( seconds <= frame_cost || frame_cost <= 0.0 )
+        return 1u;
+    return static_cast<unsigned int>( std::min( seconds / frame_cost, 1.0e6 ) );
+}
+
+
+// Launches frames until num_frames have been accumulated, resuming from and
+// periodically writing checkpoints when asked to.  With a time budget the
+// frame count follows the measured frame cost, and the render stops at the
+// last frame that is expected to finish before the deadline; every pixel
+// gets the same number of samples.
+void renderFrames()
+{
+    const auto begin = std::chrono::steady_clock::now();
+
+    // Sets the camera up exactly like the first frame of a fresh render.
+    updateCamera();
+
+    // The pilot writes its own samples into the accumulation buffers, so it
+    // runs before a checkpoint is restored over them.
+    double frame_cost = 0.0;
+    if( time_budget > 0.0 )
+        frame_cost = pilotFrameCost();
+
+    if( !resume_file.empty() )
+    {
+        restoreAccumulation( grpt::read_accumulation_file( resume_file ) );
+        std::cout << "Resuming '" << resume_file << "' at frame " << frame_number << ".\n";
+    }
+    else
+    {
+        frame_number = 1;
+    }
+
+    const unsigned int first_frame = frame_number;
+    if( time_budget > 0.0 )
+    {
+        const double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+        num_frames = first_frame - 1 + framesWithin( time_budget - elapsed, frame_cost );
+    }
+
+    const auto frames_begin = std::chrono::steady_clock::now();
+    auto last_checkpoint = frames_begin;
+    while( frame_number <= num_frames )
+    {
+        updateCamera();
+        launchFrame( bufferWidth(), bufferHeight() );
+
+        const auto now = std::chrono::steady_clock::now();
+        if( time_budget > 0.0 )
+        {
+            // Replace the pilot estimate by the mean of the frames so far.
+            const unsigned int rendered = frame_number - first_frame;
+            frame_cost = std::chrono::duration<double>( now - frames_begin ).count() / rendered;
+            const double remaining = time_budget - std::chrono::duration<double>( now - begin ).count();
+            num_frames = frame_number - 1 + ( remaining > frame_cost ? framesWithin( remaining, frame_cost ) : 0u );
+        }
+
+        if( !checkpoint_file.empty() && frame_number <= num_frames &&
+            std::chrono::duration<double>( now - last_checkpoint ).count() >= checkpoint_interval )
+        {
+            checkpoint_writer.submit( checkpoint_file, captureAccumulation() );
+            last_checkpoint = now;
+        }
+    }
+
+    if( !checkpoint_file.empty() )
+        checkpoint_writer.submit( checkpoint_file, captureAccumulation() );
+    if( !checkpoint_writer.wait() )
+        throw Exception( "Failed to write checkpoint '" + checkpoint_file + "'" );
+}
+
+
+// Hands the SD-tree's sampling distribution to the closest hit programs.
+void uploadGuidingTree()
+{
+    std::vector<grpt::guiding::spatial_node> spatial;
+    std::vector<grpt::guiding::directional_node> directional;
+    guide_tree.flatten( spatial, directional );
+
+    guiding_spatial_buffer->setSize( spatial.size() );
+    memcpy( guiding_spatial_buffer->map(), spatial.data(), spatial.size() * sizeof( spatial[0] ) );
+    guiding_spatial_buffer->unmap();
+
+    guiding_directional_buffer->setSize( directional.size() );
+    memcpy( guiding_directional_buffer->map(), directional.data(), directional.size() * sizeof( directional[0] ) );
+    guiding_directional_buffer->unmap();
+
+    context[ "guiding_bounds_min"    ]->setFloat( guide_tree.bounds_min() );
+    context[ "guiding_bounds_extent" ]->setFloat( guide_tree.bounds_extent() );
+    context[ "guiding_enabled"       ]->setUint( 1u );
+}
+
+
+// Renders num_frames frames with path guiding.  Training iteration k takes
+// 2^k frames, each recording the radiance its paths find, and refines the
+// SD-tree from them; training stops once the next iteration would leave
+// fewer frames than it takes itself, and the remaining frames, at least half
+// of the total, render with the final tree.  Each iteration restarts the
+// accumulation, so the image holds the final iteration only, which is not
+// biased towards the earlier, less well guided ones.  Returns the frames
+// the image holds.
+unsigned int renderGuidedFrames()
+{
+    updateCamera();
+    const size_t num_records = static_cast<size_t>( bufferWidth() ) * bufferHeight() * grpt::guiding::record_depth;
+    guiding_record_buffer->setSize( num_records * 2 );
+
+    unsigned int frames_done = 0;
+    while( frames_done < num_frames )
+    {
+        unsigned int length = 1u << std::min( guide_tree.iterations(), 30u );
+        const bool training = frames_done + length < num_frames &&
+                              num_frames - frames_done - length >= 2 * length;
+        if( !training )
+            length = num_frames - frames_done;
+
+        context[ "guiding_record"    ]->setUint( training ? 1u : 0u );
+        context[ "frame_seed_offset" ]->setUint( frame_seed_offset + frames_done );
+        frame_number = 1;
+        for( unsigned int frame = 0; frame < length; ++frame )
+        {
+            updateCamera();
+            launchFrame( bufferWidth(), bufferHeight() );
+
+            if( training )
+            {
+                guide_tree.add_records( static_cast<const float4*>( guiding_record_buffer->map( 0, RT_BUFFER_MAP_READ ) ), num_records );
+                guiding_record_buffer->unmap();
+            }
+        }
+        frames_done += length;
+
+        if( training )
+        {
+            guide_tree.end_iteration();
+            uploadGuidingTree();
+        }
+    }
+    context[ "guiding_record" ]->setUint( 0u );
+    return frame_number - 1;
+}
+
+
+// Renders the crop window one bucket at a time, accumulating all frames of
+// a bucket before moving on, and streams each finished bucket into a PFM.
+// Peak memory is one bucket however large the image is.  A time budget is
+// turned into a frame count once, from the pilot pass, so every bucket gets
+// the same number of samples.
+void renderBuckets( const std::string& filename )
+{
+    const auto begin = std::chrono::steady_clock::now();
+    updateCamera();
+
+    if( time_budget > 0.0 )
+    {
+        const double frame_cost = pilotFrameCost();
+        const double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+        num_frames = framesWithin( time_budget - elapsed, frame_cost );
+    }
+
+    grpt::image_io::pfm_writer out( filename, cropWidth(), cropHeight(), 3 );
+    std::vector<float> pixels( static_cast<size_t>( bufferWidth() ) * bufferHeight() * 3 );
+    Buffer output = getOutputBuffer();
+
+    for( uint32_t y = 0; y < cropHeight(); y += bucket_size )
+    {
+        for( uint32_t x = 0; x < cropWidth(); x += bucket_size )
+        {
+            const uint32_t w = std::min( bucket_size, cropWidth() - x );
+            const uint32_t h = std::min( bucket_size, cropHeight() - y );
+
+            context[ "render_offset" ]->setUint( crop_x0 + x, crop_y0 + y );
+            for( frame_number = 1; frame_number <= num_frames; ++frame_number )
+            {
+                context[ "frame_number" ]->setUint( frame_number );
+                launchFrame( w, h );
+            }
+
+            const float4* color = static_cast<const float4*>( output->map( 0, RT_BUFFER_MAP_READ ) );
+            for( uint32_t row = 0; row < h; ++row )
+            {
+                for( uint32_t col = 0; col < w; ++col )
+                {
+                    const float4& c = color[ row * bufferWidth() + col ];
+                    float* dst = &pixels[ ( row * w + col ) * 3 ];
+                    dst[0] = c.x;
+                    dst[1] = c.y;
+                    dst[2] = c.z;
+                }
+            }
+            output->unmap();
+
+            out.write_region( x, y, w, h, pixels.data() );
+        }
+    }
+    out.close();
+}
+
+
+// Copies the accumulated image and its depth aside, with the camera they were
+// rendered from, for the first frame after a camera move to reproject.
+void storeHistory()
+{
+    context->launch( 2, width, height );
+    context[ "history_eye" ]->setFloat( frame_eye );
+    context[ "history_U"   ]->setFloat( frame_u );
+    context[ "history_V"   ]->setFloat( frame_v );
+    context[ "history_W"   ]->setFloat( frame_w );
+    history_valid = true;
+}
+
+
+// One frame of the interactive loop, independent of GLUT.  While the camera
+// moves the frame is rendered at the resolution the preview controller picks
+// and stretched over the window; once it rests, full resolution frames
+// accumulate from scratch.  Returns the buffer to display.
+Buffer renderInteractiveFrame()
+{
+    const auto begin = std::chrono::steady_clock::now();
+
+    const float scale = preview.begin_frame( camera_changed );
+    preview_scale = scale;
+    const uint32_t w = std::max( 1u, static_cast<uint32_t>( width  * scale + 0.5f ) );
+    const uint32_t h = std::max( 1u, static_cast<uint32_t>( height * scale + 0.5f ) );
+    const bool reduced = w < width || h < height;
+
+    // Keep the image accumulated for the camera being left.
+    const bool restart = !reduced && ( camera_changed || preview_reduced );
+    if( reproject && camera_changed && !preview_reduced && frame_number > 1 )
+        storeHistory();
+    if( reproject )
+        context[ "history_mode" ]->setUint( reduced ? HISTORY_OFF : restart && history_valid ? HISTORY_REPROJECT : HISTORY_ACCUMULATE );
+
+    // Reduced frames only cover a corner of output_buffer, so accumulation
+    // restarts with the first full resolution frame.
+    if( preview_reduced && !reduced )
+        frame_number = 1;
+    preview_reduced = reduced;
+
+    updateCamera();
+    context[ "render_size" ]->setUint( w, h );
+    launchFrame( w, h );
+
+    Buffer result;
+    if( reduced )
+    {
+        context[ "preview_size" ]->setUint( w, h );
+        context->launch( 1, width, height );
+        context[ "render_size" ]->setUint( width, height );
+        result = preview_buffer;
+    }
+    else
+    {
+        result = denoise ? denoiseOutputBuffer() : getOutputBuffer();
+    }
+
+    preview.end_frame( std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count(), scale );
+    return result;
+}
+
+
+// Drives the interactive loop without a window: the camera orbits for the
+// first half of the frames and rests for the second, and the frame times and
+// resolutions are reported.
+void runPreviewBenchmark()
+{
+    const unsigned int moving_frames = preview_benchmark_frames / 2;
+    double moving_ms = 0.0, resting_ms = 0.0, scale_sum = 0.0;
+
+    for( unsigned int i = 0; i < preview_benchmark_frames; ++i )
+    {
+        if( i < moving_frames )
+        {
+            camera_rotate  = Matrix4x4::rotate( 0.01f, make_float3( 0.0f, 1.0f, 0.0f ) );
+            camera_changed = true;
+        }
+
+        const auto begin = std::chrono::steady_clock::now();
+        renderInteractiveFrame();
+        const double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+        if( i < moving_frames )
+        {
+            moving_ms += ms;
+            scale_sum += preview_scale;
+        }
+        else
+        {
+            resting_ms += ms;
+        }
+    }
+
+    const unsigned int resting_frames = preview_benchmark_frames - moving_frames;
+    if( moving_frames )
+        std::cout << "Moving: " << moving_frames << " frames, " << moving_ms / moving_frames << " ms per frame at "
+                  << 100.0 * scale_sum / moving_frames << "% resolution on average (target "
+                  << preview.settings().target_fps << " fps).\n";
+    if( resting_frames )
+        std::cout << "Resting: " << resting_frames << " full resolution frames, "
+                  << resting_ms / resting_frames << " ms per frame.\n";
+}
+
+
+// Worker side of tools/render_coordinator: asks the coordinator which RNG
+// frame range to render and where to save the accumulation file.
+void receiveAssignment()
+{
+    coordinator_fd = grpt::unix_socket::connect( coordinator_socket );
+    grpt::unix_socket::send_line( coordinator_fd, "hello" );
+
+    std::string line;
+    if( !grpt::unix_socket::recv_line( coordinator_fd, line ) )
+        throw Exception( "Coordinator '" + coordinator_socket + "' closed the connection" );
+
+    std::istringstream in( line );
+    std::string command;
+    in >> command >> frame_seed_offset >> num_frames >> checkpoint_file;
+    if( command != "render" || !in || num_frames == 0 )
+        throw Exception( "Unexpected coordinator message '" + line + "'" );
+
+    // One file per worker, written once at the end.
+    checkpoint_interval = std::numeric_limits<double>::infinity();
+}
+
+
+// Parses a comma separated list of AOV names, or "all".
+bool parseAovList( const std::string& list, unsigned int& mask )
+{
+    std::istringstream in( list );
+    std::string name;
+    while( std::getline( in, name, ',' ) )
+    {
+        bool found = name == "all";
+        for( const AovOutput& aov : aov_outputs )
+        {
+            if( name == aov.name || name == "all" )
+            {
+                mask |= aov.flag;
+                found = true;
+            }
+        }
+        if( !found )
+            return false;
+    }
+    return true;
+}
+
+
 void destroyContext()
 {
     if( context )
@@ -167,7 +1022,7 @@ void createContext()
 {
     context = Context::create();
     context->setRayTypeCount( 2 );
-    context->setEntryPointCount( 1 );
+    context->setEntryPointCount( 4 );   // path tracing, preview upsampling, history copy, ReSTIR resolve
     context->setStackSize( 1800 );
 
     context[ "scene_epsilon"                  ]->setFloat( 1.e-3f );
@@ -175,18 +1030,120 @@ void createContext()
     context[ "pathtrace_shadow_ray_type"      ]->setUint( 1u );
     context[ "rr_begin_depth"                 ]->setUint( rr_begin_depth );
 
-    Buffer buffer = sutil::createOutputBuffer( context, RT_FORMAT_FLOAT4, width, height, use_pbo );
+    // Accumulating launches read output_buffer back, and a resumed render
+    // uploads its checkpoint into it.
+    Buffer buffer = accumulating() ?
+        sutil::createInputOutputBuffer( context, RT_FORMAT_FLOAT4, bufferWidth(), bufferHeight(), use_pbo ) :
+        sutil::createOutputBuffer( context, RT_FORMAT_FLOAT4, bufferWidth(), bufferHeight(), use_pbo );
     context["output_buffer"]->set( buffer );
+    createAovBuffers();
+
+    preview_buffer = context->createBuffer( RT_BUFFER_OUTPUT, RT_FORMAT_FLOAT4,
+                                            interactive() ? width : 1u, interactive() ? height : 1u );
+    context[ "preview_buffer" ]->set( preview_buffer );
+    context[ "preview_size"   ]->setUint( 1u, 1u );
+
+    history_buffer = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT4,
+                                            reproject ? width : 1u, reproject ? height : 1u );
+    history_depth_buffer = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT,
+                                                  reproject ? width : 1u, reproject ? height : 1u );
+    context[ "history_buffer"          ]->set( history_buffer );
+    context[ "history_depth_buffer"    ]->set( history_depth_buffer );
+    context[ "history_mode"            ]->setUint( HISTORY_OFF );
+    context[ "history_max_weight"      ]->setFloat( 64.0f );
+    context[ "history_depth_tolerance" ]->setFloat( 0.02f );
+
+    // Guiding stays off until the first training iteration uploads a tree.
+    guiding_record_buffer = context->createBuffer( RT_BUFFER_OUTPUT, RT_FORMAT_FLOAT4, 1u );
+    guiding_spatial_buffer = context->createBuffer( RT_BUFFER_INPUT );
+    guiding_spatial_buffer->setFormat( RT_FORMAT_USER );
+    guiding_spatial_buffer->setElementSize( sizeof( grpt::guiding::spatial_node ) );
+    guiding_spatial_buffer->setSize( 1u );
+    guiding_directional_buffer = context->createBuffer( RT_BUFFER_INPUT );
+    guiding_directional_buffer->setFormat( RT_FORMAT_USER );
+    guiding_directional_buffer->setElementSize( sizeof( grpt::guiding::directional_node ) );
+    guiding_directional_buffer->setSize( 1u );
+    context[ "guiding_record_buffer"     ]->set( guiding_record_buffer );
+    context[ "guiding_spatial_nodes"     ]->set( guiding_spatial_buffer );
+    context[ "guiding_directional_nodes" ]->set( guiding_directional_buffer );
+    context[ "guiding_record"            ]->setUint( 0u );
+    context[ "guiding_enabled"           ]->setUint( 0u );
+    context[ "guiding_fraction"          ]->setFloat( 0.5f );
+    context[ "guiding_bounds_min"        ]->setFloat( make_float3( 0.0f ) );
+    context[ "guiding_bounds_extent"     ]->setFloat( make_float3( 1.0f ) );
+
+    const uint32_t restir_width  = restir ? ( interactive() ? width : bufferWidth() ) : 1u;
+    const uint32_t restir_height = restir ? ( interactive() ? height : bufferHeight() ) : 1u;
+    restir_pixels = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER, restir_width, restir_height );
+    restir_pixels->setElementSize( sizeof( grpt::restir::pixel ) );
+    restir_history = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER, restir_width, restir_height );
+    restir_history->setElementSize( sizeof( grpt::restir::pixel ) );
+    clearRestirHistory();
+    restir_frame_buffer = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT4, restir_width, restir_height );
+    context[ "restir_pixels"          ]->set( restir_pixels );
+    context[ "restir_history"         ]->set( restir_history );
+    context[ "restir_frame_buffer"    ]->set( restir_frame_buffer );
+    context[ "restir_enabled"         ]->setUint( restir ? 1u : 0u );
+    context[ "restir_candidates"      ]->setUint( 32u );
+    context[ "restir_spatial_samples" ]->setUint( 5u );
+    context[ "restir_spatial_radius"  ]->setFloat( 30.0f );
+    context[ "restir_max_history"     ]->setFloat( 20.0f );
+    context[ "restir_unbiased"        ]->setUint( restir_unbiased ? 1u : 0u );
+
+    // EARS stays off until the first recorded frames have been learnt from.
+    const size_t ears_records = ears ? static_cast<size_t>( bufferWidth() ) * bufferHeight() * ( grpt::ears::record_depth + 1 ) * 2 : 1u;
+    ears_record_buffer = context->createBuffer( RT_BUFFER_OUTPUT, RT_FORMAT_FLOAT4, ears_records );
+    ears_cells_buffer  = context->createBuffer( RT_BUFFER_INPUT, RT_FORMAT_FLOAT2, 1u );
+    ears_pixels_buffer = context->createBuffer( RT_BUFFER_INPUT, RT_FORMAT_FLOAT2,
+                                                ears ? bufferWidth() : 1u, ears ? bufferHeight() : 1u );
+    rr_stats_buffer    = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, RR_STATS_COUNT );
+    memset( rr_stats_buffer->map(), 0, RR_STATS_COUNT * sizeof( unsigned int ) );
+    rr_stats_buffer->unmap();
+    context[ "ears_record_buffer"   ]->set( ears_record_buffer );
+    context[ "ears_cells"           ]->set( ears_cells_buffer );
+    context[ "ears_pixels"          ]->set( ears_pixels_buffer );
+    context[ "rr_stats_buffer"      ]->set( rr_stats_buffer );
+    context[ "ears_enabled"         ]->setUint( 0u );
+    context[ "ears_record"          ]->setUint( 0u );
+    context[ "ears_bounds_min"      ]->setFloat( make_float3( 0.0f ) );
+    context[ "ears_bounds_extent"   ]->setFloat( make_float3( 1.0f ) );
+    context[ "ears_grid_resolution" ]->setUint( 1u );
+    context[ "ears_min_factor"      ]->setFloat( 0.05f );
+    context[ "ears_max_factor"      ]->setFloat( static_cast<float>( grpt::ears::max_split ) );
+    context[ "rr_stats"             ]->setUint( rr_stats ? 1u : 0u );
+
+#if defined(GRPT_ENABLE_STATS)
+    // The counters cover the launch and add up across frames.
+    stats_buffer = context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER, bufferWidth(), bufferHeight() );
+    stats_buffer->setElementSize( sizeof( grpt::stats::pixel_counters ) );
+    memset( stats_buffer->map(), 0, static_cast<size_t>( bufferWidth() ) * bufferHeight() * sizeof( grpt::stats::pixel_counters ) );
+    stats_buffer->unmap();
+    context[ "stats_buffer" ]->set( stats_buffer );
+#endif
 
     // Setup programs
     const char *ptx = sutil::getPtxString( SAMPLE_NAME, "../optixPathTracer.cu" );
-    context->setRayGenerationProgram( 0, context->createProgramFromPTXString( ptx, "pathtrace_camera" ) );
+    context->setRayGenerationProgram( 0, context->createProgramFromPTXString( ptx, accumulating() ? "pathtrace_camera_progressive" : "pathtrace_camera" ) );
     context->setExceptionProgram( 0, context->createProgramFromPTXString( ptx, "exception" ) );
+    context->setRayGenerationProgram( 1, context->createProgramFromPTXString( ptx, "upsample_preview" ) );
+    context->setExceptionProgram( 1, context->createProgramFromPTXString( ptx, "exception" ) );
+    context->setRayGenerationProgram( 2, context->createProgramFromPTXString( ptx, "store_history" ) );
+    context->setExceptionProgram( 2, context->createProgramFromPTXString( ptx, "exception" ) );
+    context->setRayGenerationProgram( 3, context->createProgramFromPTXString( ptx, "restir_resolve" ) );
+    context->setExceptionProgram( 3, context->createProgramFromPTXString( ptx, "exception" ) );
     context->setMissProgram( 0, context->createProgramFromPTXString( ptx, "miss" ) );
 
     context[ "sqrt_num_samples" ]->setUint( sqrt_num_samples );
+    context[ "frame_seed_offset" ]->setUint( frame_seed_offset );
+    context[ "render_offset"    ]->setUint( crop_x0, crop_y0 );
+    context[ "render_size"      ]->setUint( width, height );
     context[ "bad_color"        ]->setFloat( 1000000.0f, 0.0f, 1000000.0f ); // Super magenta to make sure it doesn't get averaged out in the progressive rendering.
     context[ "bg_color"         ]->setFloat( make_float3(0.0f) );
+
+    // Overridden per geometry instance and material for the ID AOV; 0 marks
+    // the background.
+    context[ "object_id"        ]->setUint( 0u );
+    context[ "material_id"      ]->setUint( 0u );
 }
 
 void loadLight()
@@ -229,6 +1186,7 @@ void loadGeometry()
 
     // Set up material
     Material diffuse = context->createMaterial();
+    diffuse[ "material_id" ]->setUint( 1u );
     const char *ptx = sutil::getPtxString( SAMPLE_NAME, "../src/shading_models/lambertian.cu" );
     Program diffuse_ch = context->createProgramFromPTXString( ptx, "diffuse" );
     Program diffuse_ah = context->createProgramFromPTXString( ptx, "shadow" );
@@ -236,6 +1194,7 @@ void loadGeometry()
     diffuse->setAnyHitProgram( 1, diffuse_ah );
 
     Material diffuse_light = context->createMaterial();
+    diffuse_light[ "material_id" ]->setUint( 2u );
     Program diffuse_em = context->createProgramFromPTXString( ptx, "diffuseEmitter" );
     diffuse_light->setClosestHitProgram( 0, diffuse_em );
 
@@ -337,6 +1296,9 @@ void loadGeometry()
                                         make_float3( 0.0f, 0.0f, 105.0f) ) );
     setMaterial(gis.back(), diffuse_light, "emission_color", light_em);
 
+    for( size_t i = 0; i < gis.size(); ++i )
+        gis[i][ "object_id" ]->setUint( static_cast<unsigned int>( i + 1 ) );
+
     // Create geometry group
     GeometryGroup geometry_group = context->createGeometryGroup(gis.begin(), gis.end());
     geometry_group->setAcceleration( context->createAcceleration( "Trbvh" ) );
@@ -356,7 +1318,7 @@ void setupCamera()
 
 void updateCamera()
 {
-    const float fov  = 35.0f;
+    const float fov  = camera_fov;
     const float aspect_ratio = static_cast<float>(width) / static_cast<float>(height);
     
     float3 camera_u, camera_v, camera_w;
@@ -364,24 +1326,30 @@ void updateCamera()
             camera_eye, camera_lookat, camera_up, fov, aspect_ratio,
             camera_u, camera_v, camera_w, /*fov_is_vertical*/ true );
 
-    const Matrix4x4 frame = Matrix4x4::fromBasis( 
-            normalize( camera_u ),
-            normalize( camera_v ),
-            normalize( -camera_w ),
-            camera_lookat);
-    const Matrix4x4 frame_inv = frame.inverse();
-    // Apply camera rotation twice to match old SDK behavior
-    const Matrix4x4 trans     = frame*camera_rotate*camera_rotate*frame_inv; 
-
-    camera_eye    = make_float3( trans*make_float4( camera_eye,    1.0f ) );
-    camera_lookat = make_float3( trans*make_float4( camera_lookat, 1.0f ) );
-    camera_up     = make_float3( trans*make_float4( camera_up,     0.0f ) );
-
-    sutil::calculateCameraVariables(
-            camera_eye, camera_lookat, camera_up, fov, aspect_ratio,
-            camera_u, camera_v, camera_w, true );
-
-    camera_rotate = Matrix4x4::identity();
+    // Only rebuild the frame after interaction; repeating the round trip
+    // through the inverse every frame would let the camera drift by an ulp
+    // at a time and break bitwise reproducible accumulation.
+    if( camera_changed )
+    {
+        const Matrix4x4 frame = Matrix4x4::fromBasis( 
+                normalize( camera_u ),
+                normalize( camera_v ),
+                normalize( -camera_w ),
+                camera_lookat);
+        const Matrix4x4 frame_inv = frame.inverse();
+        // Apply camera rotation twice to match old SDK behavior
+        const Matrix4x4 trans     = frame*camera_rotate*camera_rotate*frame_inv; 
+
+        camera_eye    = make_float3( trans*make_float4( camera_eye,    1.0f ) );
+        camera_lookat = make_float3( trans*make_float4( camera_lookat, 1.0f ) );
+        camera_up     = make_float3( trans*make_float4( camera_up,     0.0f ) );
+
+        sutil::calculateCameraVariables(
+                camera_eye, camera_lookat, camera_up, fov, aspect_ratio,
+                camera_u, camera_v, camera_w, true );
+
+        camera_rotate = Matrix4x4::identity();
+    }
 
     if( camera_changed ) // reset accumulation
         frame_number = 1;
@@ -393,6 +1361,11 @@ void updateCamera()
     context[ "V"  ]->setFloat( camera_v );
     context[ "W"  ]->setFloat( camera_w );
 
+    frame_eye = camera_eye;
+    frame_u   = camera_u;
+    frame_v   = camera_v;
+    frame_w   = camera_w;
+
 }
 
 
@@ -444,10 +1417,7 @@ void glutRun()
 
 void glutDisplay()
 {
-    updateCamera();
-    context->launch( 0, width, height );
-
-    sutil::displayBufferGL( getOutputBuffer() );
+    sutil::displayBufferGL( renderInteractiveFrame() );
 
     {
       static unsigned frame_count = 0;
@@ -474,6 +1444,7 @@ void glutKeyboardPress( unsigned char k, int x, int y )
             const std::string outputImage = std::string(SAMPLE_NAME) + ".ppm";
             std::cerr << "Saving current frame to '" << outputImage << "'\n";
             sutil::displayBufferPPM( outputImage.c_str(), getOutputBuffer(), false );
+            saveAovs( SAMPLE_NAME );
             break;
         }
     }
@@ -536,6 +1507,26 @@ void glutResize( int w, int h )
     sutil::ensureMinimumSize(width, height);
 
     sutil::resizeBuffer( getOutputBuffer(), width, height );
+    context[ "render_size" ]->setUint( width, height );
+    preview_buffer->setSize( width, height );
+    if( restir )
+    {
+        restir_pixels->setSize( width, height );
+        restir_history->setSize( width, height );
+        clearRestirHistory();
+        restir_frame_buffer->setSize( width, height );
+    }
+    if( reproject )
+    {
+        history_buffer->setSize( width, height );
+        history_depth_buffer->setSize( width, height );
+        history_valid = false;
+    }
+    resizeAovBuffers();
+    if( stats_buffer )
+        stats_buffer->setSize( width, height );
+    if( denoised_buffer )
+        denoised_buffer->setSize( width, height );
 
     glViewport(0, 0, width, height);
 
@@ -554,6 +1545,7 @@ void glutResize( int w, int h )
 int main( int argc, char** argv )
 {
     std::string out_file;
+    unsigned int guided_frames = 0;
     for( int i=1; i<argc; ++i )
     {
         const std::string arg( argv[i] );
@@ -579,6 +1571,104 @@ int main( int argc, char** argv )
         {
             progressive = true;
         }
+        else if( arg == "-a" || arg == "--aov"  )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+            }
+            if( !parseAovList( argv[++i], aov_mask ) )
+            {
+                std::cerr << "Unknown AOV in '" << argv[i] << "'\n";
+                grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+            }
+        }
+        else if( arg == "--frames" || arg == "--checkpoint" || arg == "--checkpoint-interval" || arg == "--resume" ||
+                 arg == "--frame-offset" || arg == "--coordinator" || arg == "--server" ||
+                 arg == "--crop" || arg == "--bucket" || arg == "--time-budget" || arg == "--target-fps" ||
+                 arg == "--preview-benchmark" || arg == "--stats" )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+            }
+            const std::string value = argv[++i];
+            if( arg == "--frames" )
+                num_frames = static_cast<unsigned int>( std::max( atoi( value.c_str() ), 1 ) );
+            else if( arg == "--checkpoint" )
+                checkpoint_file = value;
+            else if( arg == "--stats" )
+                stats_prefix = value;
+            else if( arg == "--checkpoint-interval" )
+                checkpoint_interval = atof( value.c_str() );
+            else if( arg == "--frame-offset" )
+                frame_seed_offset = static_cast<unsigned int>( std::max( atoi( value.c_str() ), 0 ) );
+            else if( arg == "--coordinator" )
+                coordinator_socket = value;
+            else if( arg == "--server" )
+            {
+                server_socket = value;
+                use_pbo = false;
+            }
+            else if( arg == "--crop" )
+            {
+                if( sscanf( value.c_str(), "%u,%u,%u,%u", &crop_x0, &crop_y0, &crop_x1, &crop_y1 ) != 4 ||
+                    crop_x0 >= crop_x1 || crop_y0 >= crop_y1 || crop_x1 > width || crop_y1 > height )
+                {
+                    std::cerr << "Crop window '" << value << "' is empty or outside the "
+                              << width << "x" << height << " image\n";
+                    grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+                }
+            }
+            else if( arg == "--bucket" )
+                bucket_size = static_cast<unsigned int>( std::max( atoi( value.c_str() ), 1 ) );
+            else if( arg == "--time-budget" )
+                time_budget = std::max( atof( value.c_str() ), 0.0 );
+            else if( arg == "--target-fps" )
+            {
+                grpt::preview_settings settings;
+                settings.target_fps = static_cast<float>( std::max( atof( value.c_str() ), 0.0 ) );
+                preview = grpt::preview_controller( settings );
+            }
+            else if( arg == "--preview-benchmark" )
+            {
+                preview_benchmark_frames = static_cast<unsigned int>( std::max( atoi( value.c_str() ), 1 ) );
+                use_pbo = false;
+            }
+            else
+                resume_file = value;
+        }
+        else if( arg == "-d" || arg == "--denoise"  )
+        {
+            denoise = true;
+            aov_mask |= AOV_ALBEDO | AOV_NORMAL | AOV_DEPTH;
+        }
+        else if( arg == "--restir" || arg == "--restir-unbiased" )
+        {
+            restir = true;
+            restir_unbiased = arg == "--restir-unbiased";
+        }
+        else if( arg == "--ears" )
+        {
+            ears = true;
+            rr_stats = true;
+        }
+        else if( arg == "--rr-stats" )
+        {
+            rr_stats = true;
+        }
+        else if( arg == "--guide" )
+        {
+            guide = true;
+        }
+        else if( arg == "--reproject" )
+        {
+            // Reprojection finds each pixel's surface through the depth AOV.
+            reproject = true;
+            aov_mask |= AOV_DEPTH;
+        }
         else
         {
             std::cerr << "Unknown option '" << arg << "'\n";
@@ -586,8 +1676,66 @@ int main( int argc, char** argv )
         }
     }
 
+    if( ( crop_x1 || bucket_size ) && ( interactive() || !server_socket.empty() ) )
+    {
+        std::cerr << "--crop and --bucket only apply to headless renders\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+    if( reproject && !interactive() )
+    {
+        std::cerr << "--reproject only applies to interactive rendering\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+    if( time_budget > 0.0 && ( interactive() || !coordinator_socket.empty() || !server_socket.empty() ) )
+    {
+        std::cerr << "--time-budget only applies to single process headless renders\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+    if( restir && !server_socket.empty() )
+    {
+        std::cerr << "--restir does not apply to the render server\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+#if !defined(GRPT_ENABLE_STATS)
+    if( !stats_prefix.empty() )
+    {
+        std::cerr << "--stats needs a build configured with -DGRPT_ENABLE_STATS=ON\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+#endif
+    if( !stats_prefix.empty() && ( interactive() || !server_socket.empty() || bucket_size ) )
+    {
+        std::cerr << "--stats only applies to headless renders of the whole crop window\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+    if( ( ears || rr_stats ) && ( interactive() || !server_socket.empty() || bucket_size ) )
+    {
+        std::cerr << "--ears and --rr-stats only apply to headless renders of the whole crop window\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+    if( ears && ( !checkpoint_file.empty() || !resume_file.empty() ) )
+    {
+        std::cerr << "--ears learns from the launches of one run and cannot be combined with checkpoints\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+    if( guide && ( interactive() || !server_socket.empty() || !coordinator_socket.empty() || bucket_size ||
+                   !checkpoint_file.empty() || !resume_file.empty() || time_budget > 0.0 ) )
+    {
+        std::cerr << "--guide only applies to single process headless renders of a fixed frame count\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+    if( bucket_size && ( aov_mask || !checkpoint_file.empty() || !resume_file.empty() || !coordinator_socket.empty() ) )
+    {
+        std::cerr << "--bucket streams the beauty image only and cannot be combined with AOVs, denoising, "
+                     "checkpoints or distributed rendering\n";
+        grpt::utils::printUsageAndExit( argv[0], SAMPLE_NAME );
+    }
+
     try
     {
+        if( !coordinator_socket.empty() )
+            receiveAssignment();
+
         std::cout << "hi\n";
 
 //        glutInitialize( &argc, argv );
@@ -600,9 +1748,35 @@ int main( int argc, char** argv )
         setupCamera();
         loadLight();
         loadGeometry();
+        scene_hash = sceneHash();
 
         context->validate();
 
+        if( !server_socket.empty() )
+        {
+            grpt::render_server server( context, server_socket );
+
+            grpt::render_server::scene cornell;
+            cornell.top_object = context[ "top_object" ]->getGeometryGroup();
+            cornell.eye        = camera_eye;
+            cornell.lookat     = camera_lookat;
+            cornell.up         = camera_up;
+            cornell.fov        = camera_fov;
+            server.add_scene( "cornell", cornell );
+
+            std::cout << "Serving scenes on '" << server_socket << "'\n";
+            server.run();
+            destroyContext();
+            return 0;
+        }
+
+        if( preview_benchmark_frames )
+        {
+            runPreviewBenchmark();
+            destroyContext();
+            return 0;
+        }
+
         if ( progressive )
         {
             glutRun();
@@ -611,14 +1785,68 @@ int main( int argc, char** argv )
         {
             std::cout << "hi" << '\n';
             auto begin = std::chrono::system_clock::now();
-            updateCamera();
-            context->launch( 0, width, height );
+            const std::string bucket_file = out_file.empty() ? "../output" + std::to_string(sqrt_num_samples) + ".pfm" : out_file;
+            if( bucket_size )
+            {
+                renderBuckets( bucket_file );
+            }
+            else if( guide )
+            {
+                guided_frames = renderGuidedFrames();
+            }
+            else if( accumulating() )
+            {
+                renderFrames();
+            }
+            else
+            {
+                updateCamera();
+                launchFrame( bufferWidth(), bufferHeight() );
+            }
             auto end = std::chrono::system_clock::now();
 
-            std::cout << "Rendering " << sqrt_num_samples * sqrt_num_samples << " samples per pixel took : " <<
+            std::cout << "Rendering " << sqrt_num_samples * sqrt_num_samples * num_frames << " samples per pixel took : " <<
                           std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " ms.\n";
-
-            sutil::displayBufferPPM( std::string{"../output" + std::to_string(sqrt_num_samples) + ".ppm"}.c_str(), getOutputBuffer(), false );
+            if( time_budget > 0.0 )
+                std::cout << "Time budget " << time_budget << " s: " << num_frames << " frames of "
+                          << sqrt_num_samples * sqrt_num_samples << " samples per pixel.\n";
+            if( rr_stats )
+                reportRussianRouletteStats();
+            if( !stats_prefix.empty() )
+                saveStats( stats_prefix, static_cast<double>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>( end - begin ).count() ) );
+            if( guide )
+                std::cout << "Path guiding: " << guide_tree.iterations() << " training iterations, "
+                          << guide_tree.leaf_count() << " spatial leaves, " << guide_tree.node_count() << " nodes ("
+                          << guide_tree.byte_size() / 1024 << " KiB); the image holds the last "
+                          << guided_frames << " frames.\n";
+
+            if( bucket_size )
+            {
+                std::cout << "Saved " << cropWidth() << "x" << cropHeight() << " image to '" << bucket_file << "'\n";
+            }
+            else if( coordinator_fd >= 0 )
+            {
+                // Workers only leave their accumulation file; the coordinator
+                // merges them and saves the image.
+                grpt::unix_socket::send_line( coordinator_fd, "done " + checkpoint_file );
+                grpt::unix_socket::close( coordinator_fd );
+            }
+            else
+            {
+                sutil::displayBufferPPM( std::string{"../output" + std::to_string(sqrt_num_samples) + ".ppm"}.c_str(), getOutputBuffer(), false );
+                saveAovs( "../output" + std::to_string(sqrt_num_samples) );
+
+                if( denoise )
+                {
+                    const std::string denoised_file = "../output" + std::to_string(sqrt_num_samples) + "_denoised.ppm";
+                    sutil::displayBufferPPM( denoised_file.c_str(), denoiseOutputBuffer(), false );
+
+                    const grpt::denoise_timings& t = denoiser.timings();
+                    std::cout << "Denoising took " << t.total_ms << " ms (prepare " << t.prepare_ms
+                              << " ms, filter " << t.filter_ms << " ms).\n";
+                }
+            }
             std::cout << getOutputBuffer() << '\n';
             destroyContext();
         }
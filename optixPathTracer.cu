@@ -28,22 +28,14 @@
 
 #include <optixu/optixu_math_namespace.h>
 #include "optixPathTracer.h"
+#include "include/guiding.hpp"
+#include "include/restir.hpp"
+#include "include/ears.hpp"
+#include "include/stats.hpp"
 #include "random.h"
 
 using namespace optix;
 
-struct PerRayData_pathtrace
-{
-    float3 result;
-    float3 radiance;
-    float3 attenuation;
-    float3 origin;
-    float3 direction;
-    unsigned int seed;
-    int depth;
-    int countEmitted;
-    int done;
-};
 // Scene wide variables
 rtDeclareVariable(float,         scene_epsilon, , );
 rtDeclareVariable(rtObject,      top_object, , );
@@ -65,25 +57,106 @@ rtDeclareVariable(float3,        V, , );
 rtDeclareVariable(float3,        W, , );
 rtDeclareVariable(float3,        bad_color, , );
 rtDeclareVariable(unsigned int,  frame_number, , );
+rtDeclareVariable(unsigned int,  frame_seed_offset, , );   // shifts the RNG frame range of distributed workers
 rtDeclareVariable(unsigned int,  sqrt_num_samples, , );
 rtDeclareVariable(unsigned int,  rr_begin_depth, , );
 rtDeclareVariable(unsigned int,  pathtrace_ray_type, , );
 rtDeclareVariable(unsigned int,  pathtrace_shadow_ray_type, , );
+rtDeclareVariable(uint2,         render_offset, , );        // image pixel of launch index (0,0)
+rtDeclareVariable(uint2,         render_size, , );          // full image size; the launch may cover a tile of it
 
 rtBuffer<float4, 2>              output_buffer;
 
+//-----------------------------------------------------------------------------
+//
+//  AOV outputs -- first hit data written in the same launch as output_buffer
+//
+//-----------------------------------------------------------------------------
+
+rtDeclareVariable(unsigned int,  aov_mask, , );
+rtDeclareVariable(float3,        bg_color, , );
+
+rtBuffer<float4, 2>              aov_albedo_buffer;
+rtBuffer<float4, 2>              aov_normal_buffer;
+rtBuffer<float, 2>               aov_depth_buffer;
+rtBuffer<uint2, 2>               aov_id_buffer;
+rtBuffer<unsigned int, 2>        aov_sample_count_buffer;
+
+struct AovSamples
+{
+    float3       albedo;     // Sums over the pixel's samples
+    float3       normal;
+    float        depth;      // Nearest first hit
+    uint2        id;         // Of the first sample
+};
+
+static __device__ __inline__ void init_aov_prd( PerRayData_pathtrace& prd )
+{
+    prd.aov_albedo      = bg_color;
+    prd.aov_normal      = make_float3( 0.0f );
+    prd.aov_depth       = RT_DEFAULT_MAX;
+    prd.aov_object_id   = 0u;
+    prd.aov_material_id = 0u;
+}
+
+static __device__ __inline__ void add_aov_sample( AovSamples& aov, const PerRayData_pathtrace& prd,
+                                                  const float3& ray_direction, bool first )
+{
+    aov.albedo += prd.aov_albedo;
+    aov.normal += prd.aov_normal;
+    if( prd.aov_depth < RT_DEFAULT_MAX )
+        aov.depth = fminf( aov.depth, prd.aov_depth * dot( ray_direction, normalize( W ) ) );
+    if( first )
+        aov.id = make_uint2( prd.aov_object_id, prd.aov_material_id );
+}
+
+// Averages the samples and writes the enabled AOV buffers.  With 'blend' set,
+// the result is accumulated into the previous frames the way output_buffer is.
+static __device__ __inline__ void write_aovs( const AovSamples& aov, unsigned int num_samples, float blend )
+{
+    const float inv_samples = 1.0f / num_samples;
+
+    if( aov_mask & AOV_ALBEDO )
+    {
+        const float3 albedo = aov.albedo * inv_samples;
+        aov_albedo_buffer[launch_index] = blend < 1.0f ?
+            make_float4( lerp( make_float3( aov_albedo_buffer[launch_index] ), albedo, blend ), 1.0f ) :
+            make_float4( albedo, 1.0f );
+    }
+    if( aov_mask & AOV_NORMAL )
+    {
+        const float3 normal = aov.normal * inv_samples;
+        aov_normal_buffer[launch_index] = blend < 1.0f ?
+            make_float4( lerp( make_float3( aov_normal_buffer[launch_index] ), normal, blend ), 0.0f ) :
+            make_float4( normal, 0.0f );
+    }
+    if( aov_mask & AOV_DEPTH )
+        aov_depth_buffer[launch_index] = blend < 1.0f ? fminf( aov_depth_buffer[launch_index], aov.depth ) : aov.depth;
+    if( aov_mask & AOV_ID )
+        aov_id_buffer[launch_index] = aov.id;
+    if( aov_mask & AOV_SAMPLE_COUNT )
+        aov_sample_count_buffer[launch_index] = blend < 1.0f ? aov_sample_count_buffer[launch_index] + num_samples : num_samples;
+}
+
 RT_PROGRAM void pathtrace_camera()
 {
-    size_t2 screen = output_buffer.size();
+    GRPT_STATS(const long long start_clock = clock64();)
+    uint2 image_index = launch_index + render_offset;
 
-    float2 inv_screen = 1.0f/make_float2(screen) * 2.f;
-    float2 pixel = (make_float2(launch_index)) * inv_screen - 1.f;
+    float2 inv_screen = 1.0f/make_float2(render_size) * 2.f;
+    float2 pixel = (make_float2(image_index)) * inv_screen - 1.f;
 
     float2 jitter_scale = inv_screen / sqrt_num_samples;
     unsigned int samples_per_pixel = sqrt_num_samples*sqrt_num_samples;
     float3 result = make_float3(0.0f);
 
-    unsigned int seed = tea<16>(screen.x*launch_index.y+launch_index.x, frame_number);
+    AovSamples aov;
+    aov.albedo = make_float3(0.0f);
+    aov.normal = make_float3(0.0f);
+    aov.depth  = RT_DEFAULT_MAX;
+    aov.id     = make_uint2(0u);
+
+    unsigned int seed = tea<16>(render_size.x*image_index.y+image_index.x, frame_number + frame_seed_offset);
     do 
     {
         //
@@ -102,8 +175,13 @@ RT_PROGRAM void pathtrace_camera()
         prd.attenuation = make_float3(1.f);
         prd.countEmitted = true;
         prd.done = false;
+        prd.emitter = false;
         prd.seed = seed;
         prd.depth = 0;
+        if(aov_mask)
+            init_aov_prd(prd);
+        const float3 camera_direction = ray_direction;
+        GRPT_STATS(++pixel_stats().paths;)
 
         // Each iteration is a segment of the ray path.  The closest hit will
         // return new segments to be traced here.
@@ -113,11 +191,13 @@ RT_PROGRAM void pathtrace_camera()
         {
             Ray ray = make_Ray(ray_origin, ray_direction, pathtrace_ray_type, scene_epsilon, RT_DEFAULT_MAX);
             rtTrace(top_object, ray, prd);
+            GRPT_STATS(++pixel_stats().radiance_rays;)
 
             if(prd.done)
             {
                 // We have hit the background or a luminaire
                 prd.result += prd.radiance * prd.attenuation;
+                GRPT_STATS(count_path_end(prd.depth);)
                 break;
             }
 
@@ -126,7 +206,10 @@ RT_PROGRAM void pathtrace_camera()
             {
                 float pcont = fmaxf(prd.attenuation);
                 if(rnd(prd.seed) >= pcont)
+                {
+                    GRPT_STATS(++pixel_stats().roulette_kills; count_path_end(prd.depth);)
                     break;
+                }
                 prd.attenuation /= pcont;
             }
 
@@ -140,6 +223,8 @@ RT_PROGRAM void pathtrace_camera()
 
         result += prd.result;
         seed = prd.seed;
+        if(aov_mask)
+            add_aov_sample(aov, prd, camera_direction, samples_per_pixel == sqrt_num_samples*sqrt_num_samples);
     } while (--samples_per_pixel);
 
     //
@@ -147,21 +232,334 @@ RT_PROGRAM void pathtrace_camera()
     //
     float3 pixel_color = result/(sqrt_num_samples*sqrt_num_samples);
     output_buffer[launch_index] = make_float4(pixel_color, 1.0f);
+
+    if(aov_mask)
+        write_aovs(aov, sqrt_num_samples*sqrt_num_samples, 1.0f);
+
+    GRPT_STATS(pixel_stats().cycles += clock64() - start_clock;)
 }
 
 
+//-----------------------------------------------------------------------------
+//
+//  Temporal reprojection -- per pixel accumulation weights in output_buffer.w
+//  let the image accumulated for the previous camera be carried over into the
+//  new view after a camera move
+//
+//-----------------------------------------------------------------------------
+
+rtDeclareVariable(unsigned int,  history_mode, , );             // HistoryMode
+rtDeclareVariable(float3,        history_eye, , );              // camera history_buffer was rendered with
+rtDeclareVariable(float3,        history_U, , );
+rtDeclareVariable(float3,        history_V, , );
+rtDeclareVariable(float3,        history_W, , );
+rtDeclareVariable(float,         history_max_weight, , );       // frames a reprojected pixel counts as at most
+rtDeclareVariable(float,         history_depth_tolerance, , );  // relative view depth change still accepted
+
+rtBuffer<float4, 2>              history_buffer;
+rtBuffer<float, 2>               history_depth_buffer;
+
+//-----------------------------------------------------------------------------
+//
+//  Path guiding training -- the first path of each pixel reports the
+//  radiance arriving at its first vertices, for the SD-tree built on the host
+//
+//-----------------------------------------------------------------------------
+
+rtDeclareVariable(uint2,         launch_dim, rtLaunchDim, );
+rtDeclareVariable(unsigned int,  guiding_record, , );
+
+// grpt::guiding::record_depth records per pixel, two float4 each: the vertex
+// position with the incident radiance's luminance over the sampling density
+// in w, then the direction with w = 1 if the record is valid.
+rtBuffer<float4>                 guiding_record_buffer;
+
+struct GuidingVertex
+{
+    float3 position;
+    float3 direction;
+    float3 result;          // path contribution up to and including the vertex
+    float3 attenuation;     // throughput towards the next vertex
+    float  pdf;
+};
+
+static __device__ __inline__ void write_guiding_records( const GuidingVertex* vertices, unsigned int count, const float3& result )
+{
+    const float3 luminance = make_float3( 0.2126f, 0.7152f, 0.0722f );
+    const unsigned int first = ( launch_index.y * launch_dim.x + launch_index.x ) * grpt::guiding::record_depth * 2;
+    for( unsigned int i = 0; i < grpt::guiding::record_depth; ++i )
+    {
+        float radiance = 0.0f;
+        bool  valid    = i < count && vertices[i].pdf > 0.0f;
+        if( valid )
+        {
+            const float throughput = dot( vertices[i].attenuation, luminance );
+            valid = throughput > 0.0f;
+            if( valid )
+                radiance = fmaxf( dot( result - vertices[i].result, luminance ), 0.0f ) / ( throughput * vertices[i].pdf );
+        }
+        guiding_record_buffer[first + 2*i]     = make_float4( valid ? vertices[i].position : make_float3( 0.0f ), radiance );
+        guiding_record_buffer[first + 2*i + 1] = make_float4( valid ? vertices[i].direction : make_float3( 0.0f ), valid ? 1.0f : 0.0f );
+    }
+}
+
+// Looks up the previous camera's accumulation for the surface seen through
+// pixel_center at view depth 'depth', and returns its weight: the frames it
+// holds, scaled by how well the depths agree, or 0 where the surface was
+// hidden or outside the previous view.
+static __device__ __inline__ float reproject_history( float2 pixel_center, float depth, float3& color )
+{
+    if( depth >= RT_DEFAULT_MAX )
+        return 0.0f;
+
+    const float3 direction = normalize( pixel_center.x*U + pixel_center.y*V + W );
+    const float3 position  = eye + direction * ( depth / dot( direction, normalize( W ) ) );
+
+    // Pinhole projection into the previous camera, inverting
+    // direction = a*U + b*V + W for the orthogonal frame U, V, W.
+    const float3 v = position - history_eye;
+    const float  s = dot( v, history_W ) / dot( history_W, history_W );
+    if( s <= 0.0f )
+        return 0.0f;
+    const float2 ndc = make_float2( dot( v, history_U ) / ( s * dot( history_U, history_U ) ),
+                                    dot( v, history_V ) / ( s * dot( history_V, history_V ) ) );
+    const float2 p = ( ndc + 1.0f ) * 0.5f * make_float2( render_size );
+    if( p.x < 0.0f || p.y < 0.0f || p.x >= render_size.x || p.y >= render_size.y )
+        return 0.0f;
+    const uint2 index = make_uint2( p );
+
+    const float expected   = dot( v, normalize( history_W ) );
+    const float error      = fabsf( history_depth_buffer[index] - expected ) / expected;
+    const float confidence = 1.0f - error / history_depth_tolerance;
+    if( confidence <= 0.0f )
+        return 0.0f;
+
+    const float4 history = history_buffer[index];
+    color = make_float3( history );
+    return fminf( history.w, history_max_weight ) * confidence;
+}
+
+RT_PROGRAM void store_history()
+{
+    history_buffer[launch_index]       = output_buffer[launch_index];
+    history_depth_buffer[launch_index] = aov_depth_buffer[launch_index];
+}
+
+//-----------------------------------------------------------------------------
+//
+//  ReSTIR direct lighting -- the progressive camera program leaves the
+//  direct lighting of primary hits out, resamples light candidates into a
+//  per-pixel reservoir and reuses the previous frame's; restir_resolve then
+//  reuses neighbouring reservoirs, shades with the result and accumulates
+//
+//-----------------------------------------------------------------------------
+
+struct PerRayData_pathtrace_shadow
+{
+    bool inShadow;
+};
+
+rtDeclareVariable(unsigned int,  restir_enabled, , );
+rtDeclareVariable(unsigned int,  restir_candidates, , );       // light candidates per pixel and frame
+rtDeclareVariable(unsigned int,  restir_spatial_samples, , );  // neighbours reused per pixel
+rtDeclareVariable(float,         restir_spatial_radius, , );   // in pixels
+rtDeclareVariable(float,         restir_max_history, , );      // previous frame's M, in multiples of the new candidates
+rtDeclareVariable(unsigned int,  restir_unbiased, , );         // trace visibility to every contributing neighbour
+
+rtBuffer<ParallelogramLight>            lights;
+rtBuffer<grpt::restir::pixel, 2>        restir_pixels;         // reservoirs of this frame after temporal reuse
+rtBuffer<grpt::restir::pixel, 2>        restir_history;        // final reservoirs of the previous frame
+rtBuffer<float4, 2>                     restir_frame_buffer;   // frame without primary direct lighting, view depth in w
+
+static __device__ __inline__ bool restir_visible( const float3& position, const grpt::restir::light_sample& y )
+{
+    const float3 d = y.position - position;
+    const float  dist = length( d );
+    PerRayData_pathtrace_shadow shadow_prd;
+    shadow_prd.inShadow = false;
+    Ray shadow_ray = make_Ray( position, d / dist, pathtrace_shadow_ray_type, scene_epsilon, dist - scene_epsilon );
+    rtTrace( top_object, shadow_ray, shadow_prd );
+    GRPT_STATS( ++pixel_stats().shadow_rays; )
+    return !shadow_prd.inShadow;
+}
+
+// Whether reservoirs of two primary hits may be combined: similar normals
+// and distances from the camera.
+static __device__ __inline__ bool restir_similar( const grpt::restir::pixel& a, const grpt::restir::pixel& b )
+{
+    if( !a.valid || !b.valid || dot( a.normal, b.normal ) < 0.9f )
+        return false;
+    const float da = length( a.position - eye );
+    const float db = length( b.position - eye );
+    return fabsf( da - db ) < 0.1f * da;
+}
+
+// Resamples restir_candidates light samples into a fresh reservoir, drops
+// the winner if it is occluded and merges the previous frame's reservoir of
+// the pixel into it.
+static __device__ __inline__ void restir_generate( grpt::restir::pixel& px, unsigned int& seed )
+{
+    px.r = grpt::restir::empty_reservoir();
+    const unsigned int num_area = lights.size();
+    if( !px.valid || num_area == 0 )
+        return;
+
+    for( unsigned int i = 0; i < restir_candidates; ++i )
+    {
+        float pdf;
+        const float u0 = rnd( seed );
+        const float u1 = rnd( seed );
+        const float u2 = rnd( seed );
+        const grpt::restir::light_sample y =
+            grpt::restir::sample_light( lights, num_area, u0, u1, u2, pdf );
+        grpt::restir::update( px.r, y, grpt::restir::target( px, y ) / pdf, 1.0f, rnd( seed ) );
+    }
+    grpt::restir::finalize( px.r, grpt::restir::target( px, px.r.y ), px.r.M );
+    if( px.r.W > 0.0f && !restir_visible( px.position, px.r.y ) )
+        px.r.W = 0.0f;
+
+    if( frame_number > 1 )
+    {
+        const grpt::restir::pixel previous = restir_history[launch_index];
+        if( restir_similar( px, previous ) && previous.r.M > 0.0f )
+        {
+            const float new_M = px.r.M;
+            const float M = fminf( previous.r.M, restir_max_history * new_M );
+            grpt::restir::reservoir r = grpt::restir::empty_reservoir();
+            grpt::restir::update( r, px.r.y, grpt::restir::target( px, px.r.y ) * px.r.W * new_M, new_M, rnd( seed ) );
+            grpt::restir::update( r, previous.r.y, grpt::restir::target( px, previous.r.y ) * previous.r.W * M, M, rnd( seed ) );
+            // The previous frame saw the same surface, so both reservoirs
+            // could have produced either sample.
+            grpt::restir::finalize( r, grpt::restir::target( px, r.y ), r.M );
+            px.r = r;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//
+//  Russian roulette and splitting -- with EARS, each vertex of a progressive
+//  path continues q times on average, q chosen from statistics the host
+//  learns from recorded paths; otherwise paths past rr_begin_depth survive
+//  with the probability of their largest throughput channel
+//
+//-----------------------------------------------------------------------------
+
+rtDeclareVariable(unsigned int,  ears_enabled, , );
+rtDeclareVariable(unsigned int,  ears_record, , );          // write ears_record_buffer this launch
+rtDeclareVariable(float3,        ears_bounds_min, , );
+rtDeclareVariable(float3,        ears_bounds_extent, , );
+rtDeclareVariable(unsigned int,  ears_grid_resolution, , );
+rtDeclareVariable(float,         ears_min_factor, , );
+rtDeclareVariable(float,         ears_max_factor, , );
+rtDeclareVariable(unsigned int,  rr_stats, , );             // count into rr_stats_buffer
+
+rtBuffer<float2>                 ears_cells;                // (M2, C) per grid cell
+rtBuffer<float2, 2>              ears_pixels;               // (V, C_pixel) per pixel
+rtBuffer<float4>                 ears_record_buffer;        // see grpt::ears::learner::add_records
+rtBuffer<unsigned int>           rr_stats_buffer;           // indexed by RussianRouletteStats
+
+// A continuation split off at a vertex, restarted by retracing the ray that
+// reached the vertex.
+struct PathBranch
+{
+    float3       origin;
+    float3       direction;
+    float3       attenuation;
+    unsigned int seed;
+    int          depth;
+    int          countEmitted;
+};
+
+struct EarsVertex
+{
+    float3       position;
+    float3       result;        // path contribution before the vertex
+    float        throughput;
+    unsigned int segments;      // traced by the pixel up to the vertex
+};
+
+static __device__ __inline__ float throughput_luminance( const float3& attenuation )
+{
+    return dot( attenuation, make_float3( 0.2126f, 0.7152f, 0.0722f ) );
+}
+
+// 'first_segment' and 'segments' count the segments of the pixel traced
+// before and after the path.
+static __device__ __inline__ void write_ears_records( const EarsVertex* vertices, unsigned int count, const float3& result,
+                                                      unsigned int first_segment, unsigned int segments )
+{
+    const unsigned int first = ( launch_index.y * launch_dim.x + launch_index.x ) * ( grpt::ears::record_depth + 1 ) * 2;
+    ears_record_buffer[first]     = make_float4( 0.0f, 0.0f, 0.0f, throughput_luminance( result ) );
+    ears_record_buffer[first + 1] = make_float4( (float)( segments - first_segment ), 0.0f, 0.0f, 1.0f );
+    for( unsigned int i = 0; i < grpt::ears::record_depth; ++i )
+    {
+        const bool valid = i < count && vertices[i].throughput > 0.0f;
+        const float radiance = valid ? throughput_luminance( result - vertices[i].result ) / vertices[i].throughput : 0.0f;
+        ears_record_buffer[first + 2*i + 2] = make_float4( valid ? vertices[i].position : make_float3( 0.0f ), radiance );
+        ears_record_buffer[first + 2*i + 3] = make_float4( valid ? (float)( segments - vertices[i].segments + 1u ) : 0.0f,
+                                                           0.0f, 0.0f, valid ? 1.0f : 0.0f );
+    }
+}
+
+// Combines a frame with the image accumulated in output_buffer, as
+// history_mode says.
+static __device__ __inline__ void accumulate_pixel( const float3& pixel_color, float2 pixel_center, float depth )
+{
+    if (history_mode != HISTORY_OFF)
+    {
+        // w counts the frames in the pixel's running mean.
+        float3 old_color = make_float3(0.0f);
+        float  weight = 0.0f;
+        if (history_mode == HISTORY_REPROJECT)
+            weight = reproject_history(pixel_center, depth, old_color);
+        else if (frame_number > 1)
+        {
+            const float4 old = output_buffer[launch_index];
+            old_color = make_float3(old);
+            weight = old.w;
+        }
+        output_buffer[launch_index] = make_float4( (old_color*weight + pixel_color) / (weight + 1.0f), weight + 1.0f );
+    }
+    else if (frame_number > 1)
+    {
+        float a = 1.0f / (float)frame_number;
+        float3 old_color = make_float3(output_buffer[launch_index]);
+        output_buffer[launch_index] = make_float4( lerp( old_color, pixel_color, a ), 1.0f );
+    }
+    else
+    {
+        output_buffer[launch_index] = make_float4(pixel_color, 1.0f);
+    }
+}
+
 RT_PROGRAM void pathtrace_camera_progressive()
 {
-    size_t2 screen = output_buffer.size();
+    GRPT_STATS(const long long start_clock = clock64();)
+    uint2 image_index = launch_index + render_offset;
 
-    float2 inv_screen = 1.0f/make_float2(screen) * 2.f;
-    float2 pixel = (make_float2(launch_index)) * inv_screen - 1.f;
+    float2 inv_screen = 1.0f/make_float2(render_size) * 2.f;
+    float2 pixel = (make_float2(image_index)) * inv_screen - 1.f;
 
     float2 jitter_scale = inv_screen / sqrt_num_samples;
     unsigned int samples_per_pixel = sqrt_num_samples*sqrt_num_samples;
     float3 result = make_float3(0.0f);
 
-    unsigned int seed = tea<16>(screen.x*launch_index.y+launch_index.x, frame_number);
+    AovSamples aov;
+    aov.albedo = make_float3(0.0f);
+    aov.normal = make_float3(0.0f);
+    aov.depth  = RT_DEFAULT_MAX;
+    aov.id     = make_uint2(0u);
+
+    grpt::restir::pixel surface;
+    surface.valid = 0u;
+
+    unsigned int segments = 0;          // traced by all samples of the pixel
+    unsigned int path_segments = 0;     // traced before the current sample
+    unsigned int paths_killed = 0;
+    unsigned int split_branches = 0;
+
+    unsigned int seed = tea<16>(render_size.x*image_index.y+image_index.x, frame_number + frame_seed_offset);
     do 
     {
         //
@@ -180,35 +578,147 @@ RT_PROGRAM void pathtrace_camera_progressive()
         prd.attenuation = make_float3(1.f);
         prd.countEmitted = true;
         prd.done = false;
+        prd.emitter = false;
         prd.seed = seed;
         prd.depth = 0;
+        if(aov_mask || restir_enabled)
+            init_aov_prd(prd);
+        const float3 camera_direction = ray_direction;
+        const bool first_sample = samples_per_pixel == sqrt_num_samples*sqrt_num_samples;
+        const bool record = guiding_record && first_sample;
+        const bool record_ears = ears_record && first_sample;
+        GuidingVertex vertices[grpt::guiding::record_depth];
+        unsigned int num_vertices = 0;
+        EarsVertex ears_vertices[grpt::ears::record_depth];
+        unsigned int num_ears_vertices = 0;
+        PathBranch branches[grpt::ears::max_split];
+        unsigned int num_branches = 0;
+        bool on_main_path = true;
+        bool resumed = false;
+        bool primary_emitter = false;
 
         // Each iteration is a segment of the ray path.  The closest hit will
-        // return new segments to be traced here.
+        // return new segments to be traced here.  Branches split off the path
+        // are traced after it.
         for(;;)
         {
             Ray ray = make_Ray(ray_origin, ray_direction, pathtrace_ray_type, scene_epsilon, RT_DEFAULT_MAX);
+            prd.direction_pdf = 0.0f;
+            prd.emitter = false;
+            const float3 attenuation_in = prd.attenuation;
+            const int countEmitted_in = prd.countEmitted;
             rtTrace(top_object, ray, prd);
+            ++segments;
+            if(prd.depth == 0 && on_main_path)
+                primary_emitter = prd.emitter;
 
+            bool terminate = false;
             if(prd.done)
             {
                 // We have hit the background or a luminaire
                 prd.result += prd.radiance * prd.attenuation;
-                break;
+                terminate = true;
+            }
+            else
+            {
+                if(record_ears && on_main_path && num_ears_vertices < grpt::ears::record_depth)
+                {
+                    EarsVertex& v = ears_vertices[num_ears_vertices++];
+                    v.position   = prd.origin;
+                    v.result     = prd.result;
+                    v.throughput = throughput_luminance(prd.attenuation);
+                    v.segments   = segments;
+                }
+
+                float q = ears_enabled && !resumed ?
+                    grpt::ears::factor(throughput_luminance(prd.attenuation),
+                                       ears_cells[grpt::ears::cell_index(prd.origin, ears_bounds_min, ears_bounds_extent, ears_grid_resolution)],
+                                       ears_pixels[launch_index], ears_min_factor, ears_max_factor) :
+                    0.0f;
+
+                if(resumed)
+                {
+                    // The branch's vertex was decided when it was split off.
+                    resumed = false;
+                }
+                else if(q > 0.0f)
+                {
+                    // Efficiency-aware Russian roulette and splitting
+                    if(q < 1.0f && rnd(prd.seed) >= q)
+                    {
+                        terminate = true;
+                        ++paths_killed;
+                    }
+                    else if(q > 1.0f)
+                    {
+                        // Only max_split branches fit the stack.  Clamping the
+                        // factor rather than the drawn count keeps the expected
+                        // number of continuations equal to q, which each is
+                        // weighted by.
+                        q = fminf(q, 1.0f + (float)(grpt::ears::max_split - num_branches));
+                        const float whole = floorf(q);
+                        const unsigned int extra = (unsigned int)whole - 1u + (rnd(prd.seed) < q - whole ? 1u : 0u);
+                        for(unsigned int i = 0; i < extra; ++i)
+                        {
+                            PathBranch& b  = branches[num_branches++];
+                            b.origin       = ray_origin;
+                            b.direction    = ray_direction;
+                            b.attenuation  = attenuation_in / q;
+                            b.seed         = tea<4>(prd.seed, i);
+                            b.depth        = prd.depth;
+                            b.countEmitted = countEmitted_in;
+                        }
+                        split_branches += extra;
+                    }
+                    if(!terminate)
+                        prd.attenuation /= q;
+                }
+                else if(prd.depth >= rr_begin_depth)
+                {
+                    // Russian roulette termination
+                    float pcont = fmaxf(prd.attenuation);
+                    if(rnd(prd.seed) >= pcont)
+                    {
+                        terminate = true;
+                        ++paths_killed;
+                    }
+                    else
+                        prd.attenuation /= pcont;
+                }
             }
 
-            // Russian roulette termination 
-            if(prd.depth >= rr_begin_depth)
+            if(terminate)
             {
-                float pcont = fmaxf(prd.attenuation);
-                if(rnd(prd.seed) >= pcont)
+                GRPT_STATS(count_path_end(prd.depth);)
+                if(num_branches == 0)
                     break;
-                prd.attenuation /= pcont;
+
+                const PathBranch& b = branches[--num_branches];
+                ray_origin        = b.origin;
+                ray_direction     = b.direction;
+                prd.attenuation   = b.attenuation;
+                prd.seed          = b.seed;
+                prd.depth         = b.depth;
+                prd.countEmitted  = b.countEmitted;
+                prd.done          = false;
+                on_main_path      = false;
+                resumed           = true;
+                continue;
             }
 
             prd.depth++;
             prd.result += prd.radiance * prd.attenuation;
 
+            if(record && on_main_path && num_vertices < grpt::guiding::record_depth)
+            {
+                GuidingVertex& v = vertices[num_vertices++];
+                v.position    = prd.origin;
+                v.direction   = prd.direction;
+                v.result      = prd.result;
+                v.attenuation = prd.attenuation;
+                v.pdf         = prd.direction_pdf;
+            }
+
             // Update ray data for the next path segment
             ray_origin = prd.origin;
             ray_direction = prd.direction;
@@ -216,23 +726,154 @@ RT_PROGRAM void pathtrace_camera_progressive()
 
         result += prd.result;
         seed = prd.seed;
+        if(aov_mask)
+            add_aov_sample(aov, prd, camera_direction, samples_per_pixel == sqrt_num_samples*sqrt_num_samples);
+        if(record)
+            write_guiding_records(vertices, num_vertices, prd.result);
+        if(record_ears)
+            write_ears_records(ears_vertices, num_ears_vertices, prd.result, path_segments, segments);
+        path_segments = segments;
+        if(restir_enabled && samples_per_pixel == sqrt_num_samples*sqrt_num_samples)
+        {
+            // The first sample's primary hit gets the pixel's direct lighting.
+            surface.valid    = prd.aov_depth < RT_DEFAULT_MAX && !primary_emitter;
+            surface.position = eye + camera_direction * prd.aov_depth;
+            surface.normal   = prd.aov_normal;
+            surface.albedo   = prd.aov_albedo;
+        }
     } while (--samples_per_pixel);
 
+    if(rr_stats)
+    {
+        atomicAdd(&rr_stats_buffer[RR_STATS_SEGMENTS], segments);
+        atomicAdd(&rr_stats_buffer[RR_STATS_KILLED],   paths_killed);
+        atomicAdd(&rr_stats_buffer[RR_STATS_SPLIT],    split_branches);
+        atomicAdd(&rr_stats_buffer[RR_STATS_PATHS],    sqrt_num_samples*sqrt_num_samples);
+    }
+
     //
-    // Update the output buffer
+    // Update the output buffer; with ReSTIR, restir_resolve does so once the
+    // primary direct lighting is known.
     //
     float3 pixel_color = result/(sqrt_num_samples*sqrt_num_samples);
 
-    if (frame_number > 1)
+    if (restir_enabled)
     {
-        float a = 1.0f / (float)frame_number;
-        float3 old_color = make_float3(output_buffer[launch_index]);
-        output_buffer[launch_index] = make_float4( lerp( old_color, pixel_color, a ), 1.0f );
+        restir_generate(surface, seed);
+        restir_pixels[launch_index] = surface;
+        restir_frame_buffer[launch_index] = make_float4(pixel_color, aov.depth);
     }
     else
     {
-        output_buffer[launch_index] = make_float4(pixel_color, 1.0f);
+        accumulate_pixel(pixel_color, pixel + 0.5f*inv_screen, aov.depth);
+    }
+
+    if(aov_mask)
+        write_aovs(aov, sqrt_num_samples*sqrt_num_samples, frame_number > 1 ? 1.0f / (float)frame_number : 1.0f);
+
+    GRPT_STATS(
+        grpt::stats::pixel_counters& stats = pixel_stats();
+        stats.paths          += sqrt_num_samples*sqrt_num_samples + split_branches;
+        stats.radiance_rays  += segments;
+        stats.roulette_kills += paths_killed;
+        stats.cycles         += clock64() - start_clock;
+    )
+}
+
+RT_PROGRAM void restir_resolve()
+{
+    GRPT_STATS(const long long start_clock = clock64();)
+    const uint2  image_index  = launch_index + render_offset;
+    const float2 inv_screen   = 1.0f/make_float2(render_size) * 2.f;
+    const float2 pixel_center = make_float2(image_index) * inv_screen - 1.f + 0.5f*inv_screen;
+
+    const grpt::restir::pixel center = restir_pixels[launch_index];
+    const float4 frame = restir_frame_buffer[launch_index];
+    float3 pixel_color = make_float3(frame);
+    grpt::restir::pixel final_pixel = center;
+
+    if (center.valid)
+    {
+        unsigned int seed = tea<16>(render_size.x*image_index.y+image_index.x, ~(frame_number + frame_seed_offset));
+
+        grpt::restir::reservoir r = grpt::restir::empty_reservoir();
+        grpt::restir::update(r, center.r.y, grpt::restir::target(center, center.r.y) * center.r.W * center.r.M,
+                             center.r.M, rnd(seed));
+
+        uint2 neighbours[grpt::restir::max_spatial_samples];
+        unsigned int num_neighbours = 0;
+        const unsigned int spatial_samples = min(restir_spatial_samples, (unsigned int)grpt::restir::max_spatial_samples);
+        for (unsigned int i = 0; i < spatial_samples; ++i)
+        {
+            const float dx = (2.0f*rnd(seed) - 1.0f) * restir_spatial_radius;
+            const float dy = (2.0f*rnd(seed) - 1.0f) * restir_spatial_radius;
+            const int x = (int)launch_index.x + (int)dx;
+            const int y = (int)launch_index.y + (int)dy;
+            if (x < 0 || y < 0 || x >= (int)launch_dim.x || y >= (int)launch_dim.y ||
+                (x == (int)launch_index.x && y == (int)launch_index.y))
+                continue;
+
+            const uint2 q = make_uint2(x, y);
+            const grpt::restir::pixel neighbour = restir_pixels[q];
+            if (!restir_similar(center, neighbour))
+                continue;
+            grpt::restir::update(r, neighbour.r.y, grpt::restir::target(center, neighbour.r.y) * neighbour.r.W * neighbour.r.M,
+                                 neighbour.r.M, rnd(seed));
+            neighbours[num_neighbours++] = q;
+        }
+
+        // The biased estimator normalises by all candidates, including those
+        // of neighbours that could not have produced the kept sample; the
+        // unbiased one only counts the neighbours that see it.
+        float Z = r.M;
+        if (restir_unbiased && r.weight_sum > 0.0f)
+        {
+            Z = center.r.M;
+            for (unsigned int i = 0; i < num_neighbours; ++i)
+            {
+                const grpt::restir::pixel neighbour = restir_pixels[neighbours[i]];
+                if (grpt::restir::target(neighbour, r.y) > 0.0f && restir_visible(neighbour.position, r.y))
+                    Z += neighbour.r.M;
+            }
+        }
+        grpt::restir::finalize(r, grpt::restir::target(center, r.y), Z);
+
+        if (r.W > 0.0f && !restir_visible(center.position, r.y))
+            r.W = 0.0f;
+        pixel_color += grpt::restir::unshadowed(center.position, center.normal, center.albedo, r.y) * r.W;
+        final_pixel.r = r;
     }
+
+    restir_history[launch_index] = final_pixel;
+    accumulate_pixel(pixel_color, pixel_center, frame.w);
+
+    GRPT_STATS(pixel_stats().cycles += clock64() - start_clock;)
+}
+
+//-----------------------------------------------------------------------------
+//
+//  Preview upsampling -- stretches a reduced resolution frame, rendered into
+//  the corner of output_buffer while the camera moves, over the window
+//
+//-----------------------------------------------------------------------------
+
+rtDeclareVariable(uint2,         preview_size, , );
+rtBuffer<float4, 2>              preview_buffer;
+
+RT_PROGRAM void upsample_preview()
+{
+    size_t2 screen = preview_buffer.size();
+
+    float2 p = (make_float2(launch_index) + 0.5f) * make_float2(preview_size) / make_float2(screen) - 0.5f;
+    p = clamp(p, make_float2(0.0f), make_float2(preview_size) - 1.0f);
+
+    uint2 p0 = make_uint2(p);
+    uint2 p1 = make_uint2(min(p0.x + 1, preview_size.x - 1), min(p0.y + 1, preview_size.y - 1));
+    float2 f = p - make_float2(p0);
+
+    float4 bottom = lerp(output_buffer[p0], output_buffer[make_uint2(p1.x, p0.y)], f.x);
+    float4 top    = lerp(output_buffer[make_uint2(p0.x, p1.y)], output_buffer[p1], f.x);
+    preview_buffer[launch_index] = lerp(bottom, top, f.y);
 }
 
 //-----------------------------------------------------------------------------
@@ -253,8 +894,6 @@ RT_PROGRAM void exception()
 //
 //-----------------------------------------------------------------------------
 
-rtDeclareVariable(float3, bg_color, , );
-
 RT_PROGRAM void miss()
 {
     current_prd.radiance = bg_color;
@@ -36,5 +36,59 @@ struct ParallelogramLight
     optix::float3 v1, v2;                                                          
     optix::float3 normal;                                                          
     optix::float3 emission;                                                        
-};                                                                               
+};
 
+
+// Bits of the 'aov_mask' variable.  Each set bit makes the camera programs
+// write the matching first hit buffer in the same launch as output_buffer.
+enum AovFlags
+{
+    AOV_ALBEDO       = 1u << 0,     // aov_albedo_buffer,       float4
+    AOV_NORMAL       = 1u << 1,     // aov_normal_buffer,       float4, world space
+    AOV_DEPTH        = 1u << 2,     // aov_depth_buffer,        float, view space z
+    AOV_ID           = 1u << 3,     // aov_id_buffer,           uint2, (object, material)
+    AOV_SAMPLE_COUNT = 1u << 4      // aov_sample_count_buffer, unsigned int
+};
+
+// Values of the 'history_mode' variable, how the progressive camera program
+// combines a frame with the accumulated image.
+enum HistoryMode
+{
+    HISTORY_OFF        = 0,         // running mean over frame_number frames
+    HISTORY_ACCUMULATE = 1,         // running mean over output_buffer.w frames per pixel
+    HISTORY_REPROJECT  = 2          // start from history_buffer reprojected into the new view
+};
+
+// Counters in 'rr_stats_buffer', filled by the progressive camera program
+// while 'rr_stats' is set.
+enum RussianRouletteStats
+{
+    RR_STATS_SEGMENTS = 0,          // path segments traced
+    RR_STATS_KILLED   = 1,          // paths ended by Russian roulette
+    RR_STATS_SPLIT    = 2,          // branches added by splitting
+    RR_STATS_PATHS    = 3,          // camera paths started
+    RR_STATS_COUNT    = 4
+};
+
+struct PerRayData_pathtrace
+{
+    optix::float3 result;
+    optix::float3 radiance;
+    optix::float3 attenuation;
+    optix::float3 origin;
+    optix::float3 direction;
+    float direction_pdf;            // solid angle density 'direction' was drawn with
+    unsigned int seed;
+    int depth;
+    int countEmitted;
+    int done;
+    int emitter;                    // set with done when the hit was a luminaire
+
+    // First hit data, filled by closest hit programs at depth 0 when
+    // aov_mask is non zero.  Misses keep the values ray generation set.
+    optix::float3 aov_albedo;
+    optix::float3 aov_normal;
+    float         aov_depth;
+    unsigned int  aov_object_id;
+    unsigned int  aov_material_id;
+};
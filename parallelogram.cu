@@ -27,6 +27,7 @@
  */
 
 #include <optix_world.h>
+#include "include/stats.hpp"
 
 using namespace optix;
 
@@ -44,6 +45,7 @@ rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
 
 RT_PROGRAM void intersect(int primIdx)
 {
+  GRPT_STATS(++pixel_stats().primitives_tested;)
   float3 n = make_float3( plane );
   float dt = dot(ray.direction, n );
   float t = (plane.w - dot(n, ray.origin))/dt;
@@ -0,0 +1,332 @@
+#include <accumulation_file.hpp>
+#include "optixPathTracer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    const uint32_t accumulation_version = 1;
+
+    void write_or_throw(std::FILE* f, const void* data, size_t size, const std::string& path)
+    {
+        if (size && std::fwrite(data, 1, size, f) != size)
+            throw std::runtime_error("write_accumulation_file( '" + path + "' ) failed to write");
+    }
+
+    void read_or_throw(std::FILE* f, void* data, size_t size, const std::string& path)
+    {
+        if (size && std::fread(data, 1, size, f) != size)
+            throw std::runtime_error("read_accumulation_file( '" + path + "' ) is truncated");
+    }
+
+    struct section_header
+    {
+        uint32_t flag;
+        uint32_t reserved;
+        uint64_t size;
+    };
+
+    // Bytes per pixel of an AOV buffer, 0 for an unknown flag.
+    size_t aov_element_size(uint32_t flag)
+    {
+        switch (flag)
+        {
+        case AOV_ALBEDO:
+        case AOV_NORMAL:
+            return 16;
+        case AOV_ID:
+            return 8;
+        case AOV_DEPTH:
+        case AOV_SAMPLE_COUNT:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    uint64_t position_or_throw(std::FILE* f, const std::string& path)
+    {
+#if defined(_WIN32)
+        const long long position = _ftelli64(f);
+#else
+        const long long position = ftello(f);
+#endif
+        if (position < 0)
+            throw std::runtime_error("read_accumulation_file( '" + path + "' ) failed to query the file position");
+        return static_cast<uint64_t>(position);
+    }
+
+    uint64_t size_or_throw(std::FILE* f, const std::string& path)
+    {
+        const uint64_t position = position_or_throw(f, path);
+#if defined(_WIN32)
+        const bool ok = _fseeki64(f, 0, SEEK_END) == 0;
+#else
+        const bool ok = fseeko(f, 0, SEEK_END) == 0;
+#endif
+        const uint64_t size = ok ? position_or_throw(f, path) : 0;
+#if defined(_WIN32)
+        if (!ok || _fseeki64(f, static_cast<__int64>(position), SEEK_SET) != 0)
+#else
+        if (!ok || fseeko(f, static_cast<off_t>(position), SEEK_SET) != 0)
+#endif
+            throw std::runtime_error("read_accumulation_file( '" + path + "' ) failed to seek");
+        return size;
+    }
+}
+
+grpt::accumulation_file::accumulation_file()
+{
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "GRAC", 4);
+    header.version = accumulation_version;
+}
+
+void grpt::write_accumulation_file(const std::string& path, const accumulation_file& file)
+{
+    const std::string tmp_path = path + ".tmp";
+    std::FILE* f = std::fopen(tmp_path.c_str(), "wb");
+    if (!f)
+        throw std::runtime_error("write_accumulation_file( '" + path + "' ) failed to open '" + tmp_path + "'");
+
+    try
+    {
+        write_or_throw(f, &file.header, sizeof(file.header), path);
+        write_or_throw(f, file.color.data(), file.color.size() * sizeof(float), path);
+        for (const auto& aov : file.aovs)
+        {
+            section_header section = { aov.flag, 0u, aov.data.size() };
+            write_or_throw(f, &section, sizeof(section), path);
+            write_or_throw(f, aov.data.data(), aov.data.size(), path);
+        }
+        if (std::fflush(f) != 0)
+            throw std::runtime_error("write_accumulation_file( '" + path + "' ) failed to flush");
+    }
+    catch (...)
+    {
+        std::fclose(f);
+        std::remove(tmp_path.c_str());
+        throw;
+    }
+
+    if (std::fclose(f) != 0 || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("write_accumulation_file( '" + path + "' ) failed to replace the file");
+    }
+}
+
+grpt::accumulation_file grpt::read_accumulation_file(const std::string& path)
+{
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f)
+        throw std::runtime_error("read_accumulation_file( '" + path + "' ) failed to open file");
+
+    accumulation_file file;
+    try
+    {
+        read_or_throw(f, &file.header, sizeof(file.header), path);
+        if (std::memcmp(file.header.magic, "GRAC", 4) != 0 || file.header.version != accumulation_version)
+            throw std::runtime_error("read_accumulation_file( '" + path + "' ) is not an accumulation file");
+
+        // Every section is checked against the image size and the bytes left
+        // before anything is allocated for it.
+        const uint64_t file_size = size_or_throw(f, path);
+        const uint64_t count = static_cast<uint64_t>(file.header.width) * file.header.height;
+        if (count > (file_size - sizeof(file.header)) / (3 * sizeof(float)))
+            throw std::runtime_error("read_accumulation_file( '" + path + "' ) is too short for a " +
+                                     std::to_string(file.header.width) + "x" + std::to_string(file.header.height) +
+                                     " image");
+        file.color.resize(static_cast<size_t>(count) * 3);
+        read_or_throw(f, file.color.data(), file.color.size() * sizeof(float), path);
+        uint64_t offset = sizeof(file.header) + file.color.size() * sizeof(float);
+
+        section_header section;
+        while (std::fread(&section, sizeof(section), 1, f) == 1)
+        {
+            const size_t element_size = aov_element_size(section.flag);
+            if (element_size == 0 || !(file.header.aov_mask & section.flag))
+                throw std::runtime_error("read_accumulation_file( '" + path + "' ) has an unexpected AOV section " +
+                                         std::to_string(section.flag));
+            if (section.size != count * element_size)
+                throw std::runtime_error("read_accumulation_file( '" + path + "' ) has an AOV section " +
+                                         std::to_string(section.flag) + " of " + std::to_string(section.size) +
+                                         " bytes, expected " + std::to_string(count * element_size));
+            offset += sizeof(section);
+            if (section.size > file_size - offset)
+                throw std::runtime_error("read_accumulation_file( '" + path + "' ) is truncated");
+            offset += section.size;
+
+            accumulation_file::aov_section aov;
+            aov.flag = section.flag;
+            aov.data.resize(section.size);
+            read_or_throw(f, aov.data.data(), aov.data.size(), path);
+            file.aovs.push_back(std::move(aov));
+        }
+        if (std::ferror(f))
+            throw std::runtime_error("read_accumulation_file( '" + path + "' ) failed to read");
+        if (offset != file_size)
+            throw std::runtime_error("read_accumulation_file( '" + path + "' ) ends in a partial section");
+    }
+    catch (...)
+    {
+        std::fclose(f);
+        throw;
+    }
+    std::fclose(f);
+
+    return file;
+}
+
+grpt::accumulation_file grpt::merge_accumulation_files(const std::vector<accumulation_file>& files)
+{
+    if (files.empty())
+        throw std::runtime_error("merge_accumulation_files: nothing to merge");
+
+    const accumulation_file::header_t& first = files[0].header;
+    const size_t count = static_cast<size_t>(first.width) * first.height;
+
+    std::vector<size_t> order(files.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return files[a].header.first_frame < files[b].header.first_frame;
+    });
+
+    uint64_t total_samples = 0;
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        const accumulation_file::header_t& h = files[order[k]].header;
+        if (h.width != first.width || h.height != first.height || h.aov_mask != first.aov_mask ||
+            h.sqrt_num_samples != first.sqrt_num_samples || h.scene_hash != first.scene_hash ||
+            files[order[k]].aovs.size() != files[0].aovs.size())
+            throw std::runtime_error("merge_accumulation_files: files belong to different renders");
+        if (k > 0 && h.first_frame < files[order[k - 1]].header.next_frame)
+            throw std::runtime_error("merge_accumulation_files: RNG frame ranges overlap");
+        total_samples += h.sample_count;
+    }
+    if (total_samples == 0)
+        throw std::runtime_error("merge_accumulation_files: no samples to merge");
+
+    accumulation_file merged;
+    merged.header = first;
+    merged.header.first_frame  = files[order.front()].header.first_frame;
+    merged.header.next_frame   = files[order.back()].header.next_frame;
+    merged.header.sample_count = total_samples;
+
+    // Means are combined in double precision, so the merge itself adds no
+    // error beyond the final rounding to float.
+    std::vector<double> sum(count * 3, 0.0);
+    for (const auto& file : files)
+    {
+        const double weight = static_cast<double>(file.header.sample_count);
+        for (size_t i = 0; i < sum.size(); ++i)
+            sum[i] += weight * file.color[i];
+    }
+    merged.color.resize(sum.size());
+    for (size_t i = 0; i < sum.size(); ++i)
+        merged.color[i] = static_cast<float>(sum[i] / total_samples);
+
+    for (size_t a = 0; a < files[0].aovs.size(); ++a)
+    {
+        const uint32_t flag = files[0].aovs[a].flag;
+        accumulation_file::aov_section section = files[order.front()].aovs[a];
+
+        const size_t element_size = aov_element_size(flag);
+        for (const auto& file : files)
+            if (file.aovs[a].flag != flag || file.aovs[a].data.size() != count * element_size)
+                throw std::runtime_error("merge_accumulation_files: AOV sections differ");
+
+        if (flag == AOV_ALBEDO || flag == AOV_NORMAL)
+        {
+            std::vector<double> aov_sum(count * 4, 0.0);
+            for (const auto& file : files)
+            {
+                const float* values = reinterpret_cast<const float*>(file.aovs[a].data.data());
+                for (size_t i = 0; i < aov_sum.size(); ++i)
+                    aov_sum[i] += static_cast<double>(file.header.sample_count) * values[i];
+            }
+            float* values = reinterpret_cast<float*>(section.data.data());
+            for (size_t i = 0; i < aov_sum.size(); ++i)
+                values[i] = static_cast<float>(aov_sum[i] / total_samples);
+        }
+        else if (flag == AOV_DEPTH)
+        {
+            float* values = reinterpret_cast<float*>(section.data.data());
+            for (const auto& file : files)
+            {
+                const float* other = reinterpret_cast<const float*>(file.aovs[a].data.data());
+                for (size_t i = 0; i < count; ++i)
+                    values[i] = std::min(values[i], other[i]);
+            }
+        }
+        else if (flag == AOV_SAMPLE_COUNT)
+        {
+            uint32_t* values = reinterpret_cast<uint32_t*>(section.data.data());
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint64_t total = 0;
+                for (const auto& file : files)
+                    total += reinterpret_cast<const uint32_t*>(file.aovs[a].data.data())[i];
+                values[i] = static_cast<uint32_t>(total);
+            }
+        }
+        // AOV_ID keeps the values of the earliest frame range, whose first
+        // sample is the one a single render would have recorded.
+
+        merged.aovs.push_back(std::move(section));
+    }
+
+    return merged;
+}
+
+uint64_t grpt::hash_bytes(const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+grpt::accumulation_writer::~accumulation_writer()
+{
+    wait();
+}
+
+void grpt::accumulation_writer::submit(const std::string& path, std::unique_ptr<accumulation_file> file)
+{
+    wait();
+
+    std::shared_ptr<accumulation_file> snapshot(std::move(file));
+    m_thread = std::thread([this, path, snapshot]()
+    {
+        try
+        {
+            write_accumulation_file(path, *snapshot);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            m_failed = true;
+        }
+    });
+}
+
+bool grpt::accumulation_writer::wait()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+
+    const bool ok = !m_failed;
+    m_failed = false;
+    return ok;
+}
@@ -0,0 +1,354 @@
+#include <denoiser.hpp>
+
+#include <ParallelFor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define GRPT_DENOISER_SSE 1
+#endif
+
+using optix::float4;
+
+namespace
+{
+    const float albedo_epsilon = 0.01f;
+    const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+    double elapsed_ms(std::chrono::steady_clock::time_point begin)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    float luminance(float r, float g, float b)
+    {
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
+    // Luminance compressed to [0,1) so the color edge stop treats fireflies
+    // and dim regions alike.
+    float tone_mapped_luminance(float r, float g, float b)
+    {
+        const float l = std::max(luminance(r, g, b), 0.0f);
+        return l / (1.0f + l);
+    }
+
+#ifdef GRPT_DENOISER_SSE
+    // exp(x) for x <= 0 via 2^floor * polynomial; relative error ~1e-4,
+    // plenty for filter weights.
+    inline __m128 exp_ps(__m128 x)
+    {
+        x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+        const __m128 t = _mm_mul_ps(x, _mm_set1_ps(1.44269504f));
+        __m128 fi = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+        fi = _mm_sub_ps(fi, _mm_and_ps(_mm_cmpgt_ps(fi, t), _mm_set1_ps(1.0f)));
+        const __m128 f = _mm_sub_ps(t, fi);
+
+        __m128 p = _mm_set1_ps(1.33336e-3f);
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.61813e-3f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.55041e-2f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.40227e-1f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.93147e-1f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+        const __m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fi), _mm_set1_epi32(127)), 23);
+        return _mm_mul_ps(p, _mm_castsi128_ps(e));
+    }
+
+    inline __m128 square_ps(__m128 x)
+    {
+        return _mm_mul_ps(x, x);
+    }
+#endif
+}
+
+grpt::denoiser::denoiser(const denoise_settings& settings) : m_settings(settings)
+{
+}
+
+void grpt::denoiser::reset_history()
+{
+    m_has_history = false;
+}
+
+void grpt::denoiser::denoise(const float4* color,
+                             const float4* albedo,
+                             const float4* normal,
+                             const float* depth,
+                             unsigned int width,
+                             unsigned int height,
+                             float4* out)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    const size_t count = static_cast<size_t>(width) * height;
+
+    if (width != m_width || height != m_height)
+    {
+        m_width  = width;
+        m_height = height;
+        m_nx.resize(count); m_ny.resize(count); m_nz.resize(count);
+        m_ar.resize(count); m_ag.resize(count); m_ab.resize(count);
+        m_ping.resize(count);
+        m_pong.resize(count);
+        m_has_history = false;
+    }
+    if (depth)
+        m_depth.assign(depth, depth + count);
+    else
+        m_depth.clear();
+
+    // Split into planes and divide out the albedo.
+    sutil::parallelFor(count, 4096, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            m_ar[i] = albedo[i].x;
+            m_ag[i] = albedo[i].y;
+            m_ab[i] = albedo[i].z;
+            m_nx[i] = normal[i].x;
+            m_ny[i] = normal[i].y;
+            m_nz[i] = normal[i].z;
+            m_ping.r[i] = color[i].x / std::max(albedo[i].x, albedo_epsilon);
+            m_ping.g[i] = color[i].y / std::max(albedo[i].y, albedo_epsilon);
+            m_ping.b[i] = color[i].z / std::max(albedo[i].z, albedo_epsilon);
+        }
+    });
+    m_timings.prepare_ms = elapsed_ms(begin);
+
+    const auto temporal_begin = std::chrono::steady_clock::now();
+    if (m_settings.temporal_alpha < 1.0f)
+        temporal_blend(m_ping);
+    m_timings.temporal_ms = elapsed_ms(temporal_begin);
+
+    const auto filter_begin = std::chrono::steady_clock::now();
+    planes* src = &m_ping;
+    planes* dst = &m_pong;
+    float sigma_color = m_settings.sigma_color;
+    for (int pass = 0; pass < m_settings.iterations; ++pass)
+    {
+        filter_pass(*src, *dst, 1 << pass, sigma_color);
+        std::swap(src, dst);
+        sigma_color *= 0.5f;
+    }
+    m_timings.filter_ms = elapsed_ms(filter_begin);
+
+    sutil::parallelFor(count, 4096, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            out[i] = optix::make_float4(src->r[i] * std::max(m_ar[i], albedo_epsilon),
+                                        src->g[i] * std::max(m_ag[i], albedo_epsilon),
+                                        src->b[i] * std::max(m_ab[i], albedo_epsilon),
+                                        color[i].w);
+        }
+    });
+    m_timings.total_ms = elapsed_ms(begin);
+}
+
+// Accumulates the noisy irradiance over frames wherever the history shows
+// the same surface; disoccluded pixels restart from the current frame.  The
+// camera is assumed static between frames.
+void grpt::denoiser::temporal_blend(planes& current)
+{
+    const size_t count = static_cast<size_t>(m_width) * m_height;
+    const bool have_depth = !m_depth.empty() && m_history_depth.size() == m_depth.size();
+
+    if (m_has_history)
+    {
+        const float alpha = m_settings.temporal_alpha;
+        sutil::parallelFor(count, 4096, [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const float ndot = m_nx[i] * m_history_nx[i] + m_ny[i] * m_history_ny[i] + m_nz[i] * m_history_nz[i];
+                const float nlen = m_nx[i] * m_nx[i] + m_ny[i] * m_ny[i] + m_nz[i] * m_nz[i];
+                bool same_surface = ndot > 0.9f * nlen || (nlen == 0.0f && ndot == 0.0f);
+                if (have_depth)
+                    same_surface = same_surface &&
+                        std::fabs(m_depth[i] - m_history_depth[i]) <= 0.1f * std::fabs(m_depth[i]);
+                if (!same_surface)
+                    continue;
+                current.r[i] = alpha * current.r[i] + (1.0f - alpha) * m_history.r[i];
+                current.g[i] = alpha * current.g[i] + (1.0f - alpha) * m_history.g[i];
+                current.b[i] = alpha * current.b[i] + (1.0f - alpha) * m_history.b[i];
+            }
+        });
+    }
+
+    m_history = current;
+    m_history_nx = m_nx;
+    m_history_ny = m_ny;
+    m_history_nz = m_nz;
+    m_history_depth = m_depth;
+    m_has_history = true;
+}
+
+// One a-trous pass: a 5x5 B3 spline kernel with taps 'step' pixels apart,
+// each weighted by the color, normal, albedo and depth edge stops combined
+// into a single exponential.
+void grpt::denoiser::filter_pass(const planes& src, planes& dst, int step, float sigma_color) const
+{
+    const int w = static_cast<int>(m_width);
+    const int h = static_cast<int>(m_height);
+    const bool have_depth = !m_depth.empty();
+
+    const float inv_color  = 1.0f / (sigma_color * sigma_color);
+    const float inv_albedo = 1.0f / (m_settings.sigma_albedo * m_settings.sigma_albedo);
+    const float normal_k   = 0.5f * m_settings.sigma_normal;
+    const float inv_depth  = 1.0f / (m_settings.sigma_depth * step);
+
+    std::vector<float> lum(static_cast<size_t>(w) * h);
+    sutil::parallelFor(lum.size(), 4096, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+            lum[i] = tone_mapped_luminance(src.r[i], src.g[i], src.b[i]);
+    });
+
+    auto filter_scalar = [&](int x, int y)
+    {
+        const size_t p = static_cast<size_t>(y) * w + x;
+        float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f, sum_w = 0.0f;
+        for (int j = 0; j < 5; ++j)
+        {
+            const int qy = y + (j - 2) * step;
+            if (qy < 0 || qy >= h)
+                continue;
+            for (int i = 0; i < 5; ++i)
+            {
+                const int qx = x + (i - 2) * step;
+                if (qx < 0 || qx >= w)
+                    continue;
+                const size_t q = static_cast<size_t>(qy) * w + qx;
+
+                const float dl = lum[p] - lum[q];
+                const float dnx = m_nx[p] - m_nx[q], dny = m_ny[p] - m_ny[q], dnz = m_nz[p] - m_nz[q];
+                const float dar = m_ar[p] - m_ar[q], dag = m_ag[p] - m_ag[q], dab = m_ab[p] - m_ab[q];
+                float e = dl * dl * inv_color
+                        + (dnx * dnx + dny * dny + dnz * dnz) * normal_k
+                        + (dar * dar + dag * dag + dab * dab) * inv_albedo;
+                if (have_depth)
+                    e += std::fabs(m_depth[p] - m_depth[q]) * inv_depth / std::max(std::fabs(m_depth[p]), 1e-3f);
+
+                const float weight = kernel[i] * kernel[j] * std::exp(-e);
+                sum_r += weight * src.r[q];
+                sum_g += weight * src.g[q];
+                sum_b += weight * src.b[q];
+                sum_w += weight;
+            }
+        }
+        // The center tap has weight 9/64, so sum_w never vanishes.
+        dst.r[p] = sum_r / sum_w;
+        dst.g[p] = sum_g / sum_w;
+        dst.b[p] = sum_b / sum_w;
+    };
+
+    sutil::parallelFor(static_cast<size_t>(h), 8, [&](size_t first_row, size_t last_row)
+    {
+        for (int y = static_cast<int>(first_row); y < static_cast<int>(last_row); ++y)
+        {
+            int x = 0;
+#ifdef GRPT_DENOISER_SSE
+            // Interior pixels, four at a time; every horizontal tap of the
+            // group is in bounds.
+            for (; x < std::min(2 * step, w); ++x)
+                filter_scalar(x, y);
+
+            const __m128 v_inv_color  = _mm_set1_ps(inv_color);
+            const __m128 v_inv_albedo = _mm_set1_ps(inv_albedo);
+            const __m128 v_normal_k   = _mm_set1_ps(normal_k);
+            const __m128 v_inv_depth  = _mm_set1_ps(inv_depth);
+            const __m128 v_sign_mask  = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+            for (; x + 3 + 2 * step < w; x += 4)
+            {
+                const size_t p = static_cast<size_t>(y) * w + x;
+                const __m128 lp  = _mm_loadu_ps(&lum[p]);
+                const __m128 nxp = _mm_loadu_ps(&m_nx[p]), nyp = _mm_loadu_ps(&m_ny[p]), nzp = _mm_loadu_ps(&m_nz[p]);
+                const __m128 arp = _mm_loadu_ps(&m_ar[p]), agp = _mm_loadu_ps(&m_ag[p]), abp = _mm_loadu_ps(&m_ab[p]);
+                __m128 inv_zp = _mm_setzero_ps(), zp = _mm_setzero_ps();
+                if (have_depth)
+                {
+                    zp = _mm_loadu_ps(&m_depth[p]);
+                    inv_zp = _mm_div_ps(v_inv_depth, _mm_max_ps(_mm_and_ps(zp, v_sign_mask), _mm_set1_ps(1e-3f)));
+                }
+
+                __m128 sum_r = _mm_setzero_ps(), sum_g = _mm_setzero_ps(), sum_b = _mm_setzero_ps(), sum_w = _mm_setzero_ps();
+                for (int j = 0; j < 5; ++j)
+                {
+                    const int qy = y + (j - 2) * step;
+                    if (qy < 0 || qy >= h)
+                        continue;
+                    for (int i = 0; i < 5; ++i)
+                    {
+                        const size_t q = static_cast<size_t>(qy) * w + x + (i - 2) * step;
+
+                        __m128 e = _mm_mul_ps(square_ps(_mm_sub_ps(lp, _mm_loadu_ps(&lum[q]))), v_inv_color);
+                        const __m128 dn = _mm_add_ps(_mm_add_ps(square_ps(_mm_sub_ps(nxp, _mm_loadu_ps(&m_nx[q]))),
+                                                                square_ps(_mm_sub_ps(nyp, _mm_loadu_ps(&m_ny[q])))),
+                                                     square_ps(_mm_sub_ps(nzp, _mm_loadu_ps(&m_nz[q]))));
+                        const __m128 da = _mm_add_ps(_mm_add_ps(square_ps(_mm_sub_ps(arp, _mm_loadu_ps(&m_ar[q]))),
+                                                                square_ps(_mm_sub_ps(agp, _mm_loadu_ps(&m_ag[q])))),
+                                                     square_ps(_mm_sub_ps(abp, _mm_loadu_ps(&m_ab[q]))));
+                        e = _mm_add_ps(e, _mm_add_ps(_mm_mul_ps(dn, v_normal_k), _mm_mul_ps(da, v_inv_albedo)));
+                        if (have_depth)
+                        {
+                            const __m128 dz = _mm_and_ps(_mm_sub_ps(zp, _mm_loadu_ps(&m_depth[q])), v_sign_mask);
+                            e = _mm_add_ps(e, _mm_mul_ps(dz, inv_zp));
+                        }
+
+                        const __m128 weight = _mm_mul_ps(_mm_set1_ps(kernel[i] * kernel[j]),
+                                                         exp_ps(_mm_sub_ps(_mm_setzero_ps(), e)));
+                        sum_r = _mm_add_ps(sum_r, _mm_mul_ps(weight, _mm_loadu_ps(&src.r[q])));
+                        sum_g = _mm_add_ps(sum_g, _mm_mul_ps(weight, _mm_loadu_ps(&src.g[q])));
+                        sum_b = _mm_add_ps(sum_b, _mm_mul_ps(weight, _mm_loadu_ps(&src.b[q])));
+                        sum_w = _mm_add_ps(sum_w, weight);
+                    }
+                }
+                _mm_storeu_ps(&dst.r[p], _mm_div_ps(sum_r, sum_w));
+                _mm_storeu_ps(&dst.g[p], _mm_div_ps(sum_g, sum_w));
+                _mm_storeu_ps(&dst.b[p], _mm_div_ps(sum_b, sum_w));
+            }
+#endif
+            for (; x < w; ++x)
+                filter_scalar(x, y);
+        }
+    });
+}
+
+double grpt::metrics::mse(const float4* a, const float4* reference, size_t count)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double dr = a[i].x - reference[i].x;
+        const double dg = a[i].y - reference[i].y;
+        const double db = a[i].z - reference[i].z;
+        sum += dr * dr + dg * dg + db * db;
+    }
+    return count ? sum / (3.0 * count) : 0.0;
+}
+
+double grpt::metrics::psnr(const float4* a, const float4* reference, size_t count)
+{
+    const double e = mse(a, reference, count);
+    return e > 0.0 ? 10.0 * std::log10(1.0 / e) : INFINITY;
+}
+
+double grpt::metrics::rel_mse(const float4* a, const float4* reference, size_t count)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float* pa = &a[i].x;
+        const float* pr = &reference[i].x;
+        for (int c = 0; c < 3; ++c)
+        {
+            const double d = pa[c] - pr[c];
+            sum += d * d / (static_cast<double>(pr[c]) * pr[c] + 0.01);
+        }
+    }
+    return count ? sum / (3.0 * count) : 0.0;
+}
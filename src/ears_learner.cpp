@@ -0,0 +1,141 @@
+#include <ears_learner.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    const size_t record_pairs = grpt::ears::record_depth + 1;
+
+    // Keeps the relative variance of black pixels finite.
+    const double mean_epsilon = 1e-4;
+}
+
+grpt::ears::learner::learner(unsigned int width, unsigned int height, const learner_settings& settings)
+    : m_settings(settings),
+      m_width(width),
+      m_height(height),
+      m_cell_moments(static_cast<size_t>(settings.grid_resolution) * settings.grid_resolution * settings.grid_resolution, moments()),
+      m_pixel_moments(static_cast<size_t>(width) * height, moments()),
+      m_cells(m_cell_moments.size(), optix::make_float2(0.0f)),
+      m_pixels(m_pixel_moments.size(), optix::make_float2(0.0f)),
+      m_bounds_min(optix::make_float3(0.0f)),
+      m_bounds_extent(optix::make_float3(1.0f)),
+      m_has_bounds(false),
+      m_ready(false)
+{
+}
+
+void grpt::ears::learner::add_records(const optix::float4* records)
+{
+    const size_t num_pixels = m_pixel_moments.size();
+
+    if (!m_has_bounds)
+    {
+        optix::float3 lo = optix::make_float3(std::numeric_limits<float>::max());
+        optix::float3 hi = optix::make_float3(-std::numeric_limits<float>::max());
+        for (size_t p = 0; p < num_pixels; ++p)
+        {
+            for (size_t v = 1; v < record_pairs; ++v)
+            {
+                const optix::float4* r = records + (p * record_pairs + v) * 2;
+                if (r[1].w <= 0.0f)
+                    continue;
+                lo = optix::fminf(lo, optix::make_float3(r[0]));
+                hi = optix::fmaxf(hi, optix::make_float3(r[0]));
+            }
+        }
+        if (lo.x <= hi.x)
+        {
+            const optix::float3 margin = (hi - lo) * 0.01f + optix::make_float3(1e-3f);
+            m_bounds_min = lo - margin;
+            m_bounds_extent = hi - lo + 2.0f * margin;
+            m_has_bounds = true;
+        }
+    }
+
+    for (size_t p = 0; p < num_pixels; ++p)
+    {
+        const optix::float4* path = records + p * record_pairs * 2;
+        if (path[1].w <= 0.0f)
+            continue;
+
+        moments& pixel = m_pixel_moments[p];
+        pixel.count  += 1.0;
+        pixel.sum    += path[0].w;
+        pixel.sum_sq += static_cast<double>(path[0].w) * path[0].w;
+        pixel.cost   += path[1].x;
+
+        if (!m_has_bounds)
+            continue;
+        for (size_t v = 1; v < record_pairs; ++v)
+        {
+            const optix::float4* r = path + v * 2;
+            if (r[1].w <= 0.0f)
+                break;
+            moments& cell = m_cell_moments[cell_index(optix::make_float3(r[0]), m_bounds_min, m_bounds_extent,
+                                                      m_settings.grid_resolution)];
+            cell.count  += 1.0;
+            cell.sum    += r[0].w;
+            cell.sum_sq += static_cast<double>(r[0].w) * r[0].w;
+            cell.cost   += r[1].x;
+        }
+    }
+}
+
+void grpt::ears::learner::update()
+{
+    for (size_t i = 0; i < m_cell_moments.size(); ++i)
+    {
+        const moments& m = m_cell_moments[i];
+        m_cells[i] = m.count > 0.0 ?
+            optix::make_float2(static_cast<float>(m.sum_sq / m.count), static_cast<float>(m.cost / m.count)) :
+            optix::make_float2(0.0f);
+    }
+
+    m_ready = false;
+    const unsigned int tile = std::max(m_settings.tile_size, 1u);
+    for (unsigned int ty = 0; ty < m_height; ty += tile)
+    {
+        for (unsigned int tx = 0; tx < m_width; tx += tile)
+        {
+            const unsigned int x1 = std::min(tx + tile, m_width);
+            const unsigned int y1 = std::min(ty + tile, m_height);
+
+            double relative_variance = 0.0, cost = 0.0, count = 0.0;
+            for (unsigned int y = ty; y < y1; ++y)
+            {
+                for (unsigned int x = tx; x < x1; ++x)
+                {
+                    const moments& m = m_pixel_moments[static_cast<size_t>(y) * m_width + x];
+                    if (m.count < 2.0)
+                        continue;
+                    const double mean = m.sum / m.count;
+                    const double variance = std::max(0.0, (m.sum_sq - m.sum * mean) / (m.count - 1.0));
+                    relative_variance += variance / (mean * mean + mean_epsilon);
+                    cost += m.cost / m.count;
+                    count += 1.0;
+                }
+            }
+
+            for (unsigned int y = ty; y < y1; ++y)
+            {
+                for (unsigned int x = tx; x < x1; ++x)
+                {
+                    const size_t i = static_cast<size_t>(y) * m_width + x;
+                    const moments& m = m_pixel_moments[i];
+                    if (count <= 0.0 || m.count <= 0.0 || relative_variance <= 0.0)
+                    {
+                        m_pixels[i] = optix::make_float2(0.0f);
+                        continue;
+                    }
+                    const double mean = m.sum / m.count;
+                    m_pixels[i] = optix::make_float2(static_cast<float>(relative_variance / count * (mean * mean + mean_epsilon)),
+                                                     static_cast<float>(cost / count));
+                    m_ready = true;
+                }
+            }
+        }
+    }
+}
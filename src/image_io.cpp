@@ -0,0 +1,171 @@
+#include <image_io.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace
+{
+    bool host_is_little_endian()
+    {
+        const uint32_t one = 1;
+        unsigned char first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    void swap_bytes(std::vector<float>& values)
+    {
+        for (auto& v : values)
+        {
+            unsigned char b[4];
+            std::memcpy(b, &v, 4);
+            std::swap(b[0], b[3]);
+            std::swap(b[1], b[2]);
+            std::memcpy(&v, b, 4);
+        }
+    }
+}
+
+void grpt::image_io::write_pfm(const std::string& path, const image& img)
+{
+    if (img.channels != 1 && img.channels != 3)
+        throw std::runtime_error("write_pfm( '" + path + "' ) needs 1 or 3 channels");
+
+    std::ofstream out(path.c_str(), std::ios::out | std::ios::binary);
+    if (!out)
+        throw std::runtime_error("write_pfm( '" + path + "' ) failed to open file");
+
+    // A negative scale marks little endian data.
+    out << (img.channels == 3 ? "PF" : "Pf") << '\n'
+        << img.width << ' ' << img.height << '\n'
+        << (host_is_little_endian() ? "-1.0" : "1.0") << '\n';
+    out.write(reinterpret_cast<const char*>(img.pixels.data()), img.pixels.size() * sizeof(float));
+
+    if (!out)
+        throw std::runtime_error("write_pfm( '" + path + "' ) failed to write file");
+}
+
+grpt::image_io::image grpt::image_io::read_pfm(const std::string& path)
+{
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if (!in)
+        throw std::runtime_error("read_pfm( '" + path + "' ) failed to open file");
+
+    std::string magic;
+    image img;
+    float scale = 0.0f;
+    in >> magic >> img.width >> img.height >> scale;
+    in.get(); // single whitespace before the raster
+
+    if (!in || (magic != "PF" && magic != "Pf") || img.width == 0 || img.height == 0 || scale == 0.0f)
+        throw std::runtime_error("read_pfm( '" + path + "' ) is not a valid PFM file");
+
+    img.channels = magic == "PF" ? 3u : 1u;
+    img.pixels.resize(static_cast<size_t>(img.width) * img.height * img.channels);
+    in.read(reinterpret_cast<char*>(img.pixels.data()), img.pixels.size() * sizeof(float));
+    if (!in)
+        throw std::runtime_error("read_pfm( '" + path + "' ) is truncated");
+
+    if ((scale < 0.0f) != host_is_little_endian())
+        swap_bytes(img.pixels);
+
+    return img;
+}
+
+grpt::image_io::image grpt::image_io::from_buffer(optix::Buffer buffer)
+{
+    RTsize buffer_width, buffer_height;
+    buffer->getSize(buffer_width, buffer_height);
+
+    image img;
+    img.width  = static_cast<unsigned int>(buffer_width);
+    img.height = static_cast<unsigned int>(buffer_height);
+
+    const RTformat format = buffer->getFormat();
+    unsigned int src_channels;
+    switch (format)
+    {
+        case RT_FORMAT_FLOAT:          src_channels = 1; break;
+        case RT_FORMAT_FLOAT3:         src_channels = 3; break;
+        case RT_FORMAT_FLOAT4:         src_channels = 4; break;
+        case RT_FORMAT_UNSIGNED_INT:   src_channels = 1; break;
+        case RT_FORMAT_UNSIGNED_INT2:  src_channels = 2; break;
+        default:
+            throw std::runtime_error("image_io::from_buffer: unsupported buffer format");
+    }
+    const bool is_uint = format == RT_FORMAT_UNSIGNED_INT || format == RT_FORMAT_UNSIGNED_INT2;
+
+    img.channels = src_channels == 1 ? 1u : 3u;
+    img.pixels.assign(static_cast<size_t>(img.width) * img.height * img.channels, 0.0f);
+
+    const size_t count = static_cast<size_t>(img.width) * img.height;
+    const void* data = buffer->map(0, RT_BUFFER_MAP_READ);
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (unsigned int c = 0; c < std::min(src_channels, img.channels); ++c)
+        {
+            img.pixels[i * img.channels + c] = is_uint ?
+                static_cast<float>(static_cast<const unsigned int*>(data)[i * src_channels + c]) :
+                static_cast<const float*>(data)[i * src_channels + c];
+        }
+    }
+    buffer->unmap();
+
+    return img;
+}
+
+void grpt::image_io::write_buffer_pfm(const std::string& path, optix::Buffer buffer)
+{
+    write_pfm(path, from_buffer(buffer));
+}
+
+grpt::image_io::pfm_writer::pfm_writer(const std::string& path, unsigned int width, unsigned int height, unsigned int channels)
+    : m_path(path),
+      m_out(path.c_str(), std::ios::out | std::ios::binary),
+      m_raster(0),
+      m_width(width),
+      m_height(height),
+      m_channels(channels)
+{
+    if (channels != 1 && channels != 3)
+        throw std::runtime_error("pfm_writer( '" + path + "' ) needs 1 or 3 channels");
+    if (!m_out)
+        throw std::runtime_error("pfm_writer( '" + path + "' ) failed to open file");
+
+    m_out << (channels == 3 ? "PF" : "Pf") << '\n'
+          << width << ' ' << height << '\n'
+          << (host_is_little_endian() ? "-1.0" : "1.0") << '\n';
+    m_raster = m_out.tellp();
+
+    // Writing the last value extends the file over the whole raster.
+    const float zero = 0.0f;
+    m_out.seekp(m_raster + static_cast<std::streamoff>(width) * height * channels * sizeof(float) - sizeof(float));
+    m_out.write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+    if (!m_out)
+        throw std::runtime_error("pfm_writer( '" + path + "' ) failed to write file");
+}
+
+void grpt::image_io::pfm_writer::write_region(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const float* pixels)
+{
+    if (x + w > m_width || y + h > m_height)
+        throw std::runtime_error("pfm_writer( '" + m_path + "' ) region outside the image");
+
+    const size_t row_size = static_cast<size_t>(w) * m_channels * sizeof(float);
+    for (unsigned int row = 0; row < h; ++row)
+    {
+        m_out.seekp(m_raster + (static_cast<std::streamoff>(y + row) * m_width + x) * m_channels * sizeof(float));
+        m_out.write(reinterpret_cast<const char*>(pixels + static_cast<size_t>(row) * w * m_channels), row_size);
+    }
+    if (!m_out)
+        throw std::runtime_error("pfm_writer( '" + m_path + "' ) failed to write file");
+}
+
+void grpt::image_io::pfm_writer::close()
+{
+    m_out.close();
+    if (!m_out)
+        throw std::runtime_error("pfm_writer( '" + m_path + "' ) failed to write file");
+}
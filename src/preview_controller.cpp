@@ -0,0 +1,44 @@
+#include <preview_controller.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+grpt::preview_controller::preview_controller(const preview_settings& settings)
+    : m_settings(settings),
+      m_scale(1.0f),
+      m_full_frame_ms(0.0),
+      m_moving(false),
+      m_still_frames(0)
+{
+}
+
+float grpt::preview_controller::begin_frame(bool camera_changed)
+{
+    if (camera_changed)
+    {
+        m_moving = true;
+        m_still_frames = 0;
+    }
+    else if (m_moving && ++m_still_frames >= m_settings.settle_frames)
+    {
+        m_moving = false;
+    }
+
+    return m_moving ? m_scale : 1.0f;
+}
+
+void grpt::preview_controller::end_frame(double frame_ms, float scale)
+{
+    if (m_settings.target_fps <= 0.0f || frame_ms <= 0.0 || scale <= 0.0f)
+        return;
+
+    // The path tracing cost is proportional to the pixel count.
+    const double full_frame_ms = frame_ms / (static_cast<double>(scale) * scale);
+    m_full_frame_ms = m_full_frame_ms > 0.0 ?
+        m_settings.smoothing * full_frame_ms + (1.0 - m_settings.smoothing) * m_full_frame_ms :
+        full_frame_ms;
+
+    const double target_ms = 1000.0 / m_settings.target_fps;
+    const double scale_for_target = std::sqrt(target_ms / m_full_frame_ms);
+    m_scale = static_cast<float>(std::min(1.0, std::max<double>(m_settings.min_scale, scale_for_target)));
+}
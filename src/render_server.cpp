@@ -0,0 +1,533 @@
+#include <render_server.hpp>
+#include <unix_socket.hpp>
+
+#include <sutil.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#  include <poll.h>
+#  include <unistd.h>
+#  include <cerrno>
+#endif
+
+namespace
+{
+    const unsigned int max_tile_size = 1024;
+
+    // A job renders its next tile only while less than this much of its
+    // output is still waiting for the client.
+    const size_t max_pending_output = 1 << 20;
+
+    unsigned int parse_uint(const std::string& key, const std::string& value)
+    {
+        char* end = nullptr;
+        const unsigned long v = std::strtoul(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || value[0] == '-')
+            throw std::runtime_error("bad value '" + value + "' for " + key);
+        return static_cast<unsigned int>(v);
+    }
+
+    optix::float3 parse_float3(const std::string& key, const std::string& value)
+    {
+        optix::float3 v;
+        char trailing;
+        if (std::sscanf(value.c_str(), "%f,%f,%f%c", &v.x, &v.y, &v.z, &trailing) != 3)
+            throw std::runtime_error("bad value '" + value + "' for " + key);
+        return v;
+    }
+}
+
+const size_t grpt::render_server::max_request_line;
+const int    grpt::render_server::client_timeout_s;
+
+grpt::render_server::render_server(optix::Context context, const std::string& socket_path)
+    : m_context(context),
+      m_socket_path(socket_path),
+      m_listen_fd(unix_socket::listen(socket_path, 16)),
+      m_running(false),
+      m_next_job(0),
+      m_tile_capacity(0)
+{
+    // Tiles carry the beauty image only.
+    m_context["aov_mask"]->setUint(0u);
+}
+
+grpt::render_server::~render_server()
+{
+    for (const connection& c : m_clients)
+        unix_socket::close(c.fd);
+    unix_socket::close(m_listen_fd);
+#if !defined(_WIN32)
+    ::unlink(m_socket_path.c_str());
+#endif
+}
+
+void grpt::render_server::add_scene(const std::string& name, const scene& s)
+{
+    m_scenes[name] = s;
+}
+
+#if !defined(_WIN32)
+
+void grpt::render_server::run()
+{
+    m_running = true;
+    while (m_running)
+    {
+        const bool can_render = std::any_of(m_jobs.begin(), m_jobs.end(),
+                                            [this](const job& j) { return ready(j); });
+
+        std::vector<pollfd> fds(1 + m_clients.size());
+        fds[0].fd = m_listen_fd;
+        fds[0].events = POLLIN;
+        for (size_t i = 0; i < m_clients.size(); ++i)
+        {
+            fds[i + 1].fd = m_clients[i].fd;
+            fds[i + 1].events = POLLIN;
+            if (m_clients[i].output_sent < m_clients[i].output.size())
+                fds[i + 1].events |= POLLOUT;
+        }
+
+        // Only block while there is nothing to render, and wake up now and
+        // then to look for idle clients.
+        if (::poll(fds.data(), fds.size(), can_render ? 0 : 1000) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("render_server: poll failed");
+        }
+
+        if (fds[0].revents & POLLIN)
+            accept_client();
+
+        for (size_t i = 1; i < fds.size() && m_running; ++i)
+        {
+            connection* c = fds[i].revents ? find_client(fds[i].fd) : nullptr;
+            if (!c)
+                continue;
+
+            const int client = c->fd;
+            try
+            {
+                if (fds[i].revents & POLLOUT)
+                    flush(*c);
+                if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !read_requests(*c))
+                    drop_client(client);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "render_server: " << e.what() << '\n';
+                drop_client(client);
+            }
+        }
+
+        // A client is idle when it neither sends nor takes anything while
+        // none of its tiles is being waited for.
+        const auto now = std::chrono::steady_clock::now();
+        std::vector<int> idle;
+        for (const connection& c : m_clients)
+        {
+            const bool has_job = std::any_of(m_jobs.begin(), m_jobs.end(),
+                                             [&c](const job& j) { return j.client == c.fd; });
+            if ((!has_job || c.output_sent < c.output.size()) &&
+                now - c.last_activity > std::chrono::seconds(client_timeout_s))
+                idle.push_back(c.fd);
+        }
+        for (int client : idle)
+        {
+            std::cerr << "render_server: dropping client idle for " << client_timeout_s << " s\n";
+            drop_client(client);
+        }
+
+        if (!m_running || m_jobs.empty())
+            continue;
+
+        // Round robin over the jobs whose client has room for another tile.
+        size_t next = m_jobs.size();
+        for (size_t k = 0; k < m_jobs.size() && next == m_jobs.size(); ++k)
+        {
+            const size_t index = (m_next_job + k) % m_jobs.size();
+            if (ready(m_jobs[index]))
+                next = index;
+        }
+        if (next == m_jobs.size())
+            continue;
+
+        m_next_job = next;
+        job& j = m_jobs[m_next_job];
+        const int client = j.client;
+        try
+        {
+            if (render_tile(j))
+            {
+                ++m_next_job;
+            }
+            else
+            {
+                send(client, "done " +
+                     std::to_string(j.sqrt_num_samples * j.sqrt_num_samples * j.frames) + " " +
+                     std::to_string(static_cast<long long>(j.elapsed_ms + 0.5)));
+                m_jobs.erase(m_jobs.begin() + m_next_job);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "render_server: " << e.what() << '\n';
+            try
+            {
+                send(client, std::string("error ") + e.what());
+            }
+            catch (const std::exception&)
+            {
+            }
+            drop_client(client);
+        }
+    }
+}
+
+void grpt::render_server::accept_client()
+{
+    connection c;
+    c.fd = unix_socket::accept(m_listen_fd);
+    try
+    {
+        unix_socket::set_nonblocking(c.fd);
+    }
+    catch (const std::exception&)
+    {
+        unix_socket::close(c.fd);
+        throw;
+    }
+    c.output_sent = 0;
+    c.last_activity = std::chrono::steady_clock::now();
+    m_clients.push_back(c);
+}
+
+bool grpt::render_server::read_requests(connection& c)
+{
+    const int client = c.fd;
+    if (!unix_socket::recv_some(client, c.input, max_request_line + 1))
+        return false;
+    c.last_activity = std::chrono::steady_clock::now();
+
+    // Handle every complete line; a partial one waits for the rest.
+    size_t begin = 0, end;
+    while (m_running && (end = c.input.find('\n', begin)) != std::string::npos &&
+           end - begin <= max_request_line)
+    {
+        handle_request(client, c.input.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    c.input.erase(0, begin);
+
+    if (m_running && std::min(c.input.find('\n'), c.input.size()) > max_request_line)
+    {
+        send(client, "error request longer than " + std::to_string(max_request_line) + " bytes");
+        return false;
+    }
+    return true;
+}
+
+void grpt::render_server::flush(connection& c)
+{
+    while (c.output_sent < c.output.size())
+    {
+        const size_t n = unix_socket::send_some(c.fd, c.output.data() + c.output_sent,
+                                                c.output.size() - c.output_sent);
+        if (n == 0)
+            break;
+        c.output_sent += n;
+        c.last_activity = std::chrono::steady_clock::now();
+    }
+    if (c.output_sent == c.output.size())
+    {
+        c.output.clear();
+        c.output_sent = 0;
+    }
+}
+
+#else
+
+void grpt::render_server::run()
+{
+    throw std::runtime_error("render_server: not supported on this platform");
+}
+
+void grpt::render_server::accept_client()
+{
+}
+
+bool grpt::render_server::read_requests(connection&)
+{
+    return false;
+}
+
+void grpt::render_server::flush(connection&)
+{
+}
+
+#endif
+
+void grpt::render_server::send(int client, const std::string& line)
+{
+    const std::string message = line + '\n';
+    send(client, message.data(), message.size());
+}
+
+void grpt::render_server::send(int client, const void* data, size_t size)
+{
+    connection* c = find_client(client);
+    if (!c)
+        return;
+
+    // The idle clock starts when there is something for the client to take.
+    if (c->output_sent == c->output.size())
+        c->last_activity = std::chrono::steady_clock::now();
+    c->output.erase(0, c->output_sent);
+    c->output_sent = 0;
+    c->output.append(static_cast<const char*>(data), size);
+    flush(*c);
+}
+
+grpt::render_server::connection* grpt::render_server::find_client(int client)
+{
+    for (connection& c : m_clients)
+    {
+        if (c.fd == client)
+            return &c;
+    }
+    return nullptr;
+}
+
+bool grpt::render_server::ready(const job& j)
+{
+    const connection* c = find_client(j.client);
+    return c && c->output.size() - c->output_sent < max_pending_output;
+}
+
+void grpt::render_server::handle_request(int client, const std::string& line)
+{
+    if (line == "scenes")
+    {
+        std::string reply = "scenes";
+        for (const auto& s : m_scenes)
+            reply += " " + s.first;
+        send(client, reply);
+    }
+    else if (line == "shutdown")
+    {
+        m_running = false;
+    }
+    else if (line.compare(0, 7, "render ") == 0 || line == "render")
+    {
+        try
+        {
+            m_jobs.push_back(parse_job(client, line));
+        }
+        catch (const std::runtime_error& e)
+        {
+            send(client, std::string("error ") + e.what());
+        }
+    }
+    else
+    {
+        send(client, "error unknown request '" + line + "'");
+    }
+}
+
+grpt::render_server::job grpt::render_server::parse_job(int client, const std::string& line) const
+{
+    job j;
+    j.client           = client;
+    j.target           = nullptr;
+    j.width            = 512;
+    j.height           = 512;
+    j.sqrt_num_samples = 1;
+    j.frames           = 1;
+    j.tile             = 64;
+    j.next_tile        = 0;
+    j.elapsed_ms       = 0.0;
+
+    std::string scene_name;
+    unsigned int spp = 1;
+    bool has_region = false, has_eye = false, has_lookat = false, has_up = false, has_fov = false;
+    optix::float3 eye, lookat, up;
+    float fov = 0.0f;
+
+    std::istringstream tokens(line.substr(6));
+    std::string token;
+    while (tokens >> token)
+    {
+        const size_t eq = token.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("expected key=value, got '" + token + "'");
+        const std::string key = token.substr(0, eq);
+        const std::string value = token.substr(eq + 1);
+
+        if (key == "scene")
+            scene_name = value;
+        else if (key == "width")
+            j.width = parse_uint(key, value);
+        else if (key == "height")
+            j.height = parse_uint(key, value);
+        else if (key == "spp")
+            spp = parse_uint(key, value);
+        else if (key == "frames")
+            j.frames = parse_uint(key, value);
+        else if (key == "tile")
+            j.tile = parse_uint(key, value);
+        else if (key == "region")
+        {
+            if (std::sscanf(value.c_str(), "%u,%u,%u,%u", &j.x0, &j.y0, &j.x1, &j.y1) != 4)
+                throw std::runtime_error("bad value '" + value + "' for region");
+            has_region = true;
+        }
+        else if (key == "eye")
+        {
+            eye = parse_float3(key, value);
+            has_eye = true;
+        }
+        else if (key == "lookat")
+        {
+            lookat = parse_float3(key, value);
+            has_lookat = true;
+        }
+        else if (key == "up")
+        {
+            up = parse_float3(key, value);
+            has_up = true;
+        }
+        else if (key == "fov")
+        {
+            fov = static_cast<float>(std::atof(value.c_str()));
+            has_fov = true;
+        }
+        else
+            throw std::runtime_error("unknown job parameter '" + key + "'");
+    }
+
+    const auto it = m_scenes.find(scene_name);
+    if (it == m_scenes.end())
+        throw std::runtime_error("unknown scene '" + scene_name + "'");
+    j.target = &it->second;
+
+    if (!has_region)
+    {
+        j.x0 = j.y0 = 0;
+        j.x1 = j.width;
+        j.y1 = j.height;
+    }
+    if (j.width == 0 || j.height == 0 || j.x0 >= j.x1 || j.y0 >= j.y1 || j.x1 > j.width || j.y1 > j.height)
+        throw std::runtime_error("empty image or region outside the image");
+    if (j.tile == 0 || j.tile > max_tile_size)
+        throw std::runtime_error("tile size must be 1 to " + std::to_string(max_tile_size));
+    j.frames = std::max(j.frames, 1u);
+
+    // Each launch takes a square number of jittered samples; round the
+    // requested count to the nearest one.
+    j.sqrt_num_samples = std::max(1u, static_cast<unsigned int>(std::sqrt(static_cast<float>(spp)) + 0.5f));
+
+    optix::float3 camera_u, camera_v, camera_w;
+    j.eye = has_eye ? eye : j.target->eye;
+    sutil::calculateCameraVariables(
+            j.eye, has_lookat ? lookat : j.target->lookat, has_up ? up : j.target->up,
+            has_fov ? fov : j.target->fov, static_cast<float>(j.width) / static_cast<float>(j.height),
+            camera_u, camera_v, camera_w, /*fov_is_vertical*/ true);
+    j.U = camera_u;
+    j.V = camera_v;
+    j.W = camera_w;
+
+    return j;
+}
+
+bool grpt::render_server::render_tile(job& j)
+{
+    const auto begin = std::chrono::steady_clock::now();
+
+    const unsigned int tiles_x = (j.x1 - j.x0 + j.tile - 1) / j.tile;
+    const unsigned int tiles_y = (j.y1 - j.y0 + j.tile - 1) / j.tile;
+    const unsigned int x = j.x0 + (j.next_tile % tiles_x) * j.tile;
+    const unsigned int y = j.y0 + (j.next_tile / tiles_x) * j.tile;
+    const unsigned int w = std::min(j.tile, j.x1 - x);
+    const unsigned int h = std::min(j.tile, j.y1 - y);
+
+    // One tile sized buffer serves every job; it only grows.
+    optix::Buffer output = m_context["output_buffer"]->getBuffer();
+    if (j.tile > m_tile_capacity)
+    {
+        m_tile_capacity = j.tile;
+        output->setSize(m_tile_capacity, m_tile_capacity);
+    }
+
+    m_context["top_object"      ]->set(j.target->top_object);
+    m_context["eye"             ]->setFloat(j.eye);
+    m_context["U"               ]->setFloat(j.U);
+    m_context["V"               ]->setFloat(j.V);
+    m_context["W"               ]->setFloat(j.W);
+    m_context["sqrt_num_samples"]->setUint(j.sqrt_num_samples);
+    m_context["render_offset"   ]->setUint(x, y);
+    m_context["render_size"     ]->setUint(j.width, j.height);
+
+    // All frames of a tile run back to back, so jobs can interleave between
+    // tiles without disturbing each other's accumulation.
+    for (unsigned int frame = 1; frame <= j.frames; ++frame)
+    {
+        m_context["frame_number"]->setUint(frame);
+        m_context->launch(0, w, h);
+    }
+
+    std::vector<float> pixels(static_cast<size_t>(w) * h * 3);
+    const optix::float4* data = static_cast<const optix::float4*>(output->map(0, RT_BUFFER_MAP_READ));
+    for (unsigned int row = 0; row < h; ++row)
+    {
+        for (unsigned int col = 0; col < w; ++col)
+        {
+            const optix::float4& p = data[static_cast<size_t>(row) * m_tile_capacity + col];
+            float* dst = &pixels[(static_cast<size_t>(row) * w + col) * 3];
+            dst[0] = p.x;
+            dst[1] = p.y;
+            dst[2] = p.z;
+        }
+    }
+    output->unmap();
+
+    j.elapsed_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    send(j.client, "tile " + std::to_string(x) + " " + std::to_string(y) + " " +
+                   std::to_string(w) + " " + std::to_string(h));
+    send(j.client, pixels.data(), pixels.size() * sizeof(float));
+
+    return ++j.next_tile < tiles_x * tiles_y;
+}
+
+void grpt::render_server::drop_client(int client)
+{
+    // Whatever the socket still takes without blocking is delivered, so a
+    // final error message usually reaches the client.
+    if (connection* c = find_client(client))
+    {
+        try
+        {
+            flush(*c);
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(),
+                                [client](const job& j) { return j.client == client; }),
+                 m_jobs.end());
+    m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(),
+                                   [client](const connection& c) { return c.fd == client; }),
+                    m_clients.end());
+    unix_socket::close(client);
+}
@@ -0,0 +1,251 @@
+#include <sd_tree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    grpt::guiding::directional_node empty_node()
+    {
+        grpt::guiding::directional_node n;
+        for (int q = 0; q < 4; ++q)
+        {
+            n.sum[q] = 0.0f;
+            n.child[q] = 0u;
+        }
+        return n;
+    }
+
+    const unsigned int no_source = ~0u;
+}
+
+grpt::guiding::sd_tree::sd_tree(const sd_tree_settings& settings)
+    : m_settings(settings),
+      m_bounds_min(optix::make_float3(0.0f)),
+      m_bounds_extent(optix::make_float3(1.0f)),
+      m_has_bounds(false),
+      m_iterations(0)
+{
+    spatial_node root;
+    root.axis = leaf_axis;
+    root.index = 0;
+    m_nodes.push_back(root);
+
+    leaf l;
+    l.sampling.push_back(empty_node());
+    l.building.push_back(empty_node());
+    l.samples = 0.0f;
+    m_leaves.push_back(l);
+}
+
+void grpt::guiding::sd_tree::add_records(const optix::float4* records, size_t count)
+{
+    if (!m_has_bounds)
+    {
+        optix::float3 lo = optix::make_float3(std::numeric_limits<float>::max());
+        optix::float3 hi = optix::make_float3(-std::numeric_limits<float>::max());
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (records[2 * i + 1].w <= 0.0f)
+                continue;
+            const optix::float3 p = optix::make_float3(records[2 * i]);
+            lo = optix::fminf(lo, p);
+            hi = optix::fmaxf(hi, p);
+        }
+        if (lo.x > hi.x)
+            return;
+
+        // Leave some room for vertices the first batch did not reach.
+        const optix::float3 margin = (hi - lo) * 0.01f + optix::make_float3(1e-3f);
+        m_bounds_min = lo - margin;
+        m_bounds_extent = hi - lo + 2.0f * margin;
+        m_has_bounds = true;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const optix::float4& position = records[2 * i];
+        const optix::float4& direction = records[2 * i + 1];
+        if (direction.w > 0.0f)
+            add_sample(optix::make_float3(position), optix::make_float3(direction), position.w);
+    }
+}
+
+void grpt::guiding::sd_tree::add_sample(const optix::float3& position, const optix::float3& direction, float radiance)
+{
+    const optix::float3 p = optix::clamp((position - m_bounds_min) / m_bounds_extent, 0.0f, 0.99999994f);
+    leaf& l = m_leaves[find_quadtree(m_nodes, p)];
+    l.samples += 1.0f;
+
+    if (!(radiance > 0.0f) || !std::isfinite(radiance))
+        return;
+
+    optix::float2 d = direction_to_square(direction);
+    unsigned int i = 0;
+    for (;;)
+    {
+        directional_node& n = l.building[i];
+        const unsigned int qx = d.x >= 0.5f ? 1u : 0u;
+        const unsigned int qy = d.y >= 0.5f ? 1u : 0u;
+        const unsigned int q = qx + 2u * qy;
+        n.sum[q] += radiance;
+        if (n.child[q] == 0u)
+            break;
+        d = d * 2.0f - optix::make_float2(static_cast<float>(qx), static_cast<float>(qy));
+        i = n.child[q];
+    }
+}
+
+void grpt::guiding::sd_tree::end_iteration()
+{
+    // The spatial threshold grows with the square root of the samples an
+    // iteration takes, which doubles from one iteration to the next.
+    const float threshold = m_settings.spatial_threshold * std::sqrt(std::pow(2.0f, static_cast<float>(m_iterations)));
+    const size_t used = byte_size();
+    size_t budget = m_settings.max_bytes > used ? m_settings.max_bytes - used : 0;
+
+    split_leaves(0, 0, threshold, budget);
+
+    for (leaf& l : m_leaves)
+    {
+        if (l.samples > 0.0f)
+            refine_quadtree(l, budget);
+        l.samples = 0.0f;
+    }
+
+    ++m_iterations;
+}
+
+void grpt::guiding::sd_tree::split_leaves(unsigned int node, unsigned int depth, float threshold, size_t& budget)
+{
+    if (m_nodes[node].axis != leaf_axis)
+    {
+        const unsigned int first = m_nodes[node].index;
+        split_leaves(first, depth + 1, threshold, budget);
+        split_leaves(first + 1, depth + 1, threshold, budget);
+        return;
+    }
+
+    const unsigned int index = m_nodes[node].index;
+    const size_t cost = 2 * sizeof(spatial_node) + m_leaves[index].sampling.size() * sizeof(directional_node);
+    if (m_leaves[index].samples <= threshold || cost > budget)
+        return;
+    budget -= cost;
+
+    // Both halves start from the parent's statistics; only the sample count
+    // is shared between them.
+    m_leaves[index].samples *= 0.5f;
+    m_leaves.push_back(m_leaves[index]);
+
+    const unsigned int first = static_cast<unsigned int>(m_nodes.size());
+    spatial_node child;
+    child.axis = leaf_axis;
+    child.index = index;
+    m_nodes.push_back(child);
+    child.index = static_cast<unsigned int>(m_leaves.size() - 1);
+    m_nodes.push_back(child);
+
+    m_nodes[node].axis = depth % 3;
+    m_nodes[node].index = first;
+
+    split_leaves(node, depth, threshold, budget);
+}
+
+void grpt::guiding::sd_tree::refine_quadtree(leaf& l, size_t& budget) const
+{
+    const std::vector<directional_node>& flux = l.building;
+    budget += l.sampling.size() * sizeof(directional_node);
+
+    const float total_flux = total(flux[0]);
+    std::vector<directional_node> refined(1, flux[0]);
+    for (int q = 0; q < 4; ++q)
+        refined[0].child[q] = 0u;
+    budget -= std::min(budget, sizeof(directional_node));
+
+    if (total_flux > 0.0f)
+    {
+        // Quadrants holding more than the threshold fraction of the flux are
+        // subdivided, one level deeper than before at most; the others
+        // collapse.  New quadrants split their parent's flux evenly.
+        struct entry
+        {
+            unsigned int source;   // node of 'flux' covering the same region, if any
+            unsigned int target;
+            unsigned int depth;
+        };
+        std::vector<entry> stack(1, entry{ 0u, 0u, 1u });
+
+        while (!stack.empty())
+        {
+            const entry e = stack.back();
+            stack.pop_back();
+
+            for (unsigned int q = 0; q < 4; ++q)
+            {
+                const float sum = refined[e.target].sum[q];
+                if (sum / total_flux <= m_settings.flux_threshold || e.depth >= m_settings.max_depth ||
+                    budget < sizeof(directional_node))
+                    continue;
+                budget -= sizeof(directional_node);
+
+                const unsigned int source = e.source != no_source && flux[e.source].child[q] != 0u ?
+                                            flux[e.source].child[q] : no_source;
+                directional_node child = empty_node();
+                for (int c = 0; c < 4; ++c)
+                    child.sum[c] = source != no_source ? flux[source].sum[c] : sum * 0.25f;
+
+                const unsigned int target = static_cast<unsigned int>(refined.size());
+                refined.push_back(child);
+                refined[e.target].child[q] = target;
+                if (source != no_source)
+                    stack.push_back(entry{ source, target, e.depth + 1 });
+            }
+        }
+    }
+
+    l.sampling = refined;
+    l.building = refined;
+    for (directional_node& n : l.building)
+        for (int q = 0; q < 4; ++q)
+            n.sum[q] = 0.0f;
+}
+
+void grpt::guiding::sd_tree::flatten(std::vector<spatial_node>& spatial, std::vector<directional_node>& directional) const
+{
+    std::vector<unsigned int> roots(m_leaves.size());
+    directional.clear();
+    for (size_t i = 0; i < m_leaves.size(); ++i)
+    {
+        const unsigned int offset = static_cast<unsigned int>(directional.size());
+        roots[i] = offset;
+        for (directional_node n : m_leaves[i].sampling)
+        {
+            for (int q = 0; q < 4; ++q)
+                if (n.child[q] != 0u)
+                    n.child[q] += offset;
+            directional.push_back(n);
+        }
+    }
+
+    spatial = m_nodes;
+    for (spatial_node& n : spatial)
+        if (n.axis == leaf_axis)
+            n.index = roots[n.index];
+}
+
+size_t grpt::guiding::sd_tree::node_count() const
+{
+    size_t count = m_nodes.size();
+    for (const leaf& l : m_leaves)
+        count += l.sampling.size();
+    return count;
+}
+
+size_t grpt::guiding::sd_tree::byte_size() const
+{
+    size_t bytes = m_nodes.size() * sizeof(spatial_node);
+    for (const leaf& l : m_leaves)
+        bytes += l.sampling.size() * sizeof(directional_node);
+    return bytes;
+}
@@ -5,6 +5,8 @@
 #include <optixu/optixu_math_namespace.h>
 #include "../../optixPathTracer.h"
 #include "../../include/point_light.hpp"
+#include "../../include/guiding.hpp"
+#include "../../include/stats.hpp"
 #include "random.h"
 
 struct PerRayData_pathtrace_shadow
@@ -12,19 +14,6 @@ struct PerRayData_pathtrace_shadow
     bool inShadow;
 };
 
-struct PerRayData_pathtrace
-{
-    float3 result;
-    float3 radiance;
-    float3 attenuation;
-    float3 origin;
-    float3 direction;
-    unsigned int seed;
-    int depth;
-    int countEmitted;
-    int done;
-};
-
 //-----------------------------------------------------------------------------
 //
 //  Lambertian surface closest-hit
@@ -45,11 +34,23 @@ rtDeclareVariable(unsigned int,  pathtrace_shadow_ray_type, , );
 rtDeclareVariable(float,         scene_epsilon, , );
 rtDeclareVariable(rtObject,      top_object, , );
 
+rtDeclareVariable(unsigned int,  aov_mask, , );
+rtDeclareVariable(unsigned int,  restir_enabled, , );
+rtDeclareVariable(unsigned int,  object_id, , );
+rtDeclareVariable(unsigned int,  material_id, , );
+
 rtDeclareVariable(PerRayData_pathtrace, current_prd, rtPayload, );
 
 rtBuffer<ParallelogramLight>     lights;
 rtBuffer<grpt::point_light>      point_lights;
 
+rtDeclareVariable(unsigned int,  guiding_enabled, , );
+rtDeclareVariable(float,         guiding_fraction, , );
+rtDeclareVariable(float3,        guiding_bounds_min, , );
+rtDeclareVariable(float3,        guiding_bounds_extent, , );
+rtBuffer<grpt::guiding::spatial_node>     guiding_spatial_nodes;
+rtBuffer<grpt::guiding::directional_node> guiding_directional_nodes;
+
 RT_PROGRAM void diffuse()
 {
     float3 world_shading_normal   = optix::normalize( rtTransformNormal( RT_OBJECT_TO_WORLD, shading_normal ) );
@@ -58,28 +59,80 @@ RT_PROGRAM void diffuse()
 
     float3 hitpoint = ray.origin + t_hit * ray.direction;
 
+    // ReSTIR reads the primary hit from the AOV fields.
+    if( ( aov_mask || restir_enabled ) && current_prd.depth == 0 )
+    {
+        current_prd.aov_albedo      = diffuse_color;
+        current_prd.aov_normal      = ffnormal;
+        current_prd.aov_depth       = t_hit;
+        current_prd.aov_object_id   = object_id;
+        current_prd.aov_material_id = material_id;
+    }
+
     //
     // Generate a reflection ray.  This will be traced back in ray-gen.
     //
     current_prd.origin = hitpoint;
 
+    // With a trained SD-tree, the direction comes from the learnt incident
+    // radiance with probability guiding_fraction and from the cosine
+    // otherwise; the sample is weighted by the density of the mixture.
+    unsigned int guide_root = 0;
+    float guide_fraction = 0.0f;
+    if( guiding_enabled )
+    {
+        const float3 q = optix::clamp( ( hitpoint - guiding_bounds_min ) / guiding_bounds_extent, 0.0f, 0.99999994f );
+        guide_root = grpt::guiding::find_quadtree( guiding_spatial_nodes, q );
+        if( grpt::guiding::total( guiding_directional_nodes[guide_root] ) > 0.0f )
+            guide_fraction = guiding_fraction;
+    }
+
     float z1=rnd(current_prd.seed);
     float z2=rnd(current_prd.seed);
     float3 p;
-    optix::cosine_sample_hemisphere(z1, z2, p);
-    optix::Onb onb( ffnormal );
-    onb.inverse_transform( p );
+    if( guide_fraction > 0.0f && rnd(current_prd.seed) < guide_fraction )
+    {
+        float guide_pdf;
+        p = grpt::guiding::square_to_direction(
+                grpt::guiding::sample( guiding_directional_nodes, guide_root, make_float2( z1, z2 ), guide_pdf ) );
+    }
+    else
+    {
+        optix::cosine_sample_hemisphere(z1, z2, p);
+        optix::Onb onb( ffnormal );
+        onb.inverse_transform( p );
+    }
     current_prd.direction = p;
+    current_prd.countEmitted = false;
 
-    // NOTE: f/pdf = 1 since we are perfectly importance sampling lambertian
-    // with cosine density.
+    // NOTE: f/pdf = 1 without guiding since we are perfectly importance
+    // sampling lambertian with cosine density.
+    float sample_weight = 1.0f;
+    if( guide_fraction > 0.0f )
+    {
+        const float cosine_pdf = fmaxf( optix::dot( p, ffnormal ), 0.0f ) * M_1_PIf;
+        const float guide_pdf  = grpt::guiding::pdf( guiding_directional_nodes, guide_root,
+                                                     grpt::guiding::direction_to_square( p ) ) * ( 0.25f * M_1_PIf );
+        current_prd.direction_pdf = guide_fraction * guide_pdf + ( 1.0f - guide_fraction ) * cosine_pdf;
+        sample_weight = cosine_pdf / current_prd.direction_pdf;
+    }
+    else
+    {
+        current_prd.direction_pdf = optix::dot( p, ffnormal ) * M_1_PIf;
+    }
     current_prd.attenuation = current_prd.attenuation * diffuse_color;
-    current_prd.countEmitted = false;
+
+    // A guided direction below the surface ends the path, which keeps the
+    // direct lighting of this vertex.
+    if( sample_weight <= 0.0f )
+        current_prd.done = true;
 
     //
-    // Next event estimation (compute direct lighting).
+    // Next event estimation (compute direct lighting).  With ReSTIR, the
+    // area light direct lighting of primary hits is resolved after the
+    // launch instead.
     //
-    unsigned int num_lights = lights.size();
+    unsigned int num_lights = restir_enabled && current_prd.depth == 0 ? 0 : lights.size();
     float3 result = make_float3(0.0f);
 
     for(int i = 0; i < num_lights; ++i)
@@ -104,6 +157,7 @@ RT_PROGRAM void diffuse()
             // Note: bias both ends of the shadow ray, in case the light is also present as geometry in the scene.
             optix::Ray shadow_ray = optix::make_Ray( hitpoint, L, pathtrace_shadow_ray_type, scene_epsilon, Ldist - scene_epsilon );
             rtTrace(top_object, shadow_ray, shadow_prd);
+            GRPT_STATS(++pixel_stats().shadow_rays;)
 
             if(!shadow_prd.inShadow)
             {
@@ -134,6 +188,7 @@ RT_PROGRAM void diffuse()
             // Note: bias both ends of the shadow ray, in case the light is also present as geometry in the scene.
             optix::Ray shadow_ray = optix::make_Ray( hitpoint, L, pathtrace_shadow_ray_type, scene_epsilon, Ldist - scene_epsilon );
             rtTrace(top_object, shadow_ray, shadow_prd);
+            GRPT_STATS(++pixel_stats().shadow_rays;)
 
             if(!shadow_prd.inShadow)
             {
@@ -147,6 +202,13 @@ RT_PROGRAM void diffuse()
         }
     }
 
+    // The ray-gen weights the direct lighting by the attenuation, which now
+    // carries the guided sample's weight as well.
+    if( sample_weight > 0.0f )
+    {
+        current_prd.attenuation = current_prd.attenuation * sample_weight;
+        result = result / sample_weight;
+    }
     current_prd.radiance = result;
 }
 
@@ -171,5 +233,16 @@ RT_PROGRAM void diffuseEmitter()
 {
     current_prd.radiance = current_prd.countEmitted ? emission_color : make_float3(0.f);
     current_prd.done = true;
+    current_prd.emitter = true;
+
+    if( ( aov_mask || restir_enabled ) && current_prd.depth == 0 )
+    {
+        const float3 world_shading_normal = optix::normalize( rtTransformNormal( RT_OBJECT_TO_WORLD, shading_normal ) );
+        current_prd.aov_albedo      = optix::fminf( emission_color, make_float3( 1.0f ) );
+        current_prd.aov_normal      = optix::faceforward( world_shading_normal, -ray.direction, world_shading_normal );
+        current_prd.aov_depth       = t_hit;
+        current_prd.aov_object_id   = object_id;
+        current_prd.aov_material_id = material_id;
+    }
 }
 
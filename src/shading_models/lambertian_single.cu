@@ -5,6 +5,7 @@
 #include <optixu/optixu_math_namespace.h>
 #include "../../optixPathTracer.h"
 #include "../../include/point_light.hpp"
+#include "../../include/stats.hpp"
 #include "random.h"
 
 struct PerRayData_pathtrace_shadow
@@ -12,19 +13,6 @@ struct PerRayData_pathtrace_shadow
     bool inShadow;
 };
 
-struct PerRayData_pathtrace
-{
-    float3 result;
-    float3 radiance;
-    float3 attenuation;
-    float3 origin;
-    float3 direction;
-    unsigned int seed;
-    int depth;
-    int countEmitted;
-    int done;
-};
-
 //-----------------------------------------------------------------------------
 //
 //  Lambertian surface closest-hit
@@ -100,6 +88,7 @@ RT_PROGRAM void diffuse()
             // Note: bias both ends of the shadow ray, in case the light is also present as geometry in the scene.
             optix::Ray shadow_ray = optix::make_Ray( hitpoint, L, pathtrace_shadow_ray_type, scene_epsilon, Ldist - scene_epsilon );
             rtTrace(top_object, shadow_ray, shadow_prd);
+            GRPT_STATS(++pixel_stats().shadow_rays;)
 
             if(!shadow_prd.inShadow)
             {
@@ -136,5 +125,6 @@ RT_PROGRAM void diffuseEmitter()
 {
     current_prd.radiance = current_prd.countEmitted ? emission_color : make_float3(0.f);
     current_prd.done = true;
+    current_prd.emitter = true;
 }
 
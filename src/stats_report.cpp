@@ -0,0 +1,98 @@
+#include <stats_report.hpp>
+#include <image_io.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    double ratio(unsigned long long a, unsigned long long b)
+    {
+        return b ? static_cast<double>(a) / b : 0.0;
+    }
+
+    template <class Value>
+    void write_heatmap(const std::string& path, const grpt::stats::pixel_counters* counters, unsigned int width,
+                       unsigned int height, Value value)
+    {
+        grpt::image_io::image img;
+        img.width = width;
+        img.height = height;
+        img.channels = 1;
+        img.pixels.resize(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < img.pixels.size(); ++i)
+            img.pixels[i] = static_cast<float>(value(counters[i]));
+        grpt::image_io::write_pfm(path, img);
+    }
+}
+
+grpt::stats::summary grpt::stats::summarize(const pixel_counters* counters, unsigned int width, unsigned int height)
+{
+    summary s;
+    s.width = width;
+    s.height = height;
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
+    {
+        const pixel_counters& c = counters[i];
+        s.cycles            += c.cycles;
+        s.max_pixel_cycles   = std::max(s.max_pixel_cycles, c.cycles);
+        s.paths             += c.paths;
+        s.radiance_rays     += c.radiance_rays;
+        s.shadow_rays       += c.shadow_rays;
+        s.primitives_tested += c.primitives_tested;
+        s.roulette_kills    += c.roulette_kills;
+        for (int b = 0; b < depth_bins; ++b)
+            s.depth[b] += c.depth[b];
+    }
+    return s;
+}
+
+void grpt::stats::write_json(const std::string& path, const summary& s, double render_ms)
+{
+    std::ofstream out(path.c_str());
+    if (!out)
+        throw std::runtime_error("write_json( '" + path + "' ) failed to open file");
+
+    const unsigned long long pixels = static_cast<unsigned long long>(s.width) * s.height;
+    const unsigned long long rays = s.radiance_rays + s.shadow_rays;
+    out << "{\n"
+        << "  \"width\": " << s.width << ",\n"
+        << "  \"height\": " << s.height << ",\n"
+        << "  \"render_ms\": " << render_ms << ",\n"
+        << "  \"paths\": " << s.paths << ",\n"
+        << "  \"radiance_rays\": " << s.radiance_rays << ",\n"
+        << "  \"shadow_rays\": " << s.shadow_rays << ",\n"
+        << "  \"primitives_tested\": " << s.primitives_tested << ",\n"
+        << "  \"roulette_kills\": " << s.roulette_kills << ",\n"
+        << "  \"cycles\": " << s.cycles << ",\n"
+        << "  \"rays_per_path\": " << ratio(rays, s.paths) << ",\n"
+        << "  \"primitives_per_ray\": " << ratio(s.primitives_tested, rays) << ",\n"
+        << "  \"roulette_kill_fraction\": " << ratio(s.roulette_kills, s.paths) << ",\n"
+        << "  \"mean_pixel_cycles\": " << ratio(s.cycles, pixels) << ",\n"
+        << "  \"max_pixel_cycles\": " << s.max_pixel_cycles << ",\n"
+        << "  \"depth_histogram\": [";
+    for (int b = 0; b < depth_bins; ++b)
+        out << (b ? ", " : "") << s.depth[b];
+    out << "]\n}\n";
+
+    if (!out)
+        throw std::runtime_error("write_json( '" + path + "' ) failed to write file");
+}
+
+void grpt::stats::write_heatmaps(const std::string& prefix, const pixel_counters* counters, unsigned int width,
+                                 unsigned int height)
+{
+    write_heatmap(prefix + "_cycles.pfm", counters, width, height,
+                  [](const pixel_counters& c) { return static_cast<double>(c.cycles); });
+    write_heatmap(prefix + "_rays.pfm", counters, width, height,
+                  [](const pixel_counters& c) { return static_cast<double>(c.radiance_rays + c.shadow_rays); });
+    write_heatmap(prefix + "_primitives.pfm", counters, width, height,
+                  [](const pixel_counters& c) { return ratio(c.primitives_tested, c.radiance_rays + c.shadow_rays); });
+    write_heatmap(prefix + "_depth.pfm", counters, width, height, [](const pixel_counters& c) {
+        unsigned long long bounces = 0;
+        for (int b = 0; b < depth_bins; ++b)
+            bounces += static_cast<unsigned long long>(b) * c.depth[b];
+        return ratio(bounces, c.paths);
+    });
+}
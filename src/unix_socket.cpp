@@ -0,0 +1,264 @@
+#include <unix_socket.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+
+#if !defined(_WIN32)
+
+namespace
+{
+    std::runtime_error socket_error(const std::string& what)
+    {
+        return std::runtime_error("unix_socket: " + what + " failed: " + std::strerror(errno));
+    }
+
+    sockaddr_un make_address(const std::string& path)
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("unix_socket: path '" + path + "' is too long");
+        std::strcpy(address.sun_path, path.c_str());
+        return address;
+    }
+}
+
+int grpt::unix_socket::listen(const std::string& path, int backlog)
+{
+    const sockaddr_un address = make_address(path);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw socket_error("socket");
+
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(fd, backlog) != 0)
+    {
+        const std::runtime_error error = socket_error("listen on '" + path + "'");
+        ::close(fd);
+        throw error;
+    }
+    return fd;
+}
+
+int grpt::unix_socket::accept(int listen_fd)
+{
+    int fd;
+    do
+    {
+        fd = ::accept(listen_fd, nullptr, nullptr);
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd < 0)
+        throw socket_error("accept");
+    return fd;
+}
+
+int grpt::unix_socket::connect(const std::string& path)
+{
+    const sockaddr_un address = make_address(path);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw socket_error("socket");
+
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        const std::runtime_error error = socket_error("connect to '" + path + "'");
+        ::close(fd);
+        throw error;
+    }
+    return fd;
+}
+
+void grpt::unix_socket::close(int fd)
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool grpt::unix_socket::wait_readable(int fd, int timeout_ms)
+{
+    pollfd p;
+    p.fd = fd;
+    p.events = POLLIN;
+    p.revents = 0;
+    const int n = ::poll(&p, 1, timeout_ms);
+    if (n < 0 && errno != EINTR)
+        throw socket_error("poll");
+    return n > 0;
+}
+
+void grpt::unix_socket::send_line(int fd, const std::string& line)
+{
+    const std::string message = line + '\n';
+    send_bytes(fd, message.data(), message.size());
+}
+
+void grpt::unix_socket::send_bytes(int fd, const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    size_t sent = 0;
+    while (sent < size)
+    {
+        const ssize_t n = ::send(fd, bytes + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw socket_error("send");
+        sent += static_cast<size_t>(n);
+    }
+}
+
+bool grpt::unix_socket::recv_bytes(int fd, void* data, size_t size)
+{
+    char* bytes = static_cast<char*>(data);
+    size_t received = 0;
+    while (received < size)
+    {
+        const ssize_t n = ::recv(fd, bytes + received, size - received, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw socket_error("recv");
+        if (n == 0)
+            return false;
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool grpt::unix_socket::recv_line(int fd, std::string& line)
+{
+    // Byte at a time: messages are a few dozen bytes and a line never
+    // straddles into data meant for someone else.
+    line.clear();
+    for (;;)
+    {
+        char c;
+        const ssize_t n = ::recv(fd, &c, 1, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw socket_error("recv");
+        if (n == 0)
+            return false;
+        if (c == '\n')
+            return true;
+        line += c;
+    }
+}
+
+void grpt::unix_socket::set_nonblocking(int fd)
+{
+    const int flags = ::fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+        throw socket_error("fcntl");
+}
+
+bool grpt::unix_socket::recv_some(int fd, std::string& buffer, size_t max_size)
+{
+    char bytes[4096];
+    ssize_t n;
+    do
+    {
+        n = ::recv(fd, bytes, std::min(max_size, sizeof(bytes)), 0);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return true;
+    if (n < 0)
+        throw socket_error("recv");
+    if (n == 0)
+        return false;
+    buffer.append(bytes, static_cast<size_t>(n));
+    return true;
+}
+
+size_t grpt::unix_socket::send_some(int fd, const void* data, size_t size)
+{
+    ssize_t n;
+    do
+    {
+        n = ::send(fd, data, size, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    if (n < 0)
+        throw socket_error("send");
+    return static_cast<size_t>(n);
+}
+
+#else
+
+int grpt::unix_socket::listen(const std::string&, int)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+int grpt::unix_socket::accept(int)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+int grpt::unix_socket::connect(const std::string&)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+void grpt::unix_socket::close(int)
+{
+}
+
+bool grpt::unix_socket::wait_readable(int, int)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+void grpt::unix_socket::send_line(int, const std::string&)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+bool grpt::unix_socket::recv_line(int, std::string&)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+void grpt::unix_socket::send_bytes(int, const void*, size_t)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+bool grpt::unix_socket::recv_bytes(int, void*, size_t)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+void grpt::unix_socket::set_nonblocking(int)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+bool grpt::unix_socket::recv_some(int, std::string&, size_t)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+size_t grpt::unix_socket::send_some(int, const void*, size_t)
+{
+    throw std::runtime_error("unix_socket: not supported on this platform");
+}
+
+#endif
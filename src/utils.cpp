@@ -144,6 +144,40 @@ void grpt::utils::printUsageAndExit( const std::string& argv0, const std::string
               "  -h | --help               Print this usage message and exit.\n"
               "  -f | --file               Save single frame to file and exit.\n"
               "  -n | --nopbo              Disable GL interop for display buffer.\n"
+              "  -p | --progressive        Render interactively.\n"
+              "  -a | --aov <list>         Also write first hit AOVs as PFM images; a comma separated\n"
+              "                            list of albedo, normal, depth, id, count, or all.\n"
+              "  -d | --denoise            Denoise the frame on the CPU, guided by the albedo, normal\n"
+              "                            and depth AOVs.\n"
+              "  --frames <n>              Accumulate n launches of the sample count per pixel.\n"
+              "  --checkpoint <file>       Save the accumulation to file periodically and at the end.\n"
+              "  --checkpoint-interval <s> Seconds between checkpoints (default 60).\n"
+              "  --resume <file>           Continue the render saved in a checkpoint.\n"
+              "  --crop <x0,y0,x1,y1>      Only render this window of the image; outputs cover the window.\n"
+              "  --bucket <n>              Render n x n buckets one after another, streaming them into\n"
+              "                            a PFM (--file, default ../output<samples>.pfm).\n"
+              "  --time-budget <s>         Render as many frames as fit in s seconds instead of --frames;\n"
+              "                            the frame count is estimated from a one sample pilot pass.\n"
+              "  --restir                  Resample the area light direct lighting of primary hits from\n"
+              "                            light candidates reused across neighbours and frames (biased).\n"
+              "  --restir-unbiased         As --restir, tracing visibility to the neighbours reused.\n"
+              "  --ears                    Pick Russian roulette and splitting factors per path vertex\n"
+              "                            from learnt radiance and cost statistics, and report the\n"
+              "                            segments traced.  Not with checkpoints.\n"
+              "  --stats <prefix>          Write integrator statistics to <prefix>_stats.json and per pixel\n"
+              "                            heatmaps to <prefix>_{cycles,rays,primitives,depth}.pfm.  Needs a\n"
+              "                            build configured with -DGRPT_ENABLE_STATS=ON.\n"
+              "  --rr-stats                Report the segments traced and paths killed by roulette.\n"
+              "  --guide                   Guide diffuse bounces with an SD-tree learnt over training\n"
+              "                            iterations of doubling length; needs --frames.\n"
+              "  --target-fps <fps>        Frame rate interactive frames aim for while the camera moves,\n"
+              "                            by lowering their resolution (default 30, 0 disables).\n"
+              "  --reproject               Carry the accumulated image over into the new view after a\n"
+              "                            camera move instead of restarting, rejecting disocclusions.\n"
+              "  --preview-benchmark <n>   Run n interactive frames headlessly, orbiting the camera for\n"
+              "                            the first half, and report frame times.\n"
+              "  --server <socket>         Keep the scene loaded and render jobs sent to a Unix socket\n"
+              "                            by clients such as render_client.\n"
               "App Keystrokes:\n"
               "  q  Quit\n"
               "  s  Save image to '" << sample_name << ".ppm'\n"
@@ -0,0 +1,477 @@
+#include "BinaryPLY.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#  include <fstream>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define BINARY_PLY_SSE2 1
+#endif
+
+namespace
+{
+
+//-----------------------------------------------------------------------------
+//
+// Read only view of a whole file
+//
+//-----------------------------------------------------------------------------
+
+class MappedFile
+{
+public:
+  explicit MappedFile( const std::string& filename )
+    : m_data( 0 ), m_size( 0 )
+  {
+#if defined(_WIN32)
+    std::ifstream in( filename.c_str(), std::ios::in | std::ios::binary );
+    if( !in )
+      throw std::runtime_error( "loadBinaryPLY: Unable to open '" + filename + "'" );
+    in.seekg( 0, std::ios::end );
+    m_buffer.resize( static_cast<size_t>( in.tellg() ) );
+    in.seekg( 0, std::ios::beg );
+    in.read( reinterpret_cast<char*>( m_buffer.data() ), m_buffer.size() );
+    if( !in )
+      throw std::runtime_error( "loadBinaryPLY: Unable to read '" + filename + "'" );
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#else
+    const int fd = open( filename.c_str(), O_RDONLY );
+    if( fd < 0 )
+      throw std::runtime_error( "loadBinaryPLY: Unable to open '" + filename + "'" );
+    struct stat st;
+    if( fstat( fd, &st ) != 0 )
+    {
+      close( fd );
+      throw std::runtime_error( "loadBinaryPLY: Unable to stat '" + filename + "'" );
+    }
+    m_size = static_cast<size_t>( st.st_size );
+    if( m_size > 0 )
+    {
+      void* p = mmap( 0, m_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if( p == MAP_FAILED )
+      {
+        close( fd );
+        throw std::runtime_error( "loadBinaryPLY: Unable to map '" + filename + "'" );
+      }
+      // The chunks are read in parallel, so ask for everything up front.
+      madvise( p, m_size, MADV_WILLNEED );
+      m_data = static_cast<const unsigned char*>( p );
+    }
+    close( fd );
+#endif
+  }
+
+  ~MappedFile()
+  {
+#if !defined(_WIN32)
+    if( m_data )
+      munmap( const_cast<unsigned char*>( m_data ), m_size );
+#endif
+  }
+
+  const unsigned char* data() const { return m_data; }
+  size_t               size() const { return m_size; }
+
+private:
+  MappedFile( const MappedFile& );
+  MappedFile& operator=( const MappedFile& );
+
+  const unsigned char*       m_data;
+  size_t                     m_size;
+#if defined(_WIN32)
+  std::vector<unsigned char> m_buffer;
+#endif
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// Header
+//
+//-----------------------------------------------------------------------------
+
+struct PlyProperty
+{
+  std::string name;
+  size_t      size;           // bytes of a scalar, or of a list's entries
+  size_t      count_size;     // bytes of a list's count; 0 for scalars
+  bool        is_float;
+};
+
+struct PlyElement
+{
+  std::string              name;
+  size_t                   count;
+  std::vector<PlyProperty> properties;
+
+  // Bytes per record, or 0 if a list makes records variable in size.
+  size_t stride() const
+  {
+    size_t s = 0;
+    for( size_t i = 0; i < properties.size(); ++i )
+    {
+      if( properties[i].count_size )
+        return 0;
+      s += properties[i].size;
+    }
+    return s;
+  }
+
+  // Offset of scalar property 'name' in a record, or -1.
+  long offset( const std::string& name, bool& is_float, size_t& size ) const
+  {
+    size_t o = 0;
+    for( size_t i = 0; i < properties.size(); ++i )
+    {
+      if( properties[i].name == name && !properties[i].count_size )
+      {
+        is_float = properties[i].is_float;
+        size = properties[i].size;
+        return static_cast<long>( o );
+      }
+      o += properties[i].size;
+    }
+    return -1;
+  }
+};
+
+
+bool scalarType( const std::string& type, size_t& size, bool& is_float )
+{
+  is_float = false;
+  if( type == "char" || type == "int8" || type == "uchar" || type == "uint8" )
+    size = 1;
+  else if( type == "short" || type == "int16" || type == "ushort" || type == "uint16" )
+    size = 2;
+  else if( type == "int" || type == "int32" || type == "uint" || type == "uint32" )
+    size = 4;
+  else if( type == "float" || type == "float32" )
+  {
+    size = 4;
+    is_float = true;
+  }
+  else if( type == "double" || type == "float64" )
+  {
+    size = 8;
+    is_float = true;
+  }
+  else
+    return false;
+  return true;
+}
+
+
+// Parses the header; returns false for ASCII files and unknown syntax.
+bool parseHeader( const unsigned char* data, size_t size, bool& big_endian,
+                  std::vector<PlyElement>& elements, size_t& data_offset )
+{
+  static const char end_marker[] = "end_header";
+  const unsigned char* end = std::search( data, data + size, end_marker, end_marker + sizeof( end_marker ) - 1 );
+  if( end == data + size )
+    return false;
+  const unsigned char* body = end + sizeof( end_marker ) - 1;
+  if( body < data + size && *body == '\r' )
+    ++body;
+  if( body >= data + size || *body != '\n' )
+    return false;
+  data_offset = static_cast<size_t>( body + 1 - data );
+
+  std::istringstream header( std::string( reinterpret_cast<const char*>( data ), end - data ) );
+  std::string line;
+  bool have_format = false;
+  while( std::getline( header, line ) )
+  {
+    std::istringstream in( line );
+    std::string keyword;
+    in >> keyword;
+    if( keyword == "format" )
+    {
+      std::string format;
+      in >> format;
+      if( format == "binary_little_endian" )
+        big_endian = false;
+      else if( format == "binary_big_endian" )
+        big_endian = true;
+      else
+        return false;
+      have_format = true;
+    }
+    else if( keyword == "element" )
+    {
+      PlyElement e;
+      in >> e.name >> e.count;
+      if( !in )
+        return false;
+      elements.push_back( e );
+    }
+    else if( keyword == "property" )
+    {
+      if( elements.empty() )
+        return false;
+      PlyProperty p;
+      std::string type;
+      in >> type;
+      if( type == "list" )
+      {
+        std::string count_type, entry_type;
+        in >> count_type >> entry_type;
+        bool count_float = false;
+        if( !scalarType( count_type, p.count_size, count_float ) || count_float ||
+            !scalarType( entry_type, p.size, p.is_float ) )
+          return false;
+      }
+      else
+      {
+        p.count_size = 0;
+        if( !scalarType( type, p.size, p.is_float ) )
+          return false;
+      }
+      in >> p.name;
+      if( !in )
+        return false;
+      elements.back().properties.push_back( p );
+    }
+    else if( keyword != "ply" && keyword != "comment" && keyword != "obj_info" && !keyword.empty() )
+    {
+      return false;
+    }
+  }
+  return have_format;
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// Decoding
+//
+//-----------------------------------------------------------------------------
+
+bool hostIsBigEndian()
+{
+  const uint32_t one = 1;
+  unsigned char first;
+  memcpy( &first, &one, 1 );
+  return first == 0;
+}
+
+
+inline uint32_t byteSwap( uint32_t v )
+{
+  return ( v >> 24 ) | ( ( v >> 8 ) & 0xff00u ) | ( ( v << 8 ) & 0xff0000u ) | ( v << 24 );
+}
+
+
+void byteSwap32( void* values, size_t count )
+{
+  uint32_t* v = static_cast<uint32_t*>( values );
+  size_t i = 0;
+#if defined(BINARY_PLY_SSE2)
+  for( ; i + 4 <= count; i += 4 )
+  {
+    __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( v + i ) );
+    x = _mm_or_si128( _mm_slli_epi16( x, 8 ), _mm_srli_epi16( x, 8 ) );     // bytes within halves
+    x = _mm_shufflehi_epi16( _mm_shufflelo_epi16( x, 0xB1 ), 0xB1 );        // halves within words
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( v + i ), x );
+  }
+#endif
+  for( ; i < count; ++i )
+    v[i] = byteSwap( v[i] );
+}
+
+
+uint32_t readCount( const unsigned char* p, size_t size, bool swap )
+{
+  if( size == 1 )
+    return *p;
+  if( size == 2 )
+  {
+    uint16_t c;
+    memcpy( &c, p, 2 );
+    return swap ? static_cast<uint16_t>( ( c >> 8 ) | ( c << 8 ) ) : c;
+  }
+  uint32_t c;
+  memcpy( &c, p, 4 );
+  return swap ? byteSwap( c ) : c;
+}
+
+
+const size_t chunk_size = 1u << 16;   // records per parallelFor chunk
+
+
+// Copies the three floats at 'offsets' of each record into 'out', and
+// returns their bounding box when 'bbox' is given.
+void decodeFloat3( const unsigned char* records, size_t stride, const long offsets[3], size_t count, bool swap,
+                   float* out, float* bbox_min, float* bbox_max )
+{
+  const size_t num_chunks = ( count + chunk_size - 1 ) / chunk_size;
+  // Chunks that parallelFor folds into one inline call keep the empty box.
+  std::vector<float> chunk_bounds( num_chunks * 6, 1e16f );
+  for( size_t c = 0; c < num_chunks; ++c )
+    std::fill( &chunk_bounds[6 * c + 3], &chunk_bounds[6 * c + 6], -1e16f );
+
+  sutil::parallelFor( count, chunk_size, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      const unsigned char* r = records + i * stride;
+      memcpy( out + 3 * i + 0, r + offsets[0], 4 );
+      memcpy( out + 3 * i + 1, r + offsets[1], 4 );
+      memcpy( out + 3 * i + 2, r + offsets[2], 4 );
+    }
+    if( swap )
+      byteSwap32( out + 3 * begin, 3 * ( end - begin ) );
+
+    if( bbox_min )
+    {
+      float lo[3] = {  1e16f,  1e16f,  1e16f };
+      float hi[3] = { -1e16f, -1e16f, -1e16f };
+      for( size_t i = begin; i < end; ++i )
+      {
+        for( int k = 0; k < 3; ++k )
+        {
+          lo[k] = std::min( lo[k], out[3 * i + k] );
+          hi[k] = std::max( hi[k], out[3 * i + k] );
+        }
+      }
+      float* b = &chunk_bounds[6 * ( begin / chunk_size )];
+      std::copy( lo, lo + 3, b );
+      std::copy( hi, hi + 3, b + 3 );
+    }
+  } );
+
+  if( bbox_min )
+  {
+    for( size_t c = 0; c < num_chunks; ++c )
+    {
+      for( int k = 0; k < 3; ++k )
+      {
+        bbox_min[k] = std::min( bbox_min[k], chunk_bounds[6 * c + k] );
+        bbox_max[k] = std::max( bbox_max[k], chunk_bounds[6 * c + 3 + k] );
+      }
+    }
+  }
+}
+
+
+// Copies the vertex indices of triangle records; returns false if a face
+// is not a triangle.
+bool decodeTriangles( const unsigned char* records, size_t count_size, size_t count, bool swap, int32_t* out )
+{
+  const size_t stride = count_size + 3 * sizeof( int32_t );
+  std::atomic<bool> triangles( true );
+
+  sutil::parallelFor( count, chunk_size, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      const unsigned char* r = records + i * stride;
+      if( readCount( r, count_size, swap ) != 3 )
+      {
+        triangles = false;
+        return;
+      }
+      memcpy( out + 3 * i, r + count_size, 3 * sizeof( int32_t ) );
+    }
+    if( swap )
+      byteSwap32( out + 3 * begin, 3 * ( end - begin ) );
+  } );
+
+  return triangles;
+}
+
+} // namespace
+
+
+bool loadBinaryPLY( const std::string& filename, Mesh& mesh )
+{
+  MappedFile file( filename );
+
+  bool big_endian = false;
+  std::vector<PlyElement> elements;
+  size_t offset = 0;
+  if( !parseHeader( file.data(), file.size(), big_endian, elements, offset ) )
+    return false;
+
+  // Element blocks follow each other, so everything up to the faces must
+  // have fixed size records.
+  const PlyElement* vertices = 0;
+  const PlyElement* faces    = 0;
+  size_t vertex_offset = 0, face_offset = 0;
+  for( size_t i = 0; i < elements.size() && !faces; ++i )
+  {
+    const PlyElement& e = elements[i];
+    if( e.name == "face" )
+    {
+      faces = &e;
+      face_offset = offset;
+      break;
+    }
+    const size_t stride = e.stride();
+    if( stride == 0 )
+      return false;
+    if( e.name == "vertex" )
+    {
+      vertices = &e;
+      vertex_offset = offset;
+    }
+    offset += e.count * stride;
+  }
+  if( !vertices || static_cast<int64_t>( vertices->count ) != mesh.num_vertices )
+    return false;
+  if( mesh.num_triangles > 0 &&
+      ( !faces || static_cast<int64_t>( faces->count ) != mesh.num_triangles || faces->properties.size() != 1 ||
+        !faces->properties[0].count_size || faces->properties[0].size != 4 || faces->properties[0].is_float ||
+        faces->properties[0].name != "vertex_indices" ) )
+    return false;
+
+  // Positions and normals must be floats.  Normals are read when the mesh
+  // wants them and the file has them; otherwise they are generated later.
+  const char* names[6] = { "x", "y", "z", "nx", "ny", "nz" };
+  long offsets[6];
+  bool float_types[6];
+  for( int k = 0; k < 6; ++k )
+  {
+    bool is_float = false;
+    size_t size = 0;
+    offsets[k] = vertices->offset( names[k], is_float, size );
+    float_types[k] = is_float && size == 4;
+  }
+  const bool read_normals = mesh.has_normals && offsets[3] >= 0 && offsets[4] >= 0 && offsets[5] >= 0;
+  for( int k = 0; k < ( read_normals ? 6 : 3 ); ++k )
+    if( offsets[k] < 0 || !float_types[k] )
+      return false;
+
+  const size_t vertex_stride = vertices->stride();
+  const size_t face_stride   = faces ? faces->properties[0].count_size + 3 * sizeof( int32_t ) : 0;
+  if( vertex_offset + vertices->count * vertex_stride > file.size() ||
+      ( mesh.num_triangles > 0 && face_offset + faces->count * face_stride > file.size() ) )
+    throw std::runtime_error( "loadBinaryPLY: '" + filename + "' is shorter than its header declares" );
+
+  const bool swap = big_endian != hostIsBigEndian();
+
+  if( mesh.num_triangles > 0 &&
+      !decodeTriangles( file.data() + face_offset, faces->properties[0].count_size, faces->count, swap, mesh.tri_indices ) )
+    return false;
+
+  decodeFloat3( file.data() + vertex_offset, vertex_stride, offsets, vertices->count, swap, mesh.positions,
+                mesh.bbox_min, mesh.bbox_max );
+  if( read_normals )
+    decodeFloat3( file.data() + vertex_offset, vertex_stride, offsets + 3, vertices->count, swap, mesh.normals, 0, 0 );
+
+  return true;
+}
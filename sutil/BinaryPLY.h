@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <string>
+
+//-----------------------------------------------------------------------------
+//
+// Bulk decoder for binary PLY files
+//
+// rply hands every scalar of a file to a callback, which limits large scans
+// to a few MB/s.  Files in binary_little_endian or binary_big_endian format
+// whose vertex and face elements have fixed size records are instead read
+// element block by element block from a memory mapped file: the records are
+// deinterleaved into the mesh arrays in parallel chunks, byte swapped in bulk
+// where the file and host disagree, and the bounding box is reduced across
+// the chunks.
+//
+// The fast path needs float x, y, z (and optionally nx, ny, nz) vertex
+// properties among any other scalar ones, a face element whose only property
+// is a list of 4 byte vertex indices with every face a triangle, and scalar
+// properties only in elements before the faces.
+//
+//-----------------------------------------------------------------------------
+
+// Loads positions, normals, triangles and the bounding box into 'mesh',
+// allocated for the counts the file declares.  Returns false when the file
+// does not fit the fast path, in which case the caller falls back to rply
+// and the mesh arrays hold no meaningful data.  Throws std::runtime_error
+// when the file cannot be mapped or is shorter than its header declares.
+bool loadBinaryPLY( const std::string& filename, Mesh& mesh );
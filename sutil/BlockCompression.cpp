@@ -0,0 +1,526 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define BLOCK_COMPRESSION_SSE2 1
+#endif
+
+using namespace optix;
+
+//-----------------------------------------------------------------------------
+//
+// Helpers
+//
+//-----------------------------------------------------------------------------
+
+namespace
+{
+
+inline int quantize( float v, int max_value )
+{
+  return std::min( std::max( static_cast<int>( v * max_value + 0.5f ), 0 ), max_value );
+}
+
+
+inline uint16_t packRGB565( const float3& c )
+{
+  return static_cast<uint16_t>( ( quantize( c.x, 31 ) << 11 ) | ( quantize( c.y, 63 ) << 5 ) | quantize( c.z, 31 ) );
+}
+
+
+// Expands to 8 bits the way hardware decoders do before converting to float.
+inline float4 unpackRGB565( uint16_t c )
+{
+  const int r = ( c >> 11 ) & 31;
+  const int g = ( c >>  5 ) & 63;
+  const int b =   c         & 31;
+  return make_float4( ( ( r << 3 ) | ( r >> 2 ) ) / 255.0f,
+                      ( ( g << 2 ) | ( g >> 4 ) ) / 255.0f,
+                      ( ( b << 3 ) | ( b >> 2 ) ) / 255.0f,
+                      1.0f );
+}
+
+
+inline float distance2( const float4& a, const float4& b )
+{
+  const float4 d = a - b;
+  return dot( d, d );
+}
+
+
+// Endpoints of the texels' extent along their principal axis, found with a
+// few power iterations on the covariance matrix.  'channels' is 3 or 4.
+void principalEndpoints( const float4 texels[16], int channels, float4& e0, float4& e1 )
+{
+  float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for( int i = 0; i < 16; ++i )
+    for( int c = 0; c < channels; ++c )
+      mean[c] += ( &texels[i].x )[c] * ( 1.0f / 16.0f );
+
+  float cov[4][4];
+  memset( cov, 0, sizeof( cov ) );
+  for( int i = 0; i < 16; ++i )
+    for( int r = 0; r < channels; ++r )
+      for( int c = 0; c < channels; ++c )
+        cov[r][c] += ( ( &texels[i].x )[r] - mean[r] ) * ( ( &texels[i].x )[c] - mean[c] );
+
+  float axis[4] = { 1.0f, 1.0f, 1.0f, channels == 4 ? 1.0f : 0.0f };
+  for( int iter = 0; iter < 8; ++iter )
+  {
+    float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float norm = 0.0f;
+    for( int r = 0; r < channels; ++r )
+    {
+      for( int c = 0; c < channels; ++c )
+        next[r] += cov[r][c] * axis[c];
+      norm = std::max( norm, std::fabs( next[r] ) );
+    }
+    if( norm < 1.0e-12f )
+      break;
+    for( int r = 0; r < channels; ++r )
+      axis[r] = next[r] / norm;
+  }
+
+  float tmin = 1.0e30f, tmax = -1.0e30f;
+  for( int i = 0; i < 16; ++i )
+  {
+    float t = 0.0f;
+    for( int c = 0; c < channels; ++c )
+      t += ( ( &texels[i].x )[c] - mean[c] ) * axis[c];
+    tmin = std::min( tmin, t );
+    tmax = std::max( tmax, t );
+  }
+
+  float* p0 = &e0.x;
+  float* p1 = &e1.x;
+  for( int c = 0; c < 4; ++c )
+  {
+    p0[c] = c < channels ? std::min( std::max( mean[c] + axis[c]*tmax, 0.0f ), 1.0f ) : 1.0f;
+    p1[c] = c < channels ? std::min( std::max( mean[c] + axis[c]*tmin, 0.0f ), 1.0f ) : 1.0f;
+  }
+}
+
+
+// Little endian bit reader/writer over a 128-bit block.
+struct BlockBits
+{
+  unsigned char* data;
+  unsigned int   pos;
+
+  void write( uint32_t value, unsigned int count )
+  {
+    for( unsigned int i = 0; i < count; ++i, ++pos )
+      if( value & ( 1u << i ) )
+        data[pos >> 3] |= static_cast<unsigned char>( 1u << ( pos & 7 ) );
+  }
+};
+
+
+struct ConstBlockBits
+{
+  const unsigned char* data;
+  unsigned int         pos;
+
+  uint32_t read( unsigned int count )
+  {
+    uint32_t value = 0;
+    for( unsigned int i = 0; i < count; ++i, ++pos )
+      value |= static_cast<uint32_t>( ( data[pos >> 3] >> ( pos & 7 ) ) & 1u ) << i;
+    return value;
+  }
+};
+
+
+const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+// Interpolates a 16 entry mode 6 palette from 8-bit endpoints.
+void bc7Palette( const int e0[4], const int e1[4], float4 palette[16] )
+{
+  for( int i = 0; i < 16; ++i )
+  {
+    const int w = BC7_WEIGHTS4[i];
+    float* p = &palette[i].x;
+    for( int c = 0; c < 4; ++c )
+      p[c] = ( ( ( 64 - w ) * e0[c] + w * e1[c] + 32 ) >> 6 ) / 255.0f;
+  }
+}
+
+
+// Picks the 7-bit endpoint and shared p bit closest to an 8-bit color.
+void bc7QuantizeEndpoint( const float4& color, int q[4], int& pbit )
+{
+  float best_err = 1.0e30f;
+  for( int p = 0; p < 2; ++p )
+  {
+    int   cand[4];
+    float err = 0.0f;
+    for( int c = 0; c < 4; ++c )
+    {
+      const float target = ( &color.x )[c] * 255.0f;
+      cand[c] = std::min( std::max( static_cast<int>( std::floor( ( target - p ) * 0.5f + 0.5f ) ), 0 ), 127 );
+      const float d = static_cast<float>( ( cand[c] << 1 ) | p ) - target;
+      err += d * d;
+    }
+    if( err < best_err )
+    {
+      best_err = err;
+      pbit = p;
+      memcpy( q, cand, sizeof( cand ) );
+    }
+  }
+}
+
+} // namespace
+
+
+//-----------------------------------------------------------------------------
+//
+// BC1
+//
+//-----------------------------------------------------------------------------
+
+void encodeBlockBC1( const float4 texels[16], unsigned char block[8] )
+{
+  float4 e0, e1;
+  principalEndpoints( texels, 3, e0, e1 );
+
+  uint16_t c0 = packRGB565( make_float3( e0 ) );
+  uint16_t c1 = packRGB565( make_float3( e1 ) );
+  if( c0 < c1 )
+    std::swap( c0, c1 );
+
+  uint32_t indices = 0;
+  if( c0 != c1 )
+  {
+    // Four color mode requires c0 > c1.
+    float4 palette[4];
+    palette[0] = unpackRGB565( c0 );
+    palette[1] = unpackRGB565( c1 );
+    palette[2] = ( palette[0] * 2.0f + palette[1] ) * ( 1.0f / 3.0f );
+    palette[3] = ( palette[0] + palette[1] * 2.0f ) * ( 1.0f / 3.0f );
+
+    for( int i = 0; i < 16; ++i )
+    {
+      const float4 t = make_float4( texels[i].x, texels[i].y, texels[i].z, 1.0f );
+      uint32_t best = 0;
+      float    best_d = distance2( t, palette[0] );
+      for( uint32_t k = 1; k < 4; ++k )
+      {
+        const float d = distance2( t, palette[k] );
+        if( d < best_d )
+        {
+          best_d = d;
+          best   = k;
+        }
+      }
+      indices |= best << ( 2*i );
+    }
+  }
+
+  block[0] = static_cast<unsigned char>( c0 & 0xff );
+  block[1] = static_cast<unsigned char>( c0 >> 8 );
+  block[2] = static_cast<unsigned char>( c1 & 0xff );
+  block[3] = static_cast<unsigned char>( c1 >> 8 );
+  memcpy( block + 4, &indices, 4 );
+}
+
+
+void decodeBlockBC1( const unsigned char block[8], float4 texels[16] )
+{
+  const uint16_t c0 = static_cast<uint16_t>( block[0] | ( block[1] << 8 ) );
+  const uint16_t c1 = static_cast<uint16_t>( block[2] | ( block[3] << 8 ) );
+  uint32_t indices;
+  memcpy( &indices, block + 4, 4 );
+
+  const float4 a = unpackRGB565( c0 );
+  const float4 b = unpackRGB565( c1 );
+
+#if defined(BLOCK_COMPRESSION_SSE2)
+  __m128 palette[4];
+  palette[0] = _mm_loadu_ps( &a.x );
+  palette[1] = _mm_loadu_ps( &b.x );
+  if( c0 > c1 )
+  {
+    const __m128 third = _mm_set1_ps( 1.0f / 3.0f );
+    palette[2] = _mm_mul_ps( _mm_add_ps( _mm_add_ps( palette[0], palette[0] ), palette[1] ), third );
+    palette[3] = _mm_mul_ps( _mm_add_ps( _mm_add_ps( palette[1], palette[1] ), palette[0] ), third );
+  }
+  else
+  {
+    palette[2] = _mm_mul_ps( _mm_add_ps( palette[0], palette[1] ), _mm_set1_ps( 0.5f ) );
+    palette[3] = _mm_setzero_ps();  // Transparent black
+  }
+  for( int i = 0; i < 16; ++i )
+    _mm_storeu_ps( &texels[i].x, palette[ ( indices >> ( 2*i ) ) & 3u ] );
+#else
+  float4 palette[4];
+  palette[0] = a;
+  palette[1] = b;
+  if( c0 > c1 )
+  {
+    palette[2] = ( a * 2.0f + b ) * ( 1.0f / 3.0f );
+    palette[3] = ( a + b * 2.0f ) * ( 1.0f / 3.0f );
+  }
+  else
+  {
+    palette[2] = ( a + b ) * 0.5f;
+    palette[3] = make_float4( 0.0f );
+  }
+  for( int i = 0; i < 16; ++i )
+    texels[i] = palette[ ( indices >> ( 2*i ) ) & 3u ];
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// BC4 / BC5
+//
+//-----------------------------------------------------------------------------
+
+void encodeBlockBC4( const float values[16], unsigned char block[8] )
+{
+  float vmin = values[0], vmax = values[0];
+  for( int i = 1; i < 16; ++i )
+  {
+    vmin = std::min( vmin, values[i] );
+    vmax = std::max( vmax, values[i] );
+  }
+
+  const int e0 = quantize( vmax, 255 );
+  const int e1 = quantize( vmin, 255 );
+  memset( block, 0, 8 );
+  block[0] = static_cast<unsigned char>( e0 );
+  block[1] = static_cast<unsigned char>( e1 );
+  if( e0 == e1 )
+    return;
+
+  // Eight value mode (e0 > e1): palette index k maps to position
+  // 0, 7, 1, 2, 3, 4, 5, 6 along the segment from e0 to e1.
+  static const uint64_t POSITION_TO_INDEX[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+  uint64_t indices = 0;
+  for( int i = 0; i < 16; ++i )
+  {
+    const float t   = ( e0 - values[i]*255.0f ) / static_cast<float>( e0 - e1 );
+    const int   pos = std::min( std::max( static_cast<int>( t*7.0f + 0.5f ), 0 ), 7 );
+    indices |= POSITION_TO_INDEX[pos] << ( 3*i );
+  }
+  for( int i = 0; i < 6; ++i )
+    block[2+i] = static_cast<unsigned char>( ( indices >> ( 8*i ) ) & 0xff );
+}
+
+
+void decodeBlockBC4( const unsigned char block[8], float values[16] )
+{
+  const int e0 = block[0];
+  const int e1 = block[1];
+
+  float palette[8];
+  palette[0] = e0 / 255.0f;
+  palette[1] = e1 / 255.0f;
+  if( e0 > e1 )
+  {
+    for( int k = 1; k < 7; ++k )
+      palette[k+1] = ( ( 7 - k ) * e0 + k * e1 ) / ( 7.0f * 255.0f );
+  }
+  else
+  {
+    for( int k = 1; k < 5; ++k )
+      palette[k+1] = ( ( 5 - k ) * e0 + k * e1 ) / ( 5.0f * 255.0f );
+    palette[6] = 0.0f;
+    palette[7] = 1.0f;
+  }
+
+  uint64_t indices = 0;
+  for( int i = 0; i < 6; ++i )
+    indices |= static_cast<uint64_t>( block[2+i] ) << ( 8*i );
+  for( int i = 0; i < 16; ++i )
+    values[i] = palette[ ( indices >> ( 3*i ) ) & 7u ];
+}
+
+
+void encodeBlockBC5( const float4 texels[16], unsigned char block[16] )
+{
+  float red[16], green[16];
+  for( int i = 0; i < 16; ++i )
+  {
+    red[i]   = texels[i].x;
+    green[i] = texels[i].y;
+  }
+  encodeBlockBC4( red,   block );
+  encodeBlockBC4( green, block + 8 );
+}
+
+
+void decodeBlockBC5( const unsigned char block[16], float4 texels[16] )
+{
+  float red[16], green[16];
+  decodeBlockBC4( block,     red );
+  decodeBlockBC4( block + 8, green );
+#if defined(BLOCK_COMPRESSION_SSE2)
+  // Interleave (r, g, 0, 1) four texels at a time.
+  const __m128 zero_one = _mm_setr_ps( 0.0f, 1.0f, 0.0f, 1.0f );
+  for( int i = 0; i < 16; i += 4 )
+  {
+    const __m128 r  = _mm_loadu_ps( red + i );
+    const __m128 g  = _mm_loadu_ps( green + i );
+    const __m128 lo = _mm_unpacklo_ps( r, g );   // r0 g0 r1 g1
+    const __m128 hi = _mm_unpackhi_ps( r, g );   // r2 g2 r3 g3
+    _mm_storeu_ps( &texels[i+0].x, _mm_movelh_ps( lo, zero_one ) );
+    _mm_storeu_ps( &texels[i+1].x, _mm_movehl_ps( zero_one, lo ) );
+    _mm_storeu_ps( &texels[i+2].x, _mm_movelh_ps( hi, zero_one ) );
+    _mm_storeu_ps( &texels[i+3].x, _mm_movehl_ps( zero_one, hi ) );
+  }
+#else
+  for( int i = 0; i < 16; ++i )
+    texels[i] = make_float4( red[i], green[i], 0.0f, 1.0f );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// BC7 (mode 6)
+//
+//-----------------------------------------------------------------------------
+
+void encodeBlockBC7( const float4 texels[16], unsigned char block[16] )
+{
+  float4 c0, c1;
+  principalEndpoints( texels, 4, c0, c1 );
+
+  int q0[4], q1[4], p0 = 0, p1 = 0;
+  bc7QuantizeEndpoint( c0, q0, p0 );
+  bc7QuantizeEndpoint( c1, q1, p1 );
+
+  int e0[4], e1[4];
+  for( int c = 0; c < 4; ++c )
+  {
+    e0[c] = ( q0[c] << 1 ) | p0;
+    e1[c] = ( q1[c] << 1 ) | p1;
+  }
+  float4 palette[16];
+  bc7Palette( e0, e1, palette );
+
+  int indices[16];
+  for( int i = 0; i < 16; ++i )
+  {
+    int   best   = 0;
+    float best_d = distance2( texels[i], palette[0] );
+    for( int k = 1; k < 16; ++k )
+    {
+      const float d = distance2( texels[i], palette[k] );
+      if( d < best_d )
+      {
+        best_d = d;
+        best   = k;
+      }
+    }
+    indices[i] = best;
+  }
+
+  // The anchor (first) index is stored without its top bit; swapping the
+  // endpoints mirrors the palette and clears it.
+  if( indices[0] & 8 )
+  {
+    std::swap( p0, p1 );
+    for( int c = 0; c < 4; ++c )
+      std::swap( q0[c], q1[c] );
+    for( int i = 0; i < 16; ++i )
+      indices[i] = 15 - indices[i];
+  }
+
+  memset( block, 0, 16 );
+  BlockBits bits = { block, 0u };
+  bits.write( 1u << 6, 7 );                    // Mode 6
+  for( int c = 0; c < 4; ++c )
+  {
+    bits.write( static_cast<uint32_t>( q0[c] ), 7 );
+    bits.write( static_cast<uint32_t>( q1[c] ), 7 );
+  }
+  bits.write( static_cast<uint32_t>( p0 ), 1 );
+  bits.write( static_cast<uint32_t>( p1 ), 1 );
+  bits.write( static_cast<uint32_t>( indices[0] ), 3 );
+  for( int i = 1; i < 16; ++i )
+    bits.write( static_cast<uint32_t>( indices[i] ), 4 );
+}
+
+
+bool decodeBlockBC7( const unsigned char block[16], float4 texels[16] )
+{
+  if( ( block[0] & 0x7f ) != ( 1u << 6 ) )
+  {
+    for( int i = 0; i < 16; ++i )
+      texels[i] = make_float4( 0.0f );
+    return false;
+  }
+
+  ConstBlockBits bits = { block, 7u };
+  int q0[4], q1[4];
+  for( int c = 0; c < 4; ++c )
+  {
+    q0[c] = static_cast<int>( bits.read( 7 ) );
+    q1[c] = static_cast<int>( bits.read( 7 ) );
+  }
+  const int p0 = static_cast<int>( bits.read( 1 ) );
+  const int p1 = static_cast<int>( bits.read( 1 ) );
+
+  int e0[4], e1[4];
+  for( int c = 0; c < 4; ++c )
+  {
+    e0[c] = ( q0[c] << 1 ) | p0;
+    e1[c] = ( q1[c] << 1 ) | p1;
+  }
+  float4 palette[16];
+  bc7Palette( e0, e1, palette );
+
+  texels[0] = palette[ bits.read( 3 ) ];
+  for( int i = 1; i < 16; ++i )
+    texels[i] = palette[ bits.read( 4 ) ];
+  return true;
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// RGB9E5
+//
+//-----------------------------------------------------------------------------
+
+uint32_t encodeRGB9E5( const float3& c )
+{
+  const int   N = 9, B = 15, E_MAX = 31;
+  const float max_value = static_cast<float>( ( 1 << N ) - 1 ) / ( 1 << N ) * std::ldexp( 1.0f, E_MAX - B );
+
+  const float r = std::min( std::max( c.x, 0.0f ), max_value );
+  const float g = std::min( std::max( c.y, 0.0f ), max_value );
+  const float b = std::min( std::max( c.z, 0.0f ), max_value );
+  const float max_c = std::max( r, std::max( g, b ) );
+
+  int exp_shared = std::max( -B - 1, static_cast<int>( std::floor( std::log2( std::max( max_c, 1.0e-30f ) ) ) ) ) + 1 + B;
+  float denom = std::ldexp( 1.0f, exp_shared - B - N );
+  if( static_cast<int>( std::floor( max_c / denom + 0.5f ) ) == ( 1 << N ) )
+  {
+    denom *= 2.0f;
+    ++exp_shared;
+  }
+
+  const uint32_t rm = static_cast<uint32_t>( std::floor( r / denom + 0.5f ) );
+  const uint32_t gm = static_cast<uint32_t>( std::floor( g / denom + 0.5f ) );
+  const uint32_t bm = static_cast<uint32_t>( std::floor( b / denom + 0.5f ) );
+  return rm | ( gm << 9 ) | ( bm << 18 ) | ( static_cast<uint32_t>( exp_shared ) << 27 );
+}
+
+
+float3 decodeRGB9E5( uint32_t v )
+{
+  const float scale = std::ldexp( 1.0f, static_cast<int>( v >> 27 ) - 15 - 9 );
+  return make_float3( ( v         & 0x1ff ) * scale,
+                      ( ( v >> 9  ) & 0x1ff ) * scale,
+                      ( ( v >> 18 ) & 0x1ff ) * scale );
+}
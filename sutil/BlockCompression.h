@@ -0,0 +1,41 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include <sutilapi.h>
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+//
+// 4x4 block texture codecs
+//
+// Texels are passed row-major, 16 per block, as floats in [0,1].  Block
+// layouts follow the D3D BC formats so files can be inspected with standard
+// tools:
+//   BC1 :  8 bytes, RGB with two 5:6:5 endpoints and 2-bit indices
+//   BC4 :  8 bytes, one channel with two 8-bit endpoints and 3-bit indices
+//   BC5 : 16 bytes, two BC4 blocks for the red and green channels
+//   BC7 : 16 bytes, RGBA; the encoder emits mode 6 (one subset, 7.7.7.7 + p
+//         bit endpoints, 4-bit indices) and the decoder accepts mode 6 only
+//
+// RGB9E5 is the shared exponent HDR texel format (9-bit mantissas, 5-bit
+// exponent, 4 bytes per texel) used in place of BC6H for .hdr sources.
+//
+//-----------------------------------------------------------------------------
+
+SUTILAPI void encodeBlockBC1( const optix::float4 texels[16], unsigned char block[8] );
+SUTILAPI void decodeBlockBC1( const unsigned char block[8], optix::float4 texels[16] );
+
+SUTILAPI void encodeBlockBC4( const float values[16], unsigned char block[8] );
+SUTILAPI void decodeBlockBC4( const unsigned char block[8], float values[16] );
+
+// Stores the x and y channels; decoding sets z = 0 and w = 1.
+SUTILAPI void encodeBlockBC5( const optix::float4 texels[16], unsigned char block[16] );
+SUTILAPI void decodeBlockBC5( const unsigned char block[16], optix::float4 texels[16] );
+
+// Returns false (and decodes to black) for BC7 modes other than 6.
+SUTILAPI void encodeBlockBC7( const optix::float4 texels[16], unsigned char block[16] );
+SUTILAPI bool decodeBlockBC7( const unsigned char block[16], optix::float4 texels[16] );
+
+SUTILAPI uint32_t      encodeRGB9E5( const optix::float3& c );
+SUTILAPI optix::float3 decodeRGB9E5( uint32_t v );
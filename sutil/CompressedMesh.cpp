@@ -0,0 +1,513 @@
+#include "CompressedMesh.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using optix::float2;
+using optix::float3;
+using optix::float4;
+
+namespace
+{
+
+const size_t cluster_grain = 256;   // Clusters per parallelFor chunk
+
+
+//-----------------------------------------------------------------------------
+// Attribute encodings
+//-----------------------------------------------------------------------------
+
+inline int16_t toSnorm16( float v )
+{
+  return static_cast<int16_t>( lrintf( std::min( std::max( v, -1.0f ), 1.0f ) * 32767.0f ) );
+}
+
+
+inline float fromSnorm16( int16_t v )
+{
+  return std::max( v / 32767.0f, -1.0f );
+}
+
+
+inline float signNotZero( float v )
+{
+  return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+
+// Unit vector to the octahedron folded onto [-1, 1]^2.
+inline void octEncode( float x, float y, float z, int16_t out[2] )
+{
+  const float l1 = fabsf( x ) + fabsf( y ) + fabsf( z );
+  if( l1 == 0.0f )
+  {
+    out[0] = out[1] = 0;
+    return;
+  }
+  float u = x / l1, v = y / l1;
+  if( z < 0.0f )
+  {
+    const float fu = ( 1.0f - fabsf( v ) ) * signNotZero( u );
+    const float fv = ( 1.0f - fabsf( u ) ) * signNotZero( v );
+    u = fu;
+    v = fv;
+  }
+  out[0] = toSnorm16( u );
+  out[1] = toSnorm16( v );
+}
+
+
+inline float3 octDecode( int16_t a, int16_t b )
+{
+  float3 n = optix::make_float3( fromSnorm16( a ), fromSnorm16( b ), 0.0f );
+  n.z = 1.0f - fabsf( n.x ) - fabsf( n.y );
+  const float t = std::max( -n.z, 0.0f );
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return optix::normalize( n );
+}
+
+
+// IEEE 754 binary16, round to nearest even; overflow goes to infinity.
+uint16_t floatToHalf( float f )
+{
+  uint32_t x;
+  memcpy( &x, &f, sizeof( x ) );
+  const uint16_t sign = static_cast<uint16_t>( ( x >> 16 ) & 0x8000u );
+  const uint32_t abs  = x & 0x7fffffffu;
+
+  if( abs >= 0x7f800000u )                     // Inf or NaN
+    return sign | 0x7c00u | ( abs > 0x7f800000u ? 0x200u : 0u );
+  if( abs >= 0x477ff000u )                     // Rounds past the largest half
+    return sign | 0x7c00u;
+  if( abs < 0x38800000u )                      // Subnormal half or zero
+  {
+    if( abs < 0x33000000u )
+      return sign;
+    const uint32_t shift    = 126u - ( abs >> 23 );   // 14..24
+    const uint32_t mantissa = ( abs & 0x7fffffu ) | 0x800000u;
+    uint32_t h = mantissa >> shift;
+    const uint32_t rest = mantissa & ( ( 1u << shift ) - 1u );
+    const uint32_t half = 1u << ( shift - 1 );
+    if( rest > half || ( rest == half && ( h & 1u ) ) )
+      ++h;
+    return sign | static_cast<uint16_t>( h );
+  }
+  uint32_t h = ( ( abs - 0x38000000u ) >> 13 );
+  const uint32_t rest = abs & 0x1fffu;
+  if( rest > 0x1000u || ( rest == 0x1000u && ( h & 1u ) ) )
+    ++h;
+  return sign | static_cast<uint16_t>( h );
+}
+
+
+float halfToFloat( uint16_t h )
+{
+  const uint32_t sign     = static_cast<uint32_t>( h & 0x8000u ) << 16;
+  const uint32_t exponent = ( h >> 10 ) & 0x1fu;
+  const uint32_t mantissa = h & 0x3ffu;
+  uint32_t x;
+  if( exponent == 0x1fu )
+  {
+    x = sign | 0x7f800000u | ( mantissa << 13 );
+  }
+  else if( exponent != 0 )
+  {
+    x = sign | ( ( exponent + 112u ) << 23 ) | ( mantissa << 13 );
+  }
+  else
+  {
+    const float v = mantissa * ( 1.0f / 16777216.0f );   // mantissa * 2^-24
+    memcpy( &x, &v, sizeof( x ) );
+    x |= sign;
+  }
+  float f;
+  memcpy( &f, &x, sizeof( f ) );
+  return f;
+}
+
+
+//-----------------------------------------------------------------------------
+// Position grids
+//-----------------------------------------------------------------------------
+
+// Smallest e with extent <= steps * 2^e.
+inline int gridExponent( double extent, double steps )
+{
+  int e;
+  const double m = frexp( extent / steps, &e );
+  return m == 0.5 ? e - 1 : e;
+}
+
+
+// 'x' rounded to the grid of step 2^rounding, in steps of 2^exponent,
+// which must not be coarser.
+inline int64_t gridCoordinate( float x, float origin, int rounding, int exponent )
+{
+  const int64_t grid = static_cast<int64_t>( floor( ldexp( double( x ) - origin, -rounding ) + 0.5 ) );
+  return grid * ( int64_t( 1 ) << ( rounding - exponent ) );
+}
+
+} // namespace
+
+
+//-----------------------------------------------------------------------------
+//
+// CompressedMesh
+//
+//-----------------------------------------------------------------------------
+
+CompressedMesh::CompressedMesh()
+  : m_num_triangles( 0 )
+{
+  m_grid_origin[0] = m_grid_origin[1] = m_grid_origin[2] = 0.0f;
+}
+
+
+void CompressedMesh::compress( const Mesh& mesh )
+{
+  m_num_triangles = mesh.num_triangles;
+  m_clusters.clear();
+  m_cluster_lookup.clear();
+  m_positions.clear();
+  m_normals.clear();
+  m_tangents.clear();
+  m_texcoords.clear();
+  m_indices.assign( 3 * size_t( std::max( mesh.num_triangles, 0 ) ), 0 );
+  m_mat_params.assign( mesh.mat_params, mesh.mat_params + std::max( mesh.num_materials, 0 ) );
+  if( mesh.num_triangles <= 0 || mesh.num_vertices <= 0 )
+  {
+    m_num_triangles = 0;
+    m_indices.clear();
+    return;
+  }
+
+  // Cut triangles into clusters and give each its own vertex list, in
+  // first-use order.
+  std::vector<uint32_t> cluster_vertices;            // Mesh vertex of every cluster vertex
+  std::vector<int32_t>  local( mesh.num_vertices, -1 );
+  size_t cluster_start = 0;                            // First entry of the open cluster in cluster_vertices
+  for( int32_t tri = 0; tri < mesh.num_triangles; ++tri )
+  {
+    const int32_t* idx      = mesh.tri_indices + 3 * tri;
+    const int32_t  material = mesh.mat_indices ? mesh.mat_indices[tri] : 0;
+    unsigned int new_vertices = 0;
+    for( int k = 0; k < 3; ++k )
+      if( local[idx[k]] < 0 && ( k < 1 || idx[k] != idx[0] ) && ( k < 2 || idx[k] != idx[1] ) )
+        ++new_vertices;
+
+    MeshCluster* open = m_clusters.empty() ? 0 : &m_clusters.back();
+    if( !open || open->num_triangles == max_cluster_triangles || open->material != material ||
+        open->num_vertices + new_vertices > 256 )
+    {
+      for( size_t v = cluster_start; v < cluster_vertices.size(); ++v )
+        local[cluster_vertices[v]] = -1;
+      cluster_start = cluster_vertices.size();
+
+      MeshCluster c;
+      memset( &c, 0, sizeof( c ) );
+      c.first_vertex   = static_cast<uint32_t>( cluster_vertices.size() );
+      c.first_triangle = static_cast<uint32_t>( tri );
+      c.material       = material;
+      m_clusters.push_back( c );
+      open = &m_clusters.back();
+    }
+
+    for( int k = 0; k < 3; ++k )
+    {
+      if( local[idx[k]] < 0 )
+      {
+        local[idx[k]] = open->num_vertices++;
+        cluster_vertices.push_back( static_cast<uint32_t>( idx[k] ) );
+      }
+      m_indices[3 * size_t( tri ) + k] = static_cast<uint8_t>( local[idx[k]] );
+    }
+    ++open->num_triangles;
+  }
+
+  m_cluster_lookup.resize( ( size_t( mesh.num_triangles ) + 63 ) / 64 );
+  for( size_t c = 0, block = 0; block < m_cluster_lookup.size(); ++block )
+  {
+    while( block * 64 >= m_clusters[c].first_triangle + m_clusters[c].num_triangles )
+      ++c;
+    m_cluster_lookup[block] = static_cast<uint32_t>( c );
+  }
+
+  // Each cluster gets a power of two grid step, fine enough that its own
+  // bounds span 16 bits.  The grids share the mesh corner as origin, and a
+  // vertex stored by several clusters is rounded once, on the coarsest of
+  // their grids; the finer grids hold that point exactly, so the copies
+  // decode to the same float and the surface stays watertight.
+  const size_t num_clusters = m_clusters.size();
+  std::vector<float> cluster_bounds( 6 * num_clusters );
+  sutil::parallelFor( num_clusters, cluster_grain, [&]( size_t begin, size_t end )
+  {
+    for( size_t c = begin; c < end; ++c )
+    {
+      float* b = &cluster_bounds[6 * c];
+      b[0] = b[1] = b[2] =  1e30f;
+      b[3] = b[4] = b[5] = -1e30f;
+      for( uint32_t v = 0; v < m_clusters[c].num_vertices; ++v )
+      {
+        const float* p = mesh.positions + 3 * size_t( cluster_vertices[m_clusters[c].first_vertex + v] );
+        for( int k = 0; k < 3; ++k )
+        {
+          b[k]     = std::min( b[k], p[k] );
+          b[k + 3] = std::max( b[k + 3], p[k] );
+        }
+      }
+    }
+  } );
+  float mesh_max[3] = { -1e30f, -1e30f, -1e30f };
+  m_grid_origin[0] = m_grid_origin[1] = m_grid_origin[2] = 1e30f;
+  for( size_t c = 0; c < num_clusters; ++c )
+  {
+    for( int k = 0; k < 3; ++k )
+    {
+      m_grid_origin[k] = std::min( m_grid_origin[k], cluster_bounds[6 * c + k] );
+      mesh_max[k]      = std::max( mesh_max[k], cluster_bounds[6 * c + 3 + k] );
+    }
+  }
+
+  // No grid is finer than 2^23 steps across the mesh, so grid coordinates
+  // stay exact in a float.
+  double mesh_extent = 0.0;
+  for( int k = 0; k < 3; ++k )
+    mesh_extent = std::max( mesh_extent, double( mesh_max[k] ) - m_grid_origin[k] );
+  const int min_exponent = mesh_extent > 0.0 ? std::max( gridExponent( mesh_extent, 8388608.0 ), -100 ) : 0;
+
+  std::vector<int> exponents( num_clusters );
+  for( size_t c = 0; c < num_clusters; ++c )
+  {
+    double extent = 0.0;
+    for( int k = 0; k < 3; ++k )
+      extent = std::max( extent, double( cluster_bounds[6 * c + 3 + k] ) - cluster_bounds[6 * c + k] );
+    // Two steps of slack cover the rounding of the corner and the vertices.
+    exponents[c] = extent > 0.0 ? std::max( gridExponent( extent, 65533.0 ), min_exponent ) : min_exponent;
+  }
+
+  // Rounding a shared vertex on a neighbour's coarser grid can push it out
+  // of a cluster's 16 bit range; coarsen such clusters until all fit.
+  std::vector<int>  vertex_exponents( mesh.num_vertices );
+  std::vector<char> coarsen( num_clusters );
+  for( bool changed = true; changed; )
+  {
+    std::fill( vertex_exponents.begin(), vertex_exponents.end(), min_exponent );
+    for( size_t c = 0; c < num_clusters; ++c )
+    {
+      for( uint32_t i = m_clusters[c].first_vertex; i < m_clusters[c].first_vertex + m_clusters[c].num_vertices; ++i )
+      {
+        int& e = vertex_exponents[cluster_vertices[i]];
+        e = std::max( e, exponents[c] );
+      }
+    }
+
+    sutil::parallelFor( num_clusters, cluster_grain, [&]( size_t begin, size_t end )
+    {
+      for( size_t c = begin; c < end; ++c )
+      {
+        MeshCluster& cluster = m_clusters[c];
+        int64_t lo[3], hi[3];
+        lo[0] = lo[1] = lo[2] = std::numeric_limits<int64_t>::max();
+        hi[0] = hi[1] = hi[2] = std::numeric_limits<int64_t>::min();
+        for( uint32_t i = cluster.first_vertex; i < cluster.first_vertex + cluster.num_vertices; ++i )
+        {
+          const size_t v = cluster_vertices[i];
+          for( int k = 0; k < 3; ++k )
+          {
+            const int64_t grid =
+                gridCoordinate( mesh.positions[3 * v + k], m_grid_origin[k], vertex_exponents[v], exponents[c] );
+            lo[k] = std::min( lo[k], grid );
+            hi[k] = std::max( hi[k], grid );
+          }
+        }
+        coarsen[c] = 0;
+        for( int k = 0; k < 3; ++k )
+        {
+          cluster.grid_origin[k] = static_cast<int32_t>( lo[k] );
+          if( hi[k] - lo[k] > 65535 )
+            coarsen[c] = 1;
+        }
+      }
+    } );
+
+    changed = false;
+    for( size_t c = 0; c < num_clusters; ++c )
+    {
+      if( coarsen[c] )
+      {
+        ++exponents[c];
+        changed = true;
+      }
+    }
+  }
+
+  const size_t num_vertices = cluster_vertices.size();
+  m_positions.resize( 3 * num_vertices );
+  if( mesh.has_normals && mesh.normals )
+    m_normals.resize( 2 * num_vertices );
+  if( mesh.has_tangents && mesh.tangents )
+    m_tangents.resize( 2 * num_vertices );
+  if( mesh.has_texcoords && mesh.texcoords )
+    m_texcoords.resize( 2 * num_vertices );
+
+  sutil::parallelFor( num_clusters, cluster_grain, [&]( size_t begin, size_t end )
+  {
+    for( size_t c = begin; c < end; ++c )
+    {
+      MeshCluster& cluster = m_clusters[c];
+      cluster.grid_step    = ldexpf( 1.0f, exponents[c] );
+
+      for( uint32_t i = cluster.first_vertex; i < cluster.first_vertex + cluster.num_vertices; ++i )
+      {
+        const size_t v = cluster_vertices[i];
+        for( int k = 0; k < 3; ++k )
+        {
+          const int64_t grid =
+              gridCoordinate( mesh.positions[3 * v + k], m_grid_origin[k], vertex_exponents[v], exponents[c] );
+          m_positions[3 * size_t( i ) + k] = static_cast<uint16_t>( grid - cluster.grid_origin[k] );
+        }
+        if( !m_normals.empty() )
+        {
+          const float* n = mesh.normals + 3 * v;
+          octEncode( n[0], n[1], n[2], &m_normals[2 * size_t( i )] );
+        }
+        if( !m_tangents.empty() )
+        {
+          const float* t = mesh.tangents + 4 * v;
+          int16_t* out = &m_tangents[2 * size_t( i )];
+          octEncode( t[0], t[1], t[2], out );
+          out[1] = static_cast<int16_t>( ( out[1] & ~1 ) | ( t[3] < 0.0f ? 1 : 0 ) );
+        }
+        if( !m_texcoords.empty() )
+        {
+          m_texcoords[2 * size_t( i ) + 0] = floatToHalf( mesh.texcoords[2 * v + 0] );
+          m_texcoords[2 * size_t( i ) + 1] = floatToHalf( mesh.texcoords[2 * v + 1] );
+        }
+      }
+    }
+  } );
+}
+
+
+void CompressedMesh::decompress( Mesh& mesh ) const
+{
+  const size_t num_vertices = m_positions.size() / 3;
+  mesh.num_vertices  = static_cast<int32_t>( num_vertices );
+  mesh.num_triangles = m_num_triangles;
+  mesh.has_normals   = hasNormals();
+  mesh.has_tangents  = hasTangents();
+  mesh.has_texcoords = hasTexcoords();
+  mesh.num_materials = static_cast<int32_t>( m_mat_params.size() );
+  allocMesh( mesh );
+  if( m_num_triangles == 0 )
+    return;
+
+  for( size_t i = 0; i < m_mat_params.size(); ++i )
+    mesh.mat_params[i] = m_mat_params[i];
+
+  sutil::parallelFor( m_clusters.size(), cluster_grain, [&]( size_t begin, size_t end )
+  {
+    for( size_t c = begin; c < end; ++c )
+    {
+      const MeshCluster& cluster = m_clusters[c];
+      for( uint32_t t = cluster.first_triangle; t < cluster.first_triangle + cluster.num_triangles; ++t )
+      {
+        for( int k = 0; k < 3; ++k )
+        {
+          const uint32_t v = cluster.first_vertex + m_indices[3 * size_t( t ) + k];
+          mesh.tri_indices[3 * size_t( t ) + k] = static_cast<int32_t>( v );
+        }
+        mesh.mat_indices[t] = cluster.material;
+      }
+      for( uint32_t i = cluster.first_vertex; i < cluster.first_vertex + cluster.num_vertices; ++i )
+      {
+        const uint16_t* q = &m_positions[3 * size_t( i )];
+        for( int k = 0; k < 3; ++k )
+          mesh.positions[3 * size_t( i ) + k] =
+              m_grid_origin[k] + static_cast<float>( cluster.grid_origin[k] + q[k] ) * cluster.grid_step;
+        if( mesh.has_normals )
+        {
+          const float3 n = octDecode( m_normals[2 * size_t( i )], m_normals[2 * size_t( i ) + 1] );
+          memcpy( mesh.normals + 3 * size_t( i ), &n, sizeof( float3 ) );
+        }
+        if( mesh.has_tangents )
+        {
+          const int16_t* t = &m_tangents[2 * size_t( i )];
+          const float3 d = octDecode( t[0], t[1] );
+          const float4 tangent = optix::make_float4( d.x, d.y, d.z, ( t[1] & 1 ) ? -1.0f : 1.0f );
+          memcpy( mesh.tangents + 4 * size_t( i ), &tangent, sizeof( float4 ) );
+        }
+        if( mesh.has_texcoords )
+        {
+          mesh.texcoords[2 * size_t( i ) + 0] = halfToFloat( m_texcoords[2 * size_t( i ) + 0] );
+          mesh.texcoords[2 * size_t( i ) + 1] = halfToFloat( m_texcoords[2 * size_t( i ) + 1] );
+        }
+      }
+    }
+  } );
+
+  for( int k = 0; k < 3; ++k )
+  {
+    mesh.bbox_min[k] =  1e16f;
+    mesh.bbox_max[k] = -1e16f;
+  }
+  for( size_t i = 0; i < num_vertices; ++i )
+  {
+    for( int k = 0; k < 3; ++k )
+    {
+      mesh.bbox_min[k] = std::min( mesh.bbox_min[k], mesh.positions[3 * i + k] );
+      mesh.bbox_max[k] = std::max( mesh.bbox_max[k], mesh.positions[3 * i + k] );
+    }
+  }
+}
+
+
+void CompressedMesh::triangleVertex( uint32_t tri, int corner, float3* position, float3* normal, float2* texcoord,
+                                     float4* tangent ) const
+{
+  const MeshCluster& c = cluster( tri );
+  const size_t       i = c.first_vertex + m_indices[3 * size_t( tri ) + corner];
+  if( position )
+  {
+    const uint16_t* q = &m_positions[3 * i];
+    *position = optix::make_float3( m_grid_origin[0] + static_cast<float>( c.grid_origin[0] + q[0] ) * c.grid_step,
+                                    m_grid_origin[1] + static_cast<float>( c.grid_origin[1] + q[1] ) * c.grid_step,
+                                    m_grid_origin[2] + static_cast<float>( c.grid_origin[2] + q[2] ) * c.grid_step );
+  }
+  if( normal && hasNormals() )
+    *normal = octDecode( m_normals[2 * i], m_normals[2 * i + 1] );
+  if( texcoord && hasTexcoords() )
+    *texcoord = optix::make_float2( halfToFloat( m_texcoords[2 * i] ), halfToFloat( m_texcoords[2 * i + 1] ) );
+  if( tangent && hasTangents() )
+  {
+    const float3 d = octDecode( m_tangents[2 * i], m_tangents[2 * i + 1] );
+    *tangent = optix::make_float4( d.x, d.y, d.z, ( m_tangents[2 * i + 1] & 1 ) ? -1.0f : 1.0f );
+  }
+}
+
+
+int32_t CompressedMesh::material( uint32_t tri ) const
+{
+  return cluster( tri ).material;
+}
+
+
+size_t CompressedMesh::memoryBytes() const
+{
+  return m_clusters.size() * sizeof( MeshCluster ) + m_cluster_lookup.size() * sizeof( uint32_t ) +
+         m_positions.size() * sizeof( uint16_t ) + m_normals.size() * sizeof( int16_t ) +
+         m_tangents.size() * sizeof( int16_t ) + m_texcoords.size() * sizeof( uint16_t ) + m_indices.size();
+}
+
+
+size_t CompressedMesh::meshBytes( const Mesh& mesh )
+{
+  const size_t v = std::max( mesh.num_vertices, 0 ), t = std::max( mesh.num_triangles, 0 );
+  return v * sizeof( float ) * ( 3 + ( mesh.has_normals ? 3 : 0 ) + ( mesh.has_tangents ? 4 : 0 ) +
+                                 ( mesh.has_texcoords ? 2 : 0 ) ) +
+         t * 4 * sizeof( int32_t );
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "HostBVH.h"
+#include "Mesh.h"
+
+#include <optixu/optixu_math_namespace.h>
+#include <sutilapi.h>
+
+#include <stdint.h>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// CompressedMesh -- quantized, clustered copy of a Mesh for host queries
+//
+// Triangles are cut, in their current order, into clusters of at most
+// max_cluster_triangles triangles, 256 vertices and one material; run
+// optimizeMeshLayout() first so clusters are spatially compact.  Each
+// cluster keeps its own vertex list:
+//   positions: 3 x 16 bits, offsets from the cluster corner on the
+//              cluster's own power of two grid, sized to its bounds; a
+//              vertex shared with a cluster on a coarser grid is rounded on
+//              that grid, so both copies decode to the same float and the
+//              surface stays watertight.  Grids stop at 2^23 steps across
+//              the mesh so grid coordinates stay exact in a float
+//   normals  : octahedral, 2 x 16 bit snorm
+//   tangents : octahedral, 2 x 16 bit snorm, bitangent sign in bit 0 of y
+//   texcoords: 2 x half
+//   indices  : 3 x 8 bits into the cluster's vertex list
+// against 12 + 12 + 16 + 8 bytes per vertex and 16 per triangle (with the
+// material index) uncompressed.  Vertices on cluster borders are stored
+// once per cluster.  The host intersector decodes positions inline;
+// shading attributes are decoded one vertex at a time.
+//
+//-----------------------------------------------------------------------------
+
+struct MeshCluster
+{
+  int32_t  grid_origin[3];    // Cluster corner, in grid steps from the mesh corner
+  float    grid_step;         // Power of two
+  uint32_t first_vertex;      // Into the per vertex arrays
+  uint32_t first_triangle;
+  uint16_t num_triangles;
+  uint16_t num_vertices;
+  int32_t  material;
+};
+
+
+class CompressedMesh
+{
+public:
+  static const unsigned int max_cluster_triangles = 256;
+
+  SUTILAPI CompressedMesh();
+
+  // Replaces the contents with a compressed copy of 'mesh'.
+  SUTILAPI void compress( const Mesh& mesh );
+
+  // Allocates 'mesh' with allocMesh() and fills it with the decoded data;
+  // clusters' duplicated vertices stay separate.
+  SUTILAPI void decompress( Mesh& mesh ) const;
+
+  int32_t numTriangles() const   { return m_num_triangles; }
+  bool    hasNormals() const     { return !m_normals.empty(); }
+  bool    hasTexcoords() const   { return !m_texcoords.empty(); }
+  bool    hasTangents() const    { return !m_tangents.empty(); }
+
+  // Positions of triangle 'tri'.  'cache' may be null; it receives the
+  // cluster, index and position reads.
+  inline void trianglePositions( uint32_t tri, optix::float3 p[3], CacheModel* cache = 0 ) const;
+
+  // Decoded attributes of corner 0..2 of triangle 'tri'; each output may be
+  // null and is left untouched when the mesh lacks the attribute.
+  SUTILAPI void triangleVertex( uint32_t tri, int corner, optix::float3* position, optix::float3* normal,
+                                optix::float2* texcoord, optix::float4* tangent ) const;
+
+  SUTILAPI int32_t material( uint32_t tri ) const;
+
+  SUTILAPI size_t memoryBytes() const;
+
+  // Bytes the same data takes in an uncompressed Mesh.
+  SUTILAPI static size_t meshBytes( const Mesh& mesh );
+
+private:
+  inline const MeshCluster& cluster( uint32_t tri ) const;
+
+  int32_t                     m_num_triangles;
+  float                       m_grid_origin[3];   // Mesh corner
+  std::vector<MeshCluster>    m_clusters;
+  std::vector<uint32_t>       m_cluster_lookup;   // Cluster of triangle 64 * i
+  std::vector<uint16_t>       m_positions;
+  std::vector<int16_t>        m_normals;
+  std::vector<int16_t>        m_tangents;
+  std::vector<uint16_t>       m_texcoords;
+  std::vector<uint8_t>        m_indices;
+  std::vector<MaterialParams> m_mat_params;
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// Inline members
+//
+//-----------------------------------------------------------------------------
+
+inline const MeshCluster& CompressedMesh::cluster( uint32_t tri ) const
+{
+  // Clusters hold at least one triangle, so the scan from the cluster of
+  // the enclosing 64 triangle block is short.
+  uint32_t c = m_cluster_lookup[tri >> 6];
+  while( tri >= m_clusters[c].first_triangle + m_clusters[c].num_triangles )
+    ++c;
+  return m_clusters[c];
+}
+
+
+inline void CompressedMesh::trianglePositions( uint32_t tri, optix::float3 p[3], CacheModel* cache ) const
+{
+  const MeshCluster& c   = cluster( tri );
+  const uint8_t*     idx = &m_indices[3 * size_t( tri )];
+  if( cache )
+  {
+    cache->touch( &c, sizeof( MeshCluster ) );
+    cache->touch( idx, 3 );
+  }
+  for( int k = 0; k < 3; ++k )
+  {
+    const uint16_t* q = &m_positions[3 * size_t( c.first_vertex + idx[k] )];
+    if( cache )
+      cache->touch( q, 3 * sizeof( uint16_t ) );
+    p[k] = optix::make_float3(
+        m_grid_origin[0] + static_cast<float>( c.grid_origin[0] + q[0] ) * c.grid_step,
+        m_grid_origin[1] + static_cast<float>( c.grid_origin[1] + q[1] ) * c.grid_step,
+        m_grid_origin[2] + static_cast<float>( c.grid_origin[2] + q[2] ) * c.grid_step );
+  }
+}
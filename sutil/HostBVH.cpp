@@ -0,0 +1,1208 @@
+#include "HostBVH.h"
+#include "CompressedMesh.h"
+#include "Numa.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define HOST_BVH_SSE2 1
+#endif
+
+using optix::float3;
+
+namespace
+{
+
+const unsigned int bin_count = 16;
+const unsigned int max_depth = 64;   // Deeper nodes become leaves; bounds the traversal stack
+const unsigned int subtree_depth = 8;   // Of the roots of refit and partial rebuild subtrees
+
+
+struct Bounds
+{
+  float3 lo;
+  float3 hi;
+
+  // std::min/max rather than optix::fminf/fmaxf, which go through libm on
+  // the host and dominate the build.
+  void grow( const float3& p )     { grow( p, p ); }
+  void grow( const Bounds& b )     { grow( b.lo, b.hi ); }
+  void grow( const float3& l, const float3& h )
+  {
+    lo.x = std::min( lo.x, l.x ); lo.y = std::min( lo.y, l.y ); lo.z = std::min( lo.z, l.z );
+    hi.x = std::max( hi.x, h.x ); hi.y = std::max( hi.y, h.y ); hi.z = std::max( hi.z, h.z );
+  }
+  float area() const
+  {
+    const float3 e = hi - lo;
+    return e.x < 0.0f ? 0.0f : 2.0f * ( e.x * e.y + e.y * e.z + e.z * e.x );
+  }
+};
+
+
+inline Bounds emptyBounds()
+{
+  const float big = std::numeric_limits<float>::max();
+  Bounds b = { optix::make_float3( big ), optix::make_float3( -big ) };
+  return b;
+}
+
+
+inline Bounds nodeBounds( const BVHNode& n )
+{
+  Bounds b = { optix::make_float3( n.bbox_min[0], n.bbox_min[1], n.bbox_min[2] ),
+               optix::make_float3( n.bbox_max[0], n.bbox_max[1], n.bbox_max[2] ) };
+  return b;
+}
+
+
+inline void setNodeBounds( BVHNode& n, const Bounds& b )
+{
+  n.bbox_min[0] = b.lo.x; n.bbox_min[1] = b.lo.y; n.bbox_min[2] = b.lo.z;
+  n.bbox_max[0] = b.hi.x; n.bbox_max[1] = b.hi.y; n.bbox_max[2] = b.hi.z;
+}
+
+
+inline float component( const float3& v, int axis )
+{
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+
+inline float3 vertex( const float* positions, int32_t index )
+{
+  return optix::make_float3( positions[3 * index + 0], positions[3 * index + 1], positions[3 * index + 2] );
+}
+
+
+struct PrimRef
+{
+  Bounds   box;
+  uint32_t id;
+
+  float3 centroid() const { return 0.5f * ( box.lo + box.hi ); }
+};
+
+
+inline unsigned int binIndex( const float3& c, const float3& lo, const float3& scale, int axis, unsigned int bins )
+{
+  const float b = ( component( c, axis ) - component( lo, axis ) ) * component( scale, axis );
+  return std::min( static_cast<unsigned int>( std::max( b, 0.0f ) ), bins - 1 );
+}
+
+
+struct BuildTask
+{
+  uint32_t     node;
+  uint32_t     begin;
+  uint32_t     end;
+  unsigned int depth;
+};
+
+
+// Entry distance of the ray into the node's box, or false if it misses
+// the box within [tmin, tmax].
+inline bool intersectBox( const BVHNode& n, const float3& o, const float3& inv_dir, float tmin, float tmax,
+                          float& t_enter )
+{
+  const float tx0 = ( n.bbox_min[0] - o.x ) * inv_dir.x, tx1 = ( n.bbox_max[0] - o.x ) * inv_dir.x;
+  const float ty0 = ( n.bbox_min[1] - o.y ) * inv_dir.y, ty1 = ( n.bbox_max[1] - o.y ) * inv_dir.y;
+  const float tz0 = ( n.bbox_min[2] - o.z ) * inv_dir.z, tz1 = ( n.bbox_max[2] - o.z ) * inv_dir.z;
+  t_enter = std::max( std::max( std::min( tx0, tx1 ), std::min( ty0, ty1 ) ), std::max( std::min( tz0, tz1 ), tmin ) );
+  const float t_exit = std::min( std::min( std::max( tx0, tx1 ), std::max( ty0, ty1 ) ), std::min( std::max( tz0, tz1 ), tmax ) );
+  return t_enter <= t_exit;
+}
+
+
+// Top-down binned SAH build over 'refs', which it reorders; leaves index
+// 'triangles', the ids of 'refs' in final order.  'root_depth' is the depth
+// the result will be attached at, so the max_depth limit holds overall.
+void buildNodes( std::vector<PrimRef>& refs, unsigned int max_leaf_size, std::vector<BVHNode>& nodes,
+                 std::vector<uint32_t>& triangles, unsigned int root_depth = 0 )
+{
+  nodes.clear();
+  triangles.clear();
+  if( refs.empty() )
+    return;
+  max_leaf_size = std::max( max_leaf_size, 1u );
+
+  nodes.reserve( 2 * refs.size() );
+  nodes.push_back( BVHNode() );
+  std::vector<BuildTask> tasks;
+  BuildTask root = { 0, 0, static_cast<uint32_t>( refs.size() ), root_depth };
+  tasks.push_back( root );
+
+  while( !tasks.empty() )
+  {
+    const BuildTask task = tasks.back();
+    tasks.pop_back();
+
+    Bounds bounds = emptyBounds(), centroid_bounds = emptyBounds();
+    for( uint32_t i = task.begin; i < task.end; ++i )
+    {
+      bounds.grow( refs[i].box );
+      centroid_bounds.grow( refs[i].centroid() );
+    }
+
+    BVHNode& node = nodes[task.node];
+    setNodeBounds( node, bounds );
+    node.first = task.begin;
+    node.count = task.end - task.begin;
+
+    const uint32_t n = task.end - task.begin;
+    if( n <= 1 || task.depth + 1 >= max_depth )
+      continue;
+
+    // Binned SAH over all three axes in one sweep of the range: unit cost
+    // for a traversal step and for a triangle test.  Small ranges, most of
+    // the nodes, use one bin per triangle.
+    const unsigned int bins = std::min( bin_count, n );
+    const float3 extent = centroid_bounds.hi - centroid_bounds.lo;
+    const float3 scale  = optix::make_float3( extent.x > 0.0f ? bins / extent.x : 0.0f,
+                                              extent.y > 0.0f ? bins / extent.y : 0.0f,
+                                              extent.z > 0.0f ? bins / extent.z : 0.0f );
+    Bounds   bin_bounds[3][bin_count];
+    uint32_t bin_counts[3][bin_count] = { { 0 } };
+    for( int axis = 0; axis < 3; ++axis )
+      for( unsigned int b = 0; b < bins; ++b )
+        bin_bounds[axis][b] = emptyBounds();
+    for( uint32_t i = task.begin; i < task.end; ++i )
+    {
+      const float3 c = refs[i].centroid();
+      for( int axis = 0; axis < 3; ++axis )
+      {
+        const unsigned int b = binIndex( c, centroid_bounds.lo, scale, axis, bins );
+        bin_bounds[axis][b].grow( refs[i].box );
+        ++bin_counts[axis][b];
+      }
+    }
+
+    float best_cost = std::numeric_limits<float>::max();
+    int   best_axis = -1;
+    unsigned int best_bin = 0;
+    for( int axis = 0; axis < 3; ++axis )
+    {
+      if( !( component( extent, axis ) > 0.0f ) )
+        continue;
+
+      float    right_area[bin_count];
+      uint32_t right_count[bin_count];
+      Bounds   right = emptyBounds();
+      uint32_t right_n = 0;
+      for( unsigned int b = bins - 1; b > 0; --b )
+      {
+        right.grow( bin_bounds[axis][b] );
+        right_n += bin_counts[axis][b];
+        right_area[b]  = right.area();
+        right_count[b] = right_n;
+      }
+      Bounds   left = emptyBounds();
+      uint32_t left_n = 0;
+      for( unsigned int b = 0; b + 1 < bins; ++b )
+      {
+        left.grow( bin_bounds[axis][b] );
+        left_n += bin_counts[axis][b];
+        if( left_n == 0 || right_count[b + 1] == 0 )
+          continue;
+        const float cost = left_n * left.area() + right_count[b + 1] * right_area[b + 1];
+        if( cost < best_cost )
+        {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin  = b;
+        }
+      }
+    }
+
+    const float area = bounds.area();
+    if( n <= max_leaf_size && ( best_axis < 0 || area + best_cost >= n * area ) )
+      continue;
+
+    uint32_t mid = task.begin + n / 2;
+    if( best_axis >= 0 )
+    {
+      mid = static_cast<uint32_t>(
+          std::partition( refs.begin() + task.begin, refs.begin() + task.end, [&]( const PrimRef& r ) {
+            return binIndex( r.centroid(), centroid_bounds.lo, scale, best_axis, bins ) <= best_bin;
+          } ) - refs.begin() );
+      if( mid == task.begin || mid == task.end )
+        mid = task.begin + n / 2;
+    }
+
+    const uint32_t left_child = static_cast<uint32_t>( nodes.size() );
+    nodes[task.node].first = left_child;
+    nodes[task.node].count = 0;
+    nodes.push_back( BVHNode() );
+    nodes.push_back( BVHNode() );
+
+    BuildTask right_task = { left_child + 1, mid, task.end, task.depth + 1 };
+    BuildTask left_task  = { left_child, task.begin, mid, task.depth + 1 };
+    tasks.push_back( right_task );
+    tasks.push_back( left_task );
+  }
+
+  triangles.resize( refs.size() );
+  for( size_t i = 0; i < refs.size(); ++i )
+    triangles[i] = refs[i].id;
+}
+
+
+// Triangle sources for traverse().
+struct IndexedTriangles
+{
+  const float*   vertices;
+  const int32_t* indices;
+
+  void positions( uint32_t tri, float3 p[3], CacheModel* cache ) const
+  {
+    const int32_t* idx = indices + 3 * tri;
+    if( cache )
+    {
+      cache->touch( idx, 3 * sizeof( int32_t ) );
+      for( int k = 0; k < 3; ++k )
+        cache->touch( vertices + 3 * idx[k], 3 * sizeof( float ) );
+    }
+    for( int k = 0; k < 3; ++k )
+      p[k] = vertex( vertices, idx[k] );
+  }
+};
+
+
+struct CompressedTriangles
+{
+  const CompressedMesh* mesh;
+
+  void positions( uint32_t tri, float3 p[3], CacheModel* cache ) const { mesh->trianglePositions( tri, p, cache ); }
+};
+
+
+template <class Triangles>
+inline Bounds triangleBounds( const Triangles& triangles, uint32_t tri )
+{
+  float3 p[3];
+  triangles.positions( tri, p, 0 );
+  Bounds b = emptyBounds();
+  for( int k = 0; k < 3; ++k )
+    b.grow( p[k] );
+  return b;
+}
+
+
+// Refits the subtree of 'index' bottom-up and returns its SAH cost: node
+// box areas weighted by one for interior nodes and by the triangle count
+// for leaves.  Recursion is bounded by max_depth.
+template <class Triangles>
+float refitSubtree( std::vector<BVHNode>& nodes, const std::vector<uint32_t>& leaf_triangles,
+                    const Triangles& triangles, uint32_t index )
+{
+  BVHNode& node = nodes[index];
+  Bounds   b    = emptyBounds();
+  float    cost = 0.0f;
+  if( node.count > 0 )
+  {
+    for( uint32_t i = 0; i < node.count; ++i )
+      b.grow( triangleBounds( triangles, leaf_triangles[node.first + i] ) );
+    setNodeBounds( node, b );
+    return node.count * b.area();
+  }
+  for( uint32_t c = 0; c < 2; ++c )
+  {
+    cost += refitSubtree( nodes, leaf_triangles, triangles, node.first + c );
+    b.grow( nodeBounds( nodes[node.first + c] ) );
+  }
+  setNodeBounds( node, b );
+  return cost + b.area();
+}
+
+
+void leafRange( const std::vector<BVHNode>& nodes, uint32_t index, uint32_t& first, uint32_t& count, size_t& num_nodes )
+{
+  const BVHNode& node = nodes[index];
+  ++num_nodes;
+  if( node.count > 0 )
+  {
+    first = std::min( first, node.first );
+    count += node.count;
+    return;
+  }
+  leafRange( nodes, node.first, first, count, num_nodes );
+  leafRange( nodes, node.first + 1, first, count, num_nodes );
+}
+
+
+inline float relativeCost( float cost, float area )
+{
+  return area > 0.0f ? cost / area : 0.0f;
+}
+
+
+// Closest hit among 'count' triangles, tightening 'hit'.
+template <class Triangles>
+inline void intersectLeaf( const uint32_t* ids, uint32_t count, const Triangles& triangles, const float3& o,
+                           const float3& d, float tmin, HostHit& hit, TraversalStats* stats )
+{
+  CacheModel* cache = stats ? stats->cache : 0;
+  if( cache )
+    cache->touch( ids, count * sizeof( uint32_t ) );
+  for( uint32_t i = 0; i < count; ++i )
+  {
+    const uint32_t tri = ids[i];
+    if( stats )
+      ++stats->triangles;
+    float3 p[3];
+    triangles.positions( tri, p, cache );
+
+    const float3 p0 = p[0];
+    const float3 e1 = p[1] - p0;
+    const float3 e2 = p[2] - p0;
+    const float3 pv = optix::cross( d, e2 );
+    const float det = optix::dot( e1, pv );
+    if( det == 0.0f )
+      continue;
+    const float  inv_det = 1.0f / det;
+    const float3 tv      = o - p0;
+    const float  u       = optix::dot( tv, pv ) * inv_det;
+    if( u < 0.0f || u > 1.0f )
+      continue;
+    const float3 qv = optix::cross( tv, e1 );
+    const float  v  = optix::dot( d, qv ) * inv_det;
+    if( v < 0.0f || u + v > 1.0f )
+      continue;
+    const float t = optix::dot( e2, qv ) * inv_det;
+    if( t >= tmin && t < hit.t )
+    {
+      hit.t        = t;
+      hit.triangle = static_cast<int32_t>( tri );
+      hit.u        = u;
+      hit.v        = v;
+    }
+  }
+}
+
+
+template <class Triangles>
+bool traverse( const std::vector<BVHNode>& nodes, const std::vector<uint32_t>& leaf_triangles,
+               const Triangles& triangles, const HostRay& ray, HostHit& hit, TraversalStats* stats )
+{
+  hit.t        = ray.tmax;
+  hit.triangle = -1;
+  if( nodes.empty() )
+    return false;
+
+  const float3 o       = ray.origin;
+  const float3 d       = ray.direction;
+  const float3 inv_dir = optix::make_float3( 1.0f / d.x, 1.0f / d.y, 1.0f / d.z );
+  CacheModel*  cache   = stats ? stats->cache : 0;
+
+  float t_enter;
+  if( stats )
+    ++stats->nodes;
+  if( cache )
+    cache->touch( &nodes[0], sizeof( BVHNode ) );
+  if( !intersectBox( nodes[0], o, inv_dir, ray.tmin, hit.t, t_enter ) )
+    return false;
+
+  // Deferred far children with their entry distances.
+  uint32_t stack[max_depth];
+  float    stack_t[max_depth];
+  unsigned int stack_size = 0;
+  uint32_t node = 0;
+  for( ;; )
+  {
+    const BVHNode& n = nodes[node];
+    if( n.count )
+    {
+      intersectLeaf( &leaf_triangles[n.first], n.count, triangles, o, d, ray.tmin, hit, stats );
+    }
+    else
+    {
+      // Both children share a cache line pair; visit the nearer one first.
+      const BVHNode* children = &nodes[n.first];
+      if( stats )
+        stats->nodes += 2;
+      if( cache )
+        cache->touch( children, 2 * sizeof( BVHNode ) );
+      float t0, t1;
+      const bool hit0 = intersectBox( children[0], o, inv_dir, ray.tmin, hit.t, t0 );
+      const bool hit1 = intersectBox( children[1], o, inv_dir, ray.tmin, hit.t, t1 );
+      if( hit0 && hit1 )
+      {
+        const bool near_first = t0 <= t1;
+        stack[stack_size]     = n.first + ( near_first ? 1 : 0 );
+        stack_t[stack_size++] = near_first ? t1 : t0;
+        node = n.first + ( near_first ? 0 : 1 );
+        continue;
+      }
+      if( hit0 || hit1 )
+      {
+        node = n.first + ( hit0 ? 0 : 1 );
+        continue;
+      }
+    }
+
+    // Skip deferred nodes that start beyond the closest hit found since.
+    while( stack_size > 0 && stack_t[stack_size - 1] > hit.t )
+      --stack_size;
+    if( stack_size == 0 )
+      break;
+    node = stack[--stack_size];
+  }
+
+  return hit.triangle >= 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// QuantizedBVH helpers
+//-----------------------------------------------------------------------------
+
+const unsigned int max_leaf_triangles = 4;     // Largest leaf child a node can encode
+const uint8_t      interior_child     = 7;     // Count field of interior children
+
+
+// 2^e for e in [-126, 127], built exactly from the exponent bits.
+inline float exp2i( int e )
+{
+  const uint32_t bits = static_cast<uint32_t>( e + 127 ) << 23;
+  float f;
+  memcpy( &f, &bits, sizeof( f ) );
+  return f;
+}
+
+
+// Smallest grid exponent whose 255 steps from 'origin' reach 'hi'.
+inline int8_t gridExponent( float origin, float hi )
+{
+  const float extent = hi - origin;
+  int e = extent > 0.0f ? static_cast<int>( ceilf( log2f( extent / 255.0f ) ) ) : -126;
+  e = std::min( std::max( e, -126 ), 127 );
+  while( e < 127 && origin + 255.0f * exp2i( e ) < hi )
+    ++e;
+  return static_cast<int8_t>( e );
+}
+
+
+// Grid coordinates of [lo, hi] on one axis, rounded outward with the same
+// arithmetic traversal decodes them with.
+inline void quantizeAxis( float origin, float step, float lo, float hi, uint8_t& q_lo, uint8_t& q_hi )
+{
+  int l = std::min( std::max( static_cast<int>( floorf( ( lo - origin ) / step ) ), 0 ), 255 );
+  while( l > 0 && static_cast<float>( l ) * step + origin > lo )
+    --l;
+  int h = std::min( std::max( static_cast<int>( ceilf( ( hi - origin ) / step ) ), 0 ), 255 );
+  while( h < 255 && static_cast<float>( h ) * step + origin < hi )
+    ++h;
+  q_lo = static_cast<uint8_t>( l );
+  q_hi = static_cast<uint8_t>( h );
+}
+
+
+// A piece of the binary BVH while it is collapsed: an interior node, or a
+// run of leaf triangles.
+struct CollapseItem
+{
+  Bounds   box;
+  uint32_t node;    // Binary node of interior items
+  uint32_t first;   // Leaf triangle list range of leaf items
+  uint32_t count;   // 0 for interior items
+};
+
+
+// Subtrees of up to max_leaf_triangles triangles, whose triangles are
+// consecutive in the leaf list, become a single leaf item.
+inline CollapseItem collapseItem( const std::vector<BVHNode>& nodes, const std::vector<uint32_t>& subtree_first,
+                                  const std::vector<uint32_t>& subtree_count, uint32_t index )
+{
+  const BVHNode& n = nodes[index];
+  CollapseItem item;
+  item.box.lo = optix::make_float3( n.bbox_min[0], n.bbox_min[1], n.bbox_min[2] );
+  item.box.hi = optix::make_float3( n.bbox_max[0], n.bbox_max[1], n.bbox_max[2] );
+  item.node   = index;
+  item.first  = n.first;
+  item.count  = n.count;
+  if( n.count == 0 && subtree_count[index] <= max_leaf_triangles )
+  {
+    item.first = subtree_first[index];
+    item.count = subtree_count[index];
+  }
+  return item;
+}
+
+
+inline bool canOpen( const CollapseItem& item )
+{
+  return item.count == 0 || item.count > max_leaf_triangles;
+}
+
+
+// Splits an interior item into its children and a long leaf run into
+// halves that keep the run's box.
+inline void openItem( const std::vector<BVHNode>& nodes, const std::vector<uint32_t>& subtree_first,
+                      const std::vector<uint32_t>& subtree_count, const CollapseItem& item, CollapseItem& a,
+                      CollapseItem& b )
+{
+  if( item.count == 0 )
+  {
+    const uint32_t first = nodes[item.node].first;
+    a = collapseItem( nodes, subtree_first, subtree_count, first );
+    b = collapseItem( nodes, subtree_first, subtree_count, first + 1 );
+    return;
+  }
+  a = b = item;
+  a.count = item.count / 2;
+  b.first = item.first + a.count;
+  b.count = item.count - a.count;
+}
+
+
+#if defined(HOST_BVH_SSE2)
+inline __m128 bytesToFloats( const uint8_t* q )
+{
+  int32_t packed;
+  memcpy( &packed, q, sizeof( packed ) );
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bytes = _mm_cvtsi32_si128( packed );
+  return _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_unpacklo_epi8( bytes, zero ), zero ) );
+}
+#endif
+
+
+// Entry distances of the ray into the eight child boxes; returns a bit per
+// non-empty child the ray enters within [tmin, tmax].
+inline unsigned int intersectChildren( const QuantizedBVHNode& n, const float3& o, const float3& inv_dir, float tmin,
+                                       float tmax, float t_enter[8] )
+{
+  const float step[3] = { exp2i( n.exponent[0] ), exp2i( n.exponent[1] ), exp2i( n.exponent[2] ) };
+  unsigned int mask = 0;
+#if defined(HOST_BVH_SSE2)
+  const __m128 origin_x = _mm_set1_ps( n.origin[0] ), step_x = _mm_set1_ps( step[0] );
+  const __m128 origin_y = _mm_set1_ps( n.origin[1] ), step_y = _mm_set1_ps( step[1] );
+  const __m128 origin_z = _mm_set1_ps( n.origin[2] ), step_z = _mm_set1_ps( step[2] );
+  const __m128 o_x = _mm_set1_ps( o.x ), inv_x = _mm_set1_ps( inv_dir.x );
+  const __m128 o_y = _mm_set1_ps( o.y ), inv_y = _mm_set1_ps( inv_dir.y );
+  const __m128 o_z = _mm_set1_ps( o.z ), inv_z = _mm_set1_ps( inv_dir.z );
+  for( int g = 0; g < 8; g += 4 )
+  {
+    const __m128 tx0 = _mm_mul_ps( _mm_sub_ps( _mm_add_ps( _mm_mul_ps( bytesToFloats( n.lo_x + g ), step_x ), origin_x ), o_x ), inv_x );
+    const __m128 tx1 = _mm_mul_ps( _mm_sub_ps( _mm_add_ps( _mm_mul_ps( bytesToFloats( n.hi_x + g ), step_x ), origin_x ), o_x ), inv_x );
+    const __m128 ty0 = _mm_mul_ps( _mm_sub_ps( _mm_add_ps( _mm_mul_ps( bytesToFloats( n.lo_y + g ), step_y ), origin_y ), o_y ), inv_y );
+    const __m128 ty1 = _mm_mul_ps( _mm_sub_ps( _mm_add_ps( _mm_mul_ps( bytesToFloats( n.hi_y + g ), step_y ), origin_y ), o_y ), inv_y );
+    const __m128 tz0 = _mm_mul_ps( _mm_sub_ps( _mm_add_ps( _mm_mul_ps( bytesToFloats( n.lo_z + g ), step_z ), origin_z ), o_z ), inv_z );
+    const __m128 tz1 = _mm_mul_ps( _mm_sub_ps( _mm_add_ps( _mm_mul_ps( bytesToFloats( n.hi_z + g ), step_z ), origin_z ), o_z ), inv_z );
+    const __m128 t_near = _mm_max_ps( _mm_max_ps( _mm_min_ps( tx0, tx1 ), _mm_min_ps( ty0, ty1 ) ),
+                                      _mm_max_ps( _mm_min_ps( tz0, tz1 ), _mm_set1_ps( tmin ) ) );
+    const __m128 t_far  = _mm_min_ps( _mm_min_ps( _mm_max_ps( tx0, tx1 ), _mm_max_ps( ty0, ty1 ) ),
+                                      _mm_min_ps( _mm_max_ps( tz0, tz1 ), _mm_set1_ps( tmax ) ) );
+    _mm_storeu_ps( t_enter + g, t_near );
+    mask |= static_cast<unsigned int>( _mm_movemask_ps( _mm_cmple_ps( t_near, t_far ) ) ) << g;
+  }
+#else
+  for( int c = 0; c < 8; ++c )
+  {
+    const float tx0 = ( n.lo_x[c] * step[0] + n.origin[0] - o.x ) * inv_dir.x;
+    const float tx1 = ( n.hi_x[c] * step[0] + n.origin[0] - o.x ) * inv_dir.x;
+    const float ty0 = ( n.lo_y[c] * step[1] + n.origin[1] - o.y ) * inv_dir.y;
+    const float ty1 = ( n.hi_y[c] * step[1] + n.origin[1] - o.y ) * inv_dir.y;
+    const float tz0 = ( n.lo_z[c] * step[2] + n.origin[2] - o.z ) * inv_dir.z;
+    const float tz1 = ( n.hi_z[c] * step[2] + n.origin[2] - o.z ) * inv_dir.z;
+    t_enter[c] = std::max( std::max( std::min( tx0, tx1 ), std::min( ty0, ty1 ) ), std::max( std::min( tz0, tz1 ), tmin ) );
+    const float t_exit = std::min( std::min( std::max( tx0, tx1 ), std::max( ty0, ty1 ) ), std::min( std::max( tz0, tz1 ), tmax ) );
+    if( t_enter[c] <= t_exit )
+      mask |= 1u << c;
+  }
+#endif
+  unsigned int valid = 0;
+  for( int c = 0; c < 8; ++c )
+    valid |= n.meta[c] ? 1u << c : 0u;
+  return mask & valid;
+}
+
+
+template <class Triangles>
+bool traverseQuantized( const std::vector<QuantizedBVHNode>& nodes, const std::vector<uint32_t>& leaf_triangles,
+                        const Triangles& triangles, const HostRay& ray, HostHit& hit, TraversalStats* stats )
+{
+  hit.t        = ray.tmax;
+  hit.triangle = -1;
+  if( nodes.empty() )
+    return false;
+
+  const float3 o       = ray.origin;
+  const float3 d       = ray.direction;
+  const float3 inv_dir = optix::make_float3( 1.0f / d.x, 1.0f / d.y, 1.0f / d.z );
+  CacheModel*  cache   = stats ? stats->cache : 0;
+
+  // Deferred children: node index or triangle list entry, leaf triangle
+  // count (0 for nodes) and entry distance.  A level adds at most seven;
+  // there are max_depth levels from the binary tree plus up to 32 from
+  // halving oversized leaves.
+  const unsigned int stack_capacity = 8 * ( max_depth + 32 );
+  uint32_t     stack[stack_capacity];
+  uint8_t      stack_count[stack_capacity];
+  float        stack_t[stack_capacity];
+  unsigned int stack_size = 1;
+  stack[0]       = 0;
+  stack_count[0] = 0;
+  stack_t[0]     = ray.tmin;
+
+  while( stack_size > 0 )
+  {
+    --stack_size;
+    if( stack_t[stack_size] > hit.t )
+      continue;
+    const uint32_t item = stack[stack_size];
+    if( stack_count[stack_size] )
+    {
+      intersectLeaf( &leaf_triangles[item], stack_count[stack_size], triangles, o, d, ray.tmin, hit, stats );
+      continue;
+    }
+
+    const QuantizedBVHNode& n = nodes[item];
+    if( cache )
+      cache->touch( &n, sizeof( QuantizedBVHNode ) );
+    float t_enter[8];
+    unsigned int mask = intersectChildren( n, o, inv_dir, ray.tmin, hit.t, t_enter );
+    if( stats )
+      for( int c = 0; c < 8; ++c )
+        stats->nodes += n.meta[c] ? 1 : 0;
+
+    // Push the hit children farthest first, so the nearest is popped next.
+    int   order[8];
+    int   hits = 0;
+    for( ; mask; mask &= mask - 1 )
+    {
+      int c = 0;
+      while( !( mask & ( 1u << c ) ) )
+        ++c;
+      int i = hits++;
+      for( ; i > 0 && t_enter[order[i - 1]] < t_enter[c]; --i )
+        order[i] = order[i - 1];
+      order[i] = c;
+    }
+    for( int i = 0; i < hits; ++i )
+    {
+      const int     c      = order[i];
+      const uint8_t count  = n.meta[c] >> 5;
+      const uint8_t offset = n.meta[c] & 31u;
+      if( count == interior_child )
+      {
+        stack[stack_size]       = n.child_base + offset;
+        stack_count[stack_size] = 0;
+      }
+      else
+      {
+        stack[stack_size]       = n.triangle_base + offset;
+        stack_count[stack_size] = count;
+      }
+      stack_t[stack_size++] = t_enter[c];
+    }
+  }
+
+  return hit.triangle >= 0;
+}
+
+} // namespace
+
+
+//-----------------------------------------------------------------------------
+//
+// CacheModel
+//
+//-----------------------------------------------------------------------------
+
+CacheModel::CacheModel( size_t bytes, unsigned int ways, unsigned int line_bytes )
+  : accesses( 0 ),
+    misses( 0 ),
+    local_misses( 0 ),
+    remote_misses( 0 ),
+    m_ways( std::max( ways, 1u ) ),
+    m_line_shift( 0 ),
+    m_clock( 0 ),
+    m_numa_pages( 0 ),
+    m_numa_node( -1 )
+{
+  while( ( 2u << m_line_shift ) <= line_bytes )
+    ++m_line_shift;
+  m_sets = std::max<size_t>( bytes / ( size_t( m_ways ) << m_line_shift ), 1 );
+  m_tags.assign( m_sets * m_ways, 0 );
+  m_used.assign( m_sets * m_ways, 0 );
+}
+
+
+void CacheModel::touch( const void* address, size_t bytes )
+{
+  const uint64_t first = reinterpret_cast<uintptr_t>( address ) >> m_line_shift;
+  const uint64_t last  = ( reinterpret_cast<uintptr_t>( address ) + std::max<size_t>( bytes, 1 ) - 1 ) >> m_line_shift;
+  for( uint64_t line = first; line <= last; ++line )
+  {
+    ++accesses;
+    const size_t set = static_cast<size_t>( line % m_sets ) * m_ways;
+    size_t victim = set;
+    bool hit = false;
+    for( size_t w = set; w < set + m_ways; ++w )
+    {
+      if( m_tags[w] == line + 1 )
+      {
+        m_used[w] = ++m_clock;
+        hit = true;
+        break;
+      }
+      if( m_used[w] < m_used[victim] )
+        victim = w;
+    }
+    if( !hit )
+    {
+      ++misses;
+      if( m_numa_pages )
+      {
+        const int node = m_numa_pages->node( reinterpret_cast<const void*>( line << m_line_shift ) );
+        if( node >= 0 && node != m_numa_node )
+          ++remote_misses;
+        else
+          ++local_misses;
+      }
+      m_tags[victim] = line + 1;
+      m_used[victim] = ++m_clock;
+    }
+  }
+}
+
+
+void CacheModel::setNumaPages( const NumaPageMap* pages, int node )
+{
+  m_numa_pages = pages;
+  m_numa_node  = node;
+}
+
+
+void CacheModel::clear()
+{
+  accesses = misses = local_misses = remote_misses = 0;
+  std::fill( m_tags.begin(), m_tags.end(), 0 );
+  std::fill( m_used.begin(), m_used.end(), 0 );
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// HostBVH
+//
+//-----------------------------------------------------------------------------
+
+HostBVH::HostBVH()
+  : m_positions( 0 ),
+    m_indices( 0 ),
+    m_compressed( 0 ),
+    m_max_leaf_size( 4 ),
+    m_cost( 0.0f ),
+    m_built_cost( 0.0f ),
+    m_unused_nodes( 0 )
+{
+}
+
+
+void HostBVH::build( const Mesh& mesh, unsigned int max_leaf_size )
+{
+  m_positions     = mesh.positions;
+  m_indices       = mesh.tri_indices;
+  m_compressed    = 0;
+  m_max_leaf_size = max_leaf_size;
+  const IndexedTriangles triangles = { m_positions, m_indices };
+  buildWith( triangles, std::max( mesh.num_triangles, 0 ) );
+}
+
+
+void HostBVH::build( const CompressedMesh& mesh, unsigned int max_leaf_size )
+{
+  m_positions     = 0;
+  m_indices       = 0;
+  m_compressed    = &mesh;
+  m_max_leaf_size = max_leaf_size;
+  const CompressedTriangles triangles = { m_compressed };
+  buildWith( triangles, mesh.numTriangles() );
+}
+
+
+void HostBVH::assign( const float* positions, const int32_t* indices, std::vector<BVHNode>& nodes,
+                      std::vector<uint32_t>& triangles, unsigned int max_leaf_size )
+{
+  m_positions     = positions;
+  m_indices       = indices;
+  m_compressed    = 0;
+  m_max_leaf_size = max_leaf_size;
+  m_nodes.clear();
+  m_triangles.clear();
+  m_nodes.swap( nodes );
+  m_triangles.swap( triangles );
+
+  // The refit in resetSubtrees() is a small fraction of a build.
+  const IndexedTriangles source = { m_positions, m_indices };
+  resetSubtrees( source );
+}
+
+
+void HostBVH::refit()
+{
+  if( m_compressed )
+  {
+    const CompressedTriangles triangles = { m_compressed };
+    refitWith( triangles );
+    return;
+  }
+  const IndexedTriangles triangles = { m_positions, m_indices };
+  refitWith( triangles );
+}
+
+
+unsigned int HostBVH::update( float max_degradation )
+{
+  if( m_compressed )
+  {
+    const CompressedTriangles triangles = { m_compressed };
+    return updateWith( triangles, max_degradation );
+  }
+  const IndexedTriangles triangles = { m_positions, m_indices };
+  return updateWith( triangles, max_degradation );
+}
+
+
+float HostBVH::degradation() const
+{
+  if( m_nodes.empty() || !( m_built_cost > 0.0f ) )
+    return 1.0f;
+  return relativeCost( m_cost, nodeBounds( m_nodes[0] ).area() ) / m_built_cost;
+}
+
+
+template <class Triangles>
+void HostBVH::buildWith( const Triangles& triangles, size_t num_triangles )
+{
+  // Triangle boxes are partitioned in place, so every node works on a
+  // contiguous range instead of gathering through triangle ids.
+  std::vector<PrimRef> refs( num_triangles );
+  sutil::parallelFor( refs.size(), 1u << 14, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      refs[i].box = triangleBounds( triangles, static_cast<uint32_t>( i ) );
+      refs[i].id  = static_cast<uint32_t>( i );
+    }
+  } );
+  buildNodes( refs, m_max_leaf_size, m_nodes, m_triangles );
+  resetSubtrees( triangles );
+}
+
+
+template <class Triangles>
+void HostBVH::resetSubtrees( const Triangles& triangles )
+{
+  m_subtrees.clear();
+  m_unused_nodes = 0;
+  m_cost         = 0.0f;
+  m_built_cost   = 0.0f;
+  if( m_nodes.empty() )
+    return;
+  collectSubtrees( 0, 0 );
+  refitWith( triangles );
+  for( size_t i = 0; i < m_subtrees.size(); ++i )
+    m_subtrees[i].built_cost = relativeCost( m_subtrees[i].cost, m_subtrees[i].area );
+  m_built_cost = relativeCost( m_cost, nodeBounds( m_nodes[0] ).area() );
+}
+
+
+template <class Triangles>
+void HostBVH::refitWith( const Triangles& triangles )
+{
+  if( m_nodes.empty() )
+    return;
+
+  // Subtrees are disjoint, so they refit in parallel; the few nodes above
+  // them follow.
+  sutil::parallelFor( m_subtrees.size(), 1, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      Subtree& s = m_subtrees[i];
+      s.cost = refitSubtree( m_nodes, m_triangles, triangles, s.root );
+      s.area = nodeBounds( m_nodes[s.root] ).area();
+    }
+  } );
+  size_t next_subtree = 0;
+  m_cost = refitTop( 0, next_subtree );
+}
+
+
+template <class Triangles>
+unsigned int HostBVH::updateWith( const Triangles& triangles, float max_degradation )
+{
+  refitWith( triangles );
+  if( m_nodes.empty() )
+    return 0;
+
+  std::vector<uint32_t> degraded;
+  for( size_t i = 0; i < m_subtrees.size(); ++i )
+  {
+    const Subtree& s = m_subtrees[i];
+    if( relativeCost( s.cost, s.area ) > max_degradation * s.built_cost )
+      degraded.push_back( static_cast<uint32_t>( i ) );
+  }
+
+  // Past half of the subtrees a full rebuild costs about the same and also
+  // fixes the top levels; it also reclaims the nodes partial rebuilds left.
+  if( 2 * degraded.size() > m_subtrees.size() || 2 * m_unused_nodes > m_nodes.size() )
+  {
+    buildWith( triangles, m_triangles.size() );
+    return numSubtrees();
+  }
+  if( !degraded.empty() )
+  {
+    rebuildSubtrees( triangles, degraded );
+    size_t next_subtree = 0;
+    m_cost = refitTop( 0, next_subtree );
+  }
+  if( degradation() > max_degradation )
+  {
+    buildWith( triangles, m_triangles.size() );
+    return numSubtrees();
+  }
+  return static_cast<unsigned int>( degraded.size() );
+}
+
+
+template <class Triangles>
+void HostBVH::rebuildSubtrees( const Triangles& triangles, const std::vector<uint32_t>& which )
+{
+  // Build the replacements in parallel over each subtree's own leaf list
+  // range, then splice them in: the new root overwrites the old one, which
+  // its parent points at, and the other nodes are appended.
+  std::vector<std::vector<BVHNode> >  new_nodes( which.size() );
+  std::vector<std::vector<uint32_t> > new_triangles( which.size() );
+  sutil::parallelFor( which.size(), 1, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      const Subtree&       s = m_subtrees[which[i]];
+      std::vector<PrimRef> refs( s.num_triangles );
+      for( uint32_t j = 0; j < s.num_triangles; ++j )
+      {
+        refs[j].id  = m_triangles[s.first_triangle + j];
+        refs[j].box = triangleBounds( triangles, refs[j].id );
+      }
+      buildNodes( refs, m_max_leaf_size, new_nodes[i], new_triangles[i], s.depth );
+    }
+  } );
+
+  for( size_t i = 0; i < which.size(); ++i )
+  {
+    Subtree& s = m_subtrees[which[i]];
+    uint32_t first = std::numeric_limits<uint32_t>::max(), count = 0;
+    size_t   old_nodes = 0;
+    leafRange( m_nodes, s.root, first, count, old_nodes );
+    m_unused_nodes += old_nodes - 1;
+
+    std::copy( new_triangles[i].begin(), new_triangles[i].end(), m_triangles.begin() + s.first_triangle );
+    const std::vector<BVHNode>& local = new_nodes[i];
+    const uint32_t base = static_cast<uint32_t>( m_nodes.size() ) - 1;   // Local node k > 0 lands at base + k
+    for( size_t k = 0; k < local.size(); ++k )
+    {
+      BVHNode n = local[k];
+      n.first += n.count > 0 ? s.first_triangle : base;
+      if( k == 0 )
+        m_nodes[s.root] = n;
+      else
+        m_nodes.push_back( n );
+    }
+
+    s.cost       = refitSubtree( m_nodes, m_triangles, triangles, s.root );
+    s.area       = nodeBounds( m_nodes[s.root] ).area();
+    s.built_cost = relativeCost( s.cost, s.area );
+  }
+}
+
+
+void HostBVH::collectSubtrees( uint32_t node, unsigned int depth )
+{
+  const BVHNode& n = m_nodes[node];
+  if( depth < subtree_depth && n.count == 0 )
+  {
+    collectSubtrees( n.first, depth + 1 );
+    collectSubtrees( n.first + 1, depth + 1 );
+    return;
+  }
+  Subtree s = { node, depth, std::numeric_limits<uint32_t>::max(), 0, 0.0f, 0.0f, 0.0f };
+  size_t  num_nodes = 0;
+  leafRange( m_nodes, node, s.first_triangle, s.num_triangles, num_nodes );
+  m_subtrees.push_back( s );
+}
+
+
+float HostBVH::refitTop( uint32_t node, size_t& next_subtree )
+{
+  // Meets subtree roots in collectSubtrees() order.  A partial rebuild can
+  // turn a shallow leaf root into an interior node, so roots are matched by
+  // index rather than by depth.
+  if( next_subtree < m_subtrees.size() && m_subtrees[next_subtree].root == node )
+    return m_subtrees[next_subtree++].cost;
+  const BVHNode& n = m_nodes[node];
+  const float cost = refitTop( n.first, next_subtree ) + refitTop( n.first + 1, next_subtree );
+  Bounds b = nodeBounds( m_nodes[n.first] );
+  b.grow( nodeBounds( m_nodes[n.first + 1] ) );
+  setNodeBounds( m_nodes[node], b );
+  return cost + b.area();
+}
+
+
+bool HostBVH::intersect( const HostRay& ray, HostHit& hit, TraversalStats* stats ) const
+{
+  if( m_compressed )
+  {
+    const CompressedTriangles triangles = { m_compressed };
+    return traverse( m_nodes, m_triangles, triangles, ray, hit, stats );
+  }
+  const IndexedTriangles triangles = { m_positions, m_indices };
+  return traverse( m_nodes, m_triangles, triangles, ray, hit, stats );
+}
+
+
+size_t HostBVH::memoryBytes() const
+{
+  return m_nodes.size() * sizeof( BVHNode ) + m_triangles.size() * sizeof( uint32_t );
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// QuantizedBVH
+//
+//-----------------------------------------------------------------------------
+
+QuantizedBVH::QuantizedBVH()
+  : m_source( 0 )
+{
+}
+
+
+void QuantizedBVH::build( const HostBVH& bvh )
+{
+  m_source = &bvh;
+  m_nodes.clear();
+  m_triangles.clear();
+  const std::vector<BVHNode>& binary = bvh.m_nodes;
+  if( binary.empty() )
+    return;
+
+  // Leaf list range of every subtree; children follow their parents.
+  std::vector<uint32_t> subtree_first( binary.size() ), subtree_count( binary.size() );
+  for( size_t i = binary.size(); i-- > 0; )
+  {
+    const BVHNode& n = binary[i];
+    subtree_first[i] = n.count ? n.first : subtree_first[n.first];
+    subtree_count[i] = n.count ? n.count : subtree_count[n.first] + subtree_count[n.first + 1];
+  }
+
+  struct Task
+  {
+    uint32_t     node;
+    CollapseItem item;
+  };
+  std::vector<Task> tasks;
+  m_nodes.reserve( binary.size() / 3 + 1 );
+  m_triangles.reserve( bvh.m_triangles.size() );
+  m_nodes.push_back( QuantizedBVHNode() );
+  Task root = { 0, collapseItem( binary, subtree_first, subtree_count, 0 ) };
+  tasks.push_back( root );
+
+  while( !tasks.empty() )
+  {
+    const Task task = tasks.back();
+    tasks.pop_back();
+
+    // Open the largest openable child until there are eight.
+    CollapseItem children[8];
+    unsigned int num_children = 1;
+    children[0] = task.item;
+    if( canOpen( task.item ) )
+    {
+      openItem( binary, subtree_first, subtree_count, task.item, children[0], children[1] );
+      num_children = 2;
+    }
+    while( num_children < 8 )
+    {
+      int   best = -1;
+      float best_area = -1.0f;
+      for( unsigned int c = 0; c < num_children; ++c )
+      {
+        if( canOpen( children[c] ) && children[c].box.area() > best_area )
+        {
+          best      = static_cast<int>( c );
+          best_area = children[c].box.area();
+        }
+      }
+      if( best < 0 )
+        break;
+      const CollapseItem item = children[best];
+      openItem( binary, subtree_first, subtree_count, item, children[best], children[num_children++] );
+    }
+
+    QuantizedBVHNode node;
+    memset( &node, 0, sizeof( node ) );
+    Bounds box = emptyBounds();
+    for( unsigned int c = 0; c < num_children; ++c )
+      box.grow( children[c].box );
+    node.origin[0] = box.lo.x;
+    node.origin[1] = box.lo.y;
+    node.origin[2] = box.lo.z;
+    node.exponent[0] = gridExponent( box.lo.x, box.hi.x );
+    node.exponent[1] = gridExponent( box.lo.y, box.hi.y );
+    node.exponent[2] = gridExponent( box.lo.z, box.hi.z );
+    node.child_base    = static_cast<uint32_t>( m_nodes.size() );
+    node.triangle_base = static_cast<uint32_t>( m_triangles.size() );
+
+    uint32_t num_interior = 0, leaf_offset = 0;
+    for( unsigned int c = 0; c < num_children; ++c )
+    {
+      const CollapseItem& child = children[c];
+      if( canOpen( child ) )
+      {
+        node.meta[c] = static_cast<uint8_t>( interior_child << 5 | num_interior );
+        Task t = { node.child_base + num_interior++, child };
+        tasks.push_back( t );
+      }
+      else
+      {
+        node.meta[c] = static_cast<uint8_t>( child.count << 5 | leaf_offset );
+        leaf_offset += child.count;
+        m_triangles.insert( m_triangles.end(), bvh.m_triangles.begin() + child.first,
+                            bvh.m_triangles.begin() + child.first + child.count );
+      }
+      quantizeAxis( node.origin[0], exp2i( node.exponent[0] ), child.box.lo.x, child.box.hi.x, node.lo_x[c], node.hi_x[c] );
+      quantizeAxis( node.origin[1], exp2i( node.exponent[1] ), child.box.lo.y, child.box.hi.y, node.lo_y[c], node.hi_y[c] );
+      quantizeAxis( node.origin[2], exp2i( node.exponent[2] ), child.box.lo.z, child.box.hi.z, node.lo_z[c], node.hi_z[c] );
+    }
+    m_nodes.resize( m_nodes.size() + num_interior );
+    m_nodes[task.node] = node;
+  }
+}
+
+
+bool QuantizedBVH::intersect( const HostRay& ray, HostHit& hit, TraversalStats* stats ) const
+{
+  if( m_source && m_source->m_compressed )
+  {
+    const CompressedTriangles triangles = { m_source->m_compressed };
+    return traverseQuantized( m_nodes, m_triangles, triangles, ray, hit, stats );
+  }
+  const IndexedTriangles triangles = { m_source ? m_source->m_positions : 0, m_source ? m_source->m_indices : 0 };
+  return traverseQuantized( m_nodes, m_triangles, triangles, ray, hit, stats );
+}
+
+
+size_t QuantizedBVH::memoryBytes() const
+{
+  return m_nodes.size() * sizeof( QuantizedBVHNode ) + m_triangles.size() * sizeof( uint32_t );
+}
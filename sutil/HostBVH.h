@@ -0,0 +1,248 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <optixu/optixu_math_namespace.h>
+#include <sutilapi.h>
+
+#include <stdint.h>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// HostBVH -- CPU ray queries against a Mesh
+//
+// OptiX builds and traverses its own acceleration structures on the device;
+// this binary BVH answers the same queries on the host, for tools that
+// measure how mesh layout and memory format affect traversal.  Nodes are
+// built top-down with binned SAH over triangle centroids and stored in
+// build order, the two children of an interior node side by side.  Leaves
+// index a list of triangle ids, so the mesh itself is never reordered.
+// Triangles come either from a Mesh or from a CompressedMesh, whose
+// positions are decoded as traversal reaches them.
+//
+// For animated geometry the tree is refit rather than rebuilt: boxes are
+// recomputed bottom-up from the moved vertices and the topology is kept.
+// The subtrees hanging 8 levels below the root are refit in parallel and
+// are also the unit of partial rebuilds; update() rebuilds the ones whose
+// SAH cost, relative to their root box area, grew past a threshold since
+// they were built, and the whole tree when that is cheaper or the top
+// levels degraded too.
+//
+//-----------------------------------------------------------------------------
+
+class CompressedMesh;
+class NumaPageMap;
+
+
+struct HostRay
+{
+  optix::float3 origin;
+  float         tmin;
+  optix::float3 direction;
+  float         tmax;
+};
+
+struct HostHit
+{
+  float   t;
+  int32_t triangle;   // -1 on a miss
+  float   u;          // barycentrics of vertices 1 and 2
+  float   v;
+};
+
+struct BVHNode
+{
+  float    bbox_min[3];
+  uint32_t first;     // Left child (interior) or first triangle list entry (leaf)
+  float    bbox_max[3];
+  uint32_t count;     // 0 for interior nodes, triangles in a leaf otherwise
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// CacheModel -- set associative LRU model of a data cache
+//
+// Fed with the address ranges a traversal reads, it counts the cache lines
+// a real cache of this geometry would miss.  Only used for measurements.
+//
+//-----------------------------------------------------------------------------
+
+class CacheModel
+{
+public:
+  SUTILAPI explicit CacheModel( size_t bytes = 256 * 1024, unsigned int ways = 8, unsigned int line_bytes = 64 );
+
+  SUTILAPI void touch( const void* address, size_t bytes );
+  SUTILAPI void clear();
+
+  // Splits misses by the node of the memory they fetch, as recorded in
+  // 'pages', against 'node', the kernel node number of the reading thread.
+  // Null 'pages' stops the split.
+  SUTILAPI void setNumaPages( const NumaPageMap* pages, int node );
+
+  uint64_t accesses;        // Cache lines touched
+  uint64_t misses;
+  uint64_t local_misses;    // With setNumaPages(); unrecorded memory counts as local
+  uint64_t remote_misses;
+
+private:
+  unsigned int          m_ways;
+  unsigned int          m_line_shift;
+  size_t                m_sets;
+  uint64_t              m_clock;
+  std::vector<uint64_t> m_tags;    // m_sets x m_ways, line address + 1, 0 when empty
+  std::vector<uint64_t> m_used;    // Last use per way
+  const NumaPageMap*    m_numa_pages;
+  int                   m_numa_node;
+};
+
+struct TraversalStats
+{
+  uint64_t    nodes;       // Node boxes tested
+  uint64_t    triangles;   // Ray/triangle tests
+  CacheModel* cache;       // Optional; receives every node, index and vertex read
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// HostBVH
+//
+//-----------------------------------------------------------------------------
+
+class HostBVH
+{
+public:
+  SUTILAPI HostBVH();
+
+  // Builds over the positions and triangles of 'mesh', which must stay
+  // alive while the BVH is used.  Positions may change in place between
+  // queries if refit() or update() follows every change.
+  SUTILAPI void build( const Mesh& mesh, unsigned int max_leaf_size = 4 );
+  SUTILAPI void build( const CompressedMesh& mesh, unsigned int max_leaf_size = 4 );
+
+  // Takes over 'nodes' and 'triangles', saved from a HostBVH built over the
+  // same positions and 3 indices per triangle, leaving both arguments
+  // empty; used to load trees from disk without building them.
+  SUTILAPI void assign( const float* positions, const int32_t* indices, std::vector<BVHNode>& nodes,
+                        std::vector<uint32_t>& triangles, unsigned int max_leaf_size = 4 );
+
+  // Recomputes all boxes from the current positions, keeping the topology.
+  SUTILAPI void refit();
+
+  // refit(), then rebuilds the subtrees whose SAH cost degraded by more
+  // than 'max_degradation' times, or the whole tree.  Returns the number of
+  // subtrees rebuilt, numSubtrees() for a full rebuild.
+  SUTILAPI unsigned int update( float max_degradation = 1.5f );
+
+  // SAH cost of the tree relative to its root box area, divided by the same
+  // measure when it was built; 1 right after a build.
+  SUTILAPI float degradation() const;
+
+  unsigned int numSubtrees() const { return static_cast<unsigned int>( m_subtrees.size() ); }
+  unsigned int maxLeafSize() const { return m_max_leaf_size; }
+
+  // Closest hit in [ray.tmin, ray.tmax].  'stats' may be null.
+  SUTILAPI bool intersect( const HostRay& ray, HostHit& hit, TraversalStats* stats = 0 ) const;
+
+  const std::vector<BVHNode>&  nodes() const     { return m_nodes; }
+
+  // Triangle ids in leaf order, the order reorderMeshTriangles() expects
+  // for a BVH guided layout.
+  const std::vector<uint32_t>& triangles() const { return m_triangles; }
+
+  // Includes the nodes of subtrees replaced by partial rebuilds, which stay
+  // allocated until the next full rebuild.
+  SUTILAPI size_t memoryBytes() const;
+
+private:
+  friend class QuantizedBVH;
+
+  struct Subtree
+  {
+    uint32_t     root;
+    unsigned int depth;            // Of the root
+    uint32_t     first_triangle;   // Leaf list range, fixed for the life of the tree
+    uint32_t     num_triangles;
+    float        cost;             // SAH cost at the last refit, in area units
+    float        area;             // Root box area at the last refit
+    float        built_cost;       // cost / area when the subtree was built
+  };
+
+  template <class Triangles> void buildWith( const Triangles& triangles, size_t num_triangles );
+  template <class Triangles> void resetSubtrees( const Triangles& triangles );
+  template <class Triangles> void refitWith( const Triangles& triangles );
+  template <class Triangles> unsigned int updateWith( const Triangles& triangles, float max_degradation );
+  template <class Triangles> void rebuildSubtrees( const Triangles& triangles, const std::vector<uint32_t>& which );
+  void  collectSubtrees( uint32_t node, unsigned int depth );
+  float refitTop( uint32_t node, size_t& next_subtree );
+
+  const float*          m_positions;      // Set for Mesh geometry
+  const int32_t*        m_indices;
+  const CompressedMesh* m_compressed;     // Set for CompressedMesh geometry
+  unsigned int          m_max_leaf_size;
+  std::vector<BVHNode>  m_nodes;
+  std::vector<uint32_t> m_triangles;
+  std::vector<Subtree>  m_subtrees;       // Left to right
+  float                 m_cost;           // SAH cost of the whole tree at the last refit
+  float                 m_built_cost;     // m_cost / root area when built
+  size_t                m_unused_nodes;   // Left behind by partial rebuilds
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// QuantizedBVH -- 8-wide BVH with 8-bit child boxes
+//
+// Collapses a HostBVH into nodes of up to eight children, as in compressed
+// wide BVHs.  A node stores its box corner and a power of two grid step
+// per axis; child boxes are 8-bit grid coordinates rounded outward, so a
+// decoded box always contains the exact one.  Leaf children hold up to
+// four triangles, listed consecutively from the node's triangle_base, and
+// take whole binary subtrees that small.
+// Traversal decodes and tests four children per SSE2 step.
+//
+//-----------------------------------------------------------------------------
+
+struct QuantizedBVHNode
+{
+  float    origin[3];        // Grid corner
+  int8_t   exponent[3];      // Grid step 2^exponent per axis
+  uint8_t  pad;
+  uint32_t child_base;       // First interior child; interior children are consecutive
+  uint32_t triangle_base;    // First triangle list entry of the leaf children
+  uint8_t  meta[8];          // count << 5 | offset: count 0 empty, 1-4 leaf triangles
+                             // at triangle_base + offset, 7 interior node child_base + offset
+  uint8_t  lo_x[8];
+  uint8_t  lo_y[8];
+  uint8_t  lo_z[8];
+  uint8_t  hi_x[8];
+  uint8_t  hi_y[8];
+  uint8_t  hi_z[8];
+};
+
+
+class QuantizedBVH
+{
+public:
+  SUTILAPI QuantizedBVH();
+
+  // Converts 'bvh', which must stay alive with its geometry while this
+  // tree is used.  Boxes are copied, so convert again after 'bvh' is refit
+  // or updated.
+  SUTILAPI void build( const HostBVH& bvh );
+
+  // Same contract as HostBVH::intersect().
+  SUTILAPI bool intersect( const HostRay& ray, HostHit& hit, TraversalStats* stats = 0 ) const;
+
+  const std::vector<QuantizedBVHNode>& nodes() const { return m_nodes; }
+
+  SUTILAPI size_t memoryBytes() const;
+
+private:
+  const HostBVH*                m_source;
+  std::vector<QuantizedBVHNode> m_nodes;
+  std::vector<uint32_t>         m_triangles;
+};
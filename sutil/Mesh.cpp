@@ -31,6 +31,8 @@
 #include <optixu/optixu_math_stream_namespace.h>
 
 #include "Mesh.h" 
+#include "BinaryPLY.h"
+#include "MeshProcessing.h"
 #include "rply-1.01/rply.h"
 #include "tinyobjloader/tiny_obj_loader.h"
 #include <algorithm>
@@ -92,6 +94,11 @@ bool checkValid( const Mesh& mesh )
     std::cerr << "Mesh has texcoords, but texcoords is NULL" << std::endl;
     return false;
   }
+  if( mesh.has_tangents && !mesh.tangents )
+  {
+    std::cerr << "Mesh has tangents, but tangents is NULL" << std::endl;
+    return false;
+  }
   if ( mesh.num_materials == 0 )
   {
     std::cerr << "Mesh not valid: num_materials = 0" << std::endl;
@@ -159,6 +166,7 @@ bool fileIsPLY( const std::string& filename )
 struct PlyData
 {
   Mesh* mesh;
+  bool has_normals;   // file provides nx, ny, nz
   int32_t cur_vertex;
   int32_t cur_index;
 };
@@ -189,7 +197,7 @@ int plyLoadVertex( p_ply_argument argument )
       data->mesh->positions[3*data->cur_vertex+2] = value;
       data->mesh->bbox_min[2] = std::min( data->mesh->bbox_min[2], value );
       data->mesh->bbox_max[2] = std::max( data->mesh->bbox_max[2], value );
-      if( !data->mesh->has_normals )
+      if( !data->has_normals )
         ++data->cur_vertex;
       break;
 
@@ -241,47 +249,6 @@ int plyLoadFace( p_ply_argument argument )
   return 1;
 }
 
-  
-void applyLoadXForm( Mesh& mesh, const float* load_xform )
-{
-  if( !load_xform )
-      return;
-
-  bool have_matrix = false;
-  for( int32_t i = 0; i < 16; ++i )
-    if( load_xform[i] != 0.0f )
-      have_matrix = true;
-
-  if( have_matrix )
-  {
-    mesh.bbox_min[0] = mesh.bbox_min[1] = mesh.bbox_min[2] =  1e16f;
-    mesh.bbox_max[0] = mesh.bbox_max[1] = mesh.bbox_max[2] = -1e16f;
-
-    optix::Matrix4x4 mat( load_xform );
-
-    float3* positions = reinterpret_cast<float3*>( mesh.positions );
-    for( int32_t i = 0; i < mesh.num_vertices; ++i )
-    {
-      const float3 v = optix::make_float3( mat*optix::make_float4( positions[i], 1.0f ) );
-      positions[i] = v; 
-      mesh.bbox_min[0] = std::min<float>( mesh.bbox_min[0], v.x );
-      mesh.bbox_min[1] = std::min<float>( mesh.bbox_min[1], v.y );
-      mesh.bbox_min[2] = std::min<float>( mesh.bbox_min[2], v.z );
-      mesh.bbox_max[0] = std::max<float>( mesh.bbox_max[0], v.x );
-      mesh.bbox_max[1] = std::max<float>( mesh.bbox_max[1], v.y );
-      mesh.bbox_max[2] = std::max<float>( mesh.bbox_max[2], v.z );
-    }
-
-    if( mesh.has_normals )
-    {
-      mat = mat.inverse().transpose();
-      float3* normals = reinterpret_cast<float3*>( mesh.normals );
-      for( int32_t i = 0; i < mesh.num_vertices; ++i )
-        normals[i] = optix::make_float3( mat*optix::make_float4( normals[i], 1.0f ) );
-    }
-  }
-}
-
 } 
 
 //------------------------------------------------------------------------------
@@ -312,6 +279,7 @@ private:
   };
   std::string                         m_filename;
   FileType                            m_filetype;
+  bool                                m_file_normals;   // normals come from the file, not processMesh
   
   std::vector<tinyobj::shape_t>       m_shapes;
   std::vector<tinyobj::material_t>    m_materials;
@@ -319,7 +287,8 @@ private:
 
 
 MeshLoader::Impl::Impl( const std::string& filename )
-  : m_filename( filename )
+  : m_filename( filename ),
+    m_file_normals( false )
 {
    if( fileIsOBJ( m_filename ) )
      m_filetype = OBJ;
@@ -340,6 +309,11 @@ void MeshLoader::Impl::scanMesh( Mesh& mesh )
     scanMeshPLY( mesh );
   else
     throw std::runtime_error( "MeshLoader: Unsupported file type for '" + m_filename + "'" );
+
+  // Tangents are generated after loading for texture mapped meshes with
+  // normals, as are normals the caller asks for and the file lacks.
+  m_file_normals    = mesh.has_normals;
+  mesh.has_tangents = mesh.has_texcoords && mesh.has_normals;
 }
 
 
@@ -363,7 +337,7 @@ void MeshLoader::Impl::loadMesh( Mesh& mesh, const float* load_xform )
   else
     throw std::runtime_error( "MeshLoader: Unsupported file type for '" + m_filename + "'" );
 
-  applyLoadXForm( mesh, load_xform );
+  processMesh( mesh, load_xform, !m_file_normals );
 }
 
 
@@ -392,28 +366,33 @@ void MeshLoader::Impl::scanMeshPLY( Mesh& mesh )
 
 void MeshLoader::Impl::loadMeshPLY( Mesh& mesh )
 {
-  p_ply ply = ply_open( m_filename.c_str(), 0 );                       
+  // Binary files with fixed size records skip rply's per value callbacks.
+  if( !loadBinaryPLY( m_filename, mesh ) )
+  {
+    p_ply ply = ply_open( m_filename.c_str(), 0 );                       
 
-  if( !ply )
-    throw std::runtime_error( "MeshLoader: Unable to open '" + m_filename + "'" );
+    if( !ply )
+      throw std::runtime_error( "MeshLoader: Unable to open '" + m_filename + "'" );
 
-  if( !ply_read_header( ply ) )
-    throw std::runtime_error( "MeshLoader: Unable to read PLY header '" + m_filename + "'" );
+    if( !ply_read_header( ply ) )
+      throw std::runtime_error( "MeshLoader: Unable to read PLY header '" + m_filename + "'" );
   
-  PlyData ply_data = {0};
-  ply_data.mesh = &mesh;
-
-  ply_set_read_cb( ply, "vertex", "x",  plyLoadVertex, &ply_data, 0 );
-  ply_set_read_cb( ply, "vertex", "y",  plyLoadVertex, &ply_data, 1 );
-  ply_set_read_cb( ply, "vertex", "z",  plyLoadVertex, &ply_data, 2 );
-  ply_set_read_cb( ply, "vertex", "nx", plyLoadVertex, &ply_data, 3 );
-  ply_set_read_cb( ply, "vertex", "ny", plyLoadVertex, &ply_data, 4 );
-  ply_set_read_cb( ply, "vertex", "nz", plyLoadVertex, &ply_data, 5 );
-  ply_set_read_cb( ply, "face", "vertex_indices", plyLoadFace, &ply_data, 0);
-
-  if( !ply_read( ply ) ) 
-    throw std::runtime_error( "MeshLoader: Error parsing ply file (" + m_filename + ")" );
-  ply_close( ply );
+    PlyData ply_data = {0};
+    ply_data.mesh        = &mesh;
+    ply_data.has_normals = m_file_normals && mesh.has_normals;
+
+    ply_set_read_cb( ply, "vertex", "x",  plyLoadVertex, &ply_data, 0 );
+    ply_set_read_cb( ply, "vertex", "y",  plyLoadVertex, &ply_data, 1 );
+    ply_set_read_cb( ply, "vertex", "z",  plyLoadVertex, &ply_data, 2 );
+    ply_set_read_cb( ply, "vertex", "nx", plyLoadVertex, &ply_data, 3 );
+    ply_set_read_cb( ply, "vertex", "ny", plyLoadVertex, &ply_data, 4 );
+    ply_set_read_cb( ply, "vertex", "nz", plyLoadVertex, &ply_data, 5 );
+    ply_set_read_cb( ply, "face", "vertex_indices", plyLoadFace, &ply_data, 0);
+
+    if( !ply_read( ply ) ) 
+      throw std::runtime_error( "MeshLoader: Error parsing ply file (" + m_filename + ")" );
+    ply_close( ply );
+  }
 
 
   // Fill in default white matte material
@@ -530,7 +509,7 @@ void MeshLoader::Impl::loadMeshOBJ( Mesh& mesh )
       mesh.positions[ vrt_offset*3 + i*3+2 ] = z; 
     }
 
-    if( mesh.has_normals )
+    if( m_file_normals && mesh.has_normals )
       for( uint64_t i = 0; i < shape.mesh.normals.size(); ++i )
         mesh.normals[ vrt_offset*3 + i ] = shape.mesh.normals[i];
     
@@ -607,6 +586,7 @@ void printMeshInfo( const Mesh& mesh, std::ostream& out )
       << "\tnum vertices : " << mesh.num_vertices  << std::endl
       << "\thas normals  : " << mesh.has_normals   << std::endl
       << "\thas texcoords: " << mesh.has_texcoords << std::endl
+      << "\thas tangents : " << mesh.has_tangents  << std::endl
       << "\tnum triangles: " << mesh.num_triangles << std::endl
       << "\tnum materials: " << mesh.num_materials << std::endl
       << "\tbbox min     : ( " << mesh.bbox_min[0] << ", "
@@ -658,6 +638,7 @@ SUTILAPI void allocMesh( Mesh& mesh )
   mesh.positions   = new float[ 3*mesh.num_vertices ];
   mesh.normals     = mesh.has_normals   ? new float[ 3*mesh.num_vertices ]   : 0;
   mesh.texcoords   = mesh.has_texcoords ? new float[ 2*mesh.num_vertices ]   : 0;
+  mesh.tangents    = mesh.has_tangents  ? new float[ 4*mesh.num_vertices ]   : 0;
   mesh.tri_indices = new int32_t[ 3*mesh.num_triangles ]; 
   mesh.mat_indices = new int32_t[ 1*mesh.num_triangles ]; 
 
@@ -670,6 +651,7 @@ SUTILAPI void freeMesh( Mesh& mesh )
   delete [] mesh.positions;
   delete [] mesh.normals;
   delete [] mesh.texcoords;
+  delete [] mesh.tangents;
   delete [] mesh.tri_indices;
   delete [] mesh.mat_indices;
   delete [] mesh.mat_params;
@@ -72,6 +72,9 @@ struct Mesh
   bool                has_texcoords;  //
   float*              texcoords;      // Triangle UVs (len 0 or num_vertices)
 
+  bool                has_tangents;   //
+  float*              tangents;       // Tangent xyz, bitangent sign w (len 0 or num_vertices)
+
 
   int32_t             num_triangles;  // Number of triangles
   int32_t*            tri_indices;    // Indices into positions, normals, texcoords
@@ -91,7 +94,8 @@ struct Mesh
 //------------------------------------------------------------------------------
 
 // Allocates memory for mesh using std lib new.
-// Assumes num_vertices, has_normals, has_texcoords, num_triangles initialized.
+// Assumes num_vertices, has_normals, has_texcoords, has_tangents,
+// num_triangles initialized.
 SUTILAPI void allocMesh( Mesh& mesh );
 
 // Calls std lib delete on non-null arrays in mesh
@@ -105,6 +109,13 @@ SUTILAPI void printMeshInfo    ( const Mesh& mesh,          std::ostream& out =
 //
 // Mesh Loader
 //
+// scanMesh() reports the normals and texcoords the file provides, and asks
+// for tangents on meshes with both.  Setting has_normals before loadMesh()
+// on a mesh whose file has none generates smooth normals, and setting
+// has_tangents as well generates tangents against them.  Smooth normals
+// round off hard edges, such as a box's, so only ask for them on meshes
+// meant to look smooth.
+//
 //------------------------------------------------------------------------------
 class MeshLoader
 {
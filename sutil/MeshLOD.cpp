@@ -0,0 +1,659 @@
+#include "MeshLOD.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+using optix::float3;
+
+namespace
+{
+
+const double boundary_weight = 10.0;   // Of a border penalty plane, relative to a face plane
+const float  min_normal_cos  = 0.2f;   // Collapses may turn a face normal by up to about 78 degrees
+
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix.
+struct Quadric
+{
+  double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+  void clear() { a00 = a01 = a02 = a03 = a11 = a12 = a13 = a22 = a23 = a33 = 0.0; }
+
+  void addPlane( const double n[3], double d, double w )
+  {
+    a00 += w * n[0] * n[0]; a01 += w * n[0] * n[1]; a02 += w * n[0] * n[2]; a03 += w * n[0] * d;
+    a11 += w * n[1] * n[1]; a12 += w * n[1] * n[2]; a13 += w * n[1] * d;
+    a22 += w * n[2] * n[2]; a23 += w * n[2] * d;
+    a33 += w * d * d;
+  }
+
+  void add( const Quadric& q )
+  {
+    a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03; a11 += q.a11;
+    a12 += q.a12; a13 += q.a13; a22 += q.a22; a23 += q.a23; a33 += q.a33;
+  }
+
+  double error( const float3& p ) const
+  {
+    const double x = p.x, y = p.y, z = p.z;
+    return a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * ( a01 * x * y + a02 * x * z + a12 * y * z ) +
+           2.0 * ( a03 * x + a13 * y + a23 * z ) + a33;
+  }
+
+  // Point of least error; false when the planes do not pin one down.
+  bool minimum( float3& p ) const
+  {
+    const double i00 = a11 * a22 - a12 * a12, i01 = a02 * a12 - a01 * a22, i02 = a01 * a12 - a02 * a11;
+    const double i11 = a00 * a22 - a02 * a02, i12 = a01 * a02 - a00 * a12, i22 = a00 * a11 - a01 * a01;
+    const double det   = a00 * i00 + a01 * i01 + a02 * i02;
+    const double trace = a00 + a11 + a22;
+    if( !( std::fabs( det ) > 1e-9 * trace * trace * trace ) )
+      return false;
+    p = optix::make_float3( static_cast<float>( -( i00 * a03 + i01 * a13 + i02 * a23 ) / det ),
+                            static_cast<float>( -( i01 * a03 + i11 * a13 + i12 * a23 ) / det ),
+                            static_cast<float>( -( i02 * a03 + i12 * a13 + i22 * a23 ) / det ) );
+    return true;
+  }
+};
+
+
+struct Collapse
+{
+  double   cost;
+  uint32_t from;           // Removed
+  uint32_t to;             // Kept, moved to target
+  uint32_t from_version;
+  uint32_t to_version;
+  float3   target;
+
+  bool operator>( const Collapse& c ) const { return cost > c.cost; }
+};
+
+
+inline float3 toFloat3( const float* a )
+{
+  return optix::make_float3( a[0], a[1], a[2] );
+}
+
+
+inline float3 faceNormal( const float3& a, const float3& b, const float3& c )
+{
+  return optix::cross( b - a, c - a );
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// Simplifier -- edge collapses over the position welded mesh
+//
+//-----------------------------------------------------------------------------
+
+class Simplifier
+{
+public:
+  explicit Simplifier( const Mesh& mesh );
+
+  // Collapses cheapest first until at most 'target' triangles remain or no
+  // valid collapse is left; returns the triangles remaining.
+  int32_t collapseTo( int32_t target );
+
+  // The current triangles as a mesh of the loaded vertices they use.
+  void extract( Mesh& out ) const;
+
+  float error() const { return static_cast<float>( std::sqrt( m_max_cost ) ); }
+
+  // Largest angle, in radians, between the shading normal a loaded vertex
+  // had and the shading normals around the vertex it was collapsed into.
+  float normalError() const;
+
+private:
+  bool     sameAttributes( int32_t a, int32_t b ) const;
+  float3   position( uint32_t v ) const { return m_positions[v]; }
+  void     pushEdge( uint32_t a, uint32_t b );
+  bool     valid( const Collapse& c );
+  bool     keepsOrientation( uint32_t v, uint32_t skip, const float3& target ) const;
+  void     apply( const Collapse& c );
+
+  const Mesh&                        m_mesh;
+  std::vector<uint32_t>              m_weld;        // Loaded vertex -> welded vertex
+  std::vector<float3>                m_positions;   // Per welded vertex
+  std::vector<float3>                m_normals;     // Loaded shading normal per welded vertex
+  std::vector<uint32_t>              m_parent;      // Welded vertex each was collapsed into
+  std::vector<Quadric>               m_quadrics;
+  std::vector<uint32_t>              m_versions;
+  std::vector<uint8_t>               m_locked;
+  std::vector<uint8_t>               m_removed;
+  std::vector<std::vector<uint32_t> > m_vertex_triangles;
+  std::vector<uint32_t>              m_triangles;   // 3 welded vertices per triangle
+  std::vector<int32_t>               m_corners;     // 3 loaded vertices per triangle
+  std::vector<uint8_t>               m_alive;
+  int32_t                            m_live;
+  double                             m_max_cost;
+  std::vector<uint32_t>              m_marks;       // Scratch stamps per welded vertex
+  uint32_t                           m_stamp;
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > m_heap;
+};
+
+
+Simplifier::Simplifier( const Mesh& mesh )
+  : m_mesh( mesh ),
+    m_live( 0 ),
+    m_max_cost( 0.0 ),
+    m_stamp( 0 )
+{
+  const size_t num_loaded = std::max( mesh.num_vertices, 0 );
+  const size_t num_triangles = std::max( mesh.num_triangles, 0 );
+
+  // Weld by position; copies with different attributes make a seam.
+  std::vector<uint32_t> order( num_loaded );
+  for( size_t i = 0; i < num_loaded; ++i )
+    order[i] = static_cast<uint32_t>( i );
+  const float* p = mesh.positions;
+  std::sort( order.begin(), order.end(), [p]( uint32_t a, uint32_t b ) {
+    return std::lexicographical_compare( p + 3 * size_t( a ), p + 3 * size_t( a ) + 3, p + 3 * size_t( b ),
+                                         p + 3 * size_t( b ) + 3 );
+  } );
+  m_weld.resize( num_loaded );
+  for( size_t i = 0; i < num_loaded; ++i )
+  {
+    const uint32_t v = order[i];
+    const float* a = p + 3 * size_t( v );
+    const float* b = i > 0 ? p + 3 * size_t( order[i - 1] ) : a;
+    if( i == 0 || a[0] != b[0] || a[1] != b[1] || a[2] != b[2] )   // Values, so -0 welds to 0
+    {
+      m_positions.push_back( optix::make_float3( p[3 * size_t( v )], p[3 * size_t( v ) + 1], p[3 * size_t( v ) + 2] ) );
+      m_locked.push_back( 0 );
+    }
+    else if( !sameAttributes( v, order[i - 1] ) )
+    {
+      m_locked.back() = 1;
+    }
+    m_weld[v] = static_cast<uint32_t>( m_positions.size() - 1 );
+  }
+  const size_t num_welded = m_positions.size();
+  m_quadrics.resize( num_welded );
+  for( size_t v = 0; v < num_welded; ++v )
+    m_quadrics[v].clear();
+  m_versions.assign( num_welded, 0 );
+  m_removed.assign( num_welded, 0 );
+  m_marks.assign( num_welded, 0 );
+  m_vertex_triangles.resize( num_welded );
+  m_normals.assign( num_welded, optix::make_float3( 0.0f ) );
+  m_parent.resize( num_welded );
+  for( size_t v = 0; v < num_welded; ++v )
+    m_parent[v] = static_cast<uint32_t>( v );
+
+  // Triangles, dropping ones that weld to degenerate, and face planes.
+  m_triangles.resize( 3 * num_triangles );
+  m_corners.assign( mesh.tri_indices, mesh.tri_indices + 3 * num_triangles );
+  m_alive.assign( num_triangles, 0 );
+  std::vector<float3> normals( num_triangles );
+  for( size_t t = 0; t < num_triangles; ++t )
+  {
+    uint32_t* w = &m_triangles[3 * t];
+    for( int k = 0; k < 3; ++k )
+      w[k] = m_weld[m_corners[3 * t + k]];
+    if( w[0] == w[1] || w[1] == w[2] || w[2] == w[0] )
+      continue;
+    m_alive[t] = 1;
+    ++m_live;
+    for( int k = 0; k < 3; ++k )
+      m_vertex_triangles[w[k]].push_back( static_cast<uint32_t>( t ) );
+
+    const float3 n = faceNormal( position( w[0] ), position( w[1] ), position( w[2] ) );
+    const float  l = optix::length( n );
+    normals[t] = l > 0.0f ? n / l : n;
+    for( int k = 0; k < 3; ++k )
+      m_normals[w[k]] += mesh.has_normals ? toFloat3( mesh.normals + 3 * size_t( m_corners[3 * t + k] ) ) : n;
+    if( l > 0.0f )
+    {
+      const double nd[3] = { normals[t].x, normals[t].y, normals[t].z };
+      const double d     = -optix::dot( normals[t], position( w[0] ) );
+      for( int k = 0; k < 3; ++k )
+        m_quadrics[w[k]].addPlane( nd, d, 1.0 );
+    }
+  }
+
+  for( size_t v = 0; v < num_welded; ++v )
+  {
+    const float l = optix::length( m_normals[v] );
+    m_normals[v] = l > 0.0f ? m_normals[v] / l : m_normals[v];
+  }
+
+  // Edges in sorted order; the ones with one face, with faces of different
+  // materials or with more than two faces get penalty planes through the
+  // edge, perpendicular to each face.
+  std::vector<std::pair<uint64_t, uint32_t> > edges;
+  edges.reserve( 3 * m_live );
+  for( size_t t = 0; t < num_triangles; ++t )
+  {
+    if( !m_alive[t] )
+      continue;
+    for( int k = 0; k < 3; ++k )
+    {
+      const uint64_t a = m_triangles[3 * t + k], b = m_triangles[3 * t + ( k + 1 ) % 3];
+      edges.push_back( std::make_pair( std::min( a, b ) << 32 | std::max( a, b ), static_cast<uint32_t>( t ) ) );
+    }
+  }
+  std::sort( edges.begin(), edges.end() );
+  for( size_t i = 0; i < edges.size(); )
+  {
+    size_t end = i + 1;
+    while( end < edges.size() && edges[end].first == edges[i].first )
+      ++end;
+    const uint32_t a = static_cast<uint32_t>( edges[i].first >> 32 );
+    const uint32_t b = static_cast<uint32_t>( edges[i].first & 0xffffffffu );
+    const bool border = end - i != 2 ||
+                        mesh.mat_indices[edges[i].second] != mesh.mat_indices[edges[i + 1].second];
+    for( size_t j = i; border && j < end; ++j )
+    {
+      const float3 e  = position( b ) - position( a );
+      float3       bn = optix::cross( e, normals[edges[j].second] );
+      const float  l  = optix::length( bn );
+      if( !( l > 0.0f ) )
+        continue;
+      bn = bn / l;
+      const double nd[3] = { bn.x, bn.y, bn.z };
+      const double d     = -optix::dot( bn, position( a ) );
+      m_quadrics[a].addPlane( nd, d, boundary_weight );
+      m_quadrics[b].addPlane( nd, d, boundary_weight );
+    }
+    i = end;
+  }
+  for( size_t i = 0; i < edges.size(); ++i )
+    if( i == 0 || edges[i].first != edges[i - 1].first )
+      pushEdge( static_cast<uint32_t>( edges[i].first >> 32 ), static_cast<uint32_t>( edges[i].first & 0xffffffffu ) );
+}
+
+
+bool Simplifier::sameAttributes( int32_t a, int32_t b ) const
+{
+  const Mesh& m = m_mesh;
+  return ( !m.has_normals || memcmp( m.normals + 3 * size_t( a ), m.normals + 3 * size_t( b ), 3 * sizeof( float ) ) == 0 ) &&
+         ( !m.has_texcoords || memcmp( m.texcoords + 2 * size_t( a ), m.texcoords + 2 * size_t( b ), 2 * sizeof( float ) ) == 0 ) &&
+         ( !m.has_tangents || memcmp( m.tangents + 4 * size_t( a ), m.tangents + 4 * size_t( b ), 4 * sizeof( float ) ) == 0 );
+}
+
+
+void Simplifier::pushEdge( uint32_t a, uint32_t b )
+{
+  if( m_removed[a] || m_removed[b] || ( m_locked[a] && m_locked[b] ) )
+    return;
+
+  Quadric q = m_quadrics[a];
+  q.add( m_quadrics[b] );
+  Collapse c;
+  if( m_locked[a] || m_locked[b] )
+  {
+    c.from   = m_locked[a] ? b : a;
+    c.to     = m_locked[a] ? a : b;
+    c.target = position( c.to );
+  }
+  else
+  {
+    // The quadric's minimum unless it is ill defined or strays far from the
+    // edge, otherwise the best of the end points and the midpoint.
+    c.from = a;
+    c.to   = b;
+    const float3 mid  = 0.5f * ( position( a ) + position( b ) );
+    const float  span = optix::length( position( b ) - position( a ) );
+    if( !q.minimum( c.target ) || !( optix::length( c.target - mid ) <= span ) )
+    {
+      const float3 candidates[3] = { position( a ), position( b ), mid };
+      c.target = candidates[0];
+      for( int i = 1; i < 3; ++i )
+        if( q.error( candidates[i] ) < q.error( c.target ) )
+          c.target = candidates[i];
+    }
+  }
+  c.cost         = std::max( q.error( c.target ), 0.0 );
+  c.from_version = m_versions[c.from];
+  c.to_version   = m_versions[c.to];
+  m_heap.push( c );
+}
+
+
+bool Simplifier::keepsOrientation( uint32_t v, uint32_t skip, const float3& target ) const
+{
+  const std::vector<uint32_t>& tris = m_vertex_triangles[v];
+  for( size_t i = 0; i < tris.size(); ++i )
+  {
+    const uint32_t  t = tris[i];
+    const uint32_t* w = &m_triangles[3 * size_t( t )];
+    if( !m_alive[t] || w[0] == skip || w[1] == skip || w[2] == skip )
+      continue;
+    float3 p[3], q[3];
+    for( int k = 0; k < 3; ++k )
+    {
+      p[k] = position( w[k] );
+      q[k] = w[k] == v ? target : p[k];
+    }
+    const float3 before = faceNormal( p[0], p[1], p[2] );
+    const float3 after  = faceNormal( q[0], q[1], q[2] );
+    const float  scale  = optix::length( before ) * optix::length( after );
+    if( !( scale > 0.0f ) || optix::dot( before, after ) < min_normal_cos * scale )
+      return false;
+  }
+  return true;
+}
+
+
+bool Simplifier::valid( const Collapse& c )
+{
+  // Link condition: the two vertices may only share the neighbours opposite
+  // the edge, or the collapse pinches the surface.
+  const uint32_t u = c.from, v = c.to;
+  const uint32_t neighbour_of_u = ++m_stamp, counted = ++m_stamp;
+  int shared_triangles = 0;
+  for( size_t i = 0; i < m_vertex_triangles[u].size(); ++i )
+  {
+    const uint32_t t = m_vertex_triangles[u][i];
+    if( !m_alive[t] )
+      continue;
+    const uint32_t* w = &m_triangles[3 * size_t( t )];
+    if( w[0] == v || w[1] == v || w[2] == v )
+      ++shared_triangles;
+    for( int k = 0; k < 3; ++k )
+      m_marks[w[k]] = neighbour_of_u;
+  }
+  if( shared_triangles == 0 )
+    return false;
+  int shared_neighbours = 0;
+  for( size_t i = 0; i < m_vertex_triangles[v].size(); ++i )
+  {
+    const uint32_t t = m_vertex_triangles[v][i];
+    if( !m_alive[t] )
+      continue;
+    const uint32_t* w = &m_triangles[3 * size_t( t )];
+    for( int k = 0; k < 3; ++k )
+    {
+      if( w[k] != u && w[k] != v && m_marks[w[k]] == neighbour_of_u )
+      {
+        m_marks[w[k]] = counted;
+        ++shared_neighbours;
+      }
+    }
+  }
+  if( shared_neighbours != shared_triangles )
+    return false;
+
+  return keepsOrientation( u, v, c.target ) && keepsOrientation( v, u, c.target );
+}
+
+
+void Simplifier::apply( const Collapse& c )
+{
+  const uint32_t u = c.from, v = c.to;
+
+  // Corners that move from u to v take the loaded vertex v has in a
+  // triangle on the collapsed edge, the copy on u's side of any seam.
+  int32_t copy = -1;
+  std::vector<uint32_t>& from_tris = m_vertex_triangles[u];
+  std::vector<uint32_t>& to_tris   = m_vertex_triangles[v];
+  for( size_t i = 0; i < from_tris.size() && copy < 0; ++i )
+  {
+    const uint32_t t = from_tris[i];
+    for( int k = 0; k < 3 && m_alive[t]; ++k )
+      if( m_triangles[3 * size_t( t ) + k] == v )
+        copy = m_corners[3 * size_t( t ) + k];
+  }
+
+  for( size_t i = 0; i < from_tris.size(); ++i )
+  {
+    const uint32_t t = from_tris[i];
+    if( !m_alive[t] )
+      continue;
+    uint32_t* w = &m_triangles[3 * size_t( t )];
+    if( w[0] == v || w[1] == v || w[2] == v )
+    {
+      m_alive[t] = 0;
+      --m_live;
+      continue;
+    }
+    for( int k = 0; k < 3; ++k )
+    {
+      if( w[k] == u )
+      {
+        w[k] = v;
+        m_corners[3 * size_t( t ) + k] = copy;
+      }
+    }
+    to_tris.push_back( t );
+  }
+  std::vector<uint32_t>().swap( from_tris );
+  size_t live = 0;
+  for( size_t i = 0; i < to_tris.size(); ++i )
+    if( m_alive[to_tris[i]] )
+      to_tris[live++] = to_tris[i];
+  to_tris.resize( live );
+
+  m_removed[u]   = 1;
+  m_parent[u]    = v;
+  m_positions[v] = c.target;
+  m_quadrics[v].add( m_quadrics[u] );
+  ++m_versions[v];
+  m_max_cost = std::max( m_max_cost, c.cost );
+
+  const uint32_t pushed = ++m_stamp;
+  m_marks[v] = pushed;
+  for( size_t i = 0; i < to_tris.size(); ++i )
+  {
+    for( int k = 0; k < 3; ++k )
+    {
+      const uint32_t n = m_triangles[3 * size_t( to_tris[i] ) + k];
+      if( m_marks[n] != pushed )
+      {
+        m_marks[n] = pushed;
+        pushEdge( v, n );
+      }
+    }
+  }
+}
+
+
+int32_t Simplifier::collapseTo( int32_t target )
+{
+  while( m_live > target && !m_heap.empty() )
+  {
+    const Collapse c = m_heap.top();
+    m_heap.pop();
+    if( m_removed[c.from] || m_removed[c.to] || m_versions[c.from] != c.from_version ||
+        m_versions[c.to] != c.to_version )
+      continue;
+    if( valid( c ) )
+      apply( c );
+  }
+  return m_live;
+}
+
+
+float Simplifier::normalError() const
+{
+  std::vector<uint32_t> root( m_parent );
+  for( size_t v = 0; v < root.size(); ++v )
+  {
+    uint32_t r = root[v];
+    while( root[r] != r )
+      r = root[r];
+    root[v] = r;
+  }
+
+  // Against the interpolated loaded normals of the triangles around the
+  // surviving vertex, or their face normals when the mesh has none.
+  float min_cos = 1.0f;
+  for( size_t v = 0; v < root.size(); ++v )
+  {
+    const float3 n = m_normals[v];
+    if( optix::dot( n, n ) == 0.0f )
+      continue;
+    const std::vector<uint32_t>& tris = m_vertex_triangles[root[v]];
+    for( size_t i = 0; i < tris.size(); ++i )
+    {
+      const uint32_t t = tris[i];
+      if( !m_alive[t] )
+        continue;
+      if( m_mesh.has_normals )
+      {
+        for( int k = 0; k < 3; ++k )
+        {
+          const float3 c = toFloat3( m_mesh.normals + 3 * size_t( m_corners[3 * size_t( t ) + k] ) );
+          const float  l = optix::length( c );
+          if( l > 0.0f )
+            min_cos = std::min( min_cos, optix::dot( n, c ) / l );
+        }
+      }
+      else
+      {
+        const uint32_t* w = &m_triangles[3 * size_t( t )];
+        const float3    f = faceNormal( position( w[0] ), position( w[1] ), position( w[2] ) );
+        const float     l = optix::length( f );
+        if( l > 0.0f )
+          min_cos = std::min( min_cos, optix::dot( n, f ) / l );
+      }
+    }
+  }
+  return std::acos( std::max( std::min( min_cos, 1.0f ), -1.0f ) );
+}
+
+
+void Simplifier::extract( Mesh& out ) const
+{
+  const Mesh& in = m_mesh;
+  std::vector<int32_t> index( std::max( in.num_vertices, 0 ), -1 );
+  std::vector<int32_t> used;
+  for( size_t t = 0; t < m_alive.size(); ++t )
+  {
+    if( !m_alive[t] )
+      continue;
+    for( int k = 0; k < 3; ++k )
+    {
+      const int32_t v = m_corners[3 * t + k];
+      if( index[v] < 0 )
+      {
+        index[v] = static_cast<int32_t>( used.size() );
+        used.push_back( v );
+      }
+    }
+  }
+
+  memset( &out, 0, sizeof( Mesh ) );
+  out.num_vertices  = static_cast<int32_t>( used.size() );
+  out.num_triangles = m_live;
+  out.has_normals   = in.has_normals;
+  out.has_texcoords = in.has_texcoords;
+  out.has_tangents  = in.has_tangents;
+  out.num_materials = in.num_materials;
+  allocMesh( out );
+  for( int k = 0; k < 3; ++k )
+  {
+    out.bbox_min[k] =  1e16f;
+    out.bbox_max[k] = -1e16f;
+  }
+  if( m_live == 0 )
+    return;
+
+  for( int32_t i = 0; i < in.num_materials; ++i )
+    out.mat_params[i] = in.mat_params[i];
+  for( size_t i = 0; i < used.size(); ++i )
+  {
+    const size_t v = used[i];
+    const float3 p = m_positions[m_weld[v]];
+    out.positions[3 * i + 0] = p.x;
+    out.positions[3 * i + 1] = p.y;
+    out.positions[3 * i + 2] = p.z;
+    out.bbox_min[0] = std::min( out.bbox_min[0], p.x ); out.bbox_max[0] = std::max( out.bbox_max[0], p.x );
+    out.bbox_min[1] = std::min( out.bbox_min[1], p.y ); out.bbox_max[1] = std::max( out.bbox_max[1], p.y );
+    out.bbox_min[2] = std::min( out.bbox_min[2], p.z ); out.bbox_max[2] = std::max( out.bbox_max[2], p.z );
+    if( out.has_normals )
+      memcpy( out.normals + 3 * i, in.normals + 3 * v, 3 * sizeof( float ) );
+    if( out.has_texcoords )
+      memcpy( out.texcoords + 2 * i, in.texcoords + 2 * v, 2 * sizeof( float ) );
+    if( out.has_tangents )
+      memcpy( out.tangents + 4 * i, in.tangents + 4 * v, 4 * sizeof( float ) );
+  }
+  size_t next = 0;
+  for( size_t t = 0; t < m_alive.size(); ++t )
+  {
+    if( !m_alive[t] )
+      continue;
+    for( int k = 0; k < 3; ++k )
+      out.tri_indices[3 * next + k] = index[m_corners[3 * t + k]];
+    out.mat_indices[next++] = in.mat_indices[t];
+  }
+}
+
+} // namespace
+
+
+void buildMeshLODs( const Mesh& mesh, std::vector<MeshLOD>& lods, unsigned int max_levels, float reduction,
+                    int32_t min_triangles )
+{
+  freeMeshLODs( lods );
+  if( mesh.num_triangles <= 0 || max_levels == 0 )
+    return;
+  reduction = std::min( std::max( reduction, 0.05f ), 0.95f );
+
+  // Shading that turns by an angle counts as the surface moving by that
+  // angle times the mesh's radius, so a level that changes shading is only
+  // picked once the whole mesh is a few pixels across.
+  const float radius = 0.5f * optix::length( toFloat3( mesh.bbox_max ) - toFloat3( mesh.bbox_min ) );
+
+  Simplifier simplifier( mesh );
+  int32_t previous = mesh.num_triangles;
+  double  target   = mesh.num_triangles;
+  for( unsigned int level = 0; level < max_levels && previous > min_triangles; ++level )
+  {
+    target *= reduction;
+    const int32_t goal = std::max( static_cast<int32_t>( target ), min_triangles );
+    const int32_t live = simplifier.collapseTo( goal );
+
+    // Short of the goal only when collapses ran out; keep that last level
+    // if it still saved half of what a full step would have.
+    if( live > goal && live > previous - ( previous - goal ) / 2 )
+      break;
+    MeshLOD lod;
+    simplifier.extract( lod.mesh );
+    lod.error = std::max( simplifier.error(), simplifier.normalError() * radius );
+    lods.push_back( lod );
+    previous = live;
+    if( live > goal )
+      break;
+  }
+}
+
+
+void freeMeshLODs( std::vector<MeshLOD>& lods )
+{
+  for( size_t i = 0; i < lods.size(); ++i )
+    freeMesh( lods[i].mesh );
+  lods.clear();
+}
+
+
+float pixelFootprint( float fov_y, unsigned int height )
+{
+  return 2.0f * tanf( 0.5f * fov_y * M_PIf / 180.0f ) / std::max( height, 1u );
+}
+
+
+float distanceToBox( const float3& p, const float3& bbox_min, const float3& bbox_max )
+{
+  const float3 d = optix::make_float3( std::max( std::max( bbox_min.x - p.x, p.x - bbox_max.x ), 0.0f ),
+                                       std::max( std::max( bbox_min.y - p.y, p.y - bbox_max.y ), 0.0f ),
+                                       std::max( std::max( bbox_min.z - p.z, p.z - bbox_max.z ), 0.0f ) );
+  return optix::length( d );
+}
+
+
+unsigned int selectMeshLOD( const std::vector<float>& level_errors, float distance, float pixel_footprint,
+                            float max_pixel_error )
+{
+  const float budget = max_pixel_error * pixel_footprint * std::max( distance, 0.0f );
+  unsigned int level = 0;
+  while( level + 1 < level_errors.size() && level_errors[level + 1] <= budget )
+    ++level;
+  return level;
+}
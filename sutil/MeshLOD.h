@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <optixu/optixu_math_namespace.h>
+#include <sutilapi.h>
+
+#include <stdint.h>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Mesh levels of detail
+//
+// buildMeshLODs() simplifies a mesh by quadric error edge collapses
+// (Garland and Heckbert) and keeps a copy each time the triangle count
+// falls to the next fraction of the original.  Vertices are welded by
+// position first, so collapses never open cracks; vertices shared by
+// several loaded vertices -- normal, texcoord or material seams -- are
+// locked in place, open boundaries and material borders carry penalty
+// planes, and collapses that would fold a triangle over or make an edge
+// non-manifold are skipped.  Surviving vertices keep their loaded shading
+// attributes.
+//
+// Each level records its error in mesh units: the larger of the square
+// root of the largest quadric error of any collapse so far, roughly the
+// furthest its surface moved, and the largest angle any shading normal
+// turned times the mesh's bounding radius, so that shading changes count
+// as well.  selectMeshLOD() picks the coarsest level whose error projects
+// to less than a given number of pixels.
+//
+//-----------------------------------------------------------------------------
+
+struct MeshLOD
+{
+  Mesh  mesh;     // Allocated with allocMesh(), release with freeMeshLODs()
+  float error;
+};
+
+
+// Replaces 'lods' with up to 'max_levels' levels of 'mesh', each with
+// about 'reduction' times the triangles of the one before, coarsest last.
+// Stops early at 'min_triangles' or when no collapse is left.
+SUTILAPI void buildMeshLODs( const Mesh& mesh, std::vector<MeshLOD>& lods, unsigned int max_levels = 6,
+                             float reduction = 0.5f, int32_t min_triangles = 64 );
+
+SUTILAPI void freeMeshLODs( std::vector<MeshLOD>& lods );
+
+// Size of a pixel one unit in front of a pinhole camera with a vertical
+// field of view of 'fov_y' degrees over 'height' pixels.
+SUTILAPI float pixelFootprint( float fov_y, unsigned int height );
+
+// Distance from 'p' to the nearest point of a box, 0 inside it.
+SUTILAPI float distanceToBox( const optix::float3& p, const optix::float3& bbox_min, const optix::float3& bbox_max );
+
+// Index of the coarsest level whose error, at 'distance', covers at most
+// 'max_pixel_error' pixels of 'pixel_footprint'.  level_errors[0] is the
+// full mesh, usually 0, and errors grow with the index.
+SUTILAPI unsigned int selectMeshLOD( const std::vector<float>& level_errors, float distance, float pixel_footprint,
+                                     float max_pixel_error = 0.5f );
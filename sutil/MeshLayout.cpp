@@ -0,0 +1,189 @@
+#include "MeshLayout.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+const size_t chunk_size = 1u << 14;   // triangles or vertices per parallelFor chunk
+
+
+// Spreads the low 10 bits of v to every third bit.
+inline uint32_t expandBits( uint32_t v )
+{
+  v = ( v | ( v << 16 ) ) & 0x030000ffu;
+  v = ( v | ( v <<  8 ) ) & 0x0300f00fu;
+  v = ( v | ( v <<  4 ) ) & 0x030c30c3u;
+  v = ( v | ( v <<  2 ) ) & 0x09249249u;
+  return v;
+}
+
+
+inline void centroid( const Mesh& mesh, size_t tri, float c[3] )
+{
+  const int32_t* idx = mesh.tri_indices + 3 * tri;
+  for( int k = 0; k < 3; ++k )
+    c[k] = ( mesh.positions[3 * idx[0] + k] + mesh.positions[3 * idx[1] + k] + mesh.positions[3 * idx[2] + k] ) *
+           ( 1.0f / 3.0f );
+}
+
+
+// Applies old -> new vertex renumbering to one attribute array of
+// 'components' floats per vertex.
+void permuteVertices( float* data, int components, const std::vector<int32_t>& new_index )
+{
+  if( !data )
+    return;
+  std::vector<float> old( data, data + new_index.size() * components );
+  sutil::parallelFor( new_index.size(), chunk_size, [&]( size_t begin, size_t end )
+  {
+    for( size_t v = begin; v < end; ++v )
+      memcpy( data + static_cast<size_t>( new_index[v] ) * components, &old[v * components],
+              components * sizeof( float ) );
+  } );
+}
+
+} // namespace
+
+
+void reorderMeshTriangles( Mesh& mesh, const std::vector<uint32_t>& order )
+{
+  const size_t num_triangles = mesh.num_triangles;
+  const size_t num_vertices  = mesh.num_vertices;
+  if( order.size() != num_triangles )
+    throw std::runtime_error( "reorderMeshTriangles: order holds " + std::to_string( order.size() ) +
+                              " triangles, mesh has " + std::to_string( num_triangles ) );
+
+  // Triangles and their materials.
+  {
+    const std::vector<int32_t> indices( mesh.tri_indices, mesh.tri_indices + 3 * num_triangles );
+    const std::vector<int32_t> materials( mesh.mat_indices, mesh.mat_indices + num_triangles );
+    sutil::parallelFor( num_triangles, chunk_size, [&]( size_t begin, size_t end )
+    {
+      for( size_t i = begin; i < end; ++i )
+      {
+        memcpy( mesh.tri_indices + 3 * i, &indices[3 * order[i]], 3 * sizeof( int32_t ) );
+        mesh.mat_indices[i] = materials[order[i]];
+      }
+    } );
+  }
+
+  // Vertices in first-use order, then the unreferenced ones.
+  std::vector<int32_t> new_index( num_vertices, -1 );
+  int32_t next = 0;
+  for( size_t c = 0; c < 3 * num_triangles; ++c )
+  {
+    const int32_t v = mesh.tri_indices[c];
+    if( v >= 0 && static_cast<size_t>( v ) < num_vertices && new_index[v] < 0 )
+      new_index[v] = next++;
+  }
+  for( size_t v = 0; v < num_vertices; ++v )
+    if( new_index[v] < 0 )
+      new_index[v] = next++;
+
+  sutil::parallelFor( 3 * num_triangles, 3 * chunk_size, [&]( size_t begin, size_t end )
+  {
+    for( size_t c = begin; c < end; ++c )
+    {
+      const int32_t v = mesh.tri_indices[c];
+      if( v >= 0 && static_cast<size_t>( v ) < num_vertices )
+        mesh.tri_indices[c] = new_index[v];
+    }
+  } );
+
+  permuteVertices( mesh.positions, 3, new_index );
+  permuteVertices( mesh.has_normals   ? mesh.normals   : 0, 3, new_index );
+  permuteVertices( mesh.has_texcoords ? mesh.texcoords : 0, 2, new_index );
+  permuteVertices( mesh.has_tangents  ? mesh.tangents  : 0, 4, new_index );
+}
+
+
+void mortonTriangleOrder( const Mesh& mesh, std::vector<uint32_t>& order )
+{
+  const size_t num_triangles = mesh.num_triangles;
+  order.resize( num_triangles );
+  if( num_triangles == 0 )
+    return;
+
+  // Centroid bounds, reduced per chunk.
+  const size_t num_chunks = ( num_triangles + chunk_size - 1 ) / chunk_size;
+  std::vector<float> chunk_bounds( num_chunks * 6 );
+  for( size_t c = 0; c < num_chunks; ++c )
+  {
+    std::fill( &chunk_bounds[6 * c],     &chunk_bounds[6 * c + 3],  1e30f );
+    std::fill( &chunk_bounds[6 * c + 3], &chunk_bounds[6 * c + 6], -1e30f );
+  }
+  sutil::parallelFor( num_triangles, chunk_size, [&]( size_t begin, size_t end )
+  {
+    float* b = &chunk_bounds[6 * ( begin / chunk_size )];
+    for( size_t i = begin; i < end; ++i )
+    {
+      float c[3];
+      centroid( mesh, i, c );
+      for( int k = 0; k < 3; ++k )
+      {
+        b[k]     = std::min( b[k], c[k] );
+        b[k + 3] = std::max( b[k + 3], c[k] );
+      }
+    }
+  } );
+  float lo[3] = { 1e30f, 1e30f, 1e30f }, scale[3];
+  float hi[3] = { -1e30f, -1e30f, -1e30f };
+  for( size_t c = 0; c < num_chunks; ++c )
+  {
+    for( int k = 0; k < 3; ++k )
+    {
+      lo[k] = std::min( lo[k], chunk_bounds[6 * c + k] );
+      hi[k] = std::max( hi[k], chunk_bounds[6 * c + 3 + k] );
+    }
+  }
+  for( int k = 0; k < 3; ++k )
+    scale[k] = hi[k] > lo[k] ? 1023.0f / ( hi[k] - lo[k] ) : 0.0f;
+
+  std::vector<uint32_t> codes( num_triangles );
+  sutil::parallelFor( num_triangles, chunk_size, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      float c[3];
+      centroid( mesh, i, c );
+      uint32_t q[3];
+      for( int k = 0; k < 3; ++k )
+        q[k] = static_cast<uint32_t>( std::min( std::max( ( c[k] - lo[k] ) * scale[k], 0.0f ), 1023.0f ) );
+      codes[i] = ( expandBits( q[0] ) << 2 ) | ( expandBits( q[1] ) << 1 ) | expandBits( q[2] );
+    }
+  } );
+
+  // Stable LSD radix sort of (code, id) pairs, 10 code bits per pass.
+  for( size_t i = 0; i < num_triangles; ++i )
+    order[i] = static_cast<uint32_t>( i );
+  std::vector<uint32_t> scratch_codes( num_triangles ), scratch_order( num_triangles );
+  for( int shift = 0; shift < 30; shift += 10 )
+  {
+    size_t offsets[1024 + 1] = { 0 };
+    for( size_t i = 0; i < num_triangles; ++i )
+      ++offsets[( ( codes[i] >> shift ) & 1023u ) + 1];
+    for( int b = 0; b < 1024; ++b )
+      offsets[b + 1] += offsets[b];
+    for( size_t i = 0; i < num_triangles; ++i )
+    {
+      const size_t slot = offsets[( codes[i] >> shift ) & 1023u]++;
+      scratch_codes[slot] = codes[i];
+      scratch_order[slot] = order[i];
+    }
+    codes.swap( scratch_codes );
+    order.swap( scratch_order );
+  }
+}
+
+
+void optimizeMeshLayout( Mesh& mesh )
+{
+  std::vector<uint32_t> order;
+  mortonTriangleOrder( mesh, order );
+  reorderMeshTriangles( mesh, order );
+}
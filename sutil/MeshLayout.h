@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <sutilapi.h>
+
+#include <stdint.h>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Mesh layout optimization
+//
+// Loaders keep triangles in file order, so triangles that are neighbours in
+// space, and end up in the same BVH leaves, can reference vertices
+// megabytes apart.  Sorting triangles spatially and renumbering vertices in
+// first-use order puts the index and vertex data a traversal touches
+// together into few cache lines.
+//
+//-----------------------------------------------------------------------------
+
+// Moves triangle order[i] to position i, carrying mat_indices along, then
+// renumbers vertices in order of first use by the new triangle list.
+// Unreferenced vertices follow in their previous order, so num_vertices and
+// all array sizes stay the same.  'order' must be a permutation of
+// [0, num_triangles); throws std::runtime_error when its size differs.
+SUTILAPI void reorderMeshTriangles( Mesh& mesh, const std::vector<uint32_t>& order );
+
+// Triangle order along a 30-bit Morton curve of triangle centroids over the
+// bounds of all centroids; ties keep file order.
+SUTILAPI void mortonTriangleOrder( const Mesh& mesh, std::vector<uint32_t>& order );
+
+// reorderMeshTriangles() in Morton order.
+SUTILAPI void optimizeMeshLayout( Mesh& mesh );
@@ -0,0 +1,381 @@
+#include "MeshProcessing.h"
+#include "ParallelFor.h"
+
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define MESH_PROCESSING_SSE2 1
+#endif
+
+using optix::float2;
+using optix::float3;
+
+namespace
+{
+
+const size_t chunk_size = 1u << 14;   // vertices or triangles per parallelFor chunk
+
+
+//-----------------------------------------------------------------------------
+//
+// Load transform and bounds
+//
+//-----------------------------------------------------------------------------
+
+// Transforms 'count' float3s in place by the upper 3x4 part of row-major
+// 'm'.  Points take the translation and grow 'lo' and 'hi'; directions are
+// renormalized instead.
+void transformFloat3( float* v, size_t count, const float* m, bool point, float lo[3], float hi[3] )
+{
+  const float tx = point ? m[3]  : 0.0f;
+  const float ty = point ? m[7]  : 0.0f;
+  const float tz = point ? m[11] : 0.0f;
+
+  size_t i = 0;
+#if defined(MESH_PROCESSING_SSE2)
+  // Four vertices per step: three loads hold x0 y0 z0 x1 | y1 z1 x2 y2 |
+  // z2 x3 y3 z3, which are shuffled into x, y and z lanes and back.
+  const float none[3] = { 0.0f, 0.0f, 0.0f };
+  const float* l = point ? lo : none;
+  const float* h = point ? hi : none;
+  __m128 lo_x = _mm_set1_ps( l[0] ), lo_y = _mm_set1_ps( l[1] ), lo_z = _mm_set1_ps( l[2] );
+  __m128 hi_x = _mm_set1_ps( h[0] ), hi_y = _mm_set1_ps( h[1] ), hi_z = _mm_set1_ps( h[2] );
+  for( ; i + 4 <= count; i += 4 )
+  {
+    float* p = v + 3 * i;
+    const __m128 a = _mm_loadu_ps( p );
+    const __m128 b = _mm_loadu_ps( p + 4 );
+    const __m128 c = _mm_loadu_ps( p + 8 );
+
+    const __m128 x = _mm_shuffle_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 3, 0, 0 ) ),
+                                     _mm_shuffle_ps( b, c, _MM_SHUFFLE( 1, 1, 2, 2 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) );
+    const __m128 y = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 0, 0, 1, 1 ) ),
+                                     _mm_shuffle_ps( b, c, _MM_SHUFFLE( 2, 2, 3, 3 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) );
+    const __m128 z = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 1, 1, 2, 2 ) ),
+                                     _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 3, 0, 0 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) );
+
+    __m128 rx = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[0] ), x ), _mm_mul_ps( _mm_set1_ps( m[1] ), y ) ),
+                                        _mm_mul_ps( _mm_set1_ps( m[2] ), z ) ), _mm_set1_ps( tx ) );
+    __m128 ry = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[4] ), x ), _mm_mul_ps( _mm_set1_ps( m[5] ), y ) ),
+                                        _mm_mul_ps( _mm_set1_ps( m[6] ), z ) ), _mm_set1_ps( ty ) );
+    __m128 rz = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[8] ), x ), _mm_mul_ps( _mm_set1_ps( m[9] ), y ) ),
+                                        _mm_mul_ps( _mm_set1_ps( m[10] ), z ) ), _mm_set1_ps( tz ) );
+
+    if( point )
+    {
+      lo_x = _mm_min_ps( lo_x, rx ); hi_x = _mm_max_ps( hi_x, rx );
+      lo_y = _mm_min_ps( lo_y, ry ); hi_y = _mm_max_ps( hi_y, ry );
+      lo_z = _mm_min_ps( lo_z, rz ); hi_z = _mm_max_ps( hi_z, rz );
+    }
+    else
+    {
+      const __m128 len2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( rx, rx ), _mm_mul_ps( ry, ry ) ), _mm_mul_ps( rz, rz ) );
+      const __m128 inv  = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( len2 ) );
+      const __m128 ok   = _mm_cmpgt_ps( len2, _mm_setzero_ps() );
+      rx = _mm_and_ps( ok, _mm_mul_ps( rx, inv ) );
+      ry = _mm_and_ps( ok, _mm_mul_ps( ry, inv ) );
+      rz = _mm_and_ps( ok, _mm_mul_ps( rz, inv ) );
+    }
+
+    _mm_storeu_ps( p,     _mm_shuffle_ps( _mm_shuffle_ps( rx, ry, _MM_SHUFFLE( 0, 0, 0, 0 ) ),
+                                          _mm_shuffle_ps( rz, rx, _MM_SHUFFLE( 1, 1, 0, 0 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+    _mm_storeu_ps( p + 4, _mm_shuffle_ps( _mm_shuffle_ps( ry, rz, _MM_SHUFFLE( 1, 1, 1, 1 ) ),
+                                          _mm_shuffle_ps( rx, ry, _MM_SHUFFLE( 2, 2, 2, 2 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+    _mm_storeu_ps( p + 8, _mm_shuffle_ps( _mm_shuffle_ps( rz, rx, _MM_SHUFFLE( 3, 3, 2, 2 ) ),
+                                          _mm_shuffle_ps( ry, rz, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+  }
+
+  if( point )
+  {
+    float lanes_lo[3][4], lanes_hi[3][4];
+    _mm_storeu_ps( lanes_lo[0], lo_x ); _mm_storeu_ps( lanes_lo[1], lo_y ); _mm_storeu_ps( lanes_lo[2], lo_z );
+    _mm_storeu_ps( lanes_hi[0], hi_x ); _mm_storeu_ps( lanes_hi[1], hi_y ); _mm_storeu_ps( lanes_hi[2], hi_z );
+    for( int k = 0; k < 3; ++k )
+    {
+      lo[k] = std::min( std::min( lanes_lo[k][0], lanes_lo[k][1] ), std::min( lanes_lo[k][2], lanes_lo[k][3] ) );
+      hi[k] = std::max( std::max( lanes_hi[k][0], lanes_hi[k][1] ), std::max( lanes_hi[k][2], lanes_hi[k][3] ) );
+    }
+  }
+#endif
+
+  for( ; i < count; ++i )
+  {
+    float* p = v + 3 * i;
+    const float x = p[0], y = p[1], z = p[2];
+    float r[3] = { m[0] * x + m[1] * y + m[2]  * z + tx,
+                   m[4] * x + m[5] * y + m[6]  * z + ty,
+                   m[8] * x + m[9] * y + m[10] * z + tz };
+    if( point )
+    {
+      for( int k = 0; k < 3; ++k )
+      {
+        lo[k] = std::min( lo[k], r[k] );
+        hi[k] = std::max( hi[k], r[k] );
+      }
+    }
+    else
+    {
+      const float len2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+      const float inv  = len2 > 0.0f ? 1.0f / sqrtf( len2 ) : 0.0f;
+      for( int k = 0; k < 3; ++k )
+        r[k] *= inv;
+    }
+    memcpy( p, r, sizeof( r ) );
+  }
+}
+
+
+// Transforms positions and, unless they are about to be regenerated,
+// normals, and recomputes the bounding box.
+void transformVertices( Mesh& mesh, const float* load_xform, bool transform_normals )
+{
+  const optix::Matrix4x4 normal_xform = optix::Matrix4x4( load_xform ).inverse().transpose();
+
+  const size_t count      = mesh.num_vertices;
+  const size_t num_chunks = ( count + chunk_size - 1 ) / chunk_size;
+
+  // Chunks that parallelFor folds into one inline call keep the empty box.
+  std::vector<float> chunk_bounds( num_chunks * 6, 1e16f );
+  for( size_t c = 0; c < num_chunks; ++c )
+    std::fill( &chunk_bounds[6 * c + 3], &chunk_bounds[6 * c + 6], -1e16f );
+
+  sutil::parallelFor( count, chunk_size, [&]( size_t begin, size_t end )
+  {
+    float* b = &chunk_bounds[6 * ( begin / chunk_size )];
+    transformFloat3( mesh.positions + 3 * begin, end - begin, load_xform, true, b, b + 3 );
+    if( transform_normals )
+      transformFloat3( mesh.normals + 3 * begin, end - begin, normal_xform.getData(), false, 0, 0 );
+  } );
+
+  mesh.bbox_min[0] = mesh.bbox_min[1] = mesh.bbox_min[2] =  1e16f;
+  mesh.bbox_max[0] = mesh.bbox_max[1] = mesh.bbox_max[2] = -1e16f;
+  for( size_t c = 0; c < num_chunks; ++c )
+  {
+    for( int k = 0; k < 3; ++k )
+    {
+      mesh.bbox_min[k] = std::min( mesh.bbox_min[k], chunk_bounds[6 * c + k] );
+      mesh.bbox_max[k] = std::max( mesh.bbox_max[k], chunk_bounds[6 * c + 3 + k] );
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// Normal and tangent generation
+//
+//-----------------------------------------------------------------------------
+
+// Any unit vector orthogonal to unit 'n'.
+inline float3 perpendicular( const float3& n )
+{
+  const float3 a = fabsf( n.x ) < 0.9f ? optix::make_float3( 1.0f, 0.0f, 0.0f ) : optix::make_float3( 0.0f, 1.0f, 0.0f );
+  return optix::normalize( optix::cross( n, a ) );
+}
+
+
+// Vertices are split into ranges, and each range gets the list of
+// triangles with a corner in it, in triangle order.  One task per range
+// then accumulates into its own vertices only, so every triangle is visited
+// at most three times whatever the thread count.  Sums run in triangle
+// order, so results do not depend on the thread count either.
+void generateFrames( Mesh& mesh, bool normals, bool tangents )
+{
+  const size_t   num_vertices  = mesh.num_vertices;
+  const size_t   num_triangles = mesh.num_triangles;
+  const uint32_t vertex_count  = static_cast<uint32_t>( mesh.num_vertices );
+
+  const float3*   positions = reinterpret_cast<const float3*>( mesh.positions );
+  const float2*   texcoords = reinterpret_cast<const float2*>( mesh.texcoords );
+  const uint32_t* indices   = reinterpret_cast<const uint32_t*>( mesh.tri_indices );
+  float3*         vertex_normals = reinterpret_cast<float3*>( mesh.normals );
+
+  std::vector<float3> sdir( tangents ? num_vertices : 0 );
+  std::vector<float3> tdir( tangents ? num_vertices : 0 );
+
+  // About one vertex range per thread, so a single thread takes every
+  // triangle in one pass without bucketing.
+  const unsigned int threads     = sutil::parallelThreadCount();
+  unsigned int       range_shift = 14;
+  while( ( size_t( 1 ) << range_shift ) * threads < num_vertices )
+    ++range_shift;
+  const size_t num_ranges = ( ( num_vertices - 1 ) >> range_shift ) + 1;
+
+  // Ranges the corners of triangle 'i' fall in, without repeats; none when
+  // an index is out of range (negative ones wrap to large unsigned values).
+  auto triangleRanges = [&]( size_t i, uint32_t ranges[3] ) -> int
+  {
+    const uint32_t* tri = indices + 3 * i;
+    if( tri[0] >= vertex_count || tri[1] >= vertex_count || tri[2] >= vertex_count )
+      return 0;
+    int count = 0;
+    for( int k = 0; k < 3; ++k )
+    {
+      const uint32_t r = tri[k] >> range_shift;
+      if( ( count < 1 || ranges[0] != r ) && ( count < 2 || ranges[1] != r ) )
+        ranges[count++] = r;
+    }
+    return count;
+  };
+
+  // Bucket triangles by range: count per triangle block, then write each
+  // block's entries after those of earlier blocks.
+  std::vector<size_t>   range_first( num_ranges + 1, 0 );
+  std::vector<uint32_t> range_triangles;
+  if( num_ranges == 1 )
+  {
+    range_first[1] = num_triangles;
+  }
+  else
+  {
+    const size_t block_size = std::max<size_t>( chunk_size, ( num_triangles + 4 * threads - 1 ) / ( 4 * threads ) );
+    const size_t num_blocks = ( num_triangles + block_size - 1 ) / block_size;
+    std::vector<uint32_t> block_offsets( num_blocks * num_ranges, 0 );
+    sutil::parallelFor( num_blocks, 1, [&]( size_t begin, size_t end )
+    {
+      for( size_t b = begin; b < end; ++b )
+      {
+        uint32_t* counts = &block_offsets[b * num_ranges];
+        for( size_t i = b * block_size; i < std::min( ( b + 1 ) * block_size, num_triangles ); ++i )
+        {
+          uint32_t ranges[3];
+          for( int n = triangleRanges( i, ranges ), k = 0; k < n; ++k )
+            ++counts[ranges[k]];
+        }
+      }
+    } );
+    for( size_t r = 0; r < num_ranges; ++r )
+    {
+      size_t next = range_first[r];
+      for( size_t b = 0; b < num_blocks; ++b )
+      {
+        const uint32_t count = block_offsets[b * num_ranges + r];
+        block_offsets[b * num_ranges + r] = static_cast<uint32_t>( next - range_first[r] );
+        next += count;
+      }
+      range_first[r + 1] = next;
+    }
+    range_triangles.resize( range_first[num_ranges] );
+    sutil::parallelFor( num_blocks, 1, [&]( size_t begin, size_t end )
+    {
+      for( size_t b = begin; b < end; ++b )
+      {
+        uint32_t* offsets = &block_offsets[b * num_ranges];
+        for( size_t i = b * block_size; i < std::min( ( b + 1 ) * block_size, num_triangles ); ++i )
+        {
+          uint32_t ranges[3];
+          for( int n = triangleRanges( i, ranges ), k = 0; k < n; ++k )
+            range_triangles[range_first[ranges[k]] + offsets[ranges[k]]++] = static_cast<uint32_t>( i );
+        }
+      }
+    } );
+  }
+
+  sutil::parallelFor( num_ranges, 1, [&]( size_t first_range, size_t end_range )
+  {
+    for( size_t range = first_range; range < end_range; ++range )
+    {
+      const size_t begin = range << range_shift;
+      const size_t end   = std::min( ( range + 1 ) << range_shift, num_vertices );
+      const float3 zero  = optix::make_float3( 0.0f );
+      for( size_t v = begin; v < end; ++v )
+      {
+        if( normals )
+          vertex_normals[v] = zero;
+        if( tangents )
+          sdir[v] = tdir[v] = zero;
+      }
+
+      const uint32_t first = static_cast<uint32_t>( begin );
+      const uint32_t count = static_cast<uint32_t>( end - begin );
+      for( size_t j = range_first[range]; j < range_first[range + 1]; ++j )
+      {
+        const uint32_t* tri = indices + 3 * ( range_triangles.empty() ? j : range_triangles[j] );
+        const bool own[3] = { tri[0] - first < count, tri[1] - first < count, tri[2] - first < count };
+        if( tri[0] >= vertex_count || tri[1] >= vertex_count || tri[2] >= vertex_count )
+          continue;
+
+        const float3 e01 = positions[tri[1]] - positions[tri[0]];
+        const float3 e02 = positions[tri[2]] - positions[tri[0]];
+        if( normals )
+        {
+          // Area weighted: the cross product is twice the triangle's area.
+          const float3 n = optix::cross( e01, e02 );
+          for( int k = 0; k < 3; ++k )
+            if( own[k] )
+              vertex_normals[tri[k]] += n;
+        }
+        if( tangents )
+        {
+          const float2 d1  = texcoords[tri[1]] - texcoords[tri[0]];
+          const float2 d2  = texcoords[tri[2]] - texcoords[tri[0]];
+          const float  det = d1.x * d2.y - d2.x * d1.y;
+          if( det == 0.0f )
+            continue;
+          const float  r = 1.0f / det;
+          const float3 s = ( e01 * d2.y - e02 * d1.y ) * r;
+          const float3 t = ( e02 * d1.x - e01 * d2.x ) * r;
+          for( int k = 0; k < 3; ++k )
+          {
+            if( own[k] )
+            {
+              sdir[tri[k]] += s;
+              tdir[tri[k]] += t;
+            }
+          }
+        }
+      }
+
+      for( size_t v = begin; v < end; ++v )
+      {
+        if( normals )
+        {
+          const float len = optix::length( vertex_normals[v] );
+          vertex_normals[v] = len > 0.0f ? vertex_normals[v] / len : optix::make_float3( 0.0f, 0.0f, 1.0f );
+        }
+        if( !tangents )
+          continue;
+
+        // Gram-Schmidt against the shading normal; w flips the bitangent
+        // where the UV mapping is mirrored.
+        const float3 nn  = optix::normalize( vertex_normals[v] );
+        float3       tan = sdir[v] - nn * optix::dot( nn, sdir[v] );
+        const float  len = optix::length( tan );
+        tan = len > 1e-20f ? tan / len : perpendicular( nn );
+
+        float* out = mesh.tangents + 4 * v;
+        out[0] = tan.x;
+        out[1] = tan.y;
+        out[2] = tan.z;
+        out[3] = optix::dot( optix::cross( nn, tan ), tdir[v] ) < 0.0f ? -1.0f : 1.0f;
+      }
+    }
+  } );
+}
+
+} // namespace
+
+
+void processMesh( Mesh& mesh, const float* load_xform, bool generate_normals )
+{
+  bool have_matrix = false;
+  for( int32_t i = 0; load_xform && i < 16; ++i )
+    if( load_xform[i] != 0.0f )
+      have_matrix = true;
+
+  generate_normals = generate_normals && mesh.has_normals;
+  const bool generate_tangents = mesh.has_tangents && mesh.has_texcoords && mesh.has_normals;
+
+  if( have_matrix )
+    transformVertices( mesh, load_xform, mesh.has_normals && !generate_normals );
+
+  if( generate_normals || generate_tangents )
+    generateFrames( mesh, generate_normals, generate_tangents );
+}
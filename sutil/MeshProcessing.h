@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Mesh.h"
+
+//-----------------------------------------------------------------------------
+//
+// Post-load mesh processing
+//
+// Runs once the format loaders have filled a mesh, as parallel sweeps over
+// the vertex arrays:
+//   transform: positions and file normals go through the load transform,
+//              four vertices per SSE2 step, and the bounding box is reduced
+//              in the same sweep
+//   frames   : area weighted smooth normals where the file had none and
+//              the caller asked for them, and tangents orthogonalized
+//              against the vertex normal with the bitangent sign in w,
+//              accumulated per vertex range over the triangles bucketed
+//              to it, in triangle order so results do not depend on the
+//              thread count
+//
+//-----------------------------------------------------------------------------
+
+// Applies 'load_xform' (row-major 4x4, skipped when null or all zero) and
+// fills mesh.normals when 'generate_normals' is set and mesh.tangents when
+// the mesh has tangents and texcoords.
+void processMesh( Mesh& mesh, const float* load_xform, bool generate_normals );
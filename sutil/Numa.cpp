@@ -0,0 +1,493 @@
+#include "Numa.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#  include <malloc.h>
+#else
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#  include <dirent.h>
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/syscall.h>
+#endif
+
+namespace
+{
+
+const size_t huge_page_bytes = size_t( 2 ) << 20;
+
+
+size_t roundUp( size_t bytes, size_t alignment )
+{
+  return ( bytes + alignment - 1 ) / alignment * alignment;
+}
+
+
+size_t systemPageBytes()
+{
+#if defined(_WIN32)
+  return 4096;
+#else
+  const long bytes = sysconf( _SC_PAGESIZE );
+  return bytes > 0 ? static_cast<size_t>( bytes ) : 4096;
+#endif
+}
+
+
+#if defined(__linux__)
+
+// Parses a kernel CPU list such as "0-3,8-11".
+std::vector<unsigned int> parseCpuList( const std::string& list )
+{
+  std::vector<unsigned int> cpus;
+  std::stringstream ss( list );
+  std::string range;
+  while( std::getline( ss, range, ',' ) )
+  {
+    if( range.empty() || range[0] < '0' || range[0] > '9' )
+      continue;
+    const unsigned long first = strtoul( range.c_str(), 0, 10 );
+    const size_t        dash  = range.find( '-' );
+    const unsigned long last  = dash == std::string::npos ? first : strtoul( range.c_str() + dash + 1, 0, 10 );
+    for( unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu )
+      cpus.push_back( static_cast<unsigned int>( cpu ) );
+  }
+  return cpus;
+}
+
+
+std::vector<NumaNode> detectNodes()
+{
+  cpu_set_t allowed;
+  CPU_ZERO( &allowed );
+  if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 )
+  {
+    for( unsigned int cpu = 0; cpu < std::max( std::thread::hardware_concurrency(), 1u ); ++cpu )
+      CPU_SET( cpu, &allowed );
+  }
+
+  std::vector<NumaNode> nodes;
+  if( DIR* dir = opendir( "/sys/devices/system/node" ) )
+  {
+    while( dirent* entry = readdir( dir ) )
+    {
+      if( strncmp( entry->d_name, "node", 4 ) != 0 || entry->d_name[4] < '0' || entry->d_name[4] > '9' )
+        continue;
+      std::ifstream in( std::string( "/sys/devices/system/node/" ) + entry->d_name + "/cpulist" );
+      std::string list;
+      if( !std::getline( in, list ) )
+        continue;
+
+      // Memory-only nodes and nodes the process may not run on drop out.
+      NumaNode node;
+      node.id = static_cast<unsigned int>( strtoul( entry->d_name + 4, 0, 10 ) );
+      const std::vector<unsigned int> cpus = parseCpuList( list );
+      for( size_t i = 0; i < cpus.size(); ++i )
+        if( CPU_ISSET( cpus[i], &allowed ) )
+          node.cpus.push_back( cpus[i] );
+      if( !node.cpus.empty() )
+        nodes.push_back( node );
+    }
+    closedir( dir );
+  }
+  std::sort( nodes.begin(), nodes.end(), []( const NumaNode& a, const NumaNode& b ) { return a.id < b.id; } );
+
+  if( nodes.empty() )
+  {
+    NumaNode node;
+    node.id = 0;
+    for( unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+      if( CPU_ISSET( cpu, &allowed ) )
+        node.cpus.push_back( cpu );
+    if( node.cpus.empty() )
+      node.cpus.push_back( 0 );
+    nodes.push_back( node );
+  }
+  return nodes;
+}
+
+#else
+
+std::vector<NumaNode> detectNodes()
+{
+  NumaNode node;
+  node.id = 0;
+  for( unsigned int cpu = 0; cpu < std::max( std::thread::hardware_concurrency(), 1u ); ++cpu )
+    node.cpus.push_back( cpu );
+  return std::vector<NumaNode>( 1, node );
+}
+
+#endif
+
+
+#if !defined(_WIN32)
+
+// Mapping lengths by address, so freeLarge() needs only the pointer.
+std::mutex                         g_mappings_mutex;
+std::unordered_map<void*, size_t>  g_mappings;
+
+#endif
+
+} // namespace
+
+
+const std::vector<NumaNode>& numaNodes()
+{
+  static const std::vector<NumaNode> nodes = detectNodes();
+  return nodes;
+}
+
+
+unsigned int numaThreadCount()
+{
+  size_t count = 0;
+  for( const NumaNode& node : numaNodes() )
+    count += node.cpus.size();
+  return static_cast<unsigned int>( count );
+}
+
+
+bool bindThreadToNumaNode( unsigned int node )
+{
+  const std::vector<NumaNode>& nodes = numaNodes();
+  if( node >= nodes.size() )
+    return false;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  for( size_t i = 0; i < nodes[node].cpus.size(); ++i )
+    CPU_SET( nodes[node].cpus[i], &set );
+  return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+#else
+  return false;
+#endif
+}
+
+
+void* allocateLarge( size_t bytes, HugePages pages, HugePages* used )
+{
+  bytes = std::max<size_t>( bytes, 1 );
+#if defined(_WIN32)
+  const size_t length = roundUp( bytes, systemPageBytes() );
+  void* memory = _aligned_malloc( length, systemPageBytes() );
+  if( !memory )
+    throw std::runtime_error( "allocateLarge: Out of memory" );
+  memset( memory, 0, length );
+  if( used )
+    *used = HUGE_PAGES_NONE;
+  return memory;
+#else
+  void*     memory = MAP_FAILED;
+  size_t    length = 0;
+  HugePages got    = HUGE_PAGES_NONE;
+#  if defined(MAP_HUGETLB)
+  if( pages == HUGE_PAGES_EXPLICIT )
+  {
+    length = roundUp( bytes, huge_page_bytes );
+    memory = mmap( 0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+    if( memory != MAP_FAILED )
+      got = HUGE_PAGES_EXPLICIT;
+  }
+#  endif
+  if( memory == MAP_FAILED )
+  {
+    length = roundUp( bytes, systemPageBytes() );
+    if( pages != HUGE_PAGES_NONE && length >= huge_page_bytes )
+    {
+      // Map a huge page more and trim both ends, so the range starts on a
+      // huge page boundary and every huge page of it can be used.
+      const size_t padded = length + huge_page_bytes;
+      char* raw = static_cast<char*>( mmap( 0, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) );
+      if( raw == MAP_FAILED )
+        throw std::runtime_error( "allocateLarge: Out of memory" );
+      char* aligned = reinterpret_cast<char*>( roundUp( reinterpret_cast<uintptr_t>( raw ), huge_page_bytes ) );
+      if( aligned > raw )
+        munmap( raw, aligned - raw );
+      if( raw + padded > aligned + length )
+        munmap( aligned + length, raw + padded - ( aligned + length ) );
+      memory = aligned;
+    }
+    else
+    {
+      memory = mmap( 0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+      if( memory == MAP_FAILED )
+        throw std::runtime_error( "allocateLarge: Out of memory" );
+    }
+    if( pages != HUGE_PAGES_NONE && adviseHugePages( memory, length ) )
+      got = HUGE_PAGES_TRANSPARENT;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( g_mappings_mutex );
+    g_mappings[memory] = length;
+  }
+  if( used )
+    *used = got;
+  return memory;
+#endif
+}
+
+
+void freeLarge( void* memory )
+{
+  if( !memory )
+    return;
+#if defined(_WIN32)
+  _aligned_free( memory );
+#else
+  size_t length = 0;
+  {
+    std::lock_guard<std::mutex> lock( g_mappings_mutex );
+    std::unordered_map<void*, size_t>::iterator i = g_mappings.find( memory );
+    if( i == g_mappings.end() )
+      return;
+    length = i->second;
+    g_mappings.erase( i );
+  }
+  munmap( memory, length );
+#endif
+}
+
+
+bool adviseHugePages( const void* memory, size_t bytes )
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  const uintptr_t begin = roundUp( reinterpret_cast<uintptr_t>( memory ), huge_page_bytes );
+  const uintptr_t end   = ( reinterpret_cast<uintptr_t>( memory ) + bytes ) / huge_page_bytes * huge_page_bytes;
+  if( begin >= end )
+    return false;
+  return madvise( reinterpret_cast<void*>( begin ), end - begin, MADV_HUGEPAGE ) == 0;
+#else
+  (void)memory;
+  (void)bytes;
+  return false;
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// NumaPageMap
+//
+//-----------------------------------------------------------------------------
+
+NumaPageMap::NumaPageMap()
+  : m_page_bytes( systemPageBytes() )
+{
+}
+
+
+void NumaPageMap::add( const void* memory, size_t bytes )
+{
+  if( !memory || bytes == 0 )
+    return;
+
+  Range range;
+  range.begin      = reinterpret_cast<uintptr_t>( memory ) / m_page_bytes * m_page_bytes;
+  range.end        = roundUp( reinterpret_cast<uintptr_t>( memory ) + bytes, m_page_bytes );
+  range.first_page = m_nodes.size();
+  const size_t num_pages = ( range.end - range.begin ) / m_page_bytes;
+
+  // With one node every placed page is on it, whether or not the kernel
+  // can say so.
+  const std::vector<NumaNode>& nodes = numaNodes();
+  m_nodes.resize( m_nodes.size() + num_pages, static_cast<int16_t>( nodes.size() == 1 ? nodes[0].id : -1 ) );
+#if defined(__linux__) && defined(SYS_move_pages)
+  const size_t batch = 4096;
+  std::vector<void*> addresses( batch );
+  std::vector<int>   status( batch );
+  for( size_t first = 0; first < num_pages; first += batch )
+  {
+    const size_t count = std::min( batch, num_pages - first );
+    for( size_t i = 0; i < count; ++i )
+      addresses[i] = reinterpret_cast<void*>( range.begin + ( first + i ) * m_page_bytes );
+    // With no target nodes, move_pages() only reports where pages are.
+    if( syscall( SYS_move_pages, 0, static_cast<unsigned long>( count ), &addresses[0], 0, &status[0], 0 ) != 0 )
+      break;
+    for( size_t i = 0; i < count; ++i )
+      m_nodes[range.first_page + first + i] = static_cast<int16_t>( status[i] >= 0 ? status[i] : -1 );
+  }
+#endif
+
+  m_ranges.insert( std::upper_bound( m_ranges.begin(), m_ranges.end(), range,
+                                     []( const Range& a, const Range& b ) { return a.begin < b.begin; } ),
+                   range );
+}
+
+
+void NumaPageMap::clear()
+{
+  m_ranges.clear();
+  m_nodes.clear();
+}
+
+
+int NumaPageMap::node( const void* address ) const
+{
+  const uintptr_t a = reinterpret_cast<uintptr_t>( address );
+  std::vector<Range>::const_iterator i = std::upper_bound(
+      m_ranges.begin(), m_ranges.end(), a, []( uintptr_t value, const Range& r ) { return value < r.begin; } );
+  if( i == m_ranges.begin() )
+    return -1;
+  --i;
+  if( a >= i->end )
+    return -1;
+  return m_nodes[i->first_page + ( a - i->begin ) / m_page_bytes];
+}
+
+
+std::vector<size_t> NumaPageMap::pagesPerNode() const
+{
+  std::vector<size_t> counts;
+  for( size_t i = 0; i < m_nodes.size(); ++i )
+  {
+    if( m_nodes[i] < 0 )
+      continue;
+    if( counts.size() <= size_t( m_nodes[i] ) )
+      counts.resize( m_nodes[i] + 1, 0 );
+    ++counts[m_nodes[i]];
+  }
+  return counts;
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// ReplicatedHostBVH
+//
+//-----------------------------------------------------------------------------
+
+ReplicatedHostBVH::ReplicatedHostBVH()
+  : m_pages( HUGE_PAGES_NONE )
+{
+}
+
+
+ReplicatedHostBVH::~ReplicatedHostBVH()
+{
+  clear();
+}
+
+
+void ReplicatedHostBVH::build( const Mesh& mesh, const HostBVH& bvh, bool replicate, HugePages pages )
+{
+  clear();
+  if( !mesh.positions || !mesh.tri_indices || bvh.nodes().empty() )
+    throw std::runtime_error( "ReplicatedHostBVH: build() requires a HostBVH built over the mesh" );
+
+  const size_t num_replicas = replicate ? numaNodes().size() : 1;
+  for( size_t r = 0; r < num_replicas; ++r )
+  {
+    Replica* replica = new Replica;
+    replica->positions = 0;
+    replica->indices   = 0;
+    replica->position_bytes = 3 * size_t( mesh.num_vertices ) * sizeof( float );
+    replica->index_bytes    = 3 * size_t( mesh.num_triangles ) * sizeof( int32_t );
+    replica->pages     = HUGE_PAGES_NONE;
+    m_replicas.push_back( replica );
+  }
+
+  // Each copy is written by a thread bound to its node, which places it
+  // there; the copies proceed in parallel.
+  std::vector<std::exception_ptr> errors( num_replicas );
+  std::vector<std::thread> threads;
+  for( size_t r = 0; r < num_replicas; ++r )
+  {
+    threads.push_back( std::thread( [&, r]()
+    {
+      try
+      {
+        bindThreadToNumaNode( static_cast<unsigned int>( r ) );
+        Replica& replica = *m_replicas[r];
+
+        HugePages index_pages = HUGE_PAGES_NONE;
+        replica.positions = static_cast<float*>( allocateLarge( replica.position_bytes, pages, &replica.pages ) );
+        replica.indices   = static_cast<int32_t*>( allocateLarge( replica.index_bytes, pages, &index_pages ) );
+        replica.pages     = std::min( replica.pages, index_pages );
+        memcpy( replica.positions, mesh.positions, replica.position_bytes );
+        memcpy( replica.indices, mesh.tri_indices, replica.index_bytes );
+
+        // reserve() maps without writing, so the advice comes in time.
+        std::vector<BVHNode> nodes;
+        nodes.reserve( bvh.nodes().size() );
+        if( pages != HUGE_PAGES_NONE )
+          adviseHugePages( nodes.data(), nodes.capacity() * sizeof( BVHNode ) );
+        nodes.assign( bvh.nodes().begin(), bvh.nodes().end() );
+
+        std::vector<uint32_t> triangles;
+        triangles.reserve( bvh.triangles().size() );
+        if( pages != HUGE_PAGES_NONE )
+          adviseHugePages( triangles.data(), triangles.capacity() * sizeof( uint32_t ) );
+        triangles.assign( bvh.triangles().begin(), bvh.triangles().end() );
+
+        replica.bvh.assign( replica.positions, replica.indices, nodes, triangles, bvh.maxLeafSize() );
+      }
+      catch( ... )
+      {
+        errors[r] = std::current_exception();
+      }
+    } ) );
+  }
+  for( size_t r = 0; r < threads.size(); ++r )
+    threads[r].join();
+  for( size_t r = 0; r < errors.size(); ++r )
+  {
+    if( errors[r] )
+    {
+      clear();
+      std::rethrow_exception( errors[r] );
+    }
+  }
+
+  m_pages = m_replicas[0]->pages;
+  for( size_t r = 1; r < m_replicas.size(); ++r )
+    m_pages = std::min( m_pages, m_replicas[r]->pages );
+}
+
+
+void ReplicatedHostBVH::clear()
+{
+  for( size_t r = 0; r < m_replicas.size(); ++r )
+  {
+    freeLarge( m_replicas[r]->positions );
+    freeLarge( m_replicas[r]->indices );
+    delete m_replicas[r];
+  }
+  m_replicas.clear();
+  m_pages = HUGE_PAGES_NONE;
+}
+
+
+size_t ReplicatedHostBVH::memoryBytes() const
+{
+  size_t bytes = 0;
+  for( size_t r = 0; r < m_replicas.size(); ++r )
+    bytes += m_replicas[r]->position_bytes + m_replicas[r]->index_bytes + m_replicas[r]->bvh.memoryBytes();
+  return bytes;
+}
+
+
+void ReplicatedHostBVH::mapPages( NumaPageMap& map ) const
+{
+  for( size_t r = 0; r < m_replicas.size(); ++r )
+  {
+    const Replica& replica = *m_replicas[r];
+    map.add( replica.positions, replica.position_bytes );
+    map.add( replica.indices, replica.index_bytes );
+    map.add( replica.bvh.nodes().data(), replica.bvh.nodes().size() * sizeof( BVHNode ) );
+    map.add( replica.bvh.triangles().data(), replica.bvh.triangles().size() * sizeof( uint32_t ) );
+  }
+}
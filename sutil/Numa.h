@@ -0,0 +1,207 @@
+#pragma once
+
+#include "HostBVH.h"
+#include "Mesh.h"
+
+#include <sutilapi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// NUMA placement for host traversal
+//
+// numaNodes() reads the topology from /sys/devices/system/node on Linux,
+// keeping only the CPUs the process may run on.  Elsewhere, or on a machine
+// without NUMA, it reports one node that holds every CPU.
+// numaParallelFor() runs worker threads bound to the CPUs of each node and
+// passes the body the node it runs on, so the body can use that node's copy
+// of the scene.
+//
+// Linux places a page on the node of the thread that first writes it.
+// ReplicatedHostBVH therefore makes its copies of a mesh's positions and
+// indices and of a HostBVH's nodes and triangle list from a thread bound
+// to each node, so every replica is local to the threads that read it.
+//
+// Large arrays can ask for huge pages, which cut TLB misses in traversal.
+// Transparent ones come through madvise( MADV_HUGEPAGE ) before the first
+// write.  Explicit ones come from the hugetlbfs pool through MAP_HUGETLB,
+// falling back to transparent when the pool is short.
+//
+//-----------------------------------------------------------------------------
+
+struct NumaNode
+{
+  unsigned int              id;     // Kernel node number
+  std::vector<unsigned int> cpus;
+};
+
+enum HugePages
+{
+  HUGE_PAGES_NONE        = 0,
+  HUGE_PAGES_TRANSPARENT = 1,
+  HUGE_PAGES_EXPLICIT    = 2
+};
+
+
+// Detected once; never empty, and every node has at least one CPU.
+SUTILAPI const std::vector<NumaNode>& numaNodes();
+
+// CPUs over all nodes.
+SUTILAPI unsigned int numaThreadCount();
+
+// Restricts the calling thread to the CPUs of numaNodes()[node].  Returns
+// false where thread affinity is not supported.
+SUTILAPI bool bindThreadToNumaNode( unsigned int node );
+
+// Page aligned, zeroed memory straight from the system, not yet touched,
+// so it lands on the node of the first thread to write it.  'used', when
+// given, receives the kind of pages actually obtained.  Throws
+// std::runtime_error when out of memory.
+SUTILAPI void* allocateLarge( size_t bytes, HugePages pages, HugePages* used = 0 );
+SUTILAPI void  freeLarge( void* memory );
+
+// Asks for transparent huge pages on the whole 2 MB pages inside a range
+// that has not been written yet.  Returns false where not supported or
+// when no whole huge page falls inside.
+SUTILAPI bool adviseHugePages( const void* memory, size_t bytes );
+
+
+//-----------------------------------------------------------------------------
+//
+// NumaPageMap -- node of every page of a set of address ranges
+//
+// Recorded once with the kernel's placement at the time; CacheModel uses
+// it to split the misses of a traversal into local and remote ones.
+//
+//-----------------------------------------------------------------------------
+
+class NumaPageMap
+{
+public:
+  SUTILAPI NumaPageMap();
+
+  SUTILAPI void add( const void* memory, size_t bytes );
+  SUTILAPI void clear();
+
+  // -1 outside the recorded ranges or for pages not yet placed.
+  SUTILAPI int node( const void* address ) const;
+
+  // Recorded pages on each node, by kernel node number.
+  SUTILAPI std::vector<size_t> pagesPerNode() const;
+
+private:
+  struct Range
+  {
+    uintptr_t begin;
+    uintptr_t end;
+    size_t    first_page;   // In m_nodes
+  };
+
+  size_t               m_page_bytes;
+  std::vector<Range>   m_ranges;   // Sorted by begin
+  std::vector<int16_t> m_nodes;
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// ReplicatedHostBVH -- a HostBVH and its mesh arrays copied per NUMA node
+//
+//-----------------------------------------------------------------------------
+
+class ReplicatedHostBVH
+{
+public:
+  SUTILAPI ReplicatedHostBVH();
+  SUTILAPI ~ReplicatedHostBVH();
+
+  // Copies the positions and indices of 'mesh' and 'bvh', which must have
+  // been built over 'mesh', once per node when 'replicate' is set, else
+  // once on the first node.  Vertex and index arrays take 'pages'; the
+  // tree's own arrays take transparent huge pages unless 'pages' is none.
+  SUTILAPI void build( const Mesh& mesh, const HostBVH& bvh, bool replicate, HugePages pages = HUGE_PAGES_TRANSPARENT );
+  SUTILAPI void clear();
+
+  // The copy threads on numaNodes()[node] should read.
+  const HostBVH& bvh( unsigned int node ) const
+  {
+    return m_replicas[m_replicas.size() > 1 ? node : 0]->bvh;
+  }
+
+  size_t numReplicas() const { return m_replicas.size(); }
+
+  // Smallest page kind any replica's vertex and index arrays obtained.
+  HugePages hugePages() const { return m_pages; }
+
+  // Over all replicas.
+  SUTILAPI size_t memoryBytes() const;
+
+  // Adds every array of every replica to 'map'.
+  SUTILAPI void mapPages( NumaPageMap& map ) const;
+
+private:
+  ReplicatedHostBVH( const ReplicatedHostBVH& );
+  ReplicatedHostBVH& operator=( const ReplicatedHostBVH& );
+
+  struct Replica
+  {
+    float*    positions;
+    int32_t*  indices;
+    size_t    position_bytes;
+    size_t    index_bytes;
+    HugePages pages;
+    HostBVH   bvh;
+  };
+
+  std::vector<Replica*> m_replicas;
+  HugePages             m_pages;
+};
+
+
+namespace sutil
+{
+
+// parallelFor() over 'num_threads' threads, or numaThreadCount() when 0,
+// dealt round robin to the nodes of numaNodes() and bound to them.  Calls
+// body( begin, end, node ) with the index of the node the chunk runs on.
+// The calling thread only waits, so its own affinity is left alone.
+template <typename Body>
+void numaParallelFor( size_t count, size_t grain, unsigned int num_threads, const Body& body )
+{
+  if( count == 0 )
+    return;
+  grain = std::max<size_t>( grain, 1u );
+
+  const size_t num_nodes  = numaNodes().size();
+  const size_t num_chunks = ( count + grain - 1 ) / grain;
+  if( num_threads == 0 )
+    num_threads = numaThreadCount();
+  num_threads = static_cast<unsigned int>( std::max<size_t>( std::min<size_t>( num_threads, num_chunks ), 1u ) );
+
+  std::atomic<size_t> next_chunk( 0 );
+  std::vector<std::thread> threads;
+  threads.reserve( num_threads );
+  for( unsigned int i = 0; i < num_threads; ++i )
+  {
+    const unsigned int node = static_cast<unsigned int>( i % num_nodes );
+    threads.push_back( std::thread( [&, node]()
+    {
+      bindThreadToNumaNode( node );
+      for( size_t chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++ )
+      {
+        const size_t begin = chunk * grain;
+        body( begin, std::min( begin + grain, count ), node );
+      }
+    } ) );
+  }
+  for( size_t i = 0; i < threads.size(); ++i )
+    threads[i].join();
+}
+
+} // namespace sutil
@@ -29,6 +29,8 @@
 #include <optixu/optixu_math_namespace.h>
 
 #include "Mesh.h"
+#include "MeshLayout.h"
+#include "MeshLOD.h"
 #include "OptiXMesh.h"
 #include "sutil.h"
 #include <algorithm>
@@ -62,6 +64,10 @@ void setupMeshLoaderInputs(
     Mesh&                     mesh
     )
 {
+  // No shader reads tangents, so they are neither generated nor uploaded.
+  mesh.has_tangents = false;
+  mesh.tangents     = 0;
+
   buffers.tri_indices = context->createBuffer( RT_BUFFER_INPUT, RT_FORMAT_INT3,   mesh.num_triangles );
   buffers.mat_indices = context->createBuffer( RT_BUFFER_INPUT, RT_FORMAT_INT,    mesh.num_triangles );
   buffers.positions   = context->createBuffer( RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, mesh.num_vertices );
@@ -157,16 +163,12 @@ optix::Program createIntersectionProgram( optix::Context context )
 }
 
 
-void translateMeshToOptiX(
+std::vector<optix::Material> createOptiXMaterials(
     const Mesh&        mesh,
-    const MeshBuffers& buffers,
     OptiXMesh&         optix_mesh
     )
 {
-  optix::Context ctx       = optix_mesh.context;
-  optix_mesh.bbox_min      = optix::make_float3( mesh.bbox_min );
-  optix_mesh.bbox_max      = optix::make_float3( mesh.bbox_max );
-  optix_mesh.num_triangles = mesh.num_triangles;
+  optix::Context ctx = optix_mesh.context;
 
   std::vector<optix::Material> optix_materials;
   if( optix_mesh.material )
@@ -195,6 +197,18 @@ void translateMeshToOptiX(
             mesh.mat_params[i],
             have_textures ) );
   }
+  return optix_materials;
+}
+
+
+optix::GeometryInstance createOptiXGeometryInstance(
+    const Mesh&                         mesh,
+    const MeshBuffers&                  buffers,
+    OptiXMesh&                          optix_mesh,
+    const std::vector<optix::Material>& optix_materials
+    )
+{
+  optix::Context ctx = optix_mesh.context;
 
   optix::Geometry geometry = ctx->createGeometry();  
   geometry[ "vertex_buffer"   ]->setBuffer( buffers.positions ); 
@@ -210,21 +224,82 @@ void translateMeshToOptiX(
                                     optix_mesh.intersection :
                                     createIntersectionProgram( ctx ) );
 
-  optix_mesh.geom_instance = ctx->createGeometryInstance(
-                                 geometry,
-                                 optix_materials.begin(),
-                                 optix_materials.end()
+  return ctx->createGeometryInstance(
+             geometry,
+             optix_materials.begin(),
+             optix_materials.end()
+             );
+}
+
+
+void translateMeshToOptiX(
+    const Mesh&        mesh,
+    const MeshBuffers& buffers,
+    OptiXMesh&         optix_mesh
+    )
+{
+  optix_mesh.bbox_min      = optix::make_float3( mesh.bbox_min );
+  optix_mesh.bbox_max      = optix::make_float3( mesh.bbox_max );
+  optix_mesh.num_triangles = mesh.num_triangles;
+
+  optix_mesh.geom_instance = createOptiXGeometryInstance(
+                                 mesh,
+                                 buffers,
+                                 optix_mesh,
+                                 createOptiXMaterials( mesh, optix_mesh )
                                  );
 }
 
 
+// Buffers holding a copy of a mesh already in host memory.
+void uploadMesh(
+    optix::Context            context, 
+    MeshBuffers&              buffers,
+    const Mesh&               mesh,
+    bool                      single_material
+    )
+{
+  Mesh mapped = mesh;
+  setupMeshLoaderInputs( context, buffers, mapped );
+  delete [] mapped.mat_params;
+  mapped.mat_params = 0;
+
+  const size_t num_vertices = mesh.num_vertices;
+  memcpy( mapped.tri_indices, mesh.tri_indices, mesh.num_triangles*3*sizeof(int32_t) );
+  if( single_material )
+    memset( mapped.mat_indices, 0, mesh.num_triangles*sizeof(int32_t) );
+  else
+    memcpy( mapped.mat_indices, mesh.mat_indices, mesh.num_triangles*sizeof(int32_t) );
+  memcpy( mapped.positions, mesh.positions, num_vertices*3*sizeof(float) );
+  if( mesh.has_normals )
+    memcpy( mapped.normals, mesh.normals, num_vertices*3*sizeof(float) );
+  if( mesh.has_texcoords )
+    memcpy( mapped.texcoords, mesh.texcoords, num_vertices*2*sizeof(float) );
+
+  unmap( buffers, mapped );
+}
+
+
+optix::GeometryGroup createLODGroup(
+    optix::Context            context, 
+    optix::GeometryInstance   instance
+    )
+{
+  optix::GeometryGroup group = context->createGeometryGroup();
+  group->addChild( instance );
+  group->setAcceleration( context->createAcceleration( "Trbvh" ) );
+  return group;
+}
+
+
 } // namespace end
 
 
 void loadMesh(
     const std::string&          filename,
     OptiXMesh&                  optix_mesh, 
-    const optix::Matrix4x4&     load_xform
+    const optix::Matrix4x4&     load_xform,
+    bool                        optimize_layout
     )
 {
   if( !optix_mesh.context )
@@ -242,8 +317,175 @@ void loadMesh(
   setupMeshLoaderInputs( context, buffers, mesh );
 
   loader.loadMesh( mesh, load_xform.getData() );
+  if( optimize_layout )
+    optimizeMeshLayout( mesh );
 
   translateMeshToOptiX( mesh, buffers, optix_mesh );
 
   unmap( buffers, mesh );
 }
+
+
+void updateMeshVertices(
+    OptiXMesh&                  optix_mesh,
+    const float*                positions,
+    const float*                normals,
+    optix::Acceleration         acceleration
+    )
+{
+  if( !optix_mesh.geom_instance )
+  {
+    throw std::runtime_error( "OptiXMesh: updateMeshVertices() requires a loaded mesh" );
+  }
+
+  optix::Geometry geometry      = optix_mesh.geom_instance->getGeometry();
+  optix::Buffer   vertex_buffer = geometry[ "vertex_buffer" ]->getBuffer();
+  RTsize num_vertices = 0;
+  vertex_buffer->getSize( num_vertices );
+
+  float* dst = reinterpret_cast<float*>( vertex_buffer->map( 0, RT_BUFFER_MAP_WRITE_DISCARD ) );
+  memcpy( dst, positions, num_vertices*3*sizeof(float) );
+  vertex_buffer->unmap();
+
+  float bbox_min[3] = {  1e16f,  1e16f,  1e16f };
+  float bbox_max[3] = { -1e16f, -1e16f, -1e16f };
+  for( RTsize i = 0; i < num_vertices; ++i )
+  {
+    for( int k = 0; k < 3; ++k )
+    {
+      bbox_min[k] = std::min( bbox_min[k], positions[3*i+k] );
+      bbox_max[k] = std::max( bbox_max[k], positions[3*i+k] );
+    }
+  }
+  optix_mesh.bbox_min = optix::make_float3( bbox_min );
+  optix_mesh.bbox_max = optix::make_float3( bbox_max );
+
+  optix::Buffer normal_buffer = geometry[ "normal_buffer" ]->getBuffer();
+  RTsize num_normals = 0;
+  normal_buffer->getSize( num_normals );
+  if( normals && num_normals == num_vertices )
+  {
+    dst = reinterpret_cast<float*>( normal_buffer->map( 0, RT_BUFFER_MAP_WRITE_DISCARD ) );
+    memcpy( dst, normals, num_normals*3*sizeof(float) );
+    normal_buffer->unmap();
+  }
+
+  if( acceleration )
+    acceleration->markDirty();
+}
+
+
+void loadMeshLODs(
+    const std::string&          filename,
+    OptiXMesh&                  optix_mesh,
+    OptiXMeshLODs&              lods,
+    const optix::Matrix4x4&     load_xform,
+    bool                        optimize_layout,
+    unsigned int                max_levels
+    )
+{
+  if( !optix_mesh.context )
+  {
+    throw std::runtime_error( "OptiXMesh: loadMeshLODs() requires valid OptiX context" );
+  }
+
+  optix::Context context = optix_mesh.context;
+
+  Mesh mesh;
+  MeshLoader loader( filename );
+  loader.scanMesh( mesh );
+
+  MeshBuffers buffers;
+  setupMeshLoaderInputs( context, buffers, mesh );
+
+  loader.loadMesh( mesh, load_xform.getData() );
+  if( optimize_layout )
+    optimizeMeshLayout( mesh );
+
+  // Simplify from the mapped buffers before the override material, if any,
+  // rewrites their material indices.
+  std::vector<MeshLOD> simplified;
+  buildMeshLODs( mesh, simplified, max_levels );
+
+  optix_mesh.bbox_min      = optix::make_float3( mesh.bbox_min );
+  optix_mesh.bbox_max      = optix::make_float3( mesh.bbox_max );
+  optix_mesh.num_triangles = mesh.num_triangles;
+
+  const std::vector<optix::Material> optix_materials = createOptiXMaterials( mesh, optix_mesh );
+  optix_mesh.geom_instance = createOptiXGeometryInstance( mesh, buffers, optix_mesh, optix_materials );
+
+  lods.groups.assign( 1, createLODGroup( context, optix_mesh.geom_instance ) );
+  lods.errors.assign( 1, 0.0f );
+  lods.num_triangles.assign( 1, mesh.num_triangles );
+
+  unmap( buffers, mesh );
+
+  for( size_t i = 0; i < simplified.size(); ++i )
+  {
+    const Mesh& level = simplified[i].mesh;
+    MeshBuffers level_buffers;
+    uploadMesh( context, level_buffers, level, optix_mesh.material );
+    lods.groups.push_back( createLODGroup(
+          context,
+          createOptiXGeometryInstance( level, level_buffers, optix_mesh, optix_materials ) ) );
+    lods.errors.push_back( simplified[i].error );
+    lods.num_triangles.push_back( level.num_triangles );
+  }
+  freeMeshLODs( simplified );
+}
+
+
+bool selectMeshLODs(
+    const OptiXMeshLODs&                 lods,
+    const OptiXMesh&                     mesh,
+    const std::vector<optix::Transform>& instances,
+    std::vector<unsigned int>&           levels,
+    const optix::float3&                 eye,
+    float                                pixel_footprint,
+    float                                max_pixel_error
+    )
+{
+  if( lods.groups.empty() )
+    return false;
+  if( levels.size() != instances.size() )
+    levels.assign( instances.size(), ~0u );
+
+  bool changed = false;
+  for( size_t i = 0; i < instances.size(); ++i )
+  {
+    float m[16];
+    instances[i]->getMatrix( false, m, 0 );
+
+    // World space bounds of the transformed box, and the largest scale the
+    // transform applies, which grows the error as it grows the mesh.
+    float lo[3] = {  1e16f,  1e16f,  1e16f };
+    float hi[3] = { -1e16f, -1e16f, -1e16f };
+    for( int corner = 0; corner < 8; ++corner )
+    {
+      const float p[3] = { corner & 1 ? mesh.bbox_max.x : mesh.bbox_min.x,
+                           corner & 2 ? mesh.bbox_max.y : mesh.bbox_min.y,
+                           corner & 4 ? mesh.bbox_max.z : mesh.bbox_min.z };
+      for( int k = 0; k < 3; ++k )
+      {
+        const float w = m[4*k]*p[0] + m[4*k+1]*p[1] + m[4*k+2]*p[2] + m[4*k+3];
+        lo[k] = std::min( lo[k], w );
+        hi[k] = std::max( hi[k], w );
+      }
+    }
+    float scale = 0.0f;
+    for( int k = 0; k < 3; ++k )
+      scale = std::max( scale, sqrtf( m[k]*m[k] + m[4+k]*m[4+k] + m[8+k]*m[8+k] ) );
+
+    const float distance = distanceToBox( eye, optix::make_float3( lo ), optix::make_float3( hi ) );
+    const unsigned int level = scale > 0.0f ?
+                               selectMeshLOD( lods.errors, distance / scale, pixel_footprint, max_pixel_error ) :
+                               static_cast<unsigned int>( lods.groups.size() - 1 );
+    if( level != levels[i] )
+    {
+      instances[i]->setChild( lods.groups[level] );
+      levels[i] = level;
+      changed = true;
+    }
+  }
+  return changed;
+}
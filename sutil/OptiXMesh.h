@@ -34,6 +34,8 @@
 #include <optixu/optixpp_namespace.h>
 #include <optixu/optixu_matrix_namespace.h>
 
+#include <vector>
+
 
 //------------------------------------------------------------------------------
 //
@@ -72,5 +74,70 @@ struct OptiXMesh
 SUTILAPI void loadMesh(
     const std::string&        filename,
     OptiXMesh&                mesh, 
-    const optix::Matrix4x4&   load_xform = optix::Matrix4x4::identity()
+    const optix::Matrix4x4&   load_xform = optix::Matrix4x4::identity(),
+    bool                      optimize_layout = false  // Morton sort triangles, see MeshLayout.h
+    );
+
+
+// Replaces the vertex positions of a loaded mesh, and its normals when
+// 'normals' is given and the mesh has them, for animation.  Both arrays
+// hold 3 floats per vertex in the mesh's vertex order, which loadMesh()
+// changes when it optimizes the layout.  Updates bbox_min/bbox_max and marks
+// 'acceleration', the one built over the mesh, dirty when given.  Set the
+// acceleration's "refit" property to "1" to have OptiX refit rather than
+// rebuild it on the next launch.
+SUTILAPI void updateMeshVertices(
+    OptiXMesh&                mesh,
+    const float*              positions,
+    const float*              normals = 0,
+    optix::Acceleration       acceleration = optix::Acceleration()
+    );
+
+
+//------------------------------------------------------------------------------
+//
+// Levels of detail of a mesh, built by buildMeshLODs() (see MeshLOD.h).
+//
+// Each level is a GeometryGroup with its own Trbvh acceleration over one
+// geometry instance; all levels share the materials and bbox of the full
+// mesh, level 0.  Place the mesh under Transforms whose child is one of the
+// groups and let selectMeshLODs() repoint them as the camera moves.
+//
+//------------------------------------------------------------------------------
+struct OptiXMeshLODs
+{
+  std::vector<optix::GeometryGroup>  groups;          // Finest first
+  std::vector<float>                 errors;          // Object space, 0 for level 0
+  std::vector<int>                   num_triangles;
+};
+
+
+// Loads a mesh like loadMesh(), filling 'mesh' with level 0, and simplifies
+// it into up to 'max_levels' more levels, each about half the triangles of
+// the one before.
+SUTILAPI void loadMeshLODs(
+    const std::string&        filename,
+    OptiXMesh&                mesh,
+    OptiXMeshLODs&            lods,
+    const optix::Matrix4x4&   load_xform = optix::Matrix4x4::identity(),
+    bool                      optimize_layout = false,
+    unsigned int              max_levels = 6
+    );
+
+
+// Points each of 'instances', Transforms over the levels of 'lods', at the
+// coarsest level whose error covers at most 'max_pixel_error' pixels seen
+// from 'eye', the camera position.  'pixel_footprint' is pixelFootprint()
+// of the camera's vertical field of view and image height.  'levels' holds
+// the current level per instance, and is resized when it does not match.
+// Returns true when any instance changed level; mark the acceleration over
+// the instances dirty then.
+SUTILAPI bool selectMeshLODs(
+    const OptiXMeshLODs&                 lods,
+    const OptiXMesh&                     mesh,
+    const std::vector<optix::Transform>& instances,
+    std::vector<unsigned int>&           levels,
+    const optix::float3&                 eye,
+    float                                pixel_footprint,
+    float                                max_pixel_error = 0.5f
     );
@@ -0,0 +1,631 @@
+#include "PagedBVH.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+using optix::float3;
+
+namespace
+{
+
+const char     paged_magic[8] = { 'S', 'U', 'T', 'I', 'L', 'P', 'G', '1' };
+const uint64_t page_alignment = 4096;
+const size_t   ray_chunk_size = 4096;
+const unsigned int max_tree_depth = 64;           // Of HostBVH trees, which bounds traversal stacks
+const unsigned int top_stack_size = 2 * max_tree_depth + 2;
+
+
+size_t pageBytes( const PagedFileEntry& e )
+{
+  return e.num_nodes * sizeof( BVHNode ) + e.num_triangles * ( sizeof( uint32_t ) + 3 * sizeof( int32_t ) ) +
+         3 * e.num_vertices * sizeof( float );
+}
+
+
+// Memory a resident page takes: the file data plus the leaf triangle list.
+size_t residentBytes( const PagedFileEntry& e )
+{
+  return pageBytes( e ) + e.num_triangles * sizeof( uint32_t );
+}
+
+
+inline bool intersectBox( const BVHNode& n, const float3& o, const float3& inv_dir, float tmin, float tmax,
+                          float& t_enter )
+{
+  const float tx0 = ( n.bbox_min[0] - o.x ) * inv_dir.x, tx1 = ( n.bbox_max[0] - o.x ) * inv_dir.x;
+  const float ty0 = ( n.bbox_min[1] - o.y ) * inv_dir.y, ty1 = ( n.bbox_max[1] - o.y ) * inv_dir.y;
+  const float tz0 = ( n.bbox_min[2] - o.z ) * inv_dir.z, tz1 = ( n.bbox_max[2] - o.z ) * inv_dir.z;
+  t_enter = std::max( std::max( std::min( tx0, tx1 ), std::min( ty0, ty1 ) ), std::max( std::min( tz0, tz1 ), tmin ) );
+  const float t_exit = std::min( std::min( std::max( tx0, tx1 ), std::max( ty0, ty1 ) ), std::min( std::max( tz0, tz1 ), tmax ) );
+  return t_enter <= t_exit;
+}
+
+
+// True when every interior node's children follow it inside 'nodes', every
+// leaf's range lies within 'num_leaf_entries' and no node is deeper than a
+// HostBVH could be, so traversal stays in bounds and terminates.
+bool validTree( const std::vector<BVHNode>& nodes, uint64_t num_leaf_entries )
+{
+  std::vector<uint32_t> depth( nodes.size(), 0 );
+  for( size_t i = 0; i < nodes.size(); ++i )
+  {
+    const BVHNode& n = nodes[i];
+    if( n.count > 0 )
+    {
+      if( uint64_t( n.first ) + n.count > num_leaf_entries )
+        return false;
+    }
+    else
+    {
+      if( n.first <= i || uint64_t( n.first ) + 1 >= nodes.size() || depth[i] + 1 >= max_tree_depth )
+        return false;
+      depth[n.first]     = std::max( depth[n.first], depth[i] + 1 );
+      depth[n.first + 1] = std::max( depth[n.first + 1], depth[i] + 1 );
+    }
+  }
+  return true;
+}
+
+
+struct StackEntry
+{
+  uint32_t node;
+  float    t_enter;
+};
+
+
+// Calls visit( page, t_enter ) for the pages of 'top' whose boxes 'ray'
+// enters before 'hit.t', nearest first; visit may tighten hit.t.
+template <class Visit>
+void traverseTop( const std::vector<BVHNode>& top, const HostRay& ray, HostHit& hit, const Visit& visit )
+{
+  if( top.empty() )
+    return;
+  const float3 o       = ray.origin;
+  const float3 d       = ray.direction;
+  const float3 inv_dir = optix::make_float3( 1.0f / d.x, 1.0f / d.y, 1.0f / d.z );
+
+  StackEntry stack[top_stack_size];
+  unsigned int size = 0;
+  float t_enter;
+  if( intersectBox( top[0], o, inv_dir, ray.tmin, hit.t, t_enter ) )
+  {
+    const StackEntry root = { 0, t_enter };
+    stack[size++] = root;
+  }
+  while( size > 0 )
+  {
+    const StackEntry entry = stack[--size];
+    if( entry.t_enter > hit.t )
+      continue;
+    const BVHNode& node = top[entry.node];
+    if( node.count > 0 )
+    {
+      visit( node.first, entry.t_enter );
+      continue;
+    }
+    float t0, t1;
+    const bool hit0 = intersectBox( top[node.first], o, inv_dir, ray.tmin, hit.t, t0 );
+    const bool hit1 = intersectBox( top[node.first + 1], o, inv_dir, ray.tmin, hit.t, t1 );
+    const StackEntry c0 = { node.first, t0 }, c1 = { node.first + 1, t1 };
+    if( hit0 && hit1 )
+    {
+      stack[size++] = t0 <= t1 ? c1 : c0;
+      stack[size++] = t0 <= t1 ? c0 : c1;
+    }
+    else if( hit0 )
+      stack[size++] = c0;
+    else if( hit1 )
+      stack[size++] = c1;
+  }
+}
+
+
+// Breadth-first copy of the subtree of 'nodes' under 'root' with children
+// side by side, stopping at nodes for which cut( index ) is true: they are
+// copied and passed to leaf( copy ) to rewrite.
+template <class Cut, class Leaf>
+void copySubtree( const std::vector<BVHNode>& nodes, uint32_t root, const Cut& cut, const Leaf& leaf,
+                  std::vector<BVHNode>& out )
+{
+  std::vector<uint32_t> source( 1, root );
+  out.assign( 1, nodes[root] );
+  for( size_t i = 0; i < out.size(); ++i )
+  {
+    const BVHNode& n = nodes[source[i]];
+    if( cut( source[i] ) )
+    {
+      leaf( source[i], out[i] );
+      continue;
+    }
+    out[i].first = static_cast<uint32_t>( out.size() );
+    out.push_back( nodes[n.first] );
+    out.push_back( nodes[n.first + 1] );
+    source.push_back( n.first );
+    source.push_back( n.first + 1 );
+  }
+}
+
+
+void writeOrThrow( std::ofstream& out, const void* data, size_t bytes, const std::string& filename )
+{
+  out.write( static_cast<const char*>( data ), bytes );
+  if( !out )
+    throw std::runtime_error( "writePagedMesh: Unable to write '" + filename + "'" );
+}
+
+} // namespace
+
+
+//-----------------------------------------------------------------------------
+//
+// writePagedMesh
+//
+//-----------------------------------------------------------------------------
+
+void writePagedMesh( const Mesh& mesh, const std::string& filename, unsigned int page_triangles )
+{
+  page_triangles = std::max( page_triangles, 1u );
+  HostBVH bvh;
+  bvh.build( mesh );
+  const std::vector<BVHNode>&  nodes = bvh.nodes();
+  const std::vector<uint32_t>& order = bvh.triangles();
+
+  // Triangles under every node and the first of its contiguous leaf list
+  // range; children follow their parents, left ranges come first.
+  std::vector<uint32_t> counts( nodes.size() ), firsts( nodes.size() );
+  for( size_t i = nodes.size(); i-- > 0; )
+  {
+    const BVHNode& n = nodes[i];
+    counts[i] = n.count > 0 ? n.count : counts[n.first] + counts[n.first + 1];
+    firsts[i] = n.count > 0 ? n.first : firsts[n.first];
+  }
+
+  std::vector<BVHNode>  top;
+  std::vector<uint32_t> page_roots;
+  if( !nodes.empty() )
+  {
+    copySubtree( nodes, 0,
+                 [&]( uint32_t i ) { return nodes[i].count > 0 || counts[i] <= page_triangles; },
+                 [&]( uint32_t i, BVHNode& copy )
+                 {
+                   copy.first = static_cast<uint32_t>( page_roots.size() );
+                   copy.count = 1;
+                   page_roots.push_back( i );
+                 },
+                 top );
+  }
+
+  std::ofstream out( filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+  if( !out )
+    throw std::runtime_error( "writePagedMesh: Unable to open '" + filename + "'" );
+
+  PagedFileHeader header;
+  memcpy( header.magic, paged_magic, sizeof( header.magic ) );
+  header.num_top_nodes = static_cast<uint32_t>( top.size() );
+  header.num_pages     = static_cast<uint32_t>( page_roots.size() );
+  header.num_triangles = order.size();
+  std::vector<PagedFileEntry> entries( page_roots.size() );
+  writeOrThrow( out, &header, sizeof( header ), filename );
+  writeOrThrow( out, top.data(), top.size() * sizeof( BVHNode ), filename );
+  writeOrThrow( out, entries.data(), entries.size() * sizeof( PagedFileEntry ), filename );
+  uint64_t offset = sizeof( header ) + top.size() * sizeof( BVHNode ) + entries.size() * sizeof( PagedFileEntry );
+
+  std::vector<int32_t>  local_index( std::max( mesh.num_vertices, 0 ), -1 );
+  std::vector<int32_t>  vertices;
+  std::vector<BVHNode>  page_nodes;
+  std::vector<uint32_t> ids;
+  std::vector<int32_t>  indices;
+  std::vector<float>    positions;
+  const std::vector<char> padding( page_alignment, 0 );
+  for( size_t p = 0; p < page_roots.size(); ++p )
+  {
+    const uint32_t root  = page_roots[p];
+    const uint32_t first = firsts[root];
+    copySubtree( nodes, root, [&]( uint32_t i ) { return nodes[i].count > 0; },
+                 [&]( uint32_t, BVHNode& copy ) { copy.first -= first; }, page_nodes );
+
+    // Triangles in leaf order, vertices in first-use order.
+    ids.assign( order.begin() + first, order.begin() + first + counts[root] );
+    indices.resize( 3 * ids.size() );
+    vertices.clear();
+    for( size_t t = 0; t < ids.size(); ++t )
+    {
+      for( int k = 0; k < 3; ++k )
+      {
+        const int32_t v = mesh.tri_indices[3 * size_t( ids[t] ) + k];
+        if( local_index[v] < 0 )
+        {
+          local_index[v] = static_cast<int32_t>( vertices.size() );
+          vertices.push_back( v );
+        }
+        indices[3 * t + k] = local_index[v];
+      }
+    }
+    positions.resize( 3 * vertices.size() );
+    for( size_t v = 0; v < vertices.size(); ++v )
+    {
+      memcpy( &positions[3 * v], mesh.positions + 3 * size_t( vertices[v] ), 3 * sizeof( float ) );
+      local_index[vertices[v]] = -1;
+    }
+
+    const uint64_t aligned = ( offset + page_alignment - 1 ) / page_alignment * page_alignment;
+    writeOrThrow( out, padding.data(), static_cast<size_t>( aligned - offset ), filename );
+    PagedFileEntry& e = entries[p];
+    e.offset        = aligned;
+    e.num_nodes     = static_cast<uint32_t>( page_nodes.size() );
+    e.num_triangles = static_cast<uint32_t>( ids.size() );
+    e.num_vertices  = static_cast<uint32_t>( vertices.size() );
+    e.bytes         = static_cast<uint32_t>( pageBytes( e ) );
+    writeOrThrow( out, page_nodes.data(), page_nodes.size() * sizeof( BVHNode ), filename );
+    writeOrThrow( out, ids.data(), ids.size() * sizeof( uint32_t ), filename );
+    writeOrThrow( out, indices.data(), indices.size() * sizeof( int32_t ), filename );
+    writeOrThrow( out, positions.data(), positions.size() * sizeof( float ), filename );
+    offset = aligned + e.bytes;
+  }
+
+  out.seekp( sizeof( header ) + top.size() * sizeof( BVHNode ) );
+  writeOrThrow( out, entries.data(), entries.size() * sizeof( PagedFileEntry ), filename );
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// PagedBVH::File -- page reads from a mapped file
+//
+// Pages are copied out of the mapping and the mapped range is released
+// again, so only the cache counts against the working set.
+//
+//-----------------------------------------------------------------------------
+
+class PagedBVH::File
+{
+public:
+  explicit File( const std::string& filename )
+    : m_data( 0 ), m_size( 0 )
+  {
+#if defined(_WIN32)
+    m_in.open( filename.c_str(), std::ios::in | std::ios::binary );
+    if( !m_in )
+      throw std::runtime_error( "PagedBVH: Unable to open '" + filename + "'" );
+    m_in.seekg( 0, std::ios::end );
+    m_size = static_cast<uint64_t>( m_in.tellg() );
+#else
+    const int fd = ::open( filename.c_str(), O_RDONLY );
+    if( fd < 0 )
+      throw std::runtime_error( "PagedBVH: Unable to open '" + filename + "'" );
+    struct stat st;
+    if( fstat( fd, &st ) != 0 )
+    {
+      ::close( fd );
+      throw std::runtime_error( "PagedBVH: Unable to stat '" + filename + "'" );
+    }
+    m_size = static_cast<uint64_t>( st.st_size );
+    if( m_size > 0 )
+    {
+      void* p = mmap( 0, m_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if( p == MAP_FAILED )
+      {
+        ::close( fd );
+        throw std::runtime_error( "PagedBVH: Unable to map '" + filename + "'" );
+      }
+      // Pages are read in whatever order rays reach them.
+      madvise( p, m_size, MADV_RANDOM );
+      m_data = static_cast<const unsigned char*>( p );
+    }
+    ::close( fd );
+#endif
+  }
+
+  ~File()
+  {
+#if !defined(_WIN32)
+    if( m_data )
+      munmap( const_cast<unsigned char*>( m_data ), m_size );
+#endif
+  }
+
+  uint64_t size() const { return m_size; }
+
+  void read( uint64_t offset, size_t bytes, void* dst )
+  {
+    if( offset > m_size || bytes > m_size - offset )
+      throw std::runtime_error( "PagedBVH: Read past the end of the file" );
+    if( bytes == 0 )
+      return;
+#if defined(_WIN32)
+    m_in.seekg( static_cast<std::streamoff>( offset ) );
+    m_in.read( static_cast<char*>( dst ), bytes );
+    if( !m_in )
+      throw std::runtime_error( "PagedBVH: Unable to read the file" );
+#else
+    memcpy( dst, m_data + offset, bytes );
+    const uint64_t begin = offset / page_alignment * page_alignment;
+    madvise( const_cast<unsigned char*>( m_data ) + begin, static_cast<size_t>( offset + bytes - begin ),
+             MADV_DONTNEED );
+#endif
+  }
+
+private:
+  const unsigned char* m_data;
+  uint64_t             m_size;
+#if defined(_WIN32)
+  std::ifstream        m_in;
+#endif
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// PagedBVH
+//
+//-----------------------------------------------------------------------------
+
+PagedBVH::PagedBVH()
+  : m_file( 0 ),
+    m_cache_bytes( 0 ),
+    m_num_triangles( 0 )
+{
+  memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+
+PagedBVH::~PagedBVH()
+{
+  close();
+}
+
+
+void PagedBVH::open( const std::string& filename, size_t cache_bytes )
+{
+  close();
+  m_file        = new File( filename );
+  m_cache_bytes = cache_bytes;
+  try
+  {
+    PagedFileHeader header;
+    m_file->read( 0, sizeof( header ), &header );
+    if( memcmp( header.magic, paged_magic, sizeof( paged_magic ) ) != 0 )
+      throw std::runtime_error( "PagedBVH: '" + filename + "' is not a paged mesh" );
+    m_top.resize( header.num_top_nodes );
+    m_entries.resize( header.num_pages );
+    m_file->read( sizeof( header ), m_top.size() * sizeof( BVHNode ), m_top.data() );
+    m_file->read( sizeof( header ) + m_top.size() * sizeof( BVHNode ), m_entries.size() * sizeof( PagedFileEntry ),
+                  m_entries.data() );
+    for( size_t i = 0; i < m_entries.size(); ++i )
+    {
+      const PagedFileEntry& e = m_entries[i];
+      if( e.bytes != pageBytes( e ) || e.offset > m_file->size() || e.bytes > m_file->size() - e.offset )
+        throw std::runtime_error( "PagedBVH: '" + filename + "' has a corrupt page table" );
+    }
+    if( !validTree( m_top, m_entries.size() ) )
+      throw std::runtime_error( "PagedBVH: '" + filename + "' has a corrupt top level tree" );
+    m_num_triangles = header.num_triangles;
+  }
+  catch( ... )
+  {
+    close();
+    throw;
+  }
+  m_pages.assign( m_entries.size(), 0 );
+}
+
+
+void PagedBVH::close()
+{
+  for( size_t i = 0; i < m_pages.size(); ++i )
+    delete m_pages[i];
+  m_pages.clear();
+  m_lru.clear();
+  m_top.clear();
+  m_entries.clear();
+  m_num_triangles = 0;
+  m_stats.resident_bytes = 0;
+  delete m_file;
+  m_file = 0;
+}
+
+
+void PagedBVH::resetStats()
+{
+  const size_t resident = m_stats.resident_bytes;
+  memset( &m_stats, 0, sizeof( m_stats ) );
+  m_stats.resident_bytes = m_stats.peak_resident_bytes = resident;
+}
+
+
+size_t PagedBVH::fileBytes() const
+{
+  return m_file ? static_cast<size_t>( m_file->size() ) : 0;
+}
+
+
+PagedBVH::Page& PagedBVH::page( uint32_t index )
+{
+  Page* p = m_pages[index];
+  if( p )
+  {
+    m_lru.splice( m_lru.begin(), m_lru, p->lru );
+    return *p;
+  }
+
+  const PagedFileEntry& e = m_entries[index];
+  while( !m_lru.empty() && m_stats.resident_bytes + residentBytes( e ) > m_cache_bytes )
+    evict();
+
+  p = new Page;
+  std::vector<BVHNode>  nodes( e.num_nodes );
+  std::vector<uint32_t> triangles( e.num_triangles );
+  p->ids.resize( e.num_triangles );
+  p->indices.resize( 3 * size_t( e.num_triangles ) );
+  p->positions.resize( 3 * size_t( e.num_vertices ) );
+  try
+  {
+    uint64_t offset = e.offset;
+    m_file->read( offset, nodes.size() * sizeof( BVHNode ), nodes.data() );
+    offset += nodes.size() * sizeof( BVHNode );
+    m_file->read( offset, p->ids.size() * sizeof( uint32_t ), p->ids.data() );
+    offset += p->ids.size() * sizeof( uint32_t );
+    m_file->read( offset, p->indices.size() * sizeof( int32_t ), p->indices.data() );
+    offset += p->indices.size() * sizeof( int32_t );
+    m_file->read( offset, p->positions.size() * sizeof( float ), p->positions.data() );
+
+    // Pages are only trusted as far as the header: the tree, triangle ids
+    // and vertex indices must all stay inside the page and the mesh.
+    bool valid = validTree( nodes, e.num_triangles );
+    for( size_t t = 0; valid && t < p->ids.size(); ++t )
+      valid = p->ids[t] < m_num_triangles;
+    for( size_t i = 0; valid && i < p->indices.size(); ++i )
+      valid = p->indices[i] >= 0 && uint32_t( p->indices[i] ) < e.num_vertices;
+    if( !valid )
+      throw std::runtime_error( "PagedBVH: Page " + std::to_string( index ) + " of the file is corrupt" );
+  }
+  catch( ... )
+  {
+    delete p;
+    throw;
+  }
+  for( uint32_t t = 0; t < e.num_triangles; ++t )
+    triangles[t] = t;
+  p->bvh.assign( p->positions.data(), p->indices.data(), nodes, triangles );
+  p->bytes = residentBytes( e );
+
+  m_lru.push_front( index );
+  p->lru         = m_lru.begin();
+  m_pages[index] = p;
+  ++m_stats.page_faults;
+  m_stats.bytes_read          += e.bytes;
+  m_stats.resident_bytes      += p->bytes;
+  m_stats.peak_resident_bytes  = std::max( m_stats.peak_resident_bytes, m_stats.resident_bytes );
+  return *p;
+}
+
+
+void PagedBVH::evict()
+{
+  const uint32_t index = m_lru.back();
+  m_lru.pop_back();
+  m_stats.resident_bytes -= m_pages[index]->bytes;
+  ++m_stats.evictions;
+  delete m_pages[index];
+  m_pages[index] = 0;
+}
+
+
+namespace
+{
+
+// Closest hit of 'ray' in 'page' nearer than 'hit', with the written
+// triangle index.
+template <class Page>
+inline void intersectPage( const Page& page, const HostRay& ray, HostHit& hit )
+{
+  HostRay r = ray;
+  r.tmax    = hit.t;
+  HostHit h;
+  if( page.bvh.intersect( r, h ) )
+  {
+    hit          = h;
+    hit.triangle = static_cast<int32_t>( page.ids[h.triangle] );
+  }
+}
+
+} // namespace
+
+
+bool PagedBVH::intersect( const HostRay& ray, HostHit& hit )
+{
+  hit.t        = ray.tmax;
+  hit.triangle = -1;
+  traverseTop( m_top, ray, hit, [&]( uint32_t index, float ) { intersectPage( page( index ), ray, hit ); } );
+  return hit.triangle >= 0;
+}
+
+
+void PagedBVH::intersect( const std::vector<HostRay>& rays, std::vector<HostHit>& hits )
+{
+  struct QueuedRay
+  {
+    uint32_t page;
+    uint32_t ray;
+    float    t_enter;
+  };
+
+  // Every page each ray's box tests reach; without hits yet none are culled.
+  hits.resize( rays.size() );
+  std::vector<std::vector<QueuedRay> > reached( ( rays.size() + ray_chunk_size - 1 ) / ray_chunk_size );
+  sutil::parallelFor( rays.size(), ray_chunk_size, [&]( size_t begin, size_t end )
+  {
+    std::vector<QueuedRay>& out = reached[begin / ray_chunk_size];
+    for( size_t i = begin; i < end; ++i )
+    {
+      HostHit& hit = hits[i];
+      hit.t        = rays[i].tmax;
+      hit.triangle = -1;
+      traverseTop( m_top, rays[i], hit, [&]( uint32_t index, float t_enter )
+      {
+        const QueuedRay q = { index, static_cast<uint32_t>( i ), t_enter };
+        out.push_back( q );
+      } );
+    }
+  } );
+
+  // Queues per page, then the pages: resident ones first, the rest in file
+  // order.
+  std::vector<size_t> offsets( m_entries.size() + 1, 0 );
+  for( size_t c = 0; c < reached.size(); ++c )
+    for( size_t i = 0; i < reached[c].size(); ++i )
+      ++offsets[reached[c][i].page + 1];
+  for( size_t p = 0; p < m_entries.size(); ++p )
+    offsets[p + 1] += offsets[p];
+  std::vector<QueuedRay> queues( offsets.back() );
+  {
+    std::vector<size_t> next( offsets.begin(), offsets.end() - 1 );
+    for( size_t c = 0; c < reached.size(); ++c )
+      for( size_t i = 0; i < reached[c].size(); ++i )
+        queues[next[reached[c][i].page]++] = reached[c][i];
+  }
+  std::vector<std::vector<QueuedRay> >().swap( reached );
+
+  std::vector<uint32_t> order;
+  for( int resident = 1; resident >= 0; --resident )
+    for( uint32_t p = 0; p < m_entries.size(); ++p )
+      if( offsets[p + 1] > offsets[p] && ( m_pages[p] != 0 ) == ( resident != 0 ) )
+        order.push_back( p );
+
+  m_stats.working_set_pages = order.size();
+  m_stats.working_set_bytes = 0;
+  for( size_t i = 0; i < order.size(); ++i )
+  {
+    const uint32_t p     = order[i];
+    const size_t   first = offsets[p];
+    const size_t   count = offsets[p + 1] - first;
+    m_stats.working_set_bytes += residentBytes( m_entries[p] );
+    if( !m_pages[p] )
+      m_stats.queued_rays += count;
+
+    // Each ray is queued on a page at most once, so its hit has one writer.
+    const Page& resident = page( p );
+    sutil::parallelFor( count, 256, [&]( size_t begin, size_t end )
+    {
+      for( size_t q = first + begin; q < first + end; ++q )
+      {
+        const QueuedRay& r = queues[q];
+        if( r.t_enter <= hits[r.ray].t )
+          intersectPage( resident, rays[r.ray], hits[r.ray] );
+      }
+    } );
+  }
+}
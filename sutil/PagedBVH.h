@@ -0,0 +1,135 @@
+#pragma once
+
+#include "HostBVH.h"
+#include "Mesh.h"
+
+#include <sutilapi.h>
+
+#include <list>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// PagedBVH -- out-of-core HostBVH over a disk-backed mesh
+//
+// writePagedMesh() builds a HostBVH over a mesh and cuts it into pages: the
+// largest subtrees holding at most 'page_triangles' triangles.  Each page
+// stores its subtree, triangle ids and its own compact vertex and index
+// arrays, 4 KB aligned in the file.  The tree above the pages is small and
+// stays resident; PagedBVH maps the file and reads pages into an LRU cache
+// of a fixed byte budget when rays first reach them, so meshes several
+// times larger than memory can be traced.
+//
+// Batches of rays queue on the pages they reach that are not resident.
+// Resident pages are traced first; the rest are then read once each, in
+// file order, and their queues traced in parallel, so a page is never read
+// twice per batch however small the cache.
+//
+// File layout, native byte order:
+//   PagedFileHeader
+//   BVHNode[num_top_nodes]   children side by side; count 1 marks a page
+//                            leaf with the page index in first
+//   PagedFileEntry[num_pages]
+//   pages, each BVHNode[num_nodes], uint32_t ids[num_triangles],
+//   int32_t indices[3 * num_triangles], float positions[3 * num_vertices];
+//   leaves index triangles in page order
+//
+//-----------------------------------------------------------------------------
+
+struct PagedFileHeader
+{
+  char     magic[8];          // "SUTILPG1"
+  uint32_t num_top_nodes;
+  uint32_t num_pages;
+  uint64_t num_triangles;
+};
+
+struct PagedFileEntry
+{
+  uint64_t offset;
+  uint32_t bytes;
+  uint32_t num_nodes;
+  uint32_t num_triangles;
+  uint32_t num_vertices;
+};
+
+struct PagingStats
+{
+  uint64_t page_faults;          // Pages read from the file
+  uint64_t evictions;
+  uint64_t bytes_read;
+  uint64_t queued_rays;          // Ray/page pairs deferred until the page was read
+  size_t   resident_bytes;       // Pages in the cache now
+  size_t   peak_resident_bytes;
+  size_t   working_set_pages;    // Distinct pages the last batch reached
+  size_t   working_set_bytes;
+};
+
+
+// Writes 'mesh' in the paged format.  Throws std::runtime_error if the file
+// cannot be written.
+SUTILAPI void writePagedMesh( const Mesh& mesh, const std::string& filename, unsigned int page_triangles = 16384 );
+
+
+class PagedBVH
+{
+public:
+  SUTILAPI PagedBVH();
+  SUTILAPI ~PagedBVH();
+
+  // Maps a file written by writePagedMesh(); at most 'cache_bytes' of pages,
+  // and at least one page, stay resident.  Throws std::runtime_error if the
+  // file cannot be opened or is not a paged mesh.
+  SUTILAPI void open( const std::string& filename, size_t cache_bytes );
+  SUTILAPI void close();
+
+  // Closest hit of one ray, reading pages as it reaches them.  hit.triangle
+  // is the triangle's index in the written mesh.  Both intersect() throw
+  // std::runtime_error if a page they read is corrupt.
+  SUTILAPI bool intersect( const HostRay& ray, HostHit& hit );
+
+  // Closest hits of a batch, resizing 'hits' to match 'rays'.
+  SUTILAPI void intersect( const std::vector<HostRay>& rays, std::vector<HostHit>& hits );
+
+  // Neither intersect() may run concurrently with another call; the batch
+  // version is parallel internally.
+
+  const PagingStats& stats() const          { return m_stats; }
+  SUTILAPI void      resetStats();
+
+  size_t   numPages() const                 { return m_entries.size(); }
+  uint64_t numTriangles() const             { return m_num_triangles; }
+  SUTILAPI size_t fileBytes() const;
+
+private:
+  PagedBVH( const PagedBVH& );
+  PagedBVH& operator=( const PagedBVH& );
+
+  struct Page
+  {
+    std::vector<float>    positions;
+    std::vector<int32_t>  indices;
+    std::vector<uint32_t> ids;
+    HostBVH               bvh;
+    size_t                bytes;
+    std::list<uint32_t>::iterator lru;   // Position in m_lru
+  };
+
+  // Returns the resident page, reading it and evicting least recently used
+  // pages first if needed.
+  Page& page( uint32_t index );
+  void  evict();
+
+  class File;
+
+  File*                       m_file;
+  size_t                      m_cache_bytes;
+  uint64_t                    m_num_triangles;
+  std::vector<BVHNode>        m_top;
+  std::vector<PagedFileEntry> m_entries;
+  std::vector<Page*>          m_pages;     // Null unless resident
+  std::list<uint32_t>         m_lru;       // Most recently used first
+  PagingStats                 m_stats;
+};
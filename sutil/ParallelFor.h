@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// parallelFor -- split an index range across the host's hardware threads
+//
+//-----------------------------------------------------------------------------
+
+namespace sutil
+{
+
+// Number of worker threads parallelFor() uses.
+inline unsigned int parallelThreadCount()
+{
+  const unsigned int n = std::thread::hardware_concurrency();
+  return n ? n : 1u;
+}
+
+// Calls body( begin, end ) on disjoint chunks of at most 'grain' indices that
+// together cover [0, count).  Chunks are handed out dynamically, so uneven
+// work balances across threads.  Runs inline when one chunk covers the range.
+template <typename Body>
+void parallelFor( size_t count, size_t grain, const Body& body )
+{
+  if( count == 0 )
+    return;
+  grain = std::max<size_t>( grain, 1u );
+
+  const size_t num_chunks  = ( count + grain - 1 ) / grain;
+  const size_t num_threads = std::min<size_t>( parallelThreadCount(), num_chunks );
+  if( num_threads <= 1 )
+  {
+    body( size_t( 0 ), count );
+    return;
+  }
+
+  std::atomic<size_t> next_chunk( 0 );
+  auto worker = [&]()
+  {
+    for( size_t chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++ )
+    {
+      const size_t begin = chunk * grain;
+      body( begin, std::min( begin + grain, count ) );
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve( num_threads - 1 );
+  for( size_t i = 1; i < num_threads; ++i )
+    threads.push_back( std::thread( worker ) );
+  worker();
+  for( size_t i = 0; i < threads.size(); ++i )
+    threads[i].join();
+}
+
+} // namespace sutil
@@ -0,0 +1,749 @@
+#include "TiledTexture.h"
+#include "BlockCompression.h"
+#include "HDRLoader.h"
+#include "PPMLoader.h"
+#include "sutil.h"
+
+#include <optixu/optixu_math_namespace.h>
+
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace optix;
+
+//-----------------------------------------------------------------------------
+//
+// Helpers
+//
+//-----------------------------------------------------------------------------
+
+namespace
+{
+
+const char     TMIP_MAGIC[4]    = { 'T', 'M', 'I', 'P' };
+const uint32_t TMIP_VERSION     = 1u;
+const size_t   TMIP_HEADER_SIZE = 32u;
+
+struct TmipHeader
+{
+  char     magic[4];
+  uint32_t version;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t tile_size;
+  uint32_t num_levels;
+  uint32_t reserved;
+};
+
+
+bool isBlockFormat( TexelFormat format )
+{
+  return format == TEXEL_FORMAT_BC1 || format == TEXEL_FORMAT_BC5 || format == TEXEL_FORMAT_BC7;
+}
+
+
+// Bytes per texel for plain formats, per 4x4 block for block formats.
+size_t elementBytes( TexelFormat format )
+{
+  switch( format )
+  {
+    case TEXEL_FORMAT_RGBA8:   return 4u;
+    case TEXEL_FORMAT_RGBA32F: return 16u;
+    case TEXEL_FORMAT_BC1:     return 8u;
+    case TEXEL_FORMAT_BC5:     return 16u;
+    case TEXEL_FORMAT_BC7:     return 16u;
+    case TEXEL_FORMAT_RGB9E5:  return 4u;
+    default:                   return 0u;
+  }
+}
+
+
+// Fills 'levels' with the mip chain layout down to 1x1 and returns the total
+// tile count.
+// Levels of a full chain down to 1x1: floor(log2(max(width, height))) + 1.
+uint32_t levelCountFor( uint32_t width, uint32_t height )
+{
+  uint32_t levels = 1u;
+  for( uint32_t size = std::max( width, height ); size > 1u; size /= 2u )
+    ++levels;
+  return levels;
+}
+
+
+uint64_t computeLevels( unsigned int width, unsigned int height, unsigned int tile_size,
+                        std::vector<TiledTextureLevel>& levels )
+{
+  levels.clear();
+  uint64_t num_tiles = 0;
+  for( ;; )
+  {
+    TiledTextureLevel level;
+    level.width      = width;
+    level.height     = height;
+    level.tiles_x    = ( width  + tile_size - 1 ) / tile_size;
+    level.tiles_y    = ( height + tile_size - 1 ) / tile_size;
+    level.first_tile = num_tiles;
+    levels.push_back( level );
+    num_tiles += static_cast<uint64_t>( level.tiles_x ) * level.tiles_y;
+
+    if( width == 1u && height == 1u )
+      break;
+    width  = std::max( 1u, width  / 2u );
+    height = std::max( 1u, height / 2u );
+  }
+  return num_tiles;
+}
+
+
+// 2x2 box filter; odd edges reuse the last row/column.
+void downsample( const std::vector<float4>& src, unsigned int src_w, unsigned int src_h,
+                 std::vector<float4>& dst, unsigned int dst_w, unsigned int dst_h )
+{
+  dst.resize( static_cast<size_t>( dst_w ) * dst_h );
+  for( unsigned int y = 0; y < dst_h; ++y )
+  {
+    const unsigned int y0 = std::min( 2u*y,      src_h - 1u );
+    const unsigned int y1 = std::min( 2u*y + 1u, src_h - 1u );
+    for( unsigned int x = 0; x < dst_w; ++x )
+    {
+      const unsigned int x0 = std::min( 2u*x,      src_w - 1u );
+      const unsigned int x1 = std::min( 2u*x + 1u, src_w - 1u );
+      dst[ static_cast<size_t>( y )*dst_w + x ] =
+          ( src[ static_cast<size_t>( y0 )*src_w + x0 ] + src[ static_cast<size_t>( y0 )*src_w + x1 ] +
+            src[ static_cast<size_t>( y1 )*src_w + x0 ] + src[ static_cast<size_t>( y1 )*src_w + x1 ] ) * 0.25f;
+    }
+  }
+}
+
+
+// Plain formats only; block formats go through encodeBlock().
+void encodeTexel( const float4& c, TexelFormat format, unsigned char* dst )
+{
+  if( format == TEXEL_FORMAT_RGBA8 )
+  {
+    dst[0] = static_cast<unsigned char>( clamp( static_cast<int>( c.x*255.0f + 0.5f ), 0, 255 ) );
+    dst[1] = static_cast<unsigned char>( clamp( static_cast<int>( c.y*255.0f + 0.5f ), 0, 255 ) );
+    dst[2] = static_cast<unsigned char>( clamp( static_cast<int>( c.z*255.0f + 0.5f ), 0, 255 ) );
+    dst[3] = static_cast<unsigned char>( clamp( static_cast<int>( c.w*255.0f + 0.5f ), 0, 255 ) );
+  }
+  else if( format == TEXEL_FORMAT_RGB9E5 )
+  {
+    const uint32_t v = encodeRGB9E5( make_float3( c ) );
+    memcpy( dst, &v, sizeof( v ) );
+  }
+  else
+  {
+    memcpy( dst, &c, sizeof( float4 ) );
+  }
+}
+
+
+float4 decodeTexel( const unsigned char* src, TexelFormat format )
+{
+  if( format == TEXEL_FORMAT_RGBA8 )
+    return make_float4( src[0], src[1], src[2], src[3] ) * ( 1.0f / 255.0f );
+
+  if( format == TEXEL_FORMAT_RGB9E5 )
+  {
+    uint32_t v;
+    memcpy( &v, src, sizeof( v ) );
+    return make_float4( decodeRGB9E5( v ), 1.0f );
+  }
+
+  float4 c;
+  memcpy( &c, src, sizeof( float4 ) );
+  return c;
+}
+
+
+void encodeBlock( const float4 texels[16], TexelFormat format, unsigned char* dst )
+{
+  switch( format )
+  {
+    case TEXEL_FORMAT_BC1: encodeBlockBC1( texels, dst ); break;
+    case TEXEL_FORMAT_BC5: encodeBlockBC5( texels, dst ); break;
+    case TEXEL_FORMAT_BC7: encodeBlockBC7( texels, dst ); break;
+    default: break;
+  }
+}
+
+
+void decodeBlock( const unsigned char* src, TexelFormat format, float4 texels[16] )
+{
+  switch( format )
+  {
+    case TEXEL_FORMAT_BC1: decodeBlockBC1( src, texels ); break;
+    case TEXEL_FORMAT_BC5: decodeBlockBC5( src, texels ); break;
+    case TEXEL_FORMAT_BC7: decodeBlockBC7( src, texels ); break;
+    default: break;
+  }
+}
+
+
+bool writeLevelTiles( std::ofstream& out, const std::vector<float4>& texels,
+                      const TiledTextureLevel& level, unsigned int tile_size, TexelFormat format )
+{
+  const size_t element_size = elementBytes( format );
+  std::vector<unsigned char> tile( tileBytes( format, tile_size ) );
+
+  for( unsigned int ty = 0; ty < level.tiles_y; ++ty )
+  {
+    for( unsigned int tx = 0; tx < level.tiles_x; ++tx )
+    {
+      // Texels past the image edge replicate the border.
+      if( isBlockFormat( format ) )
+      {
+        const unsigned int blocks = tile_size / 4u;
+        for( unsigned int bj = 0; bj < blocks; ++bj )
+          for( unsigned int bi = 0; bi < blocks; ++bi )
+          {
+            float4 block[16];
+            for( unsigned int k = 0; k < 16; ++k )
+            {
+              const unsigned int x = std::min( tx*tile_size + bi*4u + ( k & 3u ), level.width  - 1u );
+              const unsigned int y = std::min( ty*tile_size + bj*4u + ( k >> 2 ), level.height - 1u );
+              block[k] = texels[ static_cast<size_t>( y )*level.width + x ];
+            }
+            encodeBlock( block, format, &tile[ ( static_cast<size_t>( bj )*blocks + bi )*element_size ] );
+          }
+      }
+      else
+      {
+        for( unsigned int j = 0; j < tile_size; ++j )
+        {
+          const unsigned int y = std::min( ty*tile_size + j, level.height - 1u );
+          for( unsigned int i = 0; i < tile_size; ++i )
+          {
+            const unsigned int x = std::min( tx*tile_size + i, level.width - 1u );
+            encodeTexel( texels[ static_cast<size_t>( y )*level.width + x ], format,
+                         &tile[ ( static_cast<size_t>( j )*tile_size + i )*element_size ] );
+          }
+        }
+      }
+      out.write( reinterpret_cast<const char*>( &tile[0] ), tile.size() );
+    }
+  }
+  return out.good();
+}
+
+
+bool hasExtension( const std::string& filename, const char* ext )
+{
+  const size_t len = strlen( ext );
+  if( filename.length() < len )
+    return false;
+  for( size_t i = 0; i < len; ++i )
+    if( tolower( filename[ filename.length() - len + i ] ) != ext[i] )
+      return false;
+  return true;
+}
+
+
+std::atomic<uint64_t> g_next_texture_id( 1u );
+
+} // namespace
+
+
+//-----------------------------------------------------------------------------
+//
+// Pyramid generation
+//
+//-----------------------------------------------------------------------------
+
+bool buildTiledTexture( const std::string& src_filename,
+                        const std::string& dst_filename,
+                        unsigned int tile_size,
+                        TexelFormat format )
+{
+  TexelFormat native_format;
+  unsigned int nx = 0, ny = 0;
+  std::vector<float4> texels;
+
+  // Flip rows on load so that row 0 is the bottom of the image, matching the
+  // buffers built by PPMLoader::loadTexture() and loadHDRTexture().
+  if( hasExtension( src_filename, ".hdr" ) )
+  {
+    HDRLoader hdr( src_filename );
+    if( hdr.failed() )
+      return false;
+    native_format = TEXEL_FORMAT_RGBA32F;
+    nx = hdr.width();
+    ny = hdr.height();
+    texels.resize( static_cast<size_t>( nx ) * ny );
+    for( unsigned int j = 0; j < ny; ++j )
+      for( unsigned int i = 0; i < nx; ++i )
+      {
+        const float* src = hdr.raster() + ( static_cast<size_t>( ny-j-1 )*nx + i )*4;
+        texels[ static_cast<size_t>( j )*nx + i ] = make_float4( src[0], src[1], src[2], src[3] );
+      }
+  }
+  else
+  {
+    PPMLoader ppm( src_filename );
+    if( ppm.failed() )
+      return false;
+    native_format = TEXEL_FORMAT_RGBA8;
+    nx = ppm.width();
+    ny = ppm.height();
+    texels.resize( static_cast<size_t>( nx ) * ny );
+    for( unsigned int j = 0; j < ny; ++j )
+      for( unsigned int i = 0; i < nx; ++i )
+      {
+        const unsigned char* src = ppm.raster() + ( static_cast<size_t>( ny-j-1 )*nx + i )*3;
+        texels[ static_cast<size_t>( j )*nx + i ] = make_float4( src[0] / 255.0f, src[1] / 255.0f, src[2] / 255.0f, 1.0f );
+      }
+  }
+
+  if( nx == 0 || ny == 0 || tile_size == 0 )
+    return false;
+
+  if( format == TEXEL_FORMAT_NATIVE )
+    format = native_format;
+  if( isBlockFormat( format ) )
+    tile_size = ( tile_size + 3u ) & ~3u;
+
+  std::vector<TiledTextureLevel> levels;
+  computeLevels( nx, ny, tile_size, levels );
+
+  // Write to a temporary name first so that a half written pyramid is never
+  // picked up by a concurrent reader.
+  const std::string tmp_filename = dst_filename + ".tmp";
+  std::ofstream out( tmp_filename.c_str(), std::ofstream::binary | std::ofstream::trunc );
+  if( !out )
+  {
+    std::cerr << "buildTiledTexture( '" << dst_filename << "' ) failed to open file." << std::endl;
+    return false;
+  }
+
+  TmipHeader header;
+  memset( &header, 0, sizeof( header ) );
+  memcpy( header.magic, TMIP_MAGIC, sizeof( TMIP_MAGIC ) );
+  header.version    = TMIP_VERSION;
+  header.format     = format;
+  header.width      = nx;
+  header.height     = ny;
+  header.tile_size  = tile_size;
+  header.num_levels = static_cast<uint32_t>( levels.size() );
+  out.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+  std::vector<float4> next;
+  for( size_t l = 0; l < levels.size(); ++l )
+  {
+    if( !writeLevelTiles( out, texels, levels[l], tile_size, format ) )
+      break;
+    if( l + 1 < levels.size() )
+    {
+      downsample( texels, levels[l].width, levels[l].height, next, levels[l+1].width, levels[l+1].height );
+      texels.swap( next );
+    }
+  }
+
+  const bool ok = out.good();
+  out.close();
+  if( !ok || std::rename( tmp_filename.c_str(), dst_filename.c_str() ) != 0 )
+  {
+    std::cerr << "buildTiledTexture( '" << dst_filename << "' ) failed to write file." << std::endl;
+    std::remove( tmp_filename.c_str() );
+    return false;
+  }
+  return true;
+}
+
+
+size_t tileBytes( TexelFormat format, unsigned int tile_size )
+{
+  const size_t texels = static_cast<size_t>( tile_size ) * tile_size;
+  return isBlockFormat( format ) ? texels / 16u * elementBytes( format ) : texels * elementBytes( format );
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// TileCache
+//
+//-----------------------------------------------------------------------------
+
+TileCache::TileCache( size_t max_bytes )
+  : m_max_bytes( max_bytes )
+{
+  memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+
+TileCache::TileData TileCache::tile( const TiledTexture& texture, uint64_t tile_index )
+{
+  const uint64_t key = texture.cacheKey( tile_index );
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    std::unordered_map<uint64_t, Entry>::iterator it = m_entries.find( key );
+    if( it != m_entries.end() )
+    {
+      m_lru.splice( m_lru.begin(), m_lru, it->second.lru );
+      ++m_stats.hits;
+      return it->second.data;
+    }
+  }
+
+  // Page in without holding the cache lock so other threads keep sampling
+  // resident tiles while this one waits on the disk.
+  std::shared_ptr< std::vector<unsigned char> > data( new std::vector<unsigned char>( texture.tileBytes() ) );
+  if( !texture.readTile( tile_index, &(*data)[0] ) )
+    std::fill( data->begin(), data->end(), 0 );
+
+  std::lock_guard<std::mutex> lock( m_mutex );
+  std::unordered_map<uint64_t, Entry>::iterator it = m_entries.find( key );
+  if( it != m_entries.end() )
+  {
+    // Another thread paged the same tile in meanwhile.
+    m_lru.splice( m_lru.begin(), m_lru, it->second.lru );
+    ++m_stats.hits;
+    return it->second.data;
+  }
+
+  evictToFit( data->size() );
+
+  m_lru.push_front( key );
+  Entry& entry = m_entries[key];
+  entry.data = data;
+  entry.lru  = m_lru.begin();
+
+  ++m_stats.misses;
+  m_stats.resident_bytes += data->size();
+  m_stats.peak_bytes      = std::max( m_stats.peak_bytes, m_stats.resident_bytes );
+  return entry.data;
+}
+
+
+void TileCache::evictToFit( size_t incoming_bytes )
+{
+  while( !m_lru.empty() && m_stats.resident_bytes + incoming_bytes > m_max_bytes )
+  {
+    std::unordered_map<uint64_t, Entry>::iterator it = m_entries.find( m_lru.back() );
+    m_stats.resident_bytes -= it->second.data->size();
+    ++m_stats.evictions;
+    m_entries.erase( it );
+    m_lru.pop_back();
+  }
+}
+
+
+TileCache::Stats TileCache::stats() const
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+  return m_stats;
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// TiledTexture
+//
+//-----------------------------------------------------------------------------
+
+TiledTexture::TiledTexture( const std::string& filename, TileCache& cache )
+  : m_filename( filename ),
+    m_cache( cache ),
+    m_id( g_next_texture_id++ ),
+    m_file( 0 ),
+    m_format( TEXEL_FORMAT_RGBA8 ),
+    m_width( 0u ),
+    m_height( 0u ),
+    m_tile_size( 0u )
+{
+  m_file = std::fopen( filename.c_str(), "rb" );
+  if( !m_file )
+  {
+    std::cerr << "TiledTexture( '" << filename << "' ) failed to open file." << std::endl;
+    return;
+  }
+
+  TmipHeader header;
+  if( std::fread( &header, sizeof( header ), 1, m_file ) != 1 ||
+      memcmp( header.magic, TMIP_MAGIC, sizeof( TMIP_MAGIC ) ) != 0 ||
+      header.version != TMIP_VERSION ||
+      elementBytes( static_cast<TexelFormat>( header.format ) ) == 0 ||
+      header.width == 0 || header.height == 0 || header.tile_size == 0 ||
+      header.num_levels != levelCountFor( header.width, header.height ) ||
+      ( isBlockFormat( static_cast<TexelFormat>( header.format ) ) && header.tile_size % 4u != 0 ) )
+  {
+    std::cerr << "TiledTexture( '" << filename << "' ) is not a valid .tmip file." << std::endl;
+    std::fclose( m_file );
+    m_file = 0;
+    return;
+  }
+
+  m_format    = static_cast<TexelFormat>( header.format );
+  m_width     = header.width;
+  m_height    = header.height;
+  m_tile_size = header.tile_size;
+  computeLevels( m_width, m_height, m_tile_size, m_levels );
+}
+
+
+TiledTexture::~TiledTexture()
+{
+  if( m_file )
+    std::fclose( m_file );
+}
+
+
+bool TiledTexture::failed() const
+{
+  return m_file == 0;
+}
+
+
+unsigned int TiledTexture::width() const
+{
+  return m_width;
+}
+
+
+unsigned int TiledTexture::height() const
+{
+  return m_height;
+}
+
+
+unsigned int TiledTexture::tileSize() const
+{
+  return m_tile_size;
+}
+
+
+unsigned int TiledTexture::levelCount() const
+{
+  return static_cast<unsigned int>( m_levels.size() );
+}
+
+
+TexelFormat TiledTexture::format() const
+{
+  return m_format;
+}
+
+
+size_t TiledTexture::tileBytes() const
+{
+  return ::tileBytes( m_format, m_tile_size );
+}
+
+
+const TiledTextureLevel& TiledTexture::level( unsigned int l ) const
+{
+  return m_levels[l];
+}
+
+
+bool TiledTexture::readTile( uint64_t tile_index, unsigned char* out ) const
+{
+  std::lock_guard<std::mutex> lock( m_file_mutex );
+  const uint64_t offset = TMIP_HEADER_SIZE + tile_index * tileBytes();
+#if defined(_WIN32)
+  if( _fseeki64( m_file, static_cast<__int64>( offset ), SEEK_SET ) != 0 )
+#else
+  if( fseeko( m_file, static_cast<off_t>( offset ), SEEK_SET ) != 0 )
+#endif
+    return false;
+  return std::fread( out, tileBytes(), 1, m_file ) == 1;
+}
+
+
+float4 TiledTexture::fetch( const unsigned char* tile, uint64_t tile_index,
+                            unsigned int x, unsigned int y, BlockMemo& memo ) const
+{
+  if( !isBlockFormat( m_format ) )
+    return decodeTexel( tile + ( static_cast<size_t>( y )*m_tile_size + x )*elementBytes( m_format ), m_format );
+
+  const unsigned int blocks = m_tile_size / 4u;
+  const uint64_t     block  = static_cast<uint64_t>( y / 4u )*blocks + x / 4u;
+  const uint64_t     key    = tile_index * blocks * blocks + block;
+  if( memo.key != key )
+  {
+    decodeBlock( tile + block*elementBytes( m_format ), m_format, memo.texels );
+    memo.key = key;
+  }
+  return memo.texels[ ( y & 3u )*4u + ( x & 3u ) ];
+}
+
+
+float4 TiledTexture::texel( unsigned int l, unsigned int x, unsigned int y ) const
+{
+  const TiledTextureLevel& lvl = m_levels[l];
+  const unsigned int tx = x / m_tile_size;
+  const unsigned int ty = y / m_tile_size;
+  const uint64_t index  = lvl.first_tile + static_cast<uint64_t>( ty )*lvl.tiles_x + tx;
+  TileCache::TileData data = m_cache.tile( *this, index );
+  BlockMemo memo;
+  memo.key = ~0ull;
+  return fetch( &(*data)[0], index, x - tx*m_tile_size, y - ty*m_tile_size, memo );
+}
+
+
+void TiledTexture::decodeTile( unsigned int l, unsigned int tx, unsigned int ty,
+                               std::vector<float4>& texels ) const
+{
+  const TiledTextureLevel& lvl = m_levels[l];
+  const uint64_t index = lvl.first_tile + static_cast<uint64_t>( ty )*lvl.tiles_x + tx;
+  TileCache::TileData data = m_cache.tile( *this, index );
+
+  texels.resize( static_cast<size_t>( m_tile_size ) * m_tile_size );
+  if( isBlockFormat( m_format ) )
+  {
+    const unsigned int blocks = m_tile_size / 4u;
+    float4 block[16];
+    for( unsigned int bj = 0; bj < blocks; ++bj )
+      for( unsigned int bi = 0; bi < blocks; ++bi )
+      {
+        decodeBlock( &(*data)[ ( static_cast<size_t>( bj )*blocks + bi )*elementBytes( m_format ) ], m_format, block );
+        for( unsigned int k = 0; k < 16; ++k )
+          texels[ static_cast<size_t>( bj*4u + ( k >> 2 ) )*m_tile_size + bi*4u + ( k & 3u ) ] = block[k];
+      }
+  }
+  else
+  {
+    for( size_t i = 0; i < texels.size(); ++i )
+      texels[i] = decodeTexel( &(*data)[ i*elementBytes( m_format ) ], m_format );
+  }
+}
+
+
+float TiledTexture::lodFromFootprint( float footprint ) const
+{
+  const float texels = footprint * static_cast<float>( std::max( m_width, m_height ) );
+  const float lod    = texels > 1.0f ? std::log2( texels ) : 0.0f;
+  return std::min( lod, static_cast<float>( m_levels.size() - 1 ) );
+}
+
+
+float4 TiledTexture::sampleLevel( unsigned int l, float u, float v ) const
+{
+  const TiledTextureLevel& lvl = m_levels[l];
+
+  // Texel centers sit at half integer coordinates, as with RT_FILTER_LINEAR.
+  const float fx = ( u - std::floor( u ) ) * lvl.width  - 0.5f;
+  const float fy = ( v - std::floor( v ) ) * lvl.height - 0.5f;
+  const float x0f = std::floor( fx );
+  const float y0f = std::floor( fy );
+  const float ax  = fx - x0f;
+  const float ay  = fy - y0f;
+
+  const int w = static_cast<int>( lvl.width );
+  const int h = static_cast<int>( lvl.height );
+  const unsigned int x0 = static_cast<unsigned int>( ( static_cast<int>( x0f ) + w ) % w );
+  const unsigned int y0 = static_cast<unsigned int>( ( static_cast<int>( y0f ) + h ) % h );
+  const unsigned int x1 = ( x0 + 1u ) % lvl.width;
+  const unsigned int y1 = ( y0 + 1u ) % lvl.height;
+
+  // The four taps usually share a tile (and block); fetch each distinct
+  // tile only once.
+  const unsigned int xs[2] = { x0, x1 };
+  const unsigned int ys[2] = { y0, y1 };
+  float4 taps[4];
+  uint64_t last_index = ~0ull;
+  TileCache::TileData data;
+  BlockMemo memo;
+  memo.key = ~0ull;
+  for( int k = 0; k < 4; ++k )
+  {
+    const unsigned int x  = xs[k & 1];
+    const unsigned int y  = ys[k >> 1];
+    const unsigned int tx = x / m_tile_size;
+    const unsigned int ty = y / m_tile_size;
+    const uint64_t index  = lvl.first_tile + static_cast<uint64_t>( ty )*lvl.tiles_x + tx;
+    if( index != last_index )
+    {
+      data = m_cache.tile( *this, index );
+      last_index = index;
+    }
+    taps[k] = fetch( &(*data)[0], index, x - tx*m_tile_size, y - ty*m_tile_size, memo );
+  }
+
+  return lerp( lerp( taps[0], taps[1], ax ), lerp( taps[2], taps[3], ax ), ay );
+}
+
+
+float4 TiledTexture::sample( float u, float v, float footprint ) const
+{
+  const float lod  = lodFromFootprint( footprint );
+  const unsigned int l0 = static_cast<unsigned int>( lod );
+  const float t = lod - static_cast<float>( l0 );
+  const float4 c0 = sampleLevel( l0, u, v );
+  if( t <= 0.0f || l0 + 1u >= m_levels.size() )
+    return c0;
+  return lerp( c0, sampleLevel( l0 + 1u, u, v ), t );
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// OptiX upload
+//
+//-----------------------------------------------------------------------------
+
+optix::TextureSampler loadTiledTexture( optix::Context context,
+                                        const std::string& filename,
+                                        const optix::float3& default_color,
+                                        unsigned int max_resolution )
+{
+  // The upload streams every tile once, so a small cache suffices.
+  TileCache cache( 16u << 20 );
+  TiledTexture texture( filename, cache );
+  if( texture.failed() )
+    return sutil::loadTexture( context, "", default_color );
+
+  unsigned int base = 0;
+  while( base + 1u < texture.levelCount() &&
+         std::max( texture.level( base ).width, texture.level( base ).height ) > max_resolution )
+    ++base;
+  const unsigned int num_levels = texture.levelCount() - base;
+
+  // OptiX samplers take no block compressed formats, so compressed tiles
+  // are expanded to the matching uncompressed format here.
+  const bool is_float = texture.format() == TEXEL_FORMAT_RGBA32F || texture.format() == TEXEL_FORMAT_RGB9E5;
+  const TexelFormat upload_format = is_float ? TEXEL_FORMAT_RGBA32F : TEXEL_FORMAT_RGBA8;
+  optix::Buffer buffer = context->createBuffer( RT_BUFFER_INPUT,
+                                                is_float ? RT_FORMAT_FLOAT4 : RT_FORMAT_UNSIGNED_BYTE4,
+                                                texture.level( base ).width,
+                                                texture.level( base ).height );
+  buffer->setMipLevelCount( num_levels );
+
+  const unsigned int tile_size = texture.tileSize();
+  std::vector<float4> tile;
+  for( unsigned int l = 0; l < num_levels; ++l )
+  {
+    const TiledTextureLevel& lvl = texture.level( base + l );
+    unsigned char* dst = static_cast<unsigned char*>( buffer->map( l, RT_BUFFER_MAP_WRITE_DISCARD ) );
+    for( unsigned int ty = 0; ty < lvl.tiles_y; ++ty )
+      for( unsigned int tx = 0; tx < lvl.tiles_x; ++tx )
+      {
+        texture.decodeTile( base + l, tx, ty, tile );
+        const unsigned int w = std::min( tile_size, lvl.width  - tx*tile_size );
+        const unsigned int h = std::min( tile_size, lvl.height - ty*tile_size );
+        for( unsigned int j = 0; j < h; ++j )
+          for( unsigned int i = 0; i < w; ++i )
+          {
+            const size_t texel = static_cast<size_t>( ty*tile_size + j )*lvl.width + tx*tile_size + i;
+            encodeTexel( tile[ static_cast<size_t>( j )*tile_size + i ], upload_format,
+                         dst + texel*elementBytes( upload_format ) );
+          }
+      }
+    buffer->unmap( l );
+  }
+
+  optix::TextureSampler sampler = context->createTextureSampler();
+  sampler->setWrapMode( 0, RT_WRAP_REPEAT );
+  sampler->setWrapMode( 1, RT_WRAP_REPEAT );
+  sampler->setWrapMode( 2, RT_WRAP_REPEAT );
+  sampler->setIndexingMode( RT_TEXTURE_INDEX_NORMALIZED_COORDINATES );
+  sampler->setReadMode( RT_TEXTURE_READ_NORMALIZED_FLOAT );
+  sampler->setMaxAnisotropy( 1.0f );
+  sampler->setBuffer( buffer );
+  sampler->setFilteringModes( RT_FILTER_LINEAR, RT_FILTER_LINEAR, RT_FILTER_LINEAR );
+
+  return sampler;
+}
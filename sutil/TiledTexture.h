@@ -0,0 +1,208 @@
+#pragma once
+
+#include <optixu/optixpp_namespace.h>
+#include <sutilapi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Tiled mip pyramid file (.tmip)
+//
+// A .tmip file holds the full mip chain of a PPM or HDR image, cut into
+// square tiles.  Levels are stored finest first, tiles row-major within a
+// level, and every tile is padded to tile_size x tile_size texels so a tile's
+// file offset follows from its index alone.  Row 0 is the bottom image row,
+// the same orientation PPMLoader::loadTexture() and loadHDRTexture() upload.
+//
+//-----------------------------------------------------------------------------
+
+enum TexelFormat
+{
+  TEXEL_FORMAT_RGBA8   = 0,    // 4 bytes per texel (PPM sources)
+  TEXEL_FORMAT_RGBA32F = 1,    // 16 bytes per texel (HDR sources)
+  TEXEL_FORMAT_BC1     = 2,    // 0.5 bytes per texel, RGB
+  TEXEL_FORMAT_BC5     = 3,    // 1 byte per texel, RG (normal maps)
+  TEXEL_FORMAT_BC7     = 4,    // 1 byte per texel, RGBA
+  TEXEL_FORMAT_RGB9E5  = 5,    // 4 bytes per texel, shared exponent HDR
+
+  TEXEL_FORMAT_NATIVE  = 0xff  // buildTiledTexture(): keep the source precision
+};
+
+struct TiledTextureLevel
+{
+  unsigned int width;
+  unsigned int height;
+  unsigned int tiles_x;
+  unsigned int tiles_y;
+  uint64_t     first_tile;   // File index of this level's first tile
+};
+
+// Writes the tiled mip pyramid of src_filename (.ppm or .hdr) to
+// dst_filename, encoding tiles in 'format' (block formats round tile_size up
+// to a multiple of 4; see BlockCompression.h).  Returns false if the source
+// image could not be loaded.
+SUTILAPI bool buildTiledTexture( const std::string& src_filename,
+                                 const std::string& dst_filename,
+                                 unsigned int tile_size = 64,
+                                 TexelFormat format = TEXEL_FORMAT_NATIVE );
+
+// Bytes one tile of tile_size x tile_size texels occupies in 'format'.
+SUTILAPI size_t tileBytes( TexelFormat format, unsigned int tile_size );
+
+// Ray cone footprint in texture space: the cone of angular 'spread' hits the
+// surface at 'distance' with incidence cosine 'cos_theta'; 'uv_per_unit' is
+// the texture coordinate change per world unit on the surface.
+inline float textureFootprint( float distance, float spread, float cos_theta, float uv_per_unit )
+{
+  return distance * spread / std::max( std::fabs( cos_theta ), 1.0e-4f ) * uv_per_unit;
+}
+
+
+//-----------------------------------------------------------------------------
+//
+// TileCache -- LRU set of resident tiles bounded by a byte budget
+//
+//-----------------------------------------------------------------------------
+
+class TiledTexture;
+
+class TileCache
+{
+public:
+  typedef std::shared_ptr< const std::vector<unsigned char> > TileData;
+
+  struct Stats
+  {
+    uint64_t hits;
+    uint64_t misses;          // Tiles paged in from disk
+    uint64_t evictions;
+    size_t   resident_bytes;
+    size_t   peak_bytes;
+  };
+
+  SUTILAPI explicit TileCache( size_t max_bytes );
+
+  // Returns the tile, paging it in and evicting least recently used tiles
+  // as needed.  Callers keep the returned data alive while they read it, so
+  // an eviction never invalidates a tile that is in use.
+  SUTILAPI TileData tile( const TiledTexture& texture, uint64_t tile_index );
+
+  SUTILAPI Stats  stats() const;
+  SUTILAPI size_t maxBytes() const { return m_max_bytes; }
+
+private:
+  typedef std::list<uint64_t> LruList;
+  struct Entry
+  {
+    TileData          data;
+    LruList::iterator lru;
+  };
+
+  void evictToFit( size_t incoming_bytes );
+
+  const size_t                          m_max_bytes;
+  mutable std::mutex                    m_mutex;
+  std::unordered_map<uint64_t, Entry>   m_entries;
+  LruList                               m_lru;       // Most recently used first
+  Stats                                 m_stats;
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// TiledTexture -- host side sampler over a .tmip file
+//
+//-----------------------------------------------------------------------------
+
+class TiledTexture
+{
+public:
+  SUTILAPI TiledTexture( const std::string& filename, TileCache& cache );
+  SUTILAPI ~TiledTexture();
+
+  SUTILAPI bool         failed() const;
+  SUTILAPI unsigned int width() const;
+  SUTILAPI unsigned int height() const;
+  SUTILAPI unsigned int tileSize() const;
+  SUTILAPI unsigned int levelCount() const;
+  SUTILAPI TexelFormat  format() const;
+  SUTILAPI size_t       tileBytes() const;
+  SUTILAPI const TiledTextureLevel& level( unsigned int l ) const;
+
+  // Mip level whose texel size matches a footprint given in texture
+  // coordinates (1.0 spans the whole texture).
+  SUTILAPI float lodFromFootprint( float footprint ) const;
+
+  // Trilinear lookup with repeat wrapping.
+  SUTILAPI optix::float4 sample( float u, float v, float footprint ) const;
+
+  // Bilinear lookup in a single level with repeat wrapping.
+  SUTILAPI optix::float4 sampleLevel( unsigned int l, float u, float v ) const;
+
+  // Unfiltered texel fetch; x and y must lie inside the level.
+  SUTILAPI optix::float4 texel( unsigned int l, unsigned int x, unsigned int y ) const;
+
+  // Decodes all tile_size x tile_size texels of one tile, row-major.
+  SUTILAPI void decodeTile( unsigned int l, unsigned int tx, unsigned int ty,
+                            std::vector<optix::float4>& texels ) const;
+
+  // Reads one tile from disk into 'out' (tileBytes() long).  Used by TileCache.
+  SUTILAPI bool readTile( uint64_t tile_index, unsigned char* out ) const;
+
+  // Identifies this texture's tiles inside a shared TileCache.
+  uint64_t cacheKey( uint64_t tile_index ) const { return ( m_id << 40 ) | tile_index; }
+
+private:
+  TiledTexture( const TiledTexture& );
+  TiledTexture& operator=( const TiledTexture& );
+
+  // Last 4x4 block decoded by fetch(), so filter taps sharing a block of a
+  // compressed format decode it once.
+  struct BlockMemo
+  {
+    uint64_t      key;
+    optix::float4 texels[16];
+  };
+
+  optix::float4 fetch( const unsigned char* tile, uint64_t tile_index,
+                       unsigned int x, unsigned int y, BlockMemo& memo ) const;
+
+  std::string                    m_filename;
+  TileCache&                     m_cache;
+  uint64_t                       m_id;
+  std::FILE*                     m_file;
+  mutable std::mutex             m_file_mutex;
+
+  TexelFormat                    m_format;
+  unsigned int                   m_width;
+  unsigned int                   m_height;
+  unsigned int                   m_tile_size;
+  std::vector<TiledTextureLevel> m_levels;
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// OptiX upload
+//
+//-----------------------------------------------------------------------------
+
+// Creates a mip mapped TextureSampler from a .tmip file; build one from a
+// .ppm/.hdr source with buildTiledTexture() or tmiptool.  Only the levels no
+// larger than max_resolution texels on a side are uploaded, which bounds the
+// device memory of every texture.  Falls back to a 1x1 texture of
+// default_color if the file cannot be read.
+SUTILAPI optix::TextureSampler loadTiledTexture( optix::Context context,
+                                                 const std::string& filename,
+                                                 const optix::float3& default_color,
+                                                 unsigned int max_resolution = 2048 );
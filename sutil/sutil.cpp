@@ -41,6 +41,7 @@
 #include <sutil/sutil.h>
 #include <sutil/HDRLoader.h>
 #include <sutil/PPMLoader.h>
+#include <sutil/TiledTexture.h>
 #include <sampleConfig.h>
 
 #include <optixu/optixu_math_namespace.h>
@@ -688,7 +689,13 @@ optix::TextureSampler sutil::loadTexture( optix::Context context,
               (filename[len-2] == 'D' || filename[len-2] == 'd') &&
               (filename[len-1] == 'R' || filename[len-1] == 'r');
     }
-    if ( isHDR ) {
+    bool isTiled = false;
+    if(len >= 5) {
+      isTiled = filename.compare(len-5, 5, ".tmip") == 0;
+    }
+    if ( isTiled ) {
+        return loadTiledTexture(context, filename, default_color);
+    } else if ( isHDR ) {
         return loadHDRTexture(context, filename, default_color);
     } else {
         return loadPPMTexture(context, filename, default_color);
@@ -155,6 +155,7 @@ void SUTILAPI displayText(const char* text, float x, float y);
 
 // Create on OptiX TextureSampler for the given image file.  If the filename is
 // empty or if loading the file fails, return 1x1 texture with default color.
+// Tiled .tmip pyramids (see TiledTexture.h) are uploaded mip mapped.
 optix::TextureSampler SUTILAPI loadTexture(
         optix::Context context,             // Context used for object creation 
         const std::string& filename,        // File to load
@@ -5,6 +5,10 @@
 //
 
 //
+// (local)         Weld vertices through an open addressing hash table instead
+//                 of a std::map, keep a group's faces in one flat array and
+//                 hand finished shapes over without copying them.  Define
+//                 TINYOBJLOADER_MAP_VERTEX_CACHE for the std::map cache.
 // version 0.9.16: Make tinyobjloader header-only
 // version 0.9.15: Change API to handle no mtl file case correctly(#58)
 // version 0.9.14: Support specular highlight, bump, displacement and alpha map(#53)
@@ -139,6 +143,7 @@ void LoadMtl(std::map<std::string, int> &material_map, // [output]
 #include <cmath>
 #include <cstddef>
 #include <cctype>
+#include <stdint.h>
 
 #include <string>
 #include <vector>
@@ -161,6 +166,8 @@ struct vertex_index {
   vertex_index(int vidx, int vtidx, int vnidx)
       : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx){}
 };
+
+#ifdef TINYOBJLOADER_MAP_VERTEX_CACHE
 // for std::map
 static inline bool operator<(const vertex_index &a, const vertex_index &b) {
   if (a.v_idx != b.v_idx)
@@ -173,6 +180,123 @@ static inline bool operator<(const vertex_index &a, const vertex_index &b) {
   return false;
 }
 
+// The std::map vertex cache of earlier versions, kept as a reference for
+// benchmarking the hash welder below.
+class vertex_welder {
+public:
+  void clear() { cache_.clear(); }
+
+  // Returns the vertex 'i' was welded into, or 'next' after recording it
+  // as the vertex for 'i'.
+  unsigned int weld(const vertex_index &i, unsigned int next, bool &inserted) {
+    const std::pair<std::map<vertex_index, unsigned int>::iterator, bool> r =
+        cache_.insert(std::make_pair(i, next));
+    inserted = r.second;
+    return r.first->second;
+  }
+
+private:
+  std::map<vertex_index, unsigned int> cache_;
+};
+#else
+// Open addressing hash table from (v, vt, vn) index triples to the shape
+// vertex they were welded into, with linear probing and a load factor of at
+// most one half.  Slots are stamped with a generation, so clear() is O(1) and
+// the face groups of a file share one allocation sized for the largest.
+class vertex_welder {
+public:
+  vertex_welder() : count_(0), generation_(1) {}
+
+  void clear() {
+    count_ = 0;
+    if (++generation_ == 0) {
+      // The stamps wrapped around; start over with every slot free.
+      for (size_t s = 0; s < slots_.size(); s++)
+        slots_[s].generation = 0;
+      generation_ = 1;
+    }
+  }
+
+  // Returns the vertex 'i' was welded into, or 'next' after recording it
+  // as the vertex for 'i'.
+  unsigned int weld(const vertex_index &i, unsigned int next, bool &inserted) {
+    if (2 * (count_ + 1) > slots_.size())
+      grow();
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t s = hash(i) & mask;; s = (s + 1) & mask) {
+      slot &sl = slots_[s];
+      if (sl.generation != generation_) {
+        sl.key = i;
+        sl.value = next;
+        sl.generation = generation_;
+        count_++;
+        inserted = true;
+        return next;
+      }
+      if (sl.key.v_idx == i.v_idx && sl.key.vt_idx == i.vt_idx &&
+          sl.key.vn_idx == i.vn_idx) {
+        inserted = false;
+        return sl.value;
+      }
+    }
+  }
+
+private:
+  struct slot {
+    vertex_index key;
+    unsigned int value;
+    unsigned int generation; // the slot is free unless this is generation_
+  };
+
+  // Position major: faces refer to nearby positions far more often than
+  // not, so keeping their slots close together saves most cache misses of
+  // a scrambling hash.  The texcoord and normal indices only spread the
+  // variants of one position over a few neighbouring slots.
+  static size_t hash(const vertex_index &i) {
+    const uint32_t variant = static_cast<uint32_t>(i.vt_idx) * 0x9E3779B1u ^
+                             static_cast<uint32_t>(i.vn_idx) * 0x85EBCA77u;
+    return (static_cast<size_t>(static_cast<uint32_t>(i.v_idx)) << 1) +
+           (variant >> 28);
+  }
+
+  void grow() {
+    std::vector<slot> old;
+    old.swap(slots_);
+    slot empty;
+    empty.generation = 0;
+    slots_.assign(old.empty() ? 1024 : 2 * old.size(), empty);
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t o = 0; o < old.size(); o++) {
+      if (old[o].generation != generation_)
+        continue;
+      size_t s = hash(old[o].key) & mask;
+      while (slots_[s].generation == generation_)
+        s = (s + 1) & mask;
+      slots_[s] = old[o];
+    }
+  }
+
+  std::vector<slot> slots_;
+  size_t count_;
+  unsigned int generation_;
+};
+#endif
+
+// Faces of the current group, stored back to back so that a group costs a
+// couple of growing arrays instead of one allocation per face.
+struct face_group {
+  std::vector<vertex_index> vertices;
+  std::vector<size_t> face_ends; // one past the last vertex of each face
+
+  bool empty() const { return face_ends.empty(); }
+  void clear() {
+    vertices.clear();
+    face_ends.clear();
+  }
+};
+
 struct obj_shape {
   std::vector<float> v;
   std::vector<float> vn;
@@ -414,17 +538,18 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
 }
 
 static unsigned int
-updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
+updateVertex(vertex_welder &welder,
              std::vector<float> &positions, std::vector<float> &normals,
              std::vector<float> &texcoords,
              const std::vector<float> &in_positions,
              const std::vector<float> &in_normals,
              const std::vector<float> &in_texcoords, const vertex_index &i) {
-  const std::map<vertex_index, unsigned int>::iterator it = vertexCache.find(i);
-
-  if (it != vertexCache.end()) {
+  bool inserted = false;
+  const unsigned int idx = welder.weld(
+      i, static_cast<unsigned int>(positions.size() / 3), inserted);
+  if (!inserted) {
     // found cache
-    return it->second;
+    return idx;
   }
 
   assert(in_positions.size() > static_cast<unsigned int>(3 * i.v_idx + 2));
@@ -444,9 +569,6 @@ updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
     texcoords.push_back(in_texcoords[2 * static_cast<size_t>(i.vt_idx) + 1]);
   }
 
-  unsigned int idx = static_cast<unsigned int>(positions.size() / 3 - 1);
-  vertexCache[i] = idx;
-
   return idx;
 }
 
@@ -475,40 +597,56 @@ static void InitMaterial(material_t &material) {
   material.unknown_parameter.clear();
 }
 
+// Moves 'shape' to the end of 'shapes' without copying its mesh.
+static void appendShape(std::vector<shape_t> &shapes, shape_t &shape) {
+  shapes.push_back(shape_t());
+  shape_t &back = shapes.back();
+  back.name.swap(shape.name);
+  back.mesh.positions.swap(shape.mesh.positions);
+  back.mesh.normals.swap(shape.mesh.normals);
+  back.mesh.texcoords.swap(shape.mesh.texcoords);
+  back.mesh.indices.swap(shape.mesh.indices);
+  back.mesh.material_ids.swap(shape.mesh.material_ids);
+}
+
 static bool exportFaceGroupToShape(
-    shape_t &shape, std::map<vertex_index, unsigned int> vertexCache,
+    shape_t &shape, vertex_welder &welder,
     const std::vector<float> &in_positions,
     const std::vector<float> &in_normals,
     const std::vector<float> &in_texcoords,
-    const std::vector<std::vector<vertex_index> > &faceGroup,
+    const face_group &faceGroup,
     const int material_id, const std::string &name, bool clearCache) {
   if (faceGroup.empty()) {
     return false;
   }
 
   // Flatten vertices and indices
-  for (size_t i = 0; i < faceGroup.size(); i++) {
-    const std::vector<vertex_index> &face = faceGroup[i];
+  size_t begin = 0;
+  for (size_t i = 0; i < faceGroup.face_ends.size(); i++) {
+    const vertex_index *face = &faceGroup.vertices[begin];
+    const size_t npolys = faceGroup.face_ends[i] - begin;
+    begin = faceGroup.face_ends[i];
+    if (npolys < 3) {
+      continue;
+    }
 
     vertex_index i0 = face[0];
     vertex_index i1(-1);
     vertex_index i2 = face[1];
 
-    size_t npolys = face.size();
-
     // Polygon -> triangle fan conversion
     for (size_t k = 2; k < npolys; k++) {
       i1 = i2;
       i2 = face[k];
 
       unsigned int v0 = updateVertex(
-          vertexCache, shape.mesh.positions, shape.mesh.normals,
+          welder, shape.mesh.positions, shape.mesh.normals,
           shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i0);
       unsigned int v1 = updateVertex(
-          vertexCache, shape.mesh.positions, shape.mesh.normals,
+          welder, shape.mesh.positions, shape.mesh.normals,
           shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i1);
       unsigned int v2 = updateVertex(
-          vertexCache, shape.mesh.positions, shape.mesh.normals,
+          welder, shape.mesh.positions, shape.mesh.normals,
           shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i2);
 
       shape.mesh.indices.push_back(v0);
@@ -522,7 +660,7 @@ static bool exportFaceGroupToShape(
   shape.name = name;
 
   if (clearCache)
-    vertexCache.clear();
+    welder.clear();
 
   return true;
 }
@@ -819,12 +957,12 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
   std::vector<float> v;
   std::vector<float> vn;
   std::vector<float> vt;
-  std::vector<std::vector<vertex_index> > faceGroup;
+  face_group faceGroup;
   std::string name;
 
   // material
   std::map<std::string, int> material_map;
-  std::map<vertex_index, unsigned int> vertexCache;
+  vertex_welder welder;
   int material = -1;
 
   shape_t shape;
@@ -899,16 +1037,15 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
       token += 2;
       token += strspn(token, " \t");
 
-      std::vector<vertex_index> face;
       while (!isNewLine(token[0])) {
         vertex_index vi =
             parseTriple(token, static_cast<int>(v.size() / 3), static_cast<int>(vn.size() / 3), static_cast<int>(vt.size() / 2));
-        face.push_back(vi);
+        faceGroup.vertices.push_back(vi);
         size_t n = strspn(token, " \t\r");
         token += n;
       }
 
-      faceGroup.push_back(face);
+      faceGroup.face_ends.push_back(faceGroup.vertices.size());
 
       continue;
     }
@@ -925,10 +1062,10 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
 #endif
 
       // Create face group per material.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
+      bool ret = exportFaceGroupToShape(shape, welder, v, vn, vt,
                                         faceGroup, material, name, true);
       if (ret) {
-          shapes.push_back(shape);
+          appendShape(shapes, shape);
       }
       shape = shape_t();
       faceGroup.clear();
@@ -969,10 +1106,10 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
     if (token[0] == 'g' && isSpace((token[1]))) {
 
       // flush previous face group.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
+      bool ret = exportFaceGroupToShape(shape, welder, v, vn, vt,
                                         faceGroup, material, name, true);
       if (ret) {
-        shapes.push_back(shape);
+        appendShape(shapes, shape);
       }
 
       shape = shape_t();
@@ -1003,10 +1140,10 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
     if (token[0] == 'o' && isSpace((token[1]))) {
 
       // flush previous face group.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
+      bool ret = exportFaceGroupToShape(shape, welder, v, vn, vt,
                                         faceGroup, material, name, true);
       if (ret) {
-        shapes.push_back(shape);
+        appendShape(shapes, shape);
       }
 
       // material = -1;
@@ -1029,10 +1166,10 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
     // Ignore unknown command.
   }
 
-  bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
+  bool ret = exportFaceGroupToShape(shape, welder, v, vn, vt, faceGroup,
                                     material, name, true);
   if (ret) {
-    shapes.push_back(shape);
+    appendShape(shapes, shape);
   }
   faceGroup.clear(); // for safety
 
@@ -0,0 +1,161 @@
+// Denoises a PFM beauty image written with --aov using its albedo, normal
+// and depth AOVs, and reports timings and error metrics against an optional
+// reference render.
+
+#include <denoiser.hpp>
+#include <image_io.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using optix::float4;
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " <prefix> [options]\n";
+    std::cerr <<
+              "Reads <prefix>_color.pfm, <prefix>_albedo.pfm, <prefix>_normal.pfm and, if present,\n"
+              "<prefix>_depth.pfm; writes <prefix>_denoised.pfm.\n"
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  -r | --reference <file>   PFM reference for PSNR and relative MSE.\n"
+              "  -i | --iterations <n>     Number of a-trous passes (default 5).\n"
+              << std::endl;
+
+    exit(1);
+}
+
+std::vector<float4> toFloat4( const grpt::image_io::image& img )
+{
+    std::vector<float4> pixels( static_cast<size_t>( img.width ) * img.height );
+    for( size_t i = 0; i < pixels.size(); ++i )
+    {
+        const float* p = &img.pixels[ i * img.channels ];
+        pixels[i] = img.channels == 3 ? optix::make_float4( p[0], p[1], p[2], 1.0f )
+                                      : optix::make_float4( p[0], p[0], p[0], 1.0f );
+    }
+    return pixels;
+}
+
+void checkSize( const grpt::image_io::image& img, const grpt::image_io::image& color, const std::string& name )
+{
+    if( img.width != color.width || img.height != color.height )
+        throw std::runtime_error( "denoise: '" + name + "' does not match the color image size" );
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    std::string prefix;
+    std::string reference_file;
+    grpt::denoise_settings settings;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "-r" || arg == "--reference" || arg == "-i" || arg == "--iterations" )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            if( arg == "-r" || arg == "--reference" )
+                reference_file = argv[++i];
+            else
+                settings.iterations = atoi( argv[++i] );
+        }
+        else if( prefix.empty() && arg[0] != '-' )
+        {
+            prefix = arg;
+        }
+        else
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+    }
+
+    if( prefix.empty() )
+        printUsageAndExit( argv[0] );
+
+    try
+    {
+        const grpt::image_io::image color  = grpt::image_io::read_pfm( prefix + "_color.pfm" );
+        const grpt::image_io::image albedo = grpt::image_io::read_pfm( prefix + "_albedo.pfm" );
+        const grpt::image_io::image normal = grpt::image_io::read_pfm( prefix + "_normal.pfm" );
+        checkSize( albedo, color, "albedo" );
+        checkSize( normal, color, "normal" );
+
+        grpt::image_io::image depth;
+        try
+        {
+            depth = grpt::image_io::read_pfm( prefix + "_depth.pfm" );
+            checkSize( depth, color, "depth" );
+        }
+        catch( const std::runtime_error& )
+        {
+            depth = grpt::image_io::image();
+        }
+
+        const std::vector<float4> color4  = toFloat4( color );
+        const std::vector<float4> albedo4 = toFloat4( albedo );
+        std::vector<float4>       normal4 = toFloat4( normal );
+        for( size_t i = 0; i < normal4.size(); ++i )
+            normal4[i].w = 0.0f;
+
+        std::vector<float4> out( color4.size() );
+        grpt::denoiser denoiser( settings );
+        denoiser.denoise( color4.data(), albedo4.data(), normal4.data(),
+                          depth.channels == 1 ? depth.pixels.data() : nullptr,
+                          color.width, color.height, out.data() );
+
+        const grpt::denoise_timings& t = denoiser.timings();
+        std::cout << color.width << "x" << color.height << " denoised in " << t.total_ms << " ms (prepare "
+                  << t.prepare_ms << " ms, filter " << t.filter_ms << " ms)\n";
+
+        grpt::image_io::image result;
+        result.width    = color.width;
+        result.height   = color.height;
+        result.channels = 3;
+        result.pixels.resize( out.size() * 3 );
+        for( size_t i = 0; i < out.size(); ++i )
+        {
+            result.pixels[ i*3 + 0 ] = out[i].x;
+            result.pixels[ i*3 + 1 ] = out[i].y;
+            result.pixels[ i*3 + 2 ] = out[i].z;
+        }
+        grpt::image_io::write_pfm( prefix + "_denoised.pfm", result );
+
+        if( !reference_file.empty() )
+        {
+            const grpt::image_io::image reference = grpt::image_io::read_pfm( reference_file );
+            checkSize( reference, color, reference_file );
+            const std::vector<float4> reference4 = toFloat4( reference );
+            std::cout << "noisy:    PSNR " << grpt::metrics::psnr( color4.data(), reference4.data(), out.size() )
+                      << " dB, relMSE " << grpt::metrics::rel_mse( color4.data(), reference4.data(), out.size() ) << "\n";
+            std::cout << "denoised: PSNR " << grpt::metrics::psnr( out.data(), reference4.data(), out.size() )
+                      << " dB, relMSE " << grpt::metrics::rel_mse( out.data(), reference4.data(), out.size() ) << "\n";
+        }
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
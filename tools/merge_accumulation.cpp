@@ -0,0 +1,97 @@
+// Merges accumulation files rendered over disjoint RNG frame ranges (see
+// --frame-offset) into one, and optionally saves the merged image as PFM.
+
+#include <accumulation_file.hpp>
+#include <image_io.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " <output> <input> [<input> ...] [options]\n";
+    std::cerr <<
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  --pfm <file>              Also save the merged image as PFM.\n"
+              << std::endl;
+
+    exit(1);
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    std::vector<std::string> files;
+    std::string pfm_file;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "--pfm" )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            pfm_file = argv[++i];
+        }
+        else if( !arg.empty() && arg[0] == '-' )
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+        else
+        {
+            files.push_back( arg );
+        }
+    }
+
+    if( files.size() < 2 )
+        printUsageAndExit( argv[0] );
+
+    try
+    {
+        std::vector<grpt::accumulation_file> inputs;
+        for( size_t i = 1; i < files.size(); ++i )
+            inputs.push_back( grpt::read_accumulation_file( files[i] ) );
+
+        const grpt::accumulation_file merged = grpt::merge_accumulation_files( inputs );
+        grpt::write_accumulation_file( files[0], merged );
+
+        std::cout << "Merged " << inputs.size() << " files into '" << files[0] << "': "
+                  << merged.header.sample_count << " samples per pixel, frames "
+                  << merged.header.first_frame << " to " << merged.header.next_frame - 1 << "\n";
+
+        if( !pfm_file.empty() )
+        {
+            grpt::image_io::image img;
+            img.width    = merged.header.width;
+            img.height   = merged.header.height;
+            img.channels = 3;
+            img.pixels   = merged.color;
+            grpt::image_io::write_pfm( pfm_file, img );
+        }
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
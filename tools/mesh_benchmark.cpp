@@ -0,0 +1,606 @@
+// Traces the same rays through HostBVH for one mesh in three triangle
+// layouts -- as loaded, Morton sorted and in BVH leaf order -- then through
+// a QuantizedBVH and over a CompressedMesh, and reports host rays/sec,
+// acceleration and geometry memory and the cache lines a simulated data
+// cache misses per ray.  With --animate it instead deforms the mesh over a
+// number of frames and compares HostBVH::update() against full rebuilds;
+// with --paged it writes the mesh as a paged file and traces it out of core;
+// with --numa it compares one shared copy of the tree and mesh against
+// copies per NUMA node, with and without huge pages.
+
+#include <CompressedMesh.h>
+#include <HostBVH.h>
+#include <Mesh.h>
+#include <MeshLayout.h>
+#include <Numa.h>
+#include <PagedBVH.h>
+#include <ParallelFor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using optix::float3;
+using optix::make_float3;
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " [file.obj|file.ply] [options]\n";
+    std::cerr <<
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  -r | --runs <n>           Timed passes per layout; the fastest counts (default 3).\n"
+              "  -g | --generate <n>       Without a file, benchmark a generated bumpy sphere of\n"
+              "                            about n triangles (default 2000000).\n"
+              "  --rays <n>                Rays per ray set (default 1000000).\n"
+              "  --cache-kb <n>            Size of the simulated 8-way data cache (default 256).\n"
+              "  --shuffle                 Randomly permute the loaded triangle order first, as\n"
+              "                            exporters that emit triangles by material or group do.\n"
+              "  --animate <n>             Twist the mesh over n frames, updating the BVH each frame,\n"
+              "                            and compare update and trace times with full rebuilds.\n"
+              "  --paged <file>            Write the mesh to <file> in the paged format and trace it\n"
+              "                            through a page cache, in batches of 65536 rays.\n"
+              "  --page-cache-mb <n>       Page cache size for --paged (default: a quarter of the file).\n"
+              "  --numa                    Trace incoherent rays with threads bound per NUMA node, over\n"
+              "                            one shared copy and over per node copies, reporting local and\n"
+              "                            remote cache misses and scaling with the thread count.\n"
+              << std::endl;
+
+    exit(1);
+}
+
+// An nu x nv latitude/longitude sphere with a radial ripple, triangles in
+// row order.
+void generateSphere( Mesh& mesh, unsigned int triangles )
+{
+    const unsigned int nv = std::max( 2u, static_cast<unsigned int>( std::sqrt( triangles / 4.0 ) ) );
+    const unsigned int nu = 2 * nv;
+
+    memset( &mesh, 0, sizeof( Mesh ) );
+    mesh.num_vertices  = ( nu + 1 ) * ( nv + 1 );
+    mesh.num_triangles = 2 * nu * nv;
+    allocMesh( mesh );
+
+    for( unsigned int j = 0; j <= nv; ++j )
+    {
+        for( unsigned int i = 0; i <= nu; ++i )
+        {
+            const float theta = 2.0f * M_PIf * i / nu;
+            const float phi   = M_PIf * j / nv;
+            const float r     = 1.0f + 0.02f * sinf( 40.0f * theta ) * sinf( 30.0f * phi );
+            float* p = mesh.positions + 3 * ( j * ( nu + 1 ) + i );
+            p[0] = r * sinf( phi ) * cosf( theta );
+            p[1] = r * cosf( phi );
+            p[2] = r * sinf( phi ) * sinf( theta );
+        }
+    }
+    int32_t* idx = mesh.tri_indices;
+    for( unsigned int j = 0; j < nv; ++j )
+    {
+        for( unsigned int i = 0; i < nu; ++i )
+        {
+            const int32_t a = j * ( nu + 1 ) + i, b = a + 1, c = a + nu + 2, d = a + nu + 1;
+            *idx++ = a; *idx++ = d; *idx++ = c;
+            *idx++ = a; *idx++ = c; *idx++ = b;
+        }
+    }
+    for( int32_t t = 0; t < mesh.num_triangles; ++t )
+        mesh.mat_indices[t] = 0;
+    for( int k = 0; k < 3; ++k )
+    {
+        mesh.bbox_min[k] = -1.02f;
+        mesh.bbox_max[k] =  1.02f;
+    }
+}
+
+// Primary rays from a pinhole camera outside the bounds, looking at the
+// center, and incoherent rays between random points in the bounds.
+void makeRays( const Mesh& mesh, size_t count, std::vector<HostRay>& primary, std::vector<HostRay>& incoherent )
+{
+    const float3 lo     = make_float3( mesh.bbox_min[0], mesh.bbox_min[1], mesh.bbox_min[2] );
+    const float3 hi     = make_float3( mesh.bbox_max[0], mesh.bbox_max[1], mesh.bbox_max[2] );
+    const float3 center = 0.5f * ( lo + hi );
+    const float  radius = 0.5f * optix::length( hi - lo );
+    const float3 eye    = center + make_float3( 0.3f, 0.4f, -2.5f ) * radius;
+    const float3 w      = optix::normalize( center - eye );
+    const float3 u      = optix::normalize( optix::cross( w, make_float3( 0.0f, 1.0f, 0.0f ) ) );
+    const float3 v      = optix::cross( u, w );
+
+    const unsigned int side = std::max( 1u, static_cast<unsigned int>( std::sqrt( static_cast<double>( count ) ) ) );
+    primary.resize( size_t( side ) * side );
+    for( unsigned int y = 0; y < side; ++y )
+    {
+        for( unsigned int x = 0; x < side; ++x )
+        {
+            const float sx = ( x + 0.5f ) / side * 2.0f - 1.0f;
+            const float sy = ( y + 0.5f ) / side * 2.0f - 1.0f;
+            HostRay& ray  = primary[size_t( y ) * side + x];
+            ray.origin    = eye;
+            ray.direction = optix::normalize( w + 0.45f * ( sx * u + sy * v ) );
+            ray.tmin      = 0.0f;
+            ray.tmax      = std::numeric_limits<float>::max();
+        }
+    }
+
+    std::mt19937 rng( 7 );
+    std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+    incoherent.resize( count );
+    for( HostRay& ray : incoherent )
+    {
+        const float3 a = lo + make_float3( uniform( rng ), uniform( rng ), uniform( rng ) ) * ( hi - lo );
+        const float3 b = lo + make_float3( uniform( rng ), uniform( rng ), uniform( rng ) ) * ( hi - lo );
+        ray.origin    = a;
+        ray.direction = optix::normalize( b - a + make_float3( 1e-6f ) );
+        ray.tmin      = 0.0f;
+        ray.tmax      = std::numeric_limits<float>::max();
+    }
+}
+
+struct RaySetResult
+{
+    double   rays_per_second;
+    double   nodes_per_ray;
+    double   triangles_per_ray;
+    double   misses_per_ray;
+    size_t   hits;
+};
+
+// Without a cache size only the timing is measured.
+template <class BVH>
+RaySetResult traceRays( const BVH& bvh, const std::vector<HostRay>& rays, unsigned int runs, size_t cache_bytes )
+{
+    RaySetResult result;
+    double best = 0.0;
+    for( unsigned int r = 0; r < runs; ++r )
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        sutil::parallelFor( rays.size(), 4096, [&]( size_t first, size_t end )
+        {
+            for( size_t i = first; i < end; ++i )
+            {
+                HostHit hit;
+                bvh.intersect( rays[i], hit );
+            }
+        } );
+        const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+        best = r ? std::min( best, seconds ) : seconds;
+    }
+    result.rays_per_second = rays.size() / best;
+    result.hits = result.nodes_per_ray = result.triangles_per_ray = result.misses_per_ray = 0;
+    if( cache_bytes == 0 )
+        return result;
+
+    // Single threaded pass through the cache model, in ray order as one
+    // core would see them.
+    CacheModel     cache( cache_bytes );
+    TraversalStats stats = { 0, 0, &cache };
+    for( const HostRay& ray : rays )
+    {
+        HostHit hit;
+        result.hits += bvh.intersect( ray, hit, &stats );
+    }
+    result.nodes_per_ray     = static_cast<double>( stats.nodes ) / rays.size();
+    result.triangles_per_ray = static_cast<double>( stats.triangles ) / rays.size();
+    result.misses_per_ray    = static_cast<double>( cache.misses ) / rays.size();
+    return result;
+}
+
+// Rest positions twisted about the y axis by up to one radian per unit of
+// height at t = 1, with a travelling ripple on top.
+void deformMesh( const std::vector<float>& rest, Mesh& mesh, float t )
+{
+    sutil::parallelFor( mesh.num_vertices, 1u << 14, [&]( size_t begin, size_t end )
+    {
+        for( size_t v = begin; v < end; ++v )
+        {
+            const float* p      = &rest[3 * v];
+            const float  angle  = t * p[1];
+            const float  ripple = 1.0f + 0.03f * sinf( 12.0f * p[0] + 20.0f * t );
+            mesh.positions[3 * v + 0] = ripple * ( p[0] * cosf( angle ) - p[2] * sinf( angle ) );
+            mesh.positions[3 * v + 1] = ripple * p[1];
+            mesh.positions[3 * v + 2] = ripple * ( p[0] * sinf( angle ) + p[2] * cosf( angle ) );
+        }
+    } );
+}
+
+double millisecondsSince( const std::chrono::steady_clock::time_point& begin )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+}
+
+void animate( Mesh& mesh, const std::vector<HostRay>& rays, unsigned int frames, unsigned int runs )
+{
+    const std::vector<float> rest( mesh.positions, mesh.positions + 3 * size_t( mesh.num_vertices ) );
+
+    HostBVH updated;
+    updated.build( mesh );
+    printf( "  %5s %10s %9s %11s %10s %12s %12s\n", "frame", "update ms", "rebuilt", "degradation", "build ms",
+            "Mrays/s upd", "Mrays/s new" );
+    double update_total = 0.0, build_total = 0.0, trace_total = 0.0;
+    for( unsigned int frame = 1; frame <= frames; ++frame )
+    {
+        deformMesh( rest, mesh, static_cast<float>( frame ) / frames );
+
+        auto begin = std::chrono::steady_clock::now();
+        const unsigned int rebuilt = updated.update();
+        const double update_ms = millisecondsSince( begin );
+
+        HostBVH fresh;
+        begin = std::chrono::steady_clock::now();
+        fresh.build( mesh );
+        const double build_ms = millisecondsSince( begin );
+
+        const RaySetResult a = traceRays( updated, rays, runs, 0 );
+        const RaySetResult b = traceRays( fresh, rays, runs, 0 );
+        printf( "  %5u %10.1f %5u/%-3u %11.3f %10.1f %12.2f %12.2f\n", frame, update_ms, rebuilt,
+                updated.numSubtrees(), updated.degradation(), build_ms, a.rays_per_second * 1e-6,
+                b.rays_per_second * 1e-6 );
+        update_total += update_ms;
+        build_total  += build_ms;
+        trace_total  += 1e3 * rays.size() / a.rays_per_second;
+    }
+    printf( "  per frame: update %.1f ms, full rebuild %.1f ms, tracing %zu rays %.1f ms\n", update_total / frames,
+            build_total / frames, rays.size(), trace_total / frames );
+}
+
+void tracePaged( const Mesh& mesh, const std::string& filename, size_t cache_mb, const std::vector<HostRay>& primary,
+                 const std::vector<HostRay>& incoherent )
+{
+    auto begin = std::chrono::steady_clock::now();
+    writePagedMesh( mesh, filename );
+    const double write_ms = millisecondsSince( begin );
+
+    PagedBVH paged;
+    paged.open( filename, 0 );
+    const size_t file_bytes  = paged.fileBytes();
+    const size_t cache_bytes = cache_mb ? cache_mb * 1024 * 1024 : file_bytes / 4;
+    paged.open( filename, cache_bytes );
+    printf( "  %s: %.1f MB in %zu pages, written in %.0f ms; %.1f MB page cache\n", filename.c_str(),
+            file_bytes / ( 1024.0 * 1024.0 ), paged.numPages(), write_ms, cache_bytes / ( 1024.0 * 1024.0 ) );
+    printf( "  %-10s %9s %8s %9s %10s %10s %10s %10s\n", "rays", "Mrays/s", "faults", "MB read", "queued",
+            "peak MB", "ws pages", "ws MB" );
+
+    const size_t batch = 65536;
+    std::vector<HostRay> rays;
+    std::vector<HostHit> hits;
+    for( int set = 0; set < 2; ++set )
+    {
+        const std::vector<HostRay>& all = set ? incoherent : primary;
+        paged.resetStats();
+        size_t working_set_pages = 0, working_set_bytes = 0;
+        begin = std::chrono::steady_clock::now();
+        for( size_t first = 0; first < all.size(); first += batch )
+        {
+            rays.assign( all.begin() + first, all.begin() + std::min( first + batch, all.size() ) );
+            paged.intersect( rays, hits );
+            working_set_pages = std::max( working_set_pages, paged.stats().working_set_pages );
+            working_set_bytes = std::max( working_set_bytes, paged.stats().working_set_bytes );
+        }
+        const double seconds = millisecondsSince( begin ) * 1e-3;
+        const PagingStats& s = paged.stats();
+        printf( "  %-10s %9.2f %8lu %9.1f %10lu %10.1f %10zu %10.1f\n", set ? "incoherent" : "primary",
+                all.size() / seconds * 1e-6, static_cast<unsigned long>( s.page_faults ),
+                s.bytes_read / ( 1024.0 * 1024.0 ), static_cast<unsigned long>( s.queued_rays ),
+                s.peak_resident_bytes / ( 1024.0 * 1024.0 ), working_set_pages,
+                working_set_bytes / ( 1024.0 * 1024.0 ) );
+    }
+    printf( "  working sets are the largest of any batch\n" );
+}
+
+void traceNuma( const Mesh& mesh, const std::vector<HostRay>& rays, unsigned int runs, size_t cache_bytes )
+{
+    const std::vector<NumaNode>& nodes = numaNodes();
+    printf( "  %zu NUMA node%s:", nodes.size(), nodes.size() == 1 ? "" : "s" );
+    for( const NumaNode& node : nodes )
+        printf( " node %u %zu cpus;", node.id, node.cpus.size() );
+    printf( " tracing %zu incoherent rays\n", rays.size() );
+
+    HostBVH bvh;
+    bvh.build( mesh );
+
+    std::vector<unsigned int> thread_counts;
+    for( unsigned int n = 1; n < numaThreadCount(); n *= 2 )
+        thread_counts.push_back( n );
+    thread_counts.push_back( numaThreadCount() );
+
+    struct Config
+    {
+        const char* name;
+        bool        replicate;
+        HugePages   pages;
+    };
+    const Config configs[] = { { "shared", false, HUGE_PAGES_NONE },
+                               { "shared", false, HUGE_PAGES_TRANSPARENT },
+                               { "per node", true, HUGE_PAGES_TRANSPARENT },
+                               { "per node", true, HUGE_PAGES_EXPLICIT } };
+    const char* page_names[] = { "4K", "THP", "hugetlb" };
+
+    printf( "  %-9s %-8s %8s %-12s %10s %10s", "copies", "pages", "MB", "pages/node", "local/ray", "remote/ray" );
+    for( unsigned int n : thread_counts )
+        printf( " %7u thr", n );
+    printf( " %8s\n", "scaling" );
+    for( const Config& config : configs )
+    {
+        ReplicatedHostBVH replicated;
+        replicated.build( mesh, bvh, config.replicate, config.pages );
+        NumaPageMap pages;
+        replicated.mapPages( pages );
+        std::string placement;
+        for( size_t count : pages.pagesPerNode() )
+            placement += ( placement.empty() ? "" : "/" ) + std::to_string( count );
+
+        // Each node's threads read its copy for an equal share of the rays,
+        // as numaParallelFor() deals them.
+        const size_t sample = std::min<size_t>( rays.size(), 1u << 16 );
+        uint64_t local = 0, remote = 0;
+        for( size_t n = 0; n < nodes.size(); ++n )
+        {
+            CacheModel cache( cache_bytes );
+            cache.setNumaPages( &pages, nodes[n].id );
+            TraversalStats stats = { 0, 0, &cache };
+            for( size_t i = n * sample / nodes.size(); i < ( n + 1 ) * sample / nodes.size(); ++i )
+            {
+                HostHit hit;
+                replicated.bvh( static_cast<unsigned int>( n ) ).intersect( rays[i], hit, &stats );
+            }
+            local  += cache.local_misses;
+            remote += cache.remote_misses;
+        }
+        printf( "  %-9s %-8s %8.1f %-12s %10.2f %10.2f", config.name, page_names[replicated.hugePages()],
+                replicated.memoryBytes() / ( 1024.0 * 1024.0 ), placement.c_str(), double( local ) / sample,
+                double( remote ) / sample );
+
+        std::vector<double> rays_per_second;
+        for( unsigned int n : thread_counts )
+        {
+            double best = 0.0;
+            for( unsigned int r = 0; r < runs; ++r )
+            {
+                const auto begin = std::chrono::steady_clock::now();
+                sutil::numaParallelFor( rays.size(), 4096, n, [&]( size_t first, size_t end, unsigned int node )
+                {
+                    const HostBVH& local_bvh = replicated.bvh( node );
+                    for( size_t i = first; i < end; ++i )
+                    {
+                        HostHit hit;
+                        local_bvh.intersect( rays[i], hit );
+                    }
+                } );
+                const double seconds = millisecondsSince( begin ) * 1e-3;
+                best = r ? std::min( best, seconds ) : seconds;
+            }
+            rays_per_second.push_back( rays.size() / best );
+            printf( " %11.2f", rays.size() / best * 1e-6 );
+        }
+        printf( " %7.2fx\n", rays_per_second.back() / rays_per_second.front() );
+    }
+    printf( "  local/remote: simulated cache misses per ray by the node holding the line;\n"
+            "  thread columns in Mrays/s, threads dealt round robin to nodes; pages as obtained\n" );
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    std::string  file;
+    unsigned int runs = 3;
+    unsigned int generated_triangles = 2000000;
+    unsigned int ray_count = 1000000;
+    unsigned int cache_kb = 256;
+    unsigned int frames = 0;
+    unsigned int page_cache_mb = 0;
+    std::string  paged_file;
+    bool         shuffle = false;
+    bool         numa = false;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "--shuffle" )
+        {
+            shuffle = true;
+        }
+        else if( arg == "--numa" )
+        {
+            numa = true;
+        }
+        else if( arg == "-r" || arg == "--runs" || arg == "-g" || arg == "--generate" || arg == "--rays" ||
+                 arg == "--cache-kb" || arg == "--animate" || arg == "--page-cache-mb" )
+        {
+            if( i == argc - 1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            const unsigned int value = static_cast<unsigned int>( std::max( atoi( argv[++i] ), 1 ) );
+            if( arg == "-r" || arg == "--runs" )
+                runs = value;
+            else if( arg == "-g" || arg == "--generate" )
+                generated_triangles = value;
+            else if( arg == "--rays" )
+                ray_count = value;
+            else if( arg == "--animate" )
+                frames = value;
+            else if( arg == "--page-cache-mb" )
+                page_cache_mb = value;
+            else
+                cache_kb = value;
+        }
+        else if( arg == "--paged" )
+        {
+            if( i == argc - 1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            paged_file = argv[++i];
+        }
+        else if( !arg.empty() && arg[0] == '-' )
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+        else
+        {
+            file = arg;
+        }
+    }
+
+    Mesh mesh;
+    if( file.empty() )
+    {
+        generateSphere( mesh, generated_triangles );
+    }
+    else
+    {
+        try
+        {
+            loadMesh( file, mesh );
+        }
+        catch( const std::exception& e )
+        {
+            std::cerr << "Failed to load '" << file << "': " << e.what() << "\n";
+            return 1;
+        }
+    }
+    if( mesh.num_triangles == 0 )
+    {
+        std::cerr << "No triangles to trace\n";
+        return 1;
+    }
+
+    if( shuffle )
+    {
+        std::vector<uint32_t> order( mesh.num_triangles );
+        for( size_t i = 0; i < order.size(); ++i )
+            order[i] = static_cast<uint32_t>( i );
+        std::shuffle( order.begin(), order.end(), std::mt19937( 11 ) );
+        reorderMeshTriangles( mesh, order );
+    }
+
+    std::vector<HostRay> primary, incoherent;
+    makeRays( mesh, ray_count, primary, incoherent );
+    printf( "%s: %d triangles, %d vertices%s; %zu primary and %zu incoherent rays on %u threads,\n"
+            "%u KB 8-way simulated cache\n",
+            file.empty() ? "generated sphere" : file.c_str(), mesh.num_triangles, mesh.num_vertices,
+            shuffle ? " (shuffled)" : "", primary.size(), incoherent.size(), sutil::parallelThreadCount(), cache_kb );
+    if( frames )
+    {
+        animate( mesh, primary, frames, runs );
+        freeMesh( mesh );
+        return 0;
+    }
+    if( !paged_file.empty() )
+    {
+        try
+        {
+            tracePaged( mesh, paged_file, page_cache_mb, primary, incoherent );
+        }
+        catch( const std::exception& e )
+        {
+            std::cerr << e.what() << "\n";
+            freeMesh( mesh );
+            return 1;
+        }
+        freeMesh( mesh );
+        return 0;
+    }
+
+    if( numa )
+    {
+        try
+        {
+            traceNuma( mesh, incoherent, runs, size_t( cache_kb ) * 1024 );
+        }
+        catch( const std::exception& e )
+        {
+            std::cerr << e.what() << "\n";
+            freeMesh( mesh );
+            return 1;
+        }
+        freeMesh( mesh );
+        return 0;
+    }
+
+    printf( "  %-10s %-10s %12s %10s %10s %12s\n", "layout", "rays", "Mrays/s", "nodes/ray", "tris/ray",
+            "misses/ray" );
+
+    // The quantized tree and the compressed mesh start from the BVH leaf
+    // ordered mesh.
+    const char* layouts[] = { "loaded", "morton", "bvh leaf", "quantized", "compressed" };
+    size_t reference_hits[2] = { 0, 0 };
+    bool   consistent = true;
+    CompressedMesh compressed;
+    for( int layout = 0; layout < 5; ++layout )
+    {
+        HostBVH      bvh;
+        QuantizedBVH quantized;
+        if( layout == 1 )
+        {
+            optimizeMeshLayout( mesh );
+        }
+        else if( layout == 2 )
+        {
+            bvh.build( mesh );
+            reorderMeshTriangles( mesh, bvh.triangles() );
+        }
+        else if( layout == 4 )
+        {
+            compressed.compress( mesh );
+        }
+        const auto begin = std::chrono::steady_clock::now();
+        if( layout == 4 )
+            bvh.build( compressed );
+        else
+            bvh.build( mesh );
+        if( layout == 3 )
+            quantized.build( bvh );
+        const double build_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+        const size_t bvh_bytes = layout == 3 ? quantized.memoryBytes() : bvh.memoryBytes();
+
+        for( int set = 0; set < 2; ++set )
+        {
+            const std::vector<HostRay>& rays = set ? incoherent : primary;
+            const size_t cache_bytes = size_t( cache_kb ) * 1024;
+            const RaySetResult r = layout == 3 ? traceRays( quantized, rays, runs, cache_bytes )
+                                               : traceRays( bvh, rays, runs, cache_bytes );
+            printf( "  %-10s %-10s %12.2f %10.1f %10.1f %12.2f\n", set ? "" : layouts[layout],
+                    set ? "incoherent" : "primary", r.rays_per_second * 1e-6, r.nodes_per_ray, r.triangles_per_ray,
+                    r.misses_per_ray );
+            if( layout == 0 )
+                reference_hits[set] = r.hits;
+            else if( layout < 4 )
+                consistent = consistent && r.hits == reference_hits[set];
+            else
+                printf( "  %-10s %-10s %+ld hits from quantization\n", "", "",
+                        static_cast<long>( r.hits ) - static_cast<long>( reference_hits[set] ) );
+        }
+        const size_t geometry_bytes = layout == 4 ? compressed.memoryBytes() : CompressedMesh::meshBytes( mesh );
+        printf( "  %-10s build %.1f ms, %.1f MB of nodes, %.1f MB of geometry\n", "", build_ms,
+                bvh_bytes / ( 1024.0 * 1024.0 ), geometry_bytes / ( 1024.0 * 1024.0 ) );
+    }
+
+    freeMesh( mesh );
+    if( !consistent )
+    {
+        std::cerr << "Hit counts differ between layouts\n";
+        return 1;
+    }
+    return 0;
+}
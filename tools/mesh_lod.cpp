@@ -0,0 +1,361 @@
+// Simplifies a mesh into a chain of levels of detail and reports, per level,
+// triangles, geometry and HostBVH memory, error and build time.  It then
+// lays the mesh out as a grid of instances seen in a wide shot, picks a
+// level per instance from its distance to the camera, and compares the
+// shot traced with every instance at full detail against the shot with the
+// chosen levels: the geometry and BVH bytes and triangles each needs, and
+// how many pixels change coverage or shade.
+
+#include <HostBVH.h>
+#include <Mesh.h>
+#include <MeshLOD.h>
+#include <ParallelFor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using optix::float3;
+using optix::make_float3;
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " <file.obj|file.ply> [options]\n";
+    std::cerr <<
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  -l | --levels <n>         Levels to build below the full mesh (default 6).\n"
+              "  --grid <n>                Instances per side of the wide shot (default 16).\n"
+              "  --width <n>               Wide shot width in pixels (default 1024).\n"
+              "  --height <n>              Wide shot height in pixels (default 768).\n"
+              "  --fov <degrees>           Vertical field of view (default 40).\n"
+              "  --pixel-error <px>        Largest projected error a level may have (default 0.5).\n"
+              << std::endl;
+
+    exit(1);
+}
+
+double millisecondsSince( const std::chrono::steady_clock::time_point& begin )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+}
+
+size_t meshBytes( const Mesh& mesh )
+{
+    const size_t per_vertex = 3 + ( mesh.has_normals ? 3 : 0 ) + ( mesh.has_texcoords ? 2 : 0 ) +
+                              ( mesh.has_tangents ? 4 : 0 );
+    return size_t( mesh.num_vertices ) * per_vertex * sizeof( float ) +
+           size_t( mesh.num_triangles ) * 4 * sizeof( int32_t );
+}
+
+struct Level
+{
+    const Mesh* mesh;
+    HostBVH     bvh;
+    float       error;
+    size_t      bytes;   // Geometry and BVH
+};
+
+struct Instance
+{
+    float3       offset;
+    unsigned int level;
+};
+
+float3 toFloat3( const float* a )
+{
+    return make_float3( a[0], a[1], a[2] );
+}
+
+bool intersectBox( const HostRay& ray, const float3& lo, const float3& hi )
+{
+    const float3 inv = make_float3( 1.0f ) / ray.direction;
+    const float3 t0  = ( lo - ray.origin ) * inv;
+    const float3 t1  = ( hi - ray.origin ) * inv;
+    const float3 tn  = optix::fminf( t0, t1 );
+    const float3 tf  = optix::fmaxf( t0, t1 );
+    const float near = std::max( std::max( tn.x, tn.y ), std::max( tn.z, ray.tmin ) );
+    const float far  = std::min( std::min( tf.x, tf.y ), std::min( tf.z, ray.tmax ) );
+    return near <= far;
+}
+
+// Lambert shading of the interpolated normal, 0 to 255, or -1 on a miss.
+float shade( const Mesh& mesh, const HostHit& hit, const float3& direction )
+{
+    const int32_t* idx = mesh.tri_indices + 3 * size_t( hit.triangle );
+    float3 n;
+    if( mesh.has_normals )
+    {
+        const float* n0 = mesh.normals + 3 * size_t( idx[0] );
+        const float* n1 = mesh.normals + 3 * size_t( idx[1] );
+        const float* n2 = mesh.normals + 3 * size_t( idx[2] );
+        const float  w  = 1.0f - hit.u - hit.v;
+        n = make_float3( w * n0[0] + hit.u * n1[0] + hit.v * n2[0], w * n0[1] + hit.u * n1[1] + hit.v * n2[1],
+                         w * n0[2] + hit.u * n1[2] + hit.v * n2[2] );
+    }
+    else
+    {
+        const float3 p0 = toFloat3( mesh.positions + 3 * size_t( idx[0] ) );
+        const float3 p1 = toFloat3( mesh.positions + 3 * size_t( idx[1] ) );
+        const float3 p2 = toFloat3( mesh.positions + 3 * size_t( idx[2] ) );
+        n = optix::cross( p1 - p0, p2 - p0 );
+    }
+    n = optix::normalize( n );
+    if( optix::dot( n, direction ) > 0.0f )
+        n = -n;
+    const float3 light = optix::normalize( make_float3( 0.4f, 1.0f, -0.6f ) );
+    return 255.0f * ( 0.15f + 0.85f * std::max( optix::dot( n, light ), 0.0f ) );
+}
+
+// Traces the grid of instances, every one at level 0 when 'full' is set.
+void traceShot( const std::vector<Level>& levels, const std::vector<Instance>& instances, bool full,
+                const std::vector<HostRay>& rays, std::vector<float>& image )
+{
+    const float3 lo = toFloat3( levels[0].mesh->bbox_min );
+    const float3 hi = toFloat3( levels[0].mesh->bbox_max );
+    image.assign( rays.size(), -1.0f );
+    sutil::parallelFor( rays.size(), 1024, [&]( size_t begin, size_t end )
+    {
+        for( size_t r = begin; r < end; ++r )
+        {
+            float          t     = std::numeric_limits<float>::max();
+            const Level*   level = 0;
+            HostHit        best;
+            for( const Instance& instance : instances )
+            {
+                HostRay ray = rays[r];
+                ray.origin  = ray.origin - instance.offset;
+                ray.tmax    = t;
+                if( !intersectBox( ray, lo, hi ) )
+                    continue;
+                const Level& candidate = levels[full ? 0 : instance.level];
+                HostHit hit;
+                if( candidate.bvh.intersect( ray, hit ) && hit.t < t )
+                {
+                    t     = hit.t;
+                    best  = hit;
+                    level = &candidate;
+                }
+            }
+            if( level )
+                image[r] = shade( *level->mesh, best, rays[r].direction );
+        }
+    } );
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    std::string  file;
+    unsigned int max_levels = 6;
+    unsigned int grid = 16;
+    unsigned int width = 1024;
+    unsigned int height = 768;
+    float        fov = 40.0f;
+    float        pixel_error = 0.5f;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "-l" || arg == "--levels" || arg == "--grid" || arg == "--width" || arg == "--height" ||
+                 arg == "--fov" || arg == "--pixel-error" )
+        {
+            if( i == argc - 1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            const char* value = argv[++i];
+            if( arg == "--fov" )
+                fov = std::min( std::max( static_cast<float>( atof( value ) ), 1.0f ), 170.0f );
+            else if( arg == "--pixel-error" )
+                pixel_error = std::max( static_cast<float>( atof( value ) ), 0.0f );
+            else
+            {
+                const unsigned int n = static_cast<unsigned int>( std::max( atoi( value ), 1 ) );
+                if( arg == "-l" || arg == "--levels" )
+                    max_levels = n;
+                else if( arg == "--grid" )
+                    grid = n;
+                else if( arg == "--width" )
+                    width = n;
+                else
+                    height = n;
+            }
+        }
+        else if( !arg.empty() && arg[0] == '-' )
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+        else
+        {
+            file = arg;
+        }
+    }
+    if( file.empty() )
+        printUsageAndExit( argv[0] );
+
+    Mesh mesh;
+    try
+    {
+        loadMesh( file, mesh );
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << "Failed to load '" << file << "': " << e.what() << "\n";
+        return 1;
+    }
+    if( mesh.num_triangles == 0 )
+    {
+        std::cerr << "No triangles to simplify\n";
+        freeMesh( mesh );
+        return 1;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<MeshLOD> lods;
+    buildMeshLODs( mesh, lods, max_levels );
+    const double simplify_ms = millisecondsSince( begin );
+
+    std::vector<Level> levels( lods.size() + 1 );
+    const float3 lo     = toFloat3( mesh.bbox_min );
+    const float3 hi     = toFloat3( mesh.bbox_max );
+    const float  extent = std::max( optix::length( hi - lo ), 1e-6f );
+    printf( "%s: %d triangles, %d vertices; %zu levels simplified in %.0f ms on %u threads\n", file.c_str(),
+            mesh.num_triangles, mesh.num_vertices, lods.size(), simplify_ms, sutil::parallelThreadCount() );
+    printf( "  %-6s %10s %10s %12s %12s %12s %10s\n", "level", "tris", "verts", "mesh KB", "bvh KB", "error/extent",
+            "bvh ms" );
+    for( size_t l = 0; l < levels.size(); ++l )
+    {
+        Level& level = levels[l];
+        level.mesh   = l ? &lods[l - 1].mesh : &mesh;
+        level.error  = l ? lods[l - 1].error : 0.0f;
+        begin = std::chrono::steady_clock::now();
+        level.bvh.build( *level.mesh );
+        const double build_ms = millisecondsSince( begin );
+        level.bytes = meshBytes( *level.mesh ) + level.bvh.memoryBytes();
+        printf( "  %-6zu %10d %10d %12.1f %12.1f %12.2e %10.1f\n", l, level.mesh->num_triangles,
+                level.mesh->num_vertices, meshBytes( *level.mesh ) / 1024.0, level.bvh.memoryBytes() / 1024.0,
+                level.error / extent, build_ms );
+    }
+
+    // A grid of instances on the xz plane, seen from above one edge so the
+    // nearest are close and the furthest small.
+    const float  spacing = 1.5f * extent;
+    const float  side    = spacing * grid;
+    const float3 center  = make_float3( 0.0f, 0.0f, 0.5f * side );
+    const float3 eye     = make_float3( 0.0f, 0.35f * side, -0.45f * side );
+    const float  footprint = pixelFootprint( fov, height );
+    std::vector<float> errors( levels.size() );
+    for( size_t l = 0; l < levels.size(); ++l )
+        errors[l] = levels[l].error;
+
+    std::vector<Instance>     instances( size_t( grid ) * grid );
+    std::vector<unsigned int> histogram( levels.size(), 0 );
+    std::vector<bool>         resident( levels.size(), false );
+    size_t full_bytes = 0, lod_bytes = 0, full_triangles = 0, lod_triangles = 0;
+    for( unsigned int z = 0; z < grid; ++z )
+    {
+        for( unsigned int x = 0; x < grid; ++x )
+        {
+            Instance& instance = instances[size_t( z ) * grid + x];
+            instance.offset = make_float3( ( x + 0.5f ) * spacing - 0.5f * side, 0.0f, ( z + 0.5f ) * spacing ) -
+                              0.5f * ( lo + hi );
+            const float distance = distanceToBox( eye, lo + instance.offset, hi + instance.offset );
+            instance.level = selectMeshLOD( errors, distance, footprint, pixel_error );
+            ++histogram[instance.level];
+            resident[instance.level] = true;
+            full_triangles += mesh.num_triangles;
+            lod_triangles  += levels[instance.level].mesh->num_triangles;
+        }
+    }
+    full_bytes = levels[0].bytes;
+    for( size_t l = 0; l < levels.size(); ++l )
+        lod_bytes += resident[l] ? levels[l].bytes : 0;
+
+    const float3 w = optix::normalize( center - eye );
+    const float3 u = optix::normalize( optix::cross( w, make_float3( 0.0f, 1.0f, 0.0f ) ) );
+    const float3 v = optix::cross( u, w );
+    std::vector<HostRay> rays( size_t( width ) * height );
+    for( unsigned int y = 0; y < height; ++y )
+    {
+        for( unsigned int x = 0; x < width; ++x )
+        {
+            const float sx = ( x + 0.5f - 0.5f * width ) * footprint;
+            const float sy = ( 0.5f * height - y - 0.5f ) * footprint;
+            HostRay& ray  = rays[size_t( y ) * width + x];
+            ray.origin    = eye;
+            ray.direction = optix::normalize( w + sx * u + sy * v );
+            ray.tmin      = 0.0f;
+            ray.tmax      = std::numeric_limits<float>::max();
+        }
+    }
+
+    std::vector<float> full_image, lod_image;
+    begin = std::chrono::steady_clock::now();
+    traceShot( levels, instances, true, rays, full_image );
+    const double full_ms = millisecondsSince( begin );
+    begin = std::chrono::steady_clock::now();
+    traceShot( levels, instances, false, rays, lod_image );
+    const double lod_ms = millisecondsSince( begin );
+
+    size_t covered = 0, both = 0, coverage_changed = 0, shade_changed = 0;
+    double shade_difference = 0.0;
+    for( size_t p = 0; p < rays.size(); ++p )
+    {
+        const bool full_hit = full_image[p] >= 0.0f, lod_hit = lod_image[p] >= 0.0f;
+        covered += full_hit;
+        if( full_hit != lod_hit )
+        {
+            ++coverage_changed;
+        }
+        else if( full_hit )
+        {
+            const float d = std::fabs( full_image[p] - lod_image[p] );
+            ++both;
+            shade_difference += d;
+            shade_changed += d > 8.0f;
+        }
+    }
+
+    printf( "\nWide shot: %ux%u instances, %ux%u pixels, %.0f degree fov, %.2f pixel error\n", grid, grid, width,
+            height, fov, pixel_error );
+    printf( "  instances per level:" );
+    for( size_t l = 0; l < levels.size(); ++l )
+        printf( " %u", histogram[l] );
+    printf( "\n" );
+    printf( "  %-10s %14s %16s %18s %10s\n", "", "scene tris", "resident MB", "unshared MB", "trace ms" );
+    printf( "  %-10s %14zu %16.1f %18.1f %10.0f\n", "full", full_triangles, full_bytes / 1048576.0,
+            full_bytes * double( instances.size() ) / 1048576.0, full_ms );
+    size_t unshared_bytes = 0;
+    for( const Instance& instance : instances )
+        unshared_bytes += levels[instance.level].bytes;
+    printf( "  %-10s %14zu %16.1f %18.1f %10.0f\n", "lod", lod_triangles, lod_bytes / 1048576.0,
+            unshared_bytes / 1048576.0, lod_ms );
+    printf( "  resident: levels in use, shared by instances; unshared: a copy per instance\n" );
+    printf( "  covered pixels %zu, coverage changed %zu (%.3f%%), shade changed by more than 8/255 %zu (%.3f%%),\n"
+            "  mean shade difference %.2f/255\n",
+            covered, coverage_changed, 100.0 * coverage_changed / std::max<size_t>( covered, 1 ), shade_changed,
+            100.0 * shade_changed / std::max<size_t>( covered, 1 ),
+            shade_difference / std::max<size_t>( both, 1 ) );
+
+    freeMeshLODs( lods );
+    freeMesh( mesh );
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Times tinyobjloader's hash vertex welder against the std::map cache it
+// replaced, on the given OBJ files or on a generated one, and checks that
+// both produce byte-identical shapes.
+
+#include <tinyobjloader/tiny_obj_loader.h>
+
+#include "obj_benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " [file.obj ...] [options]\n";
+    std::cerr <<
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  -r | --runs <n>           Loads per file and loader; the fastest counts (default 3).\n"
+              "  -g | --generate <n>       Without files, benchmark a generated grid of about n quads\n"
+              "                            with positions, normals and texture coordinates\n"
+              "                            (default 2000000).\n"
+              "  --group <n>               Quads per group of the generated file (default 50000).\n"
+              << std::endl;
+
+    exit(1);
+}
+
+// Writes an n x n grid of quads with shared v/vt/vn indices, split into
+// groups that alternate between two materials.
+void writeGrid( const std::string& path, unsigned int n, unsigned int quads_per_group )
+{
+    std::ofstream out( path.c_str() );
+    for( unsigned int y = 0; y <= n; ++y )
+        for( unsigned int x = 0; x <= n; ++x )
+            out << "v " << x << ' ' << ( ( x * 7 + y * 13 ) % 17 ) * 0.01f << ' ' << y << '\n';
+    for( unsigned int y = 0; y <= n; ++y )
+        for( unsigned int x = 0; x <= n; ++x )
+            out << "vt " << static_cast<float>( x ) / n << ' ' << static_cast<float>( y ) / n << '\n';
+    out << "vn 0 1 0\nvn 0.1 0.99 0\n";
+
+    unsigned int quads = 0;
+    for( unsigned int y = 0; y < n; ++y )
+    {
+        for( unsigned int x = 0; x < n; ++x, ++quads )
+        {
+            if( quads % quads_per_group == 0 )
+            {
+                const unsigned int group = quads / quads_per_group;
+                out << "g group" << group << "\nusemtl material" << group % 2 << '\n';
+            }
+            const unsigned int i  = y * ( n + 1 ) + x + 1;
+            const unsigned int vn = ( x + y ) % 2 + 1;
+            const unsigned int corners[4] = { i, i + 1, i + n + 2, i + n + 1 };
+            out << 'f';
+            for( unsigned int c : corners )
+                out << ' ' << c << '/' << c << '/' << vn;
+            out << '\n';
+        }
+    }
+    if( !out )
+    {
+        std::cerr << "Failed to write '" << path << "'\n";
+        exit(1);
+    }
+}
+
+double loadObj( const std::string& path, std::vector<LoadedShape>& shapes, std::string& err )
+{
+    std::vector<tinyobj::shape_t>    loaded;
+    std::vector<tinyobj::material_t> materials;
+
+    const auto begin = std::chrono::steady_clock::now();
+    const bool ok = tinyobj::LoadObj( loaded, materials, err, path.c_str() );
+    const auto end = std::chrono::steady_clock::now();
+    if( !ok )
+        return -1.0;
+
+    shapes.clear();
+    for( const tinyobj::shape_t& s : loaded )
+    {
+        LoadedShape shape;
+        shape.name         = s.name;
+        shape.positions    = s.mesh.positions;
+        shape.normals      = s.mesh.normals;
+        shape.texcoords    = s.mesh.texcoords;
+        shape.indices      = s.mesh.indices;
+        shape.material_ids = s.mesh.material_ids;
+        shapes.push_back( shape );
+    }
+    return std::chrono::duration<double, std::milli>( end - begin ).count();
+}
+
+template <class T>
+bool sameBytes( const std::vector<T>& a, const std::vector<T>& b )
+{
+    return a.size() == b.size() && ( a.empty() || memcmp( a.data(), b.data(), a.size() * sizeof( T ) ) == 0 );
+}
+
+bool sameShapes( const std::vector<LoadedShape>& a, const std::vector<LoadedShape>& b )
+{
+    if( a.size() != b.size() )
+        return false;
+    for( size_t i = 0; i < a.size(); ++i )
+    {
+        if( a[i].name != b[i].name || !sameBytes( a[i].positions, b[i].positions ) ||
+            !sameBytes( a[i].normals, b[i].normals ) || !sameBytes( a[i].texcoords, b[i].texcoords ) ||
+            !sameBytes( a[i].indices, b[i].indices ) || !sameBytes( a[i].material_ids, b[i].material_ids ) )
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    std::vector<std::string> files;
+    unsigned int runs = 3;
+    unsigned int generated_quads = 2000000;
+    unsigned int quads_per_group = 50000;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "-r" || arg == "--runs" || arg == "-g" || arg == "--generate" || arg == "--group" )
+        {
+            if( i == argc - 1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            const unsigned int value = static_cast<unsigned int>( std::max( atoi( argv[++i] ), 1 ) );
+            if( arg == "-r" || arg == "--runs" )
+                runs = value;
+            else if( arg == "-g" || arg == "--generate" )
+                generated_quads = value;
+            else
+                quads_per_group = value;
+        }
+        else if( !arg.empty() && arg[0] == '-' )
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+        else
+        {
+            files.push_back( arg );
+        }
+    }
+
+    std::string generated;
+    if( files.empty() )
+    {
+        const unsigned int n = std::max( 1u, static_cast<unsigned int>( std::sqrt( static_cast<double>( generated_quads ) ) ) );
+        generated = "obj_benchmark_grid.obj";
+        std::cout << "Generating a " << n << "x" << n << " quad grid in '" << generated << "'\n";
+        writeGrid( generated, n, quads_per_group );
+        files.push_back( generated );
+    }
+
+    bool identical = true;
+    for( const std::string& file : files )
+    {
+        double best = 0.0, best_reference = 0.0;
+        std::vector<LoadedShape> shapes, reference;
+        for( unsigned int r = 0; r < runs; ++r )
+        {
+            std::string err;
+            const double ms = loadObj( file, shapes, err );
+            const double reference_ms = loadObjReference( file, reference, err );
+            if( ms < 0.0 || reference_ms < 0.0 )
+            {
+                std::cerr << "Failed to load '" << file << "': " << err << "\n";
+                return 1;
+            }
+            best = r ? std::min( best, ms ) : ms;
+            best_reference = r ? std::min( best_reference, reference_ms ) : reference_ms;
+        }
+
+        size_t triangles = 0, vertices = 0;
+        for( const LoadedShape& s : shapes )
+        {
+            triangles += s.indices.size() / 3;
+            vertices  += s.positions.size() / 3;
+        }
+        const bool same = sameShapes( shapes, reference );
+        identical = identical && same;
+        printf( "%s: %zu shapes, %zu triangles, %zu vertices\n"
+                "  std::map cache %10.1f ms\n"
+                "  hash welder    %10.1f ms  (%.2fx)\n"
+                "  output         %s\n",
+                file.c_str(), shapes.size(), triangles, vertices, best_reference, best,
+                best > 0.0 ? best_reference / best : 0.0, same ? "byte-identical" : "DIFFERENT" );
+    }
+
+    if( !generated.empty() )
+        remove( generated.c_str() );
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A tinyobj::shape_t, flattened so that loaders built into different
+// namespaces can be compared field by field.
+struct LoadedShape
+{
+    std::string               name;
+    std::vector<float>        positions;
+    std::vector<float>        normals;
+    std::vector<float>        texcoords;
+    std::vector<unsigned int> indices;
+    std::vector<int>          material_ids;
+};
+
+// Loads 'path' with the std::map vertex cache tinyobjloader used before the
+// hash welder and returns the milliseconds LoadObj took, or a negative
+// value with 'err' set on failure.
+double loadObjReference( const std::string& path, std::vector<LoadedShape>& shapes, std::string& err );
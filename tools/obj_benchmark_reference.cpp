@@ -0,0 +1,38 @@
+// tinyobjloader with its original std::map vertex cache, built into its own
+// namespace so obj_benchmark can load the same files both ways.
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#define TINYOBJLOADER_MAP_VERTEX_CACHE
+#define tinyobj tinyobj_reference
+#include <tinyobjloader/tiny_obj_loader.h>
+#undef tinyobj
+
+#include "obj_benchmark.h"
+
+#include <chrono>
+
+double loadObjReference( const std::string& path, std::vector<LoadedShape>& shapes, std::string& err )
+{
+    std::vector<tinyobj_reference::shape_t>    loaded;
+    std::vector<tinyobj_reference::material_t> materials;
+
+    const auto begin = std::chrono::steady_clock::now();
+    const bool ok = tinyobj_reference::LoadObj( loaded, materials, err, path.c_str() );
+    const auto end = std::chrono::steady_clock::now();
+    if( !ok )
+        return -1.0;
+
+    shapes.clear();
+    for( const tinyobj_reference::shape_t& s : loaded )
+    {
+        LoadedShape shape;
+        shape.name         = s.name;
+        shape.positions    = s.mesh.positions;
+        shape.normals      = s.mesh.normals;
+        shape.texcoords    = s.mesh.texcoords;
+        shape.indices      = s.mesh.indices;
+        shape.material_ids = s.mesh.material_ids;
+        shapes.push_back( shape );
+    }
+    return std::chrono::duration<double, std::milli>( end - begin ).count();
+}
@@ -0,0 +1,183 @@
+// Submits one job to a render server (optixPathTracer --server), assembles
+// the tiles it streams back into an image and reports the turnaround.  Job
+// parameters are passed through as given, e.g.
+//
+//   render_client /tmp/grpt.sock scene=cornell width=800 height=600 spp=16 region=0,0,400,300
+
+#include <image_io.hpp>
+#include <unix_socket.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " <socket> [key=value ...] [options]\n";
+    std::cerr <<
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  -o | --output <file>      Save the image as PFM (default render.pfm); pixels\n"
+              "                            outside the region are black.\n"
+              "  --scenes                  List the scenes the server has loaded and exit.\n"
+              "  --shutdown                Stop the server and exit.\n"
+              "Job keys: scene, width, height, spp, frames, tile, region=x0,y0,x1,y1,\n"
+              "          eye=x,y,z, lookat=x,y,z, up=x,y,z, fov.\n"
+              << std::endl;
+
+    exit(1);
+}
+
+unsigned int jobValue( const std::vector<std::string>& params, const std::string& key, unsigned int fallback )
+{
+    for( const std::string& param : params )
+        if( param.compare( 0, key.size() + 1, key + "=" ) == 0 )
+            return static_cast<unsigned int>( atoi( param.c_str() + key.size() + 1 ) );
+    return fallback;
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    std::string socket_path;
+    std::string output = "render.pfm";
+    std::string request;
+    std::vector<std::string> params;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "-o" || arg == "--output" )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            output = argv[++i];
+        }
+        else if( arg == "--scenes" || arg == "--shutdown" )
+        {
+            request = arg.substr( 2 );
+        }
+        else if( !arg.empty() && arg[0] == '-' )
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+        else if( socket_path.empty() )
+        {
+            socket_path = arg;
+        }
+        else
+        {
+            params.push_back( arg );
+        }
+    }
+
+    if( socket_path.empty() )
+        printUsageAndExit( argv[0] );
+
+    int fd = -1;
+    int status = 0;
+    try
+    {
+        fd = grpt::unix_socket::connect( socket_path );
+
+        if( request == "shutdown" )
+        {
+            grpt::unix_socket::send_line( fd, request );
+        }
+        else if( request == "scenes" )
+        {
+            std::string line;
+            grpt::unix_socket::send_line( fd, request );
+            if( !grpt::unix_socket::recv_line( fd, line ) )
+                throw std::runtime_error( "render_client: server closed the connection" );
+            std::cout << line << "\n";
+        }
+        else
+        {
+            // The server's defaults, needed to size the image.
+            grpt::image_io::image img;
+            img.width    = jobValue( params, "width", 512 );
+            img.height   = jobValue( params, "height", 512 );
+            img.channels = 3;
+            img.pixels.assign( static_cast<size_t>( img.width ) * img.height * 3, 0.0f );
+
+            std::string job = "render";
+            for( const std::string& param : params )
+                job += " " + param;
+
+            const auto begin = std::chrono::steady_clock::now();
+            double first_tile_ms = -1.0;
+            unsigned int tiles = 0;
+            grpt::unix_socket::send_line( fd, job );
+
+            std::string line;
+            for( ;; )
+            {
+                if( !grpt::unix_socket::recv_line( fd, line ) )
+                    throw std::runtime_error( "render_client: server closed the connection" );
+
+                unsigned int x, y, w, h;
+                if( std::sscanf( line.c_str(), "tile %u %u %u %u", &x, &y, &w, &h ) == 4 )
+                {
+                    if( x + w > img.width || y + h > img.height )
+                        throw std::runtime_error( "render_client: tile outside the image" );
+
+                    std::vector<float> pixels( static_cast<size_t>( w ) * h * 3 );
+                    if( !grpt::unix_socket::recv_bytes( fd, pixels.data(), pixels.size() * sizeof( float ) ) )
+                        throw std::runtime_error( "render_client: server closed the connection" );
+                    for( unsigned int row = 0; row < h; ++row )
+                        std::copy( pixels.begin() + static_cast<size_t>( row ) * w * 3,
+                                   pixels.begin() + static_cast<size_t>( row + 1 ) * w * 3,
+                                   img.pixels.begin() + ( static_cast<size_t>( y + row ) * img.width + x ) * 3 );
+
+                    if( first_tile_ms < 0.0 )
+                        first_tile_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+                    ++tiles;
+                }
+                else if( line.compare( 0, 5, "done " ) == 0 )
+                {
+                    break;
+                }
+                else
+                {
+                    throw std::runtime_error( "render_client: " + line );
+                }
+            }
+            const double total_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+            unsigned int spp = 0, render_ms = 0;
+            std::sscanf( line.c_str(), "done %u %u", &spp, &render_ms );
+            std::cout << tiles << " tiles, " << spp << " samples per pixel: first tile after " << first_tile_ms
+                      << " ms, done after " << total_ms << " ms (" << render_ms << " ms rendering).\n";
+
+            grpt::image_io::write_pfm( output, img );
+        }
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << e.what() << "\n";
+        status = 1;
+    }
+
+    grpt::unix_socket::close( fd );
+    return status;
+}
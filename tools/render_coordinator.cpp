@@ -0,0 +1,239 @@
+// Renders one frame with several local worker processes that split the
+// samples, not the pixels.  Each worker gets a disjoint RNG frame range over
+// a Unix socket, saves an accumulation file, and the coordinator merges the
+// files into the result a single process rendering every frame would give.
+//
+// Protocol, one line per message:
+//   worker      -> coordinator   hello
+//   coordinator -> worker        render <frame_offset> <frames> <file>
+//   worker      -> coordinator   done <file>
+
+#include <accumulation_file.hpp>
+#include <image_io.hpp>
+#include <unix_socket.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " [options] -- <renderer> [renderer options]\n";
+    std::cerr <<
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  -w | --workers <n>        Number of worker processes (default 2).\n"
+              "  -f | --frames <n>         Frames each worker accumulates (default 1).\n"
+              "  -o | --output <file>      Merged accumulation file (default merged.grac);\n"
+              "                            the image is saved next to it as <file>.pfm.\n"
+              "  -s | --socket <path>      Socket path (default /tmp/grpt_coordinator.<pid>).\n"
+              << std::endl;
+
+    exit(1);
+}
+
+pid_t spawnWorker( const std::vector<std::string>& command, const std::string& socket_path )
+{
+    const pid_t pid = fork();
+    if( pid < 0 )
+        throw std::runtime_error( "render_coordinator: fork failed" );
+    if( pid > 0 )
+        return pid;
+
+    std::vector<char*> args;
+    for( const std::string& arg : command )
+        args.push_back( const_cast<char*>( arg.c_str() ) );
+    args.push_back( const_cast<char*>( "--coordinator" ) );
+    args.push_back( const_cast<char*>( socket_path.c_str() ) );
+    args.push_back( nullptr );
+
+    execvp( args[0], args.data() );
+    std::cerr << "render_coordinator: failed to start '" << command[0] << "'\n";
+    _exit( 127 );
+}
+
+struct Worker
+{
+    pid_t pid;
+    bool  running;
+    int   status;    // waitpid() status once it has exited
+};
+
+// Reaps workers that have exited without waiting for the others; returns
+// the first one found, or -1.
+int reapWorkers( std::vector<Worker>& workers )
+{
+    int exited = -1;
+    for( size_t i = 0; i < workers.size(); ++i )
+    {
+        if( workers[i].running && waitpid( workers[i].pid, &workers[i].status, WNOHANG ) == workers[i].pid )
+        {
+            workers[i].running = false;
+            if( exited < 0 )
+                exited = static_cast<int>( i );
+        }
+    }
+    return exited;
+}
+
+std::string describeExit( int status )
+{
+    if( WIFEXITED( status ) )
+        return "exited with status " + std::to_string( WEXITSTATUS( status ) );
+    if( WIFSIGNALED( status ) )
+        return "was killed by signal " + std::to_string( WTERMSIG( status ) );
+    return "stopped";
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    unsigned int num_workers = 2;
+    unsigned int frames      = 1;
+    std::string  output      = "merged.grac";
+    std::string  socket_path = "/tmp/grpt_coordinator." + std::to_string( getpid() );
+    std::vector<std::string> command;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "--" )
+        {
+            command.assign( argv + i + 1, argv + argc );
+            break;
+        }
+        else if( arg == "-w" || arg == "--workers" || arg == "-f" || arg == "--frames" ||
+                 arg == "-o" || arg == "--output"  || arg == "-s" || arg == "--socket" )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            const std::string value( argv[++i] );
+            if( arg == "-w" || arg == "--workers" )
+                num_workers = static_cast<unsigned int>( std::max( atoi( value.c_str() ), 1 ) );
+            else if( arg == "-f" || arg == "--frames" )
+                frames = static_cast<unsigned int>( std::max( atoi( value.c_str() ), 1 ) );
+            else if( arg == "-o" || arg == "--output" )
+                output = value;
+            else
+                socket_path = value;
+        }
+        else
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+    }
+
+    if( command.empty() )
+        printUsageAndExit( argv[0] );
+
+    const auto begin = std::chrono::steady_clock::now();
+    int listen_fd = -1;
+    std::vector<Worker> workers;
+    std::vector<int> connections;
+    int status = 0;
+
+    try
+    {
+        listen_fd = grpt::unix_socket::listen( socket_path, static_cast<int>( num_workers ) );
+        for( unsigned int i = 0; i < num_workers; ++i )
+        {
+            const Worker worker = { spawnWorker( command, socket_path ), true, 0 };
+            workers.push_back( worker );
+        }
+
+        // Hand out frame ranges in the order workers connect.  No worker
+        // exits before it has rendered its range, so one that does, say
+        // because exec failed, would leave the coordinator waiting forever.
+        std::vector<std::string> files;
+        for( unsigned int i = 0; i < num_workers; ++i )
+        {
+            while( !grpt::unix_socket::wait_readable( listen_fd, 100 ) )
+            {
+                const int exited = reapWorkers( workers );
+                if( exited >= 0 )
+                    throw std::runtime_error( "render_coordinator: worker process " +
+                                              std::to_string( workers[exited].pid ) + " " +
+                                              describeExit( workers[exited].status ) + " before rendering" );
+            }
+            const int fd = grpt::unix_socket::accept( listen_fd );
+            connections.push_back( fd );
+
+            std::string line;
+            if( !grpt::unix_socket::recv_line( fd, line ) || line != "hello" )
+                throw std::runtime_error( "render_coordinator: unexpected greeting '" + line + "'" );
+
+            files.push_back( output + ".worker" + std::to_string( i ) );
+            grpt::unix_socket::send_line( fd, "render " + std::to_string( i * frames ) + " " +
+                                              std::to_string( frames ) + " " + files.back() );
+        }
+
+        for( unsigned int i = 0; i < num_workers; ++i )
+        {
+            std::string line;
+            if( !grpt::unix_socket::recv_line( connections[i], line ) || line != "done " + files[i] )
+                throw std::runtime_error( "render_coordinator: worker " + std::to_string( i ) + " failed" );
+        }
+        const double render_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+
+        std::vector<grpt::accumulation_file> inputs;
+        for( const std::string& file : files )
+            inputs.push_back( grpt::read_accumulation_file( file ) );
+        const grpt::accumulation_file merged = grpt::merge_accumulation_files( inputs );
+        grpt::write_accumulation_file( output, merged );
+
+        grpt::image_io::image img;
+        img.width    = merged.header.width;
+        img.height   = merged.header.height;
+        img.channels = 3;
+        img.pixels   = merged.color;
+        grpt::image_io::write_pfm( output + ".pfm", img );
+
+        for( const std::string& file : files )
+            std::remove( file.c_str() );
+
+        std::cout << num_workers << " workers rendered " << merged.header.sample_count
+                  << " samples per pixel in " << render_seconds << " s; merged into '" << output << "'\n";
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << e.what() << "\n";
+        status = 1;
+    }
+
+    for( int fd : connections )
+        grpt::unix_socket::close( fd );
+    grpt::unix_socket::close( listen_fd );
+    unlink( socket_path.c_str() );
+
+    for( Worker& worker : workers )
+    {
+        if( worker.running )
+            waitpid( worker.pid, &worker.status, 0 );
+        if( !WIFEXITED( worker.status ) || WEXITSTATUS( worker.status ) != 0 )
+            status = 1;
+    }
+
+    return status;
+}
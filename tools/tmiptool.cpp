@@ -0,0 +1,185 @@
+// Builds a tiled mip pyramid (.tmip) from a .ppm or .hdr image and reports
+// the size and error of the chosen texel format against the source precision.
+
+#include <TiledTexture.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+void printUsageAndExit( const std::string& argv0 )
+{
+    std::cerr << "\nUsage: " << argv0 << " <input.ppm|input.hdr> <output.tmip> [options]\n";
+    std::cerr <<
+              "Options:\n"
+              "  -h | --help               Print this usage message and exit.\n"
+              "  -t | --tile <n>           Tile size in texels (default 64).\n"
+              "  -f | --format <name>      rgba8 | rgba32f | bc1 | bc5 | bc7 | rgb9e5\n"
+              "                            (default: the source precision).\n"
+              << std::endl;
+
+    exit(1);
+}
+
+bool parseFormat( const std::string& name, TexelFormat& format )
+{
+    if( name == "rgba8" )        format = TEXEL_FORMAT_RGBA8;
+    else if( name == "rgba32f" ) format = TEXEL_FORMAT_RGBA32F;
+    else if( name == "bc1" )     format = TEXEL_FORMAT_BC1;
+    else if( name == "bc5" )     format = TEXEL_FORMAT_BC5;
+    else if( name == "bc7" )     format = TEXEL_FORMAT_BC7;
+    else if( name == "rgb9e5" )  format = TEXEL_FORMAT_RGB9E5;
+    else return false;
+    return true;
+}
+
+const char* formatName( TexelFormat format )
+{
+    switch( format )
+    {
+        case TEXEL_FORMAT_RGBA8:   return "rgba8";
+        case TEXEL_FORMAT_RGBA32F: return "rgba32f";
+        case TEXEL_FORMAT_BC1:     return "bc1";
+        case TEXEL_FORMAT_BC5:     return "bc5";
+        case TEXEL_FORMAT_BC7:     return "bc7";
+        case TEXEL_FORMAT_RGB9E5:  return "rgb9e5";
+        default:                   return "?";
+    }
+}
+
+long long fileSize( const std::string& filename )
+{
+    std::FILE* f = std::fopen( filename.c_str(), "rb" );
+    if( !f )
+        return -1;
+    std::fseek( f, 0, SEEK_END );
+    const long long size = std::ftell( f );
+    std::fclose( f );
+    return size;
+}
+
+// PSNR of level 0 of 'test' against 'reference' over the channels the
+// format stores (two for BC5, three otherwise), with a peak of 1.
+double psnr( const TiledTexture& reference, const TiledTexture& test )
+{
+    const unsigned int channels = test.format() == TEXEL_FORMAT_BC5 ? 2u : 3u;
+    double sum = 0.0;
+    for( unsigned int y = 0; y < reference.height(); ++y )
+        for( unsigned int x = 0; x < reference.width(); ++x )
+        {
+            const optix::float4 a = reference.texel( 0, x, y );
+            const optix::float4 b = test.texel( 0, x, y );
+            const float d[3] = { a.x - b.x, a.y - b.y, a.z - b.z };
+            for( unsigned int c = 0; c < channels; ++c )
+                sum += static_cast<double>( d[c] ) * d[c];
+        }
+
+    const double mse = sum / ( static_cast<double>( reference.width() ) * reference.height() * channels );
+    return mse > 0.0 ? 10.0 * std::log10( 1.0 / mse ) : std::numeric_limits<double>::infinity();
+}
+
+} // namespace
+
+
+int main( int argc, char** argv )
+{
+    std::vector<std::string> files;
+    unsigned int tile_size = 64;
+    TexelFormat  format    = TEXEL_FORMAT_NATIVE;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg( argv[i] );
+
+        if( arg == "-h" || arg == "--help" )
+        {
+            printUsageAndExit( argv[0] );
+        }
+        else if( arg == "-t" || arg == "--tile" || arg == "-f" || arg == "--format" )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << arg << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            const std::string value( argv[++i] );
+            if( arg == "-t" || arg == "--tile" )
+            {
+                tile_size = static_cast<unsigned int>( atoi( value.c_str() ) );
+                if( tile_size == 0 )
+                {
+                    std::cerr << "Invalid tile size '" << value << "'\n";
+                    printUsageAndExit( argv[0] );
+                }
+            }
+            else if( !parseFormat( value, format ) )
+            {
+                std::cerr << "Unknown format '" << value << "'\n";
+                printUsageAndExit( argv[0] );
+            }
+        }
+        else if( !arg.empty() && arg[0] == '-' )
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit( argv[0] );
+        }
+        else
+        {
+            files.push_back( arg );
+        }
+    }
+
+    if( files.size() != 2 )
+        printUsageAndExit( argv[0] );
+
+    const std::string& input  = files[0];
+    const std::string& output = files[1];
+
+    if( !buildTiledTexture( input, output, tile_size, format ) )
+    {
+        std::cerr << "tmiptool( '" << input << "' ) failed to build '" << output << "'\n";
+        return 1;
+    }
+
+    TileCache cache( 64u << 20 );
+    TiledTexture texture( output, cache );
+    if( texture.failed() )
+    {
+        std::cerr << "tmiptool( '" << output << "' ) failed to read back the output\n";
+        return 1;
+    }
+
+    const long long size = fileSize( output );
+    std::cout << output << ": " << texture.width() << "x" << texture.height()
+              << ", " << texture.levelCount() << " levels, "
+              << texture.tileSize() << "^2 tiles, " << formatName( texture.format() )
+              << ", " << size << " bytes\n";
+
+    // Compare against the same pyramid stored at the source precision.
+    const std::string reference_file = output + ".reference";
+    if( format != TEXEL_FORMAT_NATIVE &&
+        buildTiledTexture( input, reference_file, texture.tileSize() ) )
+    {
+        {
+            TiledTexture reference( reference_file, cache );
+            if( !reference.failed() && reference.format() != texture.format() )
+            {
+                const long long reference_size = fileSize( reference_file );
+                std::cout << "  vs " << formatName( reference.format() ) << ": "
+                          << reference_size << " bytes, ratio "
+                          << static_cast<double>( reference_size ) / static_cast<double>( size )
+                          << ":1, PSNR " << psnr( reference, texture ) << " dB\n";
+            }
+        }
+        std::remove( reference_file.c_str() );
+    }
+
+    return 0;
+}